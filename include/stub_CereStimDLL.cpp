@@ -1,28 +1,334 @@
 #include "CereStimDLL.h"
+#include "CereStimSim.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 using namespace std;
 
+namespace CereStimSim {
+  namespace {
+    struct Waveform {
+      bool set = false;
+      uint8_t pulses = 0;
+      uint32_t frequency = 0;
+    };
+
+    struct Device {
+      Profile profile;
+      bool profile_checked = false;
+
+      bool plugged = true;
+      bool connected = false;
+      uint8_t max_voltage = 15;
+      uint16_t max_amplitude = 10000;
+      uint32_t max_phase_charge = 0xFFFFFFFF;
+      uint32_t max_frequency = 5000;
+      Waveform waveforms[16];
+
+      // The sequence being built, and the length of its burst so far.
+      bool in_sequence = false;
+      bool in_group = false;
+      size_t sequence_commands = 0;
+      uint64_t sequence_us = 0;
+      uint64_t group_us = 0;
+      vector<uint8_t> group_electrodes;
+      // The last complete sequence, which CS_Play triggers.
+      bool sequence_ready = false;
+      uint64_t burst_us = 0;
+
+      uint64_t burst_end_ns = 0;
+      uint64_t trigger_count = 0;
+      vector<Trigger> triggers;
+      Commands commands;
+
+      mt19937_64 rng{0};
+    };
+
+    mutex device_mutex;
+    Device device;
+
+    const size_t max_sequence_commands = 128;
+
+    uint64_t NowNs() {
+      return uint64_t(chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Sleeps, then spins the last part for microsecond precision.
+    void WaitUntil(uint64_t target_ns) {
+      const uint64_t spin_ns = 2000000;
+      uint64_t now_ns = NowNs();
+      if (target_ns > now_ns + spin_ns) {
+        this_thread::sleep_for(
+            chrono::nanoseconds(target_ns - now_ns - spin_ns));
+      }
+      while (NowNs() < target_ns) { }
+    }
+
+    Profile ParseProfile(istream& in, const string& filename) {
+      Profile profile;
+      string line;
+      size_t line_num = 0;
+      while (getline(in, line)) {
+        line_num++;
+        line = line.substr(0, line.find('#'));
+        istringstream ss(line);
+        string name;
+        if ( ! (ss >> name) ) {
+          continue;
+        }
+        string value;
+        getline(ss >> ws, value);
+        while ( ! value.empty() && isspace((unsigned char)value.back()) ) {
+          value.pop_back();
+        }
+
+        try {
+          if (name == "connect_us") { profile.connect_us = stoull(value); }
+          else if (name == "configure_us") {
+            profile.configure_us = stoull(value);
+          }
+          else if (name == "sequence_us") {
+            profile.sequence_us = stoull(value);
+          }
+          else if (name == "trigger_us") { profile.trigger_us = stoull(value); }
+          else if (name == "stop_us") { profile.stop_us = stoull(value); }
+          else if (name == "status_us") { profile.status_us = stoull(value); }
+          else if (name == "jitter_us") { profile.jitter_us = stoull(value); }
+          else if (name == "busy_error") {
+            profile.busy_error = stoi(value) != 0;
+          }
+          else if (name == "shannon_k") { profile.shannon_k = stod(value); }
+          else if (name == "electrode_area_mm2") {
+            profile.electrode_area_mm2 = stod(value);
+          }
+          else if (name == "disconnect_after") {
+            profile.disconnect_after = stoull(value);
+          }
+          else if (name == "trigger_log") { profile.trigger_log = value; }
+          else if (name == "verbose") { profile.verbose = stoi(value) != 0; }
+          else {
+            throw runtime_error("unknown parameter " + name);
+          }
+        }
+        catch (exception& ex) {
+          throw runtime_error("CereStim simulator profile " + filename +
+              " line " + to_string(line_num) + ": " + ex.what());
+        }
+      }
+      return profile;
+    }
+
+    Profile ReadProfile(const string& filename) {
+      ifstream file(filename);
+      if ( ! file.is_open() ) {
+        throw runtime_error("Could not open CereStim simulator profile " +
+            filename);
+      }
+      return ParseProfile(file, filename);
+    }
+
+    // Loads the environment profile on the first call.
+    void CheckProfile() {
+      if (device.profile_checked) {
+        return;
+      }
+      device.profile_checked = true;
+      const char* filename = getenv("CERESTIM_SIM_PROFILE");
+      if (filename == nullptr || filename[0] == '\0') {
+        return;
+      }
+      try {
+        device.profile = ReadProfile(filename);
+      }
+      catch (exception& ex) {
+        cerr << ex.what() << endl;
+      }
+    }
+
+    // Takes the time of a device command of latency_us, first waiting out
+    // any burst if wait_busy.  Call with device_mutex held, as the device
+    // handles one command at a time.
+    int Command(uint64_t latency_us, bool need_connection, bool wait_busy) {
+      if (need_connection && ! device.connected) {
+        return (int)CS_Result::BDISCONNECTED;
+      }
+
+      if (wait_busy && NowNs() < device.burst_end_ns) {
+        if (device.profile.busy_error) {
+          return (int)CS_Result::BNOK;
+        }
+        WaitUntil(device.burst_end_ns);
+      }
+
+      uint64_t delay_ns = latency_us * 1000;
+      if (device.profile.jitter_us > 0) {
+        uniform_int_distribution<uint64_t> jitter(0,
+            device.profile.jitter_us * 1000);
+        delay_ns += jitter(device.rng);
+      }
+      WaitUntil(NowNs() + delay_ns);
+      return 0;
+    }
+
+    // Shannon, R. V. (1992). A model of safe levels for electrical
+    // stimulation. IEEE Transactions on biomedical engineering, 39(4),
+    // 424-426.  log(D) = k - log(Q), with D in uC/cm^2 and Q in uC/phase.
+    bool ShannonSafe(uint16_t amp_uA, uint16_t width_us) {
+      const Profile& profile = device.profile;
+      if (profile.shannon_k <= 0 || profile.electrode_area_mm2 <= 0) {
+        return true;
+      }
+      double charge_uC = amp_uA * 1e-6 * width_us;
+      double density = charge_uC / (profile.electrode_area_mm2 * 1e-2);
+      return std::log10(density) + std::log10(charge_uC) <= profile.shannon_k;
+    }
+
+    void WriteTriggerLog() {
+      if (device.profile.trigger_log.empty()) {
+        return;
+      }
+      ofstream file(device.profile.trigger_log);
+      file << "call_ns,done_ns,burst_us,result\n";
+      for (auto& t : device.triggers) {
+        file << t.call_ns << "," << t.done_ns << "," << t.burst_us << ","
+          << t.result << "\n";
+      }
+    }
+  }
+
+
+  void LoadProfile(const string& filename) {
+    Profile profile = ReadProfile(filename);
+    SetProfile(profile);
+  }
+
+  void SetProfile(const Profile& profile) {
+    lock_guard<mutex> lock(device_mutex);
+    device.profile = profile;
+    device.profile_checked = true;
+  }
+
+  Profile GetProfile() {
+    lock_guard<mutex> lock(device_mutex);
+    CheckProfile();
+    return device.profile;
+  }
+
+  void SetConnected(bool connected) {
+    lock_guard<mutex> lock(device_mutex);
+    device.plugged = connected;
+    if ( ! connected ) {
+      device.connected = false;
+      device.burst_end_ns = 0;
+    }
+  }
+
+  void Reset() {
+    lock_guard<mutex> lock(device_mutex);
+    CheckProfile();
+    Profile profile = device.profile;
+    device = Device();
+    device.profile = profile;
+    device.profile_checked = true;
+  }
+
+  vector<Trigger> Triggers() {
+    lock_guard<mutex> lock(device_mutex);
+    return device.triggers;
+  }
+
+  Commands CommandCounts() {
+    lock_guard<mutex> lock(device_mutex);
+    return device.commands;
+  }
+
+  void ClearTriggers() {
+    lock_guard<mutex> lock(device_mutex);
+    device.triggers.clear();
+    device.trigger_count = 0;
+    device.commands = Commands();
+  }
+}
+
+using namespace CereStimSim;
+
+
 CS_EXPORT int CS_Connect() {
-  cout << "CS_Connect()\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_Connect()\n";
+  }
+  int err = Command(device.profile.connect_us, false, false);
+  if (err) {
+    return err;
+  }
+  if ( ! device.plugged ) {
+    return (int)CS_Result::BINVALIDINTERFACE;
+  }
+  device.connected = true;
   return 0;
 }
 
 CS_EXPORT int CS_Disconnect() {
-  cout << "CS_Disconnect()\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_Disconnect()\n";
+  }
+  device.connected = false;
+  device.burst_end_ns = 0;
+  WriteTriggerLog();
   return 0;
 }
 
 CS_EXPORT int CS_ScanForDevices(uint64_t* max_devices, uint32_t* array_of_serial_nums) {
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
   if (max_devices == NULL || array_of_serial_nums == NULL || *max_devices == 0) {
     cout << "CS_ScanForDevices(INVALID)\n";
     return (int)CS_Result::BINVALIDPARAMS;
   }
-  cout << "CS_ScanForDevices(&" << *max_devices << ", ...)\n";
+  if (device.profile.verbose) {
+    cout << "CS_ScanForDevices(&" << *max_devices << ", ...)\n";
+  }
+  int err = Command(device.profile.status_us, false, false);
+  if (err) {
+    return err;
+  }
+  if (device.plugged) {
+    *max_devices = 1;
+    array_of_serial_nums[0] = 1;
+  }
+  else {
+    *max_devices = 0;
+  }
   return 0;
 }
 
 CS_EXPORT int CS_SetDevice(uint32_t dev) {
-  cout << "CS_SetDevice(" << dev << ")\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_SetDevice(" << dev << ")\n";
+  }
+  int err = Command(device.profile.status_us, false, false);
+  if (err) {
+    return err;
+  }
+  if ( ! device.plugged || dev != 0 ) {
+    return (int)CS_Result::BINVALIDPARAMS;
+  }
   return 0;
 }
 
@@ -30,12 +336,24 @@ CS_EXPORT int CS_SetDevice(uint32_t dev) {
 //   4.7V, 5.3V, 5.9V, 6.5V, 7.1V, 7.7V, 8.3V, 8.9V, 9.5V
 CS_EXPORT int CS_GetMaxValues(uint8_t* voltage, uint16_t* amplitude,
     uint32_t* phase_charge, uint32_t* frequency) {
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
   if (voltage == nullptr || amplitude == nullptr || phase_charge == nullptr ||
       frequency == nullptr) {
     cout << "CS_GetMaxValues(NULL)\n";
     return (int)CS_Result::BNULLPTR;
   }
-  cout << "CS_GetMaxValues(...)\n";
+  if (device.profile.verbose) {
+    cout << "CS_GetMaxValues(...)\n";
+  }
+  int err = Command(device.profile.status_us, true, false);
+  if (err) {
+    return err;
+  }
+  *voltage = device.max_voltage;
+  *amplitude = device.max_amplitude;
+  *phase_charge = device.max_phase_charge;
+  *frequency = device.max_frequency;
   return 0;
 }
 
@@ -43,8 +361,23 @@ CS_EXPORT int CS_GetMaxValues(uint8_t* voltage, uint16_t* amplitude,
 //   4.7V, 5.3V, 5.9V, 6.5V, 7.1V, 7.7V, 8.3V, 8.9V, 9.5V
 CS_EXPORT int CS_SetMaxValues(uint8_t voltage, uint16_t amplitude, uint32_t
     phase_charge, uint32_t frequency) {
-  cout << "CS_SetMaxValues(" << uint32_t(voltage) << ", " << amplitude
-    << ", " << phase_charge << ", " << frequency << ")\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_SetMaxValues(" << uint32_t(voltage) << ", " << amplitude
+      << ", " << phase_charge << ", " << frequency << ")\n";
+  }
+  int err = Command(device.profile.configure_us, true, true);
+  if (err) {
+    return err;
+  }
+  if (voltage < 7 || voltage > 15) {
+    return (int)CS_Result::BINVALIDVOLTAGE;
+  }
+  device.max_voltage = voltage;
+  device.max_amplitude = amplitude;
+  device.max_phase_charge = phase_charge;
+  device.max_frequency = frequency;
   return 0;
 }
 
@@ -53,7 +386,16 @@ CS_EXPORT int CS_SetMaxValues(uint8_t voltage, uint16_t amplitude, uint32_t
 CS_EXPORT int CS_ConfigureStimulusPattern(uint16_t waveform, uint8_t
     cathodic_first, uint8_t pulses, uint16_t amp1, uint16_t amp2, uint16_t
     width1, uint16_t width2, uint32_t frequency, uint16_t interphase) {
-  cout << "CS_ConfigureStimulusPattern(" << waveform << ", " << uint32_t(cathodic_first) << ", " << uint32_t(pulses) << ", amp=[" << amp1 << ", " << amp2 << "], width=[" << width1 << ", " << width2 << "], " << frequency << ", " << interphase << ")\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_ConfigureStimulusPattern(" << waveform << ", " << uint32_t(cathodic_first) << ", " << uint32_t(pulses) << ", amp=[" << amp1 << ", " << amp2 << "], width=[" << width1 << ", " << width2 << "], " << frequency << ", " << interphase << ")\n";
+  }
+  device.commands.configure++;
+  int err = Command(device.profile.configure_us, true, true);
+  if (err) {
+    return err;
+  }
   if (waveform == 0 || waveform > 15 ||
       cathodic_first > 1 ||
       amp1 == 0 || amp1 > 10000 ||
@@ -63,58 +405,220 @@ CS_EXPORT int CS_ConfigureStimulusPattern(uint16_t waveform, uint8_t
       cout << "CS_ConfigureStimulusPattern was invalid.\n";
     return (int)CS_Result::BINVALIDPARAMS;
   }
+  if (amp1 > device.max_amplitude || amp2 > device.max_amplitude) {
+    cout << "CS_ConfigureStimulusPattern amplitude over maximum.\n";
+    return (int)CS_Result::BAMPGREATMAX;
+  }
+  if (uint64_t(amp1) * width1 > device.max_phase_charge ||
+      uint64_t(amp2) * width2 > device.max_phase_charge) {
+    cout << "CS_ConfigureStimulusPattern phase charge over maximum.\n";
+    return (int)CS_Result::BPHASEGREATMAX;
+  }
+  if ( ! ShannonSafe(amp1, width1) || ! ShannonSafe(amp2, width2) ) {
+    cout << "CS_ConfigureStimulusPattern exceeded Shannon limit.\n";
+    return (int)CS_Result::BPHASEGREATMAX;
+  }
+  if (frequency > device.max_frequency) {
+    cout << "CS_ConfigureStimulusPattern frequency over maximum.\n";
+    return (int)CS_Result::BFREQUENCYGREATMAX;
+  }
+  Waveform& wave = device.waveforms[waveform];
+  wave.set = true;
+  wave.pulses = pulses;
+  wave.frequency = frequency;
   return 0;
 }
 
 // Up to 128 AutoStimulus and Wait commands permitted with a sequence.
 CS_EXPORT int CS_BeginningOfSequence() {
-  cout << "CS_BeginningOfSequence()\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_BeginningOfSequence()\n";
+  }
+  device.commands.sequence++;
+  int err = Command(device.profile.sequence_us, true, true);
+  if (err) {
+    return err;
+  }
+  device.in_sequence = true;
+  device.in_group = false;
+  device.sequence_commands = 0;
+  device.sequence_us = 0;
+  device.sequence_ready = false;
   return 0;
 }
 
 // Required for simultaneous stimulation
 CS_EXPORT int CS_BeginningOfGroup() {
-  cout << "CS_BeginningOfGroup()\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_BeginningOfGroup()\n";
+  }
+  int err = Command(device.profile.sequence_us, true, true);
+  if (err) {
+    return err;
+  }
+  if ( ! device.in_sequence || device.in_group ) {
+    return (int)CS_Result::BSEQUENCEERROR;
+  }
+  device.in_group = true;
+  device.group_us = 0;
+  device.group_electrodes.clear();
   return 0;
 }
 
 // waveform 1 through 15.
 CS_EXPORT int CS_AutoStimulus(uint8_t electrode, uint16_t waveform) {
-  cout << "CS_AutoStimulus(" << uint32_t(electrode) << ", " << waveform
-    << ")\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_AutoStimulus(" << uint32_t(electrode) << ", " << waveform
+      << ")\n";
+  }
+  int err = Command(device.profile.sequence_us, true, true);
+  if (err) {
+    return err;
+  }
   if (waveform == 0 || waveform > 15) {
     cout << "CS_AutoStimulus invalid.\n";
     return (int)CS_Result::BINVALIDPARAMS;
   }
+  if ( ! device.in_sequence ||
+      ++device.sequence_commands > max_sequence_commands ) {
+    return (int)CS_Result::BSEQUENCEERROR;
+  }
+  const Waveform& wave = device.waveforms[waveform];
+  if ( ! wave.set ) {
+    return (int)CS_Result::BEMPTYCONFIG;
+  }
+
+  uint64_t wave_us = uint64_t(wave.pulses) * 1000000 / wave.frequency;
+  if (device.in_group) {
+    auto& electrodes = device.group_electrodes;
+    if (find(electrodes.begin(), electrodes.end(), electrode) !=
+        electrodes.end()) {
+      return (int)CS_Result::BCHANNELUSEDINGROUP;
+    }
+    electrodes.push_back(electrode);
+    device.group_us = max(device.group_us, wave_us);
+  }
+  else {
+    device.sequence_us += wave_us;
+  }
   return 0;
 }
 
 CS_EXPORT int CS_Wait(uint16_t milliseconds) {
-  cout << "CS_Wait(" << milliseconds << ")\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_Wait(" << milliseconds << ")\n";
+  }
+  int err = Command(device.profile.sequence_us, true, true);
+  if (err) {
+    return err;
+  }
+  if ( ! device.in_sequence ||
+      ++device.sequence_commands > max_sequence_commands ) {
+    return (int)CS_Result::BSEQUENCEERROR;
+  }
+  device.sequence_us += uint64_t(milliseconds) * 1000;
   return 0;
 }
 
 CS_EXPORT int CS_EndOfGroup() {
-  cout << "CS_EndOfGroup()\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_EndOfGroup()\n";
+  }
+  int err = Command(device.profile.sequence_us, true, true);
+  if (err) {
+    return err;
+  }
+  if ( ! device.in_group ) {
+    return (int)CS_Result::BSEQUENCEERROR;
+  }
+  device.in_group = false;
+  device.sequence_us += device.group_us;
   return 0;
 }
 
 CS_EXPORT int CS_EndOfSequence() {
-  cout << "CS_EndOfSequence()\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_EndOfSequence()\n";
+  }
+  int err = Command(device.profile.sequence_us, true, true);
+  if (err) {
+    return err;
+  }
+  if ( ! device.in_sequence || device.in_group ) {
+    return (int)CS_Result::BSEQUENCEERROR;
+  }
+  device.in_sequence = false;
+  device.sequence_ready = true;
+  device.burst_us = device.sequence_us;
   return 0;
 }
 
 CS_EXPORT int CS_Play(uint16_t times) {
-  cout << "CS_Play(" << times << ")\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  Trigger trigger;
+  trigger.call_ns = NowNs();
+  if (device.profile.verbose) {
+    cout << "CS_Play(" << times << ")\n";
+  }
+  int err = Command(device.profile.trigger_us, true, true);
+  if ( ! err && ! device.sequence_ready ) {
+    err = (int)CS_Result::BSEQUENCEERROR;
+  }
+  trigger.done_ns = NowNs();
+  trigger.burst_us = err ? 0 : device.burst_us * times;
+  trigger.result = err;
+  device.triggers.push_back(trigger);
+  if (err) {
+    return err;
+  }
+
+  device.burst_end_ns = trigger.done_ns + trigger.burst_us * 1000;
+  device.trigger_count++;
+  if (device.profile.disconnect_after > 0 &&
+      device.trigger_count >= device.profile.disconnect_after) {
+    device.plugged = false;
+    device.connected = false;
+  }
   return 0;
 }
 
 CS_EXPORT int CS_Pause() {
-  cout << "CS_Pause()\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_Pause()\n";
+  }
+  int err = Command(device.profile.stop_us, true, false);
+  if (err) {
+    return err;
+  }
+  device.burst_end_ns = 0;
   return 0;
 }
 
 CS_EXPORT int CS_Stop() {
-  cout << "CS_Stop()\n";
+  lock_guard<mutex> lock(device_mutex);
+  CheckProfile();
+  if (device.profile.verbose) {
+    cout << "CS_Stop()\n";
+  }
+  int err = Command(device.profile.stop_us, true, false);
+  if (err) {
+    return err;
+  }
+  device.burst_end_ns = 0;
   return 0;
 }
@@ -61,6 +61,7 @@ namespace CML {
     max_vals.phase_charge = 20000000; // Won't go above 1.05e6 with 300us
     max_vals.frequency = 1000; // Hz
     was_active = false;
+    slot_patterns_loaded = false;
 //    is_configured = false;
 
     SetMaxValues(max_vals);
@@ -156,6 +157,7 @@ namespace CML {
     BeOpen();
 
     StopStimulation();
+    slot_patterns_loaded = false;
 
     struct FreqDurAmp {
       uint32_t frequency;
@@ -248,22 +250,8 @@ namespace CML {
     for (size_t i=0; i<fda_vec.size(); i++) {
       auto& afd = fda_vec[i];
       uint16_t interphase = 53;
-      uint64_t pulses_64 = (uint64_t(afd.duration) * afd.frequency) / 1000000;
-      if (burst_frac < 1) {
-        // Configure stim profile for burst-on period only.
-        pulses_64 = uint64_t(round(afd.frequency * burst_frac /
-                                   burst_slow_freq));
-      }
-
-      if (pulses_64 < 1) {
-        pulses_64 = 1;
-      }
-      if (pulses_64 > 255) {
-        throw std::runtime_error(std::to_string(afd.duration) + "us pulse "
-            "duration too long for " + std::to_string(afd.frequency) + "Hz "
-            "stimulus.");
-      }
-      uint8_t pulses = uint8_t(pulses_64);
+      uint8_t pulses = PulseCount(afd.frequency, afd.duration, burst_frac,
+          burst_slow_freq);
       // Anodic/positive first waveform
       ErrorCheck(
         CS_ConfigureStimulusPattern(uint16_t(2*i+1), 0, pulses, afd.amplitude,
@@ -308,6 +296,142 @@ namespace CML {
 //    is_configured = true;
   }
 
+  uint8_t CereStim::PulseCount(uint32_t frequency, uint32_t duration,
+      float pulse_burst_frac, uint32_t pulse_burst_slow_freq) {
+    uint64_t pulses_64 = (uint64_t(duration) * frequency) / 1000000;
+    if (pulse_burst_frac < 1) {
+      // Configure stim profile for burst-on period only.
+      pulses_64 = uint64_t(round(frequency * pulse_burst_frac /
+                                 pulse_burst_slow_freq));
+    }
+
+    if (pulses_64 < 1) {
+      pulses_64 = 1;
+    }
+    if (pulses_64 > 255) {
+      throw std::runtime_error(std::to_string(duration) + "us pulse "
+          "duration too long for " + std::to_string(frequency) + "Hz "
+          "stimulus.");
+    }
+    return uint8_t(pulses_64);
+  }
+
+
+  void CereStim::ConfigureSlot_Helper(size_t /*slot*/) {
+    BeOpen();
+
+    StopStimulation();
+    LoadSlotPatterns();
+  }
+
+
+  // Stores the patterns of every slot that fits, in slot order, so arming
+  // one of them only has to write its sequence.
+  void CereStim::LoadSlotPatterns() {
+    slot_patterns_loaded = false;
+    slot_patterns.clear();
+    slot_pattern_index.assign(stim_slots.size(), {});
+
+    for (size_t s=0; s<stim_slots.size(); s++) {
+      if ( ! stim_slots[s].is_set ) {
+        continue;
+      }
+
+      auto& prof = stim_slots[s].profile;
+      std::vector<CSPattern> added;
+      std::vector<uint16_t> index(prof.size());
+      for (size_t i=0; i<prof.size(); i++) {
+        CSPattern pat{prof[i].frequency, prof[i].amplitude,
+          PulseCount(prof[i].frequency, prof[i].duration,
+              stim_slots[s].burst_frac, stim_slots[s].burst_slow_freq)};
+        auto res = std::find(slot_patterns.begin(), slot_patterns.end(),
+            pat);
+        if (res == slot_patterns.end()) {
+          res = std::find(added.begin(), added.end(), pat);
+          if (res == added.end()) {
+            added.push_back(pat);
+            res = std::prev(added.end());
+          }
+          index[i] = uint16_t(slot_patterns.size() + size_t(res -
+                added.begin()));
+        }
+        else {
+          index[i] = uint16_t(res - slot_patterns.begin());
+        }
+      }
+
+      // Slots that do not fit are configured in full when armed.
+      if (slot_patterns.size() + added.size() > max_pattern_pairs) {
+        continue;
+      }
+      slot_patterns.insert(slot_patterns.end(), added.begin(), added.end());
+      slot_pattern_index[s] = std::move(index);
+    }
+
+    uint16_t interphase = 53;
+    for (size_t i=0; i<slot_patterns.size(); i++) {
+      auto& pat = slot_patterns[i];
+      // Anodic/positive first waveform
+      ErrorCheck(
+        CS_ConfigureStimulusPattern(uint16_t(2*i+1), 0, pat.pulses,
+          pat.amplitude, pat.amplitude, stim_width_us, stim_width_us,
+          pat.frequency, interphase)
+      );
+      // Cathodic/negative first waveform
+      ErrorCheck(
+        CS_ConfigureStimulusPattern(uint16_t(2*i+2), 1, pat.pulses,
+          pat.amplitude, pat.amplitude, stim_width_us, stim_width_us,
+          pat.frequency, interphase)
+      );
+    }
+
+    slot_patterns_loaded = true;
+  }
+
+
+  void CereStim::ArmSlot_Helper(size_t slot) {
+    BeOpen();
+
+    StopStimulation();
+
+    if ( ! slot_patterns_loaded ) {
+      LoadSlotPatterns();
+    }
+
+    auto& prof = stim_slots[slot].profile;
+    if (slot >= slot_pattern_index.size() ||
+        slot_pattern_index[slot].size() != prof.size()) {
+      ConfigureStimulation_Helper(prof);
+      return;
+    }
+
+    // The stored patterns are reused, so only the sequence is written.
+    auto& index = slot_pattern_index[slot];
+    ErrorCheck(
+      CS_BeginningOfSequence()
+    );
+    ErrorCheck(
+      CS_BeginningOfGroup()
+    );
+
+    for (size_t i=0; i<prof.size(); i++) {
+      ErrorCheck(
+        CS_AutoStimulus(prof[i].electrode_pos, uint16_t(2*index[i]+1))
+      );
+      ErrorCheck(
+        CS_AutoStimulus(prof[i].electrode_neg, uint16_t(2*index[i]+2))
+      );
+    }
+
+    ErrorCheck(
+      CS_EndOfGroup()
+    );
+    ErrorCheck(
+      CS_EndOfSequence()
+    );
+  }
+
+
 // TODO: JPB: (need) Remove all this old CereStim code 
 //  void CereStim::ConfigureStimulation(CSStimProfile profile) {
 //    is_configured = false;
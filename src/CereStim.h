@@ -39,6 +39,12 @@ namespace CML {
     void OpenInterface() override { OpenInterface_Handler(); }
     void CloseInterface() override { CloseInterface_Handler(); }
     void Stimulate() override { Stimulate_Handler(); }
+    void ConfigureSlot(size_t slot, StimProfile profile) override {
+      ConfigureSlot_Handler(slot, profile);
+    }
+    void ClearSlots() override { ClearSlots_Handler(); }
+    void ArmSlot(size_t slot) override { ArmSlot_Handler(slot); }
+    void StimulateSlot(size_t slot) override { StimulateSlot_Handler(slot); }
     uint32_t GetBurstSlowFreq() override { return GetBurstSlowFreq_Handler(); }
     uint32_t GetBurstDuration_us() override { return GetBurstDuration_us_Handler(); }
 
@@ -62,11 +68,37 @@ namespace CML {
     void OpenInterface_Helper() override;  // Automatic at first use.
     void CloseInterface_Helper() override;
     void Stimulate_Helper() override;
+    void ConfigureSlot_Helper(size_t slot) override;
+    void ArmSlot_Helper(size_t slot) override;
 
 
     private:
     void BeOpen();
     void ErrorCheck(int err);
+    uint8_t PulseCount(uint32_t frequency, uint32_t duration,
+        float pulse_burst_frac, uint32_t pulse_burst_slow_freq);
+    void LoadSlotPatterns();
+
+    // CS can only store 15 stimulus patterns, so 7 bipolar pairs.
+    static constexpr size_t max_pattern_pairs = 7;
+
+    class CSPattern {
+      public:
+      uint32_t frequency;
+      uint16_t amplitude;
+      uint8_t pulses;
+      bool operator==(const CSPattern& other) const {
+        return frequency == other.frequency &&
+               amplitude == other.amplitude &&
+               pulses == other.pulses;
+      }
+    };
+    // The pattern pairs stored for all slots, and for each slot the pair
+    // index of each channel, or empty if the slot did not fit.
+    std::vector<CSPattern> slot_patterns;
+    std::vector<std::vector<uint16_t>> slot_pattern_index;
+    // False once ConfigureStimulation overwrites the stored patterns.
+    bool slot_patterns_loaded = false;
 
 //    uint32_t burst_slow_freq = 0; // Unit Hz.  Slower envelope freq of bursts.
 //    float burst_frac = 1; // Fraction of 1/burst_slow_freq to stimulate for.
@@ -1,4 +1,5 @@
 #include "Classifier.h"
+#include "DecisionTrace.h"
 #include "RC/RStr.h"
 #include "Handler.h"
 
@@ -39,7 +40,10 @@ namespace CML {
       Throw_RC_Error("Classification callback not set");
     }
 
+    DecisionTrace::Span classify_span(TraceStage::CLASSIFY,
+        task_classifier_settings);
     double result = Classification(data);
+    classify_span.End();
 
     for (size_t i=0; i<data_callbacks.size(); i++) {
       data_callbacks[i].callback(result, task_classifier_settings);
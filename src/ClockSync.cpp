@@ -0,0 +1,97 @@
+#include "ClockSync.h"
+#include <algorithm>
+
+namespace CML {
+  bool ClockSync::AddExchange(double t0, double t1, double t2, double t3) {
+    Exchange ex;
+    ex.local_ms = (t0 + t3) / 2;
+    ex.offset = ((t1 - t0) + (t2 - t3)) / 2;
+    // Clock granularity can make this slightly negative.
+    ex.delay = std::max(0.0, (t3 - t0) - (t2 - t1));
+    last_delay = ex.delay;
+
+    exchanges.push_back(ex);
+    if (exchanges.size() > window) {
+      exchanges.pop_front();
+    }
+
+    min_delay = exchanges.front().delay;
+    for (auto& e : exchanges) {
+      min_delay = std::min(min_delay, e.delay);
+    }
+
+    Fit();
+    return ex.delay <= std::max(min_delay * delay_ratio,
+        min_delay + delay_slack_ms);
+  }
+
+
+  void ClockSync::Reset() {
+    *this = ClockSync();
+  }
+
+
+  double ClockSync::Offset(double local_ms) const {
+    return ref_offset + slope * (local_ms - ref_ms);
+  }
+
+
+  double ClockSync::ToLocal(double remote_ms) const {
+    // The offset changes negligibly across the offset itself, so one
+    // refinement is enough.
+    double local_ms = remote_ms - Offset(remote_ms);
+    return remote_ms - Offset(local_ms);
+  }
+
+
+  void ClockSync::Fit() {
+    double limit = std::max(min_delay * delay_ratio,
+        min_delay + delay_slack_ms);
+
+    double sum_t = 0;
+    double sum_o = 0;
+    double first_t = 0;
+    double last_t = 0;
+    size_t n = 0;
+    for (auto& e : exchanges) {
+      if (e.delay > limit) {
+        continue;
+      }
+      if (n == 0) {
+        first_t = e.local_ms;
+      }
+      last_t = e.local_ms;
+      sum_t += e.local_ms;
+      sum_o += e.offset;
+      n++;
+    }
+
+    fit_count = n;
+    if (n == 0) {
+      return;
+    }
+
+    ref_ms = sum_t / double(n);
+    ref_offset = sum_o / double(n);
+    slope = 0;
+
+    if (n < 3 || last_t - first_t < min_drift_span_ms) {
+      return;
+    }
+
+    double stt = 0;
+    double sto = 0;
+    for (auto& e : exchanges) {
+      if (e.delay > limit) {
+        continue;
+      }
+      double dt = e.local_ms - ref_ms;
+      stt += dt * dt;
+      sto += dt * (e.offset - ref_offset);
+    }
+    if (stt > 0) {
+      slope = sto / stt;
+    }
+  }
+}
+
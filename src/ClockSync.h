@@ -0,0 +1,63 @@
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <cstddef>
+#include <deque>
+
+namespace CML {
+  /// Estimates a remote clock against ours from NTP style exchanges.
+  /** Each exchange gives the local send time t0, the remote receive time
+   *  t1, the remote send time t2, and the local receive time t3, all in ms.
+   *  Exchanges delayed well beyond the fastest recent one are rejected, as
+   *  their offsets are skewed by asymmetric queueing, and a line fit over
+   *  the rest gives the offset and drift.
+   */
+  class ClockSync {
+    public:
+    /// @return True if accepted, false if rejected as an outlier.
+    bool AddExchange(double t0, double t1, double t2, double t3);
+    void Reset();
+
+    /// True once an exchange has been accepted.
+    bool IsValid() const { return fit_count > 0; }
+
+    /// The remote clock minus ours, in ms, at local time local_ms.
+    double Offset(double local_ms) const;
+    /// How much faster the remote clock runs, in parts per million.
+    double DriftPPM() const { return slope * 1e6; }
+    /// The round trip network delay of the last exchange, in ms.
+    double LastDelay() const { return last_delay; }
+    /// The smallest round trip delay within the window, in ms.
+    double MinDelay() const { return min_delay; }
+
+    /// Our clock time matching remote clock time remote_ms.
+    double ToLocal(double remote_ms) const;
+
+    protected:
+    void Fit();
+
+    struct Exchange {
+      double local_ms;  // Midpoint of t0 and t3.
+      double offset;
+      double delay;
+    };
+
+    static constexpr size_t window = 64;
+    // Accepted if delay is within this many times the minimum, or 1ms.
+    static constexpr double delay_ratio = 2.0;
+    static constexpr double delay_slack_ms = 1.0;
+    // Drift is only fit over at least this span, as it is noise otherwise.
+    static constexpr double min_drift_span_ms = 10000;
+
+    std::deque<Exchange> exchanges;
+    double min_delay = 0;
+    double last_delay = 0;
+    double ref_ms = 0;
+    double ref_offset = 0;
+    double slope = 0;
+    size_t fit_count = 0;
+  };
+}
+
+#endif // CLOCKSYNC_H
+
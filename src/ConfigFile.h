@@ -5,6 +5,8 @@
 #include "Utils.h"
 #include "ValIter.h"
 #include "RC/RC.h"
+#include <algorithm>
+#include <string_view>
 #include <type_traits>
 
 
@@ -51,12 +53,19 @@ namespace CML {
       json = nlohmann::json::parse(json_text.c_str());
     }
 
+    void Parse(std::string_view json_text) {
+      json = nlohmann::json::parse(json_text.begin(), json_text.end());
+    }
+
     void SetFilename(RC::RStr new_filename) {
       filename = new_filename;
     }
 
     RC::RStr Line() const {
-      return RC::RStr::Join(RC::RStr(json.dump(0)).Split('\n'))+"\n";
+      std::string line = json.dump(0);
+      line.erase(std::remove(line.begin(), line.end(), '\n'), line.end());
+      line += '\n';
+      return line;
     }
 
     void Save(RC::RStr pathname) const {
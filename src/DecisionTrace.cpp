@@ -0,0 +1,244 @@
+#include "DecisionTrace.h"
+#include "ConfigFile.h"
+#include "RC/File.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <memory>
+#include <vector>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace CML {
+  namespace {
+    const size_t stage_cnt = size_t(TraceStage::COUNT);
+    // Roughly an hour of decisions every 100ms, per thread.
+    const size_t max_thread_spans = 1 << 18;
+
+    struct TraceSpan {
+      TraceStage stage;
+      uint64_t classif_id;
+      uint64_t window_id;
+      uint64_t begin_ns;
+      uint64_t end_ns;
+    };
+
+    /// The spans of one thread.  Only the collector contends for mutex.
+    struct ThreadBuffer {
+      QMutex mutex;
+      std::vector<TraceSpan> spans;
+      uint64_t tid = 0;
+      TraceStage first_stage = TraceStage::COUNT;
+    };
+
+    struct TraceState {
+      QMutex mutex;
+      std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+      uint64_t session_start_ns = RCqt::TaskClockNs();
+      RCqt::LatencyHistogram stages[stage_cnt];
+    };
+
+    // Never destructed, as worker threads may record during exit.
+    TraceState& State() {
+      static TraceState* state = new TraceState();
+      return *state;
+    }
+
+    uint64_t CurrentTid() {
+#ifdef __linux__
+      return uint64_t(syscall(SYS_gettid));
+#else
+      static std::atomic<uint64_t> next_tid{1};
+      return next_tid.fetch_add(1);
+#endif
+    }
+
+    ThreadBuffer& LocalBuffer() {
+      thread_local std::shared_ptr<ThreadBuffer> local;
+      if ( ! local ) {
+        local = std::make_shared<ThreadBuffer>();
+        local->tid = CurrentTid();
+        local->spans.reserve(1024);
+        TraceState& state = State();
+        QMutexLocker lock(&state.mutex);
+        state.buffers.push_back(local);
+      }
+      return *local;
+    }
+
+    const char* StageThread(TraceStage stage) {
+      switch (stage) {
+        case TraceStage::WINDOW: return "TaskClassifierManager";
+        case TraceStage::PREFIX:
+        case TraceStage::POWERS:
+        case TraceStage::NORMALIZE: return "FeatureFilters";
+        case TraceStage::CLASSIFY: return "Classifier";
+        case TraceStage::DECISION: return "TaskStimManager";
+        case TraceStage::STIM_HOP:
+        case TraceStage::STIMULATE: return "StimWorker";
+        default: return "Unknown";
+      }
+    }
+
+    // Waits overlap other spans on their thread, so they are written as
+    // async events, which need not nest.
+    bool IsWait(TraceStage stage) {
+      return stage == TraceStage::WINDOW || stage == TraceStage::STIM_HOP ||
+        stage == TraceStage::TOTAL;
+    }
+
+    int64_t ToUs(uint64_t ns, uint64_t origin_ns) {
+      return (int64_t(ns) - int64_t(origin_ns)) / 1000;
+    }
+  }
+
+
+  std::atomic<bool> DecisionTrace::enabled_flag{true};
+
+
+  const char* DecisionTrace::StageName(TraceStage stage) {
+    switch (stage) {
+      case TraceStage::WINDOW: return "Window";
+      case TraceStage::PREFIX: return "Prefix";
+      case TraceStage::POWERS: return "Powers";
+      case TraceStage::NORMALIZE: return "Normalize";
+      case TraceStage::CLASSIFY: return "Classify";
+      case TraceStage::DECISION: return "Decision";
+      case TraceStage::STIM_HOP: return "StimHop";
+      case TraceStage::STIMULATE: return "Stimulate";
+      case TraceStage::TOTAL: return "Total";
+      default: Throw_RC_Error("Invalid trace stage.");
+    }
+  }
+
+
+  void DecisionTrace::Record(TraceStage stage,
+      const TaskClassifierSettings& settings, uint64_t begin_ns,
+      uint64_t end_ns) {
+    if ( ! Enabled() || stage >= TraceStage::COUNT ) {
+      return;
+    }
+
+    State().stages[size_t(stage)].Record(end_ns - begin_ns);
+
+    ThreadBuffer& buffer = LocalBuffer();
+    QMutexLocker lock(&buffer.mutex);
+    if (buffer.spans.size() >= max_thread_spans) {
+      return;
+    }
+    // Totals end on whichever thread finishes the decision.
+    if (buffer.first_stage == TraceStage::COUNT &&
+        stage != TraceStage::TOTAL) {
+      buffer.first_stage = stage;
+    }
+    buffer.spans.push_back(TraceSpan{stage, settings.classif_id,
+        settings.window_id, begin_ns, end_ns});
+  }
+
+
+  void DecisionTrace::Reset() {
+    TraceState& state = State();
+    QMutexLocker lock(&state.mutex);
+    for (auto& buffer : state.buffers) {
+      QMutexLocker buf_lock(&buffer->mutex);
+      buffer->spans.clear();
+    }
+    for (auto& hist : state.stages) {
+      hist.Reset();
+    }
+    state.session_start_ns = Now();
+  }
+
+
+  void DecisionTrace::WriteFile(const RC::RStr& filename) {
+    TraceState& state = State();
+    QMutexLocker lock(&state.mutex);
+
+    nlohmann::json events = nlohmann::json::array();
+    for (auto& buffer : state.buffers) {
+      QMutexLocker buf_lock(&buffer->mutex);
+      if (buffer->spans.empty()) {
+        continue;
+      }
+
+      nlohmann::json meta;
+      meta["name"] = "thread_name";
+      meta["ph"] = "M";
+      meta["pid"] = 1;
+      meta["tid"] = buffer->tid;
+      meta["args"]["name"] = StageThread(buffer->first_stage);
+      events.push_back(meta);
+
+      for (auto& span : buffer->spans) {
+        nlohmann::json ev;
+        ev["name"] = StageName(span.stage);
+        ev["cat"] = "closed_loop";
+        ev["pid"] = 1;
+        ev["tid"] = buffer->tid;
+        ev["ts"] = ToUs(span.begin_ns, state.session_start_ns);
+        if (span.classif_id != uint64_t(-1)) {
+          ev["args"]["classif_id"] = span.classif_id;
+        }
+        ev["args"]["window_id"] = span.window_id;
+
+        if (IsWait(span.stage)) {
+          ev["ph"] = "b";
+          ev["id"] = span.window_id;
+          events.push_back(ev);
+          ev["ph"] = "e";
+          ev["ts"] = ToUs(span.end_ns, state.session_start_ns);
+          events.push_back(ev);
+        }
+        else {
+          ev["ph"] = "X";
+          ev["dur"] = int64_t(span.end_ns - span.begin_ns) / 1000;
+          events.push_back(ev);
+        }
+      }
+      buffer->spans.clear();
+    }
+
+    if (events.empty()) {
+      return;
+    }
+
+    nlohmann::json trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = "ms";
+
+    RC::FileWrite fw(filename);
+    fw.Put(RC::RStr(trace.dump()) + "\n");
+    fw.Close();
+  }
+
+
+  RC::RStr DecisionTrace::Summary() {
+    if ( ! Enabled() ) {
+      return "Closed-loop tracing is disabled by the sys_config "
+        "\"closed_loop_trace\" setting.";
+    }
+
+    auto ms = [](uint64_t ns) {
+      return RC::RStr(double(ns)*1e-6, RC::FIXED, 3);
+    };
+
+    RC::RStr str = "Stage:  count, p50 / p99 / max ms\n";
+    bool any = false;
+    for (size_t s=0; s<stage_cnt; s++) {
+      auto sum = State().stages[s].Summary();
+      if (sum.count == 0) {
+        continue;
+      }
+      any = true;
+      str += RC::RStr(StageName(TraceStage(s))) + ":  " + RC::RStr(sum.count) +
+        ", " + ms(sum.p50_ns) + " / " + ms(sum.p99_ns) + " / " +
+        ms(sum.max_ns) + "\n";
+    }
+    if ( ! any ) {
+      str += "No closed-loop decisions this session.\n";
+    }
+    return str;
+  }
+}
+
@@ -0,0 +1,91 @@
+#ifndef DECISIONTRACE_H
+#define DECISIONTRACE_H
+
+#include "RC/RStr.h"
+#include "RCqt/TaskStats.h"
+#include "TaskClassifierSettings.h"
+#include <atomic>
+#include <cstdint>
+
+namespace CML {
+  /// The stages of one closed-loop decision, in pipeline order.
+  enum class TraceStage {
+    WINDOW,     // Request until the window's data is complete.
+    PREFIX,     // Early feature computation on a filling window.
+    POWERS,     // Mirroring, Morlet, log, and averaging.
+    NORMALIZE,  // Z-scoring and artifact channel removal.
+    CLASSIFY,
+    DECISION,   // TaskStimManager.
+    STIM_HOP,   // Queued from TaskStimManager until StimWorker starts.
+    STIMULATE,  // The stimulator call.
+    TOTAL,      // Request until the decision, or the stimulation, is done.
+    COUNT
+  };
+
+  /// Timing spans of every closed-loop decision, across threads.
+  /** Each stage records its begin and end times, tagged with the
+   *  classif_id and window_id of the TaskClassifierSettings it was working
+   *  on, into a buffer owned by the recording thread.  At the end of a
+   *  session the spans are written as Chrome trace-event JSON, viewable in
+   *  chrome://tracing or ui.perfetto.dev, and per-stage percentiles are
+   *  kept for display.
+   */
+  class DecisionTrace {
+    public:
+    static void SetEnabled(bool enabled) {
+      enabled_flag.store(enabled, std::memory_order_relaxed);
+    }
+    static bool Enabled() {
+      return enabled_flag.load(std::memory_order_relaxed);
+    }
+
+    static uint64_t Now() { return RCqt::TaskClockNs(); }
+
+    /// Record a completed span from the calling thread.
+    static void Record(TraceStage stage,
+        const TaskClassifierSettings& settings, uint64_t begin_ns,
+        uint64_t end_ns);
+
+    /// Records a span from construction until destruction.
+    class Span {
+      public:
+      Span(TraceStage stage, const TaskClassifierSettings& settings)
+        : stage(stage), settings(settings),
+          begin_ns(Enabled() ? Now() : 0) { }
+      ~Span() { End(); }
+      /// End early, before the callback to the next stage.
+      void End() {
+        if (begin_ns) {
+          Record(stage, settings, begin_ns, Now());
+          begin_ns = 0;
+        }
+      }
+      Span(const Span&) = delete;
+      Span& operator=(const Span&) = delete;
+      protected:
+      TraceStage stage;
+      const TaskClassifierSettings& settings;
+      uint64_t begin_ns;
+    };
+
+    /// Discard all spans and statistics, for a new session.
+    static void Reset();
+
+    /// Write and discard the recorded spans, as Chrome trace-event JSON.
+    /** Nothing is written if there are no spans.  The statistics for
+     *  Summary are kept until Reset.
+     */
+    static void WriteFile(const RC::RStr& filename);
+
+    /// A readable table of per-stage percentiles, for display.
+    static RC::RStr Summary();
+
+    static const char* StageName(TraceStage stage);
+
+    protected:
+    static std::atomic<bool> enabled_flag;
+  };
+}
+
+#endif // DECISIONTRACE_H
+
@@ -6,6 +6,7 @@
 #include "Handler.h"
 #include "ConfigFile.h"
 #include "Popup.h"
+#include <algorithm>
 
 namespace CML {
   template<class F, class P>
@@ -18,6 +19,33 @@ namespace CML {
   }
 
 
+  EDFSave::~EDFSave() {
+    // Every open in progress has replied after Sync, and any FileOpened
+    // queued here runs before the thread exits.  A handle still unclaimed
+    // arrived after that, so is closed here.
+    EDFSynch::Sync();
+    ExitWait();
+    StopSaving_Handler();
+
+    std::lock_guard<std::mutex> lock(opened->mutex);
+    for (int hdl : opened->handles) {
+      if (hdl >= 0) {
+        EDFSynch::Close(hdl);
+      }
+    }
+    opened->handles.clear();
+  }
+
+
+  void EDFSave::OpenReply::operator()(int new_hdl) const {
+    {
+      std::lock_guard<std::mutex> lock(opened->mutex);
+      opened->handles.push_back(new_hdl);
+    }
+    notify();
+  }
+
+
   void EDFSave::StartFile_Handler(const RC::RStr& filename,
                                   const FullConf& conf) {
     if (conf.elec_config.IsNull()) {
@@ -33,9 +61,39 @@ namespace CML {
     }
 
     StopSaving_Handler();
-    edf_hdl = EDFSynch::OpenWrite(filename.c_str(),
-        EDFLIB_FILETYPE_EDFPLUS, int(channels.size()));
+    open_filename = filename;
+    open_conf = conf;
+    open_pending = true;
+    open_requests++;
+    EDFSynch::OpenWrite(filename, EDFLIB_FILETYPE_EDFPLUS,
+        int(channels.size()), OpenReply{opened, FileOpened});
+  }
+
+
+  void EDFSave::FileOpened_Handler() {
+    int new_hdl;
+    {
+      std::lock_guard<std::mutex> lock(opened->mutex);
+      if (opened->handles.empty()) {
+        return;
+      }
+      new_hdl = opened->handles.front();
+      opened->handles.erase(opened->handles.begin());
+    }
 
+    open_requests--;
+    if (open_requests > 0 || ! open_pending) {
+      // Superseded by a later StartFile, or stopped while opening.
+      if (new_hdl >= 0) {
+        EDFSynch::Close(new_hdl);
+      }
+      return;
+    }
+    open_pending = false;
+
+    const RC::RStr& filename = open_filename;
+    const FullConf& conf = open_conf;
+    edf_hdl = new_hdl;
     if (edf_hdl < 0) {
       Throw_RC_Type(File,
           (RC::RStr("Could not open ")+filename+" for edf writing").c_str());
@@ -100,22 +158,19 @@ namespace CML {
     }
 
     amount_written = 0;
-    amount_buffered = 0;
-    buffer.data.Clear();
+    NewRecord();
+    writer.Start(edf_hdl, RecycleRecord);
     hndl->eeg_acq.RegisterEEGMonoCallback(callback_ID, SaveData);
   }
 
 
   void EDFSave::StopSaving_Handler() {
+    open_pending = false;
     hndl->eeg_acq.RemoveEEGMonoCallback(callback_ID);
 
     if (edf_hdl >= 0) {
-      // No error check, can be a destructor cleanup call.
-      edfwrite_annotation_utf8(edf_hdl,
-          static_cast<long long>(amount_written * 10000 / sampling_rate),
-          -1LL, "Recording ends");
-
-      EDFSynch::Close(edf_hdl);
+      // A partial record is dropped, as EDF only holds whole records.
+      writer.Finish(int64_t(amount_written * 10000 / sampling_rate));
       edf_hdl = -1;
     }
   }
@@ -123,75 +178,81 @@ namespace CML {
 
   void EDFSave::SaveData_Handler(RC::APtr<const EEGData>& data) {
     auto& datar = data->data;
-    if (edf_hdl < 0) {
+    if (edf_hdl < 0 || writer.Failed()) {
       StopSaving_Handler();
       return;
     }
 
-    if (buffer.data.size() < datar.size()) {
-      buffer.data.Resize(datar.size());
-    }
-
-    size_t max_written = 0;
-    for (size_t c=0; c<datar.size(); c++) {
-      buffer.data[c] += datar[c];
-      max_written = std::max(max_written, datar[c].size());
+    // Validate first, so a bad block leaves the record untouched.
+    size_t block_len = 0;
+    for (size_t c=0; c<channels.size(); c++) {
+      if (channels[c] >= datar.size()) {
+        StopSaving_Handler();
+        Throw_RC_Type(File, ("EDF save, configured channel " +
+              RC::RStr(c+1) + " out of bounds").c_str());
+      }
+      block_len = std::max(block_len, datar[channels[c]].size());
     }
-    amount_buffered += max_written;
 
-    // Must write data_record_duration at a time.  (sampling_rate by default)
-    while (amount_buffered > datarecord_len) {
-      // Write data in the order of the montage CSV.
-      for (size_t c=0; c<channels.size(); c++) {
-        if (c >= buffer.data.size()) {
-          StopSaving_Handler();
-          Throw_RC_Type(File, ("EDF save, configured channel " +
-                RC::RStr(c+1) + " out of bounds").c_str());
+    for (size_t c=0; c<channels.size(); c++) {
+      if (datar[channels[c]].size() < block_len) {
+        StopSaving_Handler();
+
+        RC::RStr deb_msg("Data missing details\n");
+        deb_msg += "sampling_rate = " + RC::RStr(sampling_rate) + ", ";
+        deb_msg += "data_record_duration = " + RC::RStr(datarecord_len) + ", ";
+        deb_msg += "block_len = " + RC::RStr(block_len) + "\n";
+        for (size_t dc=0; dc<channels.size(); dc++) {
+          deb_msg += RC::RStr(datar[channels[dc]].size()) + " elements:  ";
+          deb_msg += RC::RStr::Join(datar[channels[dc]], ", ");
+          deb_msg += "\n";
         }
+        DebugLog(deb_msg);
 
-        if (buffer.data[channels[c]].size() < datarecord_len) {
-          StopSaving_Handler();
-
-          RC::RStr deb_msg("Data missing details\n");
-          deb_msg += "sampling_rate = " + RC::RStr(sampling_rate) + ", ";
-          deb_msg += "data_record_duration = " + RC::RStr(datarecord_len) + ", ";
-          deb_msg += "amount_buffered = " + RC::RStr(amount_buffered) + "\n";
-          for (size_t dc=0; dc<channels.size(); dc++) {
-            deb_msg += RC::RStr(buffer.data[channels[dc]].size()) + " elements:  ";
-            deb_msg += RC::RStr::Join(buffer.data[channels[dc]], ", ");
-            deb_msg += "\n";
-          }
-          DebugLog(deb_msg);
-
-          Throw_RC_Type(File,
-              ("Data missing on edf save, channel " + RC::RStr(c+1)).c_str());
-        }
+        Throw_RC_Type(File,
+            ("Data missing on edf save, channel " + RC::RStr(c+1)).c_str());
+      }
+    }
 
-        int write_err = edfwrite_digital_short_samples(edf_hdl,
-            buffer.data[channels[c]].Raw());
-        if (write_err) {
-          StopSaving_Handler();
-          Throw_RC_Type(File, ("Could not save data to edf file, error code" +
-                        RC::RStr(write_err)).c_str());
-        }
+    // Copy into the record in the order of the montage CSV, handing each
+    // full record to the writer.
+    size_t pos = 0;
+    while (pos < block_len) {
+      size_t amnt = std::min(block_len - pos, datarecord_len - record_fill);
+      int16_t* rec = record->Raw();
+      for (size_t c=0; c<channels.size(); c++) {
+        const int16_t* src = datar[channels[c]].Raw() + pos;
+        std::copy(src, src + amnt, rec + c*datarecord_len + record_fill);
       }
+      pos += amnt;
+      record_fill += amnt;
 
-      // Move remaining data in buffer to beginning and efficiently shrink.
-      for (size_t c=0; c<buffer.data.size(); c++) {
-        if (buffer.data[c].size() < datarecord_len) {
-          continue;
-        }
-        if (buffer.data[c].size() > datarecord_len) {
-          // Not else, can't copy if == data_record_duration.
-          buffer.data[c].CopyData(0, datarecord_len);
-        }
-        buffer.data[c].Resize(buffer.data[c].size()-datarecord_len);
+      if (record_fill == datarecord_len) {
+        writer.Write(record);
+        amount_written += datarecord_len;
+        NewRecord();
       }
-      amount_buffered -= datarecord_len;
-      amount_written += datarecord_len;
     }
+  }
 
-    buffer.sample_len = amount_buffered; // Keep the buffer sample_len in line with the manual editing
+
+  void EDFSave::RecycleRecord_Handler(RC::APtr<EDFRecord>& done) {
+    if (spare_records.size() < max_spare_records &&
+        done->size() == channels.size() * datarecord_len) {
+      spare_records.push_back(done);
+    }
   }
-}
 
+
+  void EDFSave::NewRecord() {
+    record_fill = 0;
+    if ( ! spare_records.empty() ) {
+      record = spare_records.back();
+      spare_records.pop_back();
+      if (record->size() == channels.size() * datarecord_len) {
+        return;
+      }
+    }
+    record = new EDFRecord(channels.size() * datarecord_len);
+  }
+}
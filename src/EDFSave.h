@@ -2,42 +2,88 @@
 #define EDFSAVE_H
 
 #include "EEGFileSave.h"
+#include "EDFWriter.h"
 #include "EEGData.h"
 #include "RC/File.h"
 #include "RC/Ptr.h"
 #include "RCqt/Worker.h"
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace CML {
   class Handler;
 
+  /// Saves EEG data as EDF+.
+  /** Incoming samples are copied once into a whole data record, and full
+   *  records are written by an EDFWriter thread and then returned here for
+   *  reuse, so a slow disk never stalls this thread or the acquisition
+   *  callbacks.
+   */
   class EDFSave : public EEGFileSave {
     public:
     EDFSave(RC::Ptr<Handler> hndl, size_t sampling_rate)
-      : EEGFileSave(hndl), buffer(sampling_rate, 0),
-        sampling_rate(sampling_rate) {
+      : EEGFileSave(hndl), sampling_rate(sampling_rate) {
       callback_ID = RC::RStr("EDFSave_") + RC::RStr(sampling_rate);
-      buffer.sampling_rate = sampling_rate;
       datarecord_len = sampling_rate;
     }
+    ~EDFSave();
 
     RC::RStr GetExt() const override { return "edf"; }
 
     protected:
+    // Handles opened for this and not yet taken by FileOpened.  Shared
+    // with the EDFSynch replies, so a handle arriving after this thread
+    // stops is still found and closed.
+    class OpenedHandles {
+      public:
+      std::mutex mutex;
+      std::vector<int> handles;
+    };
+    // The EDFSynch reply, run on its thread.
+    class OpenReply {
+      public:
+      std::shared_ptr<OpenedHandles> opened;
+      RCqt::TaskCaller<> notify;
+      void operator()(int new_hdl) const;
+    };
+
+    // Opens the file without blocking, and sets it up in FileOpened.
     void StartFile_Handler(const RC::RStr& filename,
                            const FullConf& conf) override;
+    RCqt::TaskCaller<> FileOpened =
+      TaskHandler(EDFSave::FileOpened_Handler);
+    void FileOpened_Handler();
     // Thread ordering constraint:
     // Must call Stop after Start, before this destructor, and before
     // hndl->eeg_acq is deleted.
     void StopSaving_Handler() override;
     void SaveData_Handler(RC::APtr<const EEGData>& data) override;
 
+    RCqt::TaskCaller<RC::APtr<EDFRecord>> RecycleRecord =
+      TaskHandler(EDFSave::RecycleRecord_Handler);
+    void RecycleRecord_Handler(RC::APtr<EDFRecord>& done);
+
+    void NewRecord();
+
     template<class F, class P>
     void SetChanParam(F func, P p, RC::RStr error_msg);
 
     int edf_hdl = -1;
+    RC::RStr open_filename;
+    FullConf open_conf;
+    // Cleared by StopSaving, so a file opened after it is closed at once.
+    bool open_pending = false;
+    size_t open_requests = 0;
+    std::shared_ptr<OpenedHandles> opened =
+      std::make_shared<OpenedHandles>();
     RC::Data1D<uint8_t> channels;
-    EEGData buffer;
-    size_t amount_buffered = 0;
+    EDFWriter writer;
+    RC::APtr<EDFRecord> record;
+    size_t record_fill = 0;
+    // Written records, for reuse.
+    std::vector<RC::APtr<EDFRecord>> spare_records;
+    static const size_t max_spare_records = 8;
     size_t amount_written = 0;
     size_t sampling_rate;
     size_t datarecord_len;
@@ -29,6 +29,10 @@ namespace CML {
     Inst().Close_Task(edf_hdl);
   }
 
+  void EDFSynch::Sync() {
+    Inst().Sync_Task();
+  }
+
 
   int EDFSynch::OpenRead_Handler(const char*& filename,
       edf_hdr_struct*& edf_hdr, const int& annotations) {
@@ -36,9 +40,9 @@ namespace CML {
   }
 
 
-  int EDFSynch::OpenWrite_Handler(const char*& filename,
+  int EDFSynch::OpenWrite_Handler(const RC::RStr& filename,
       const int& filetype, const int& num_sigs) {
-    return edfopen_file_writeonly(filename, filetype, num_sigs);
+    return edfopen_file_writeonly(filename.c_str(), filetype, num_sigs);
   }
 
   void EDFSynch::Close_Handler(const int& edf_hdl) {
@@ -12,7 +12,15 @@ namespace CML {
     static int OpenRead(const char* filename, edf_hdr_struct* edf_hdr,
         int annotations);
     static int OpenWrite(const char* filename, int filetype, int num_sigs);
+    /// Without blocking, open and then call reply with the handle.
+    template<class Reply>
+    static void OpenWrite(const RC::RStr& filename, int filetype,
+                          int num_sigs, const Reply& reply) {
+      Inst().OpenWrite_Task.Then(reply, filename, filetype, num_sigs);
+    }
     static void Close(int edf_hdl);
+    /// Returns once every earlier call has finished and sent its reply.
+    static void Sync();
 
     /// Initialize this after Qt initializes but before workers do work.
     static EDFSynch& Inst();
@@ -23,16 +31,20 @@ namespace CML {
     RCqt::TaskGetter<int, const char*, edf_hdr_struct*, const int>
       OpenRead_Task =
       TaskHandler(EDFSynch::OpenRead_Handler);
-    RCqt::TaskGetter<int, const char*, const int, const int> OpenWrite_Task =
+    RCqt::TaskGetter<int, const RC::RStr, const int, const int>
+      OpenWrite_Task =
       TaskHandler(EDFSynch::OpenWrite_Handler);
     RCqt::TaskBlocker<const int> Close_Task =
       TaskHandler(EDFSynch::Close_Handler);
+    RCqt::TaskBlocker<> Sync_Task =
+      TaskHandler(EDFSynch::Sync_Handler);
 
     int OpenRead_Handler(const char*& filename, edf_hdr_struct*& edf_hdr,
         const int& annotations);
-    int OpenWrite_Handler(const char*& filename,
+    int OpenWrite_Handler(const RC::RStr& filename,
         const int& filetype, const int& num_sigs);
     void Close_Handler(const int& edf_hdl);
+    void Sync_Handler() { }
   };
 }
 
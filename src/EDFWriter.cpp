@@ -0,0 +1,49 @@
+#include "edflib/edflib.h"
+#include "EDFWriter.h"
+#include "EDFSynch.h"
+#include "RC/Errors.h"
+#include "RC/RStr.h"
+
+namespace CML {
+  void EDFWriter::Start_Handler(const int& new_edf_hdl,
+      const EDFRecordCallback& new_recycle) {
+    edf_hdl = new_edf_hdl;
+    recycle = new_recycle;
+    failed = false;
+  }
+
+
+  void EDFWriter::Write_Handler(RC::APtr<EDFRecord>& record) {
+    if (edf_hdl < 0 || Failed()) {
+      return;
+    }
+
+    // One call writes the record for every channel.
+    int write_err = edf_blockwrite_digital_short_samples(edf_hdl,
+        record->Raw());
+    if (write_err) {
+      failed = true;
+      Throw_RC_Type(File, ("Could not save data to edf file, error code " +
+            RC::RStr(write_err)).c_str());
+    }
+
+    if (recycle.IsSet()) {
+      recycle(record);
+    }
+  }
+
+
+  void EDFWriter::Finish_Handler(const int64_t& end_time) {
+    if (edf_hdl < 0) {
+      return;
+    }
+
+    // No error check, can be a destructor cleanup call.
+    edfwrite_annotation_utf8(edf_hdl, static_cast<long long>(end_time),
+        -1LL, "Recording ends");
+
+    EDFSynch::Close(edf_hdl);
+    edf_hdl = -1;
+  }
+}
+
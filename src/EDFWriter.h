@@ -0,0 +1,53 @@
+#ifndef EDFWRITER_H
+#define EDFWRITER_H
+
+#include "RC/APtr.h"
+#include "RC/Data1D.h"
+#include "RCqt/Worker.h"
+#include <atomic>
+
+namespace CML {
+  /// One EDF data record, datarecord_len samples of each channel in turn.
+  using EDFRecord = RC::Data1D<int16_t>;
+  using EDFRecordCallback = RCqt::TaskCaller<RC::APtr<EDFRecord>>;
+
+  /// Writes complete EDF data records to an open file on its own thread.
+  /** EDFSave assembles records and hands them over, so acquisition
+   *  callbacks never wait on disk.  The writer's queue depth and Write run
+   *  times in the worker metrics are the write-behind depth and write
+   *  latency.
+   */
+  class EDFWriter : public RCqt::WorkerThread {
+    public:
+    EDFWriter() { }
+
+    /// Take over writing to edf_hdl.  Written records go to recycle.
+    /** Blocks, so Failed is cleared before the caller saves again. */
+    RCqt::TaskBlocker<const int, const EDFRecordCallback> Start =
+      TaskHandler(EDFWriter::Start_Handler);
+
+    RCqt::TaskCaller<RC::APtr<EDFRecord>> Write =
+      TaskHandler(EDFWriter::Write_Handler);
+
+    /// Write everything queued, mark the end, and close the file.
+    /** @param end_time Recording end, in units of 100us. */
+    RCqt::TaskBlocker<const int64_t> Finish =
+      TaskHandler(EDFWriter::Finish_Handler);
+
+    /// True after a write error, until the next Start.
+    bool Failed() const { return failed.load(std::memory_order_relaxed); }
+
+    protected:
+    void Start_Handler(const int& new_edf_hdl,
+                       const EDFRecordCallback& new_recycle);
+    void Write_Handler(RC::APtr<EDFRecord>& record);
+    void Finish_Handler(const int64_t& end_time);
+
+    int edf_hdl = -1;
+    EDFRecordCallback recycle;
+    std::atomic<bool> failed{false};
+  };
+}
+
+#endif // EDFWRITER_H
+
@@ -62,6 +62,7 @@ namespace CML {
         }
       }
       auto data_captr = data_aptr.ExtractConst();
+      samples_acquired += max_len;
 
       // Report Original Data
       for (size_t i=0; i<mono_data_callbacks.size(); i++) {
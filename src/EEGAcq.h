@@ -8,6 +8,8 @@
 #include "EEGSource.h"
 #include "ChannelConf.h"
 #include <QTimer>
+#include <atomic>
+#include <cstdint>
 
 namespace CML {
   //using ChannelList = RC::Data1D<uint16_t>;
@@ -56,6 +58,9 @@ namespace CML {
     RCqt::TaskBlocker<> CloseSource =
       TaskHandler(EEGAcq::CloseSource_Handler);
 
+    /// Any thread.  Samples per channel acquired so far.
+    uint64_t SampleCount() const { return samples_acquired; }
+
     protected slots:
 
     void GetData_Slot();
@@ -91,6 +96,7 @@ namespace CML {
     RC::APtr<QTimer> acq_timer;
     int polling_interval_ms = 5;
     bool channels_initialized = false;
+    std::atomic<uint64_t> samples_acquired{0};
 
     RC::Data1D<EEGChan> bipolar_channels;
 
@@ -3,76 +3,81 @@
 #include "RC/RStr.h"
 
 namespace CML {
+  void EEGCircularView::CopyChan(size_t chan, RC::Data1D<double>& out) const {
+    out.Resize(sample_len);
+    std::copy(chans[chan], chans[chan] + sample_len, out.Raw());
+  }
+
+  RC::APtr<EEGDataDouble> EEGCircularView::Copy() const {
+    RC::APtr<EEGDataDouble> out_data = new EEGDataDouble(sampling_rate, sample_len);
+    out_data->data.Resize(ChanCount());
+    RC_ForRange(i, 0, ChanCount()) { // Iterate over channels
+      if (IsEmpty(i)) { continue; } // Skip empty channels
+      CopyChan(i, out_data->data[i]);
+    }
+    return out_data;
+  }
+
+
   RC::APtr<EEGDataDouble> EEGCircularData::GetRecentData(size_t amnt) {
-    if (amnt > circular_data.sample_len) {
+    if (amnt > circular_data_len) {
       Throw_RC_Error(("The amount of data requested "
             "(" + RC::RStr(amnt) + ") " +
             "is greater than the number of samples in the circular data "
-            "(" + RC::RStr(circular_data.sample_len) + ")").c_str());
+            "(" + RC::RStr(circular_data_len) + ")").c_str());
     }
 
-    RC::APtr<EEGDataDouble> out_data = new EEGDataDouble(circular_data.sampling_rate, amnt);
-    auto& circ_datar = circular_data.data;
-    auto& out_datar = out_data->data;
-    out_datar.Resize(circ_datar.size());
-
-    RC_ForIndex(i, circ_datar) { // Iterate over channels
-      auto& circ_events = circ_datar[i];
-      auto& out_events = out_datar[i];
+    return CopyOut(total_appended - amnt, amnt);
+  }
 
-      if (circ_events.IsEmpty()) { continue; } // Skip empty channels
-      out_data->EnableChan(i);
+  /// Get a pinned view of the most recent amnt samples, without copying.
+  /** Before the buffer has filled, the window is padded at the start with
+   *  zeros, as with GetDataAllAsTimeline.
+   *  @param amnt The number of samples in the view.
+   */
+  EEGCircularView EEGCircularData::GetRecentView(size_t amnt) {
+    if (amnt > circular_data_len) {
+      Throw_RC_Error(("The amount of data requested "
+            "(" + RC::RStr(amnt) + ") " +
+            "is greater than the number of samples in the circular data "
+            "(" + RC::RStr(circular_data_len) + ")").c_str());
+    }
 
-      size_t recent_start = (circular_data_start + circular_data.sample_len -
-        amnt) % circular_data_len;
+    EEGCircularView view;
+    view.sampling_rate = sampling_rate;
+    view.sample_len = amnt;
 
-      size_t amnt_to_end = circular_data_len - recent_start;
-      if (amnt <= amnt_to_end) {
-        out_events.CopyAt(0, circ_events, recent_start, amnt);
-      } else {
-        out_events.CopyAt(0, circ_events, recent_start, amnt_to_end);
-        size_t amnt_from_start = amnt - amnt_to_end;
-        out_events.CopyAt(amnt_to_end, circ_events, 0, amnt_from_start);
-      }
+    uint64_t first = total_appended - amnt;
+    view.chans.resize(ring.ChanCount(), nullptr);
+    RC_ForRange(i, 0, ring.ChanCount()) { // Iterate over channels
+      if (ring.IsEmpty(i)) { continue; } // Skip empty channels
+      view.chans[i] = ring.At(i, first);
     }
-    return out_data;
+
+    view.pin = std::make_shared<EEGCircularView::Pin>();
+    view.pin->start = int64_t(total_appended) - int64_t(amnt);
+    pins.push_back(view.pin);
+
+    return view;
   }
 
   // TODO: JPB: (refactor) Should these old GetData entries even exist?
   RC::APtr<EEGDataDouble> EEGCircularData::GetData() {
-    return GetData(circular_data_end);
+    return GetData(std::min(total_appended, uint64_t(circular_data_len)));
   }
 
+  /// Get amnt samples starting from the oldest sample in the buffer
   RC::APtr<EEGDataDouble> EEGCircularData::GetData(size_t amnt) {
-    if (amnt > circular_data.sample_len) {
+    if (amnt > circular_data_len) {
       Throw_RC_Error(("The amount of data requested "
             "(" + RC::RStr(amnt) + ") " +
             "is greater than the number of samples in the circular data "
-            "(" + RC::RStr(circular_data.sample_len) + ")").c_str());
+            "(" + RC::RStr(circular_data_len) + ")").c_str());
     }
 
-    RC::APtr<EEGDataDouble> out_data = new EEGDataDouble(circular_data.sampling_rate, amnt);
-    auto& circ_datar = circular_data.data;
-    auto& out_datar = out_data->data;
-    out_datar.Resize(circ_datar.size());
-
-    RC_ForIndex(i, circ_datar) { // Iterate over channels
-      auto& circ_events = circ_datar[i];
-      auto& out_events = out_datar[i];
-
-      if (circ_events.IsEmpty()) { continue; } // Skip empty channels
-      out_data->EnableChan(i);
-
-      size_t amnt_to_end = circular_data_len - circular_data_start;
-      if (amnt <= amnt_to_end) {
-        out_events.CopyAt(0, circ_events, circular_data_start, amnt);
-      } else {
-        out_events.CopyAt(0, circ_events, circular_data_start, amnt_to_end);
-        size_t amnt_from_start = amnt - amnt_to_end;
-        out_events.CopyAt(amnt_to_end, circ_events, 0, amnt_from_start);
-      }
-    }
-    return out_data;
+    uint64_t oldest = (total_appended > circular_data_len) ?
+      total_appended - circular_data_len : 0;
+    return CopyOut(oldest, amnt);
   }
 
   RC::APtr<EEGDataDouble> EEGCircularData::GetDataAll() {
@@ -82,48 +87,28 @@ namespace CML {
   /// This gets the data as a timeline, meaning that if the data isn't full yet
   /// then the 0s go before the data instead of after
   RC::APtr<EEGDataDouble> EEGCircularData::GetDataAllAsTimeline() {
-    RC::APtr<EEGDataDouble> out_data = new EEGDataDouble(circular_data.sampling_rate, circular_data.sample_len);
-    auto& circ_datar = circular_data.data;
-    auto& out_datar = out_data->data;
-    out_datar.Resize(circ_datar.size());
-    RC_ForIndex(i, circ_datar) { // Iterate over channels
-      auto& circ_events = circ_datar[i];
-      auto& out_events = out_datar[i];
-
-      if (circ_events.IsEmpty()) { continue; } // Skip empty channels
-      out_data->EnableChan(i);
-
-      size_t amnt = circ_events.size() - circular_data_end;
-      out_events.CopyAt(0, circ_events, circular_data_end, amnt);
-      out_events.CopyAt(amnt, circ_events, 0, circular_data_end);
-    }
-    return out_data;
+    return GetRecentData(circular_data_len);
   }
 
   void EEGCircularData::PrintData() {
-    std::cerr << (RC::RStr("circular_data_start: ") + circular_data_start +
-        "\n");
-    std::cerr << (RC::RStr("circular_data_end: ") + circular_data_end +
-        "\n");
+    std::cerr << (RC::RStr("total_appended: ") + total_appended + "\n");
     GetData()->Print();
   }
 
   void EEGCircularData::PrintRawData() {
-    std::cerr << (RC::RStr("circular_data_start: ") + circular_data_start +
-        "\n");
-    std::cerr << (RC::RStr("circular_data_end: ") + circular_data_end +
-        "\n");
-    circular_data.Print();
+    std::cerr << (RC::RStr("total_appended: ") + total_appended + "\n");
+    std::cerr << (RC::RStr("ring capacity: ") + ring.Capacity() + "\n");
+    CopyOut(0, ring.Capacity())->Print();
   }
 
   void EEGCircularData::Append(RC::APtr<const EEGDataDouble>& new_data) {
     size_t start = 0;
-    size_t amnt = new_data->data[0].size();
+    size_t amnt = new_data->sample_len;
     Append(new_data, start, amnt);
   }
 
   void EEGCircularData::Append(RC::APtr<const EEGDataDouble>& new_data, size_t start) {
-    size_t amnt = new_data->data[0].size() - start;
+    size_t amnt = new_data->sample_len - start;
     Append(new_data, start, amnt);
   }
 
@@ -134,63 +119,97 @@ namespace CML {
     */
   void EEGCircularData::Append(RC::APtr<const EEGDataDouble>& new_data, size_t start, size_t amnt) {
     auto& new_datar = new_data->data;
-    auto& circ_datar = circular_data.data;
 
     // TODO: JPB: (refactor) Decide if this is how I should set the data size
     //                       (or should I pass all the info in the constructor)
-    // Setup the circular EEGData to match the incoming EEGData
-    if (circ_datar.IsEmpty()) {
-      circ_datar.Resize(new_datar.size());
-      RC_ForIndex(i, circ_datar) { // Iterate over channels
-        auto& new_events = new_datar[i];
-        auto& circ_events = circ_datar[i];
-        if (new_events.IsEmpty()) { continue; } // Skip empty channels
-        circ_events.Resize(circular_data_len);
-        circ_events.Zero();
+    // Setup the circular ring to match the incoming EEGData
+    if (ring.ChanCount() == 0) {
+      std::vector<bool> enabled(new_datar.size());
+      RC_ForIndex(i, new_datar) { // Iterate over channels
+        enabled[i] = ! new_datar[i].IsEmpty();
       }
+      ring.Setup(enabled, circular_data_len);
     }
 
-    if (new_data->sampling_rate != circular_data.sampling_rate)
-      Throw_RC_Type(Bounds, (RC::RStr("The sampling_rate of new_data (") + new_data->sampling_rate + ") and circular_data (" + circular_data.sampling_rate + ") do not match").c_str());
-    if (new_datar.size() != circ_datar.size())
-      Throw_RC_Type(Bounds, (RC::RStr("The number of channels in new_data (") + new_datar.size() + ") and circular_data (" + circ_datar.size() + ") do not match").c_str());
-    if (start >= new_datar.size())
-      Throw_RC_Type(Bounds, (RC::RStr("The \"start\" value (") + start + ") is greater than or equal to the number of items that new_data contains (" + new_datar.size() + ")").c_str());
+    if (new_data->sampling_rate != sampling_rate)
+      Throw_RC_Type(Bounds, (RC::RStr("The sampling_rate of new_data (") + new_data->sampling_rate + ") and circular_data (" + sampling_rate + ") do not match").c_str());
+    if (new_datar.size() != ring.ChanCount())
+      Throw_RC_Type(Bounds, (RC::RStr("The number of channels in new_data (") + new_datar.size() + ") and circular_data (" + ring.ChanCount() + ") do not match").c_str());
+    if (start > new_data->sample_len)
+      Throw_RC_Type(Bounds, (RC::RStr("The \"start\" value (") + start + ") is greater than the number of items that new_data contains (" + new_data->sample_len + ")").c_str());
     if (start + amnt > new_data->sample_len)
-      Throw_RC_Type(Bounds, (RC::RStr("The end value (") + (start + amnt) + ") is greater than the number of items that new_data contains (" + new_datar[0].size() + ")").c_str());
+      Throw_RC_Type(Bounds, (RC::RStr("The end value (") + (start + amnt) + ") is greater than the number of items that new_data contains (" + new_data->sample_len + ")").c_str());
     // TODO: JPB: (feature) Log error message and write only the last buffer length of data
-    if (amnt-start > circular_data_len)
-      Throw_RC_Type(Bounds, (RC::RStr("Trying to write more values (") + (amnt - start) + ") into the circular_data than the circular_data contains (" + circular_data_len + ")").c_str());
+    if (amnt > circular_data_len)
+      Throw_RC_Type(Bounds, (RC::RStr("Trying to write more values (") + amnt + ") into the circular_data than the circular_data contains (" + circular_data_len + ")").c_str());
 
     if (amnt ==  0) { return; } // Not writing any data, so skip
 
-    size_t circ_remaining_events = circular_data_len - circular_data_end;
-    size_t frst_amnt = std::min(circ_remaining_events, amnt);
-    size_t scnd_amnt = std::max(int64_t(0),
-        int64_t(amnt) - int64_t(frst_amnt));
+    ReleasePins(amnt);
 
-    RC_ForIndex(i, circ_datar) { // Iterate over channels
+    RC_ForIndex(i, new_datar) { // Iterate over channels
       auto& new_events = new_datar[i];
-      auto& circ_events = circ_datar[i];
 
-      if (new_events.IsEmpty()) { continue; } // Skip empty channels
+      // Skip empty channels
+      if (new_events.IsEmpty() || ring.IsEmpty(i)) { continue; }
+
+      ring.Write(i, total_appended, new_events.Raw() + start, amnt);
+    }
+
+    total_appended += amnt;
+  }
+
+  /// Copy amnt samples starting at running sample count first
+  RC::APtr<EEGDataDouble> EEGCircularData::CopyOut(uint64_t first, size_t amnt) {
+    RC::APtr<EEGDataDouble> out_data = new EEGDataDouble(sampling_rate, amnt);
+    auto& out_datar = out_data->data;
+    out_datar.Resize(ring.ChanCount());
 
-      // Copy the data up to the end of the Data1D (or all the data, if possible)
-      circ_events.CopyAt(circular_data_end, new_events, start, frst_amnt);
+    RC_ForIndex(i, out_datar) { // Iterate over channels
+      if (ring.IsEmpty(i)) { continue; } // Skip empty channels
+      out_data->EnableChan(i);
 
-      // Copy the remaining data at the beginning of the Data1D
-      if (scnd_amnt)
-        circ_events.CopyAt(0, new_events, start+frst_amnt, scnd_amnt);
+      const double* src = ring.At(i, first);
+      std::copy(src, src + amnt, out_datar[i].Raw());
     }
+    return out_data;
+  }
 
-    if (!has_wrapped && (circular_data_end + amnt >= circular_data_len)) {
-      has_wrapped = true;
-      if (scnd_amnt) {
-        circular_data_start = (circular_data_start + scnd_amnt) % circular_data_len;
+  /// Make room for an append of amnt samples without disturbing live views
+  /** If any live EEGCircularView can still see samples that this append
+    * would overwrite, the current ring is handed over to those views as it
+    * is, and the ring continues in fresh memory holding only the samples
+    * that can still be read after the append.  Otherwise nothing is copied.
+    */
+  void EEGCircularData::ReleasePins(size_t amnt) {
+    // Samples before this are overwritten by the append.
+    int64_t overwrite_end = int64_t(total_appended + amnt) -
+      int64_t(ring.Capacity());
+
+    bool conflict = false;
+    std::vector<std::shared_ptr<EEGCircularView::Pin>> live;
+    for (auto& weak_pin : pins) {
+      auto pin = weak_pin.lock();
+      if (pin) {
+        conflict = conflict || (pin->start < overwrite_end);
+        live.push_back(pin);
       }
-    } else if (has_wrapped) {
-      circular_data_start = (circular_data_start + amnt) % circular_data_len;
     }
-    circular_data_end = (circular_data_end + amnt) % circular_data_len;
+
+    if ( ! conflict ) {
+      pins.assign(live.begin(), live.end());
+      return;
+    }
+
+    // Moving the ring keeps its mappings, and the views' spans, in place.
+    auto retained = std::make_shared<MirroredRing<double>>(std::move(ring));
+    int64_t keep_first = std::max(int64_t(0), int64_t(total_appended + amnt) -
+        int64_t(circular_data_len));
+    ring.CopyFrom(*retained, uint64_t(keep_first), total_appended);
+
+    for (auto& pin : live) {
+      pin->retained = retained;
+    }
+    pins.clear();
   }
 }
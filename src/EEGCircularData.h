@@ -2,16 +2,66 @@
 #define EEGCIRCULARDATA_H
 
 #include "EEGData.h"
+#include "MirroredRing.h"
 #include "RC/Ptr.h"
 #include "RCqt/Worker.h"
+#include <memory>
+#include <vector>
 
 namespace CML {
+  /// A read-only window onto the most recent samples of an EEGCircularData.
+  /** Each channel is a single contiguous span of the mirrored ring.  While
+   *  any copy of the view exists, its samples are pinned:  EEGCircularData
+   *  moves the pinned ring aside before it would overwrite them, so appends
+   *  never block on readers and the spans stay valid from any thread for
+   *  the life of the view.
+   */
+  class EEGCircularView {
+    public:
+    struct Span {
+      const double* ptr = nullptr;
+      size_t len = 0;
+    };
+
+    size_t sampling_rate = 0;
+    size_t sample_len = 0;
+
+    size_t ChanCount() const { return chans.size(); }
+    bool IsEmpty(size_t chan) const { return chans[chan] == nullptr; }
+
+    Span Chan(size_t chan) const { return Span{chans[chan], sample_len}; }
+    double At(size_t chan, size_t i) const { return chans[chan][i]; }
+
+    /// Copy a channel's window into out, which is resized to sample_len.
+    void CopyChan(size_t chan, RC::Data1D<double>& out) const;
+    /// Copy the whole window out of the ring.
+    RC::APtr<EEGDataDouble> Copy() const;
+
+    protected:
+    friend class EEGCircularData;
+
+    // Keeps the samples visible, owning them once they are moved aside.
+    struct Pin {
+      int64_t start;  // First sample, counted over all appends.
+      std::shared_ptr<MirroredRing<double>> retained;
+    };
+    std::shared_ptr<Pin> pin;
+
+    std::vector<const double*> chans;  // Window start per channel, or null.
+  };
+
+
+  /// The most recent duration_ms of EEG data, held in a mirrored ring.
+  /** Samples are addressed by the running count of samples appended, so no
+   *  wrap bookkeeping is needed, and any window up to the ring length is
+   *  contiguous.  Before the buffer first fills, windows reaching back
+   *  past the first sample read as zeros.
+   */
   class EEGCircularData {
     public:
     EEGCircularData(size_t sampling_rate, size_t duration_ms)
       : sampling_rate(sampling_rate), duration_ms(duration_ms),
-      circular_data_len(duration_ms * sampling_rate / 1000),
-      circular_data(sampling_rate, circular_data_len) {
+      circular_data_len(duration_ms * sampling_rate / 1000) {
     }
 
     // TODO: JPB: (refactor) Reuse member variables of EEGData
@@ -19,12 +69,9 @@ namespace CML {
     size_t duration_ms = 0;
     size_t circular_data_len = 1000;  // Set this in constructor
 
-    EEGDataDouble circular_data;
-    size_t circular_data_start = 0;
-    size_t circular_data_end = 0;
-    bool has_wrapped = false;
-
     RC::APtr<EEGDataDouble> GetRecentData(size_t amnt);
+    /// Like GetRecentData, but references the ring without copying.
+    EEGCircularView GetRecentView(size_t amnt);
 
     RC::APtr<EEGDataDouble> GetData();
     RC::APtr<EEGDataDouble> GetData(size_t amnt);
@@ -36,6 +83,14 @@ namespace CML {
     void Append(RC::APtr<const EEGDataDouble>& new_data);
     void Append(RC::APtr<const EEGDataDouble>& new_data, size_t start);
     void Append(RC::APtr<const EEGDataDouble>& new_data, size_t start, size_t amnt);
+
+    protected:
+    RC::APtr<EEGDataDouble> CopyOut(uint64_t first, size_t amnt);
+    void ReleasePins(size_t amnt);
+
+    MirroredRing<double> ring;
+    uint64_t total_appended = 0;
+    std::vector<std::weak_ptr<EEGCircularView::Pin>> pins;
   };
 }
 
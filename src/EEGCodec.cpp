@@ -0,0 +1,354 @@
+#include "EEGCodec.h"
+#include "RC/Errors.h"
+#include <algorithm>
+#include <cstring>
+
+namespace CML {
+  namespace {
+    // Quotients from here on are escaped to a fixed width value.
+    const uint32_t escape_q = 16;
+    // Wide enough for a zigzagged order 2 residual of int16 data.
+    const uint32_t escape_bits = 20;
+    const uint32_t max_k = escape_bits - 1;
+    // EncodeEEG magic, "EEG1".
+    const uint32_t eeg_magic = 0x31474545;
+
+    template<class T>
+    void PutLE(std::vector<uint8_t>& out, T val) {
+      for (size_t i=0; i<sizeof(T); i++) {
+        out.push_back(uint8_t(val >> (8*i)));
+      }
+    }
+
+    template<class T>
+    T GetLE(const uint8_t* in) {
+      T val = 0;
+      for (size_t i=0; i<sizeof(T); i++) {
+        val |= T(T(in[i]) << (8*i));
+      }
+      return val;
+    }
+
+    [[noreturn]] void Damaged() {
+      Throw_RC_Type(File, "Compressed eeg block is damaged");
+    }
+
+    inline uint32_t ZigZag(int32_t v) {
+      return (uint32_t(v) << 1) ^ uint32_t(v >> 31);
+    }
+
+    inline int32_t UnZigZag(uint32_t u) {
+      return int32_t(u >> 1) ^ -int32_t(u & 1);
+    }
+
+
+    class BitWriter {
+      public:
+      BitWriter(std::vector<uint8_t>& out) : out(out) { }
+
+      void Put(uint32_t val, uint32_t bits) {
+        acc = (acc << bits) | (val & ((uint64_t(1) << bits) - 1));
+        cnt += bits;
+        while (cnt >= 8) {
+          cnt -= 8;
+          out.push_back(uint8_t(acc >> cnt));
+        }
+      }
+
+      void PutOnes(uint32_t n) {
+        while (n > 24) {
+          Put(0xFFFFFF, 24);
+          n -= 24;
+        }
+        Put((1u << n) - 1, n);
+      }
+
+      /// Pad to a byte boundary.
+      void Flush() {
+        if (cnt) {
+          out.push_back(uint8_t(acc << (8 - cnt)));
+          cnt = 0;
+        }
+        acc = 0;
+      }
+
+      protected:
+      std::vector<uint8_t>& out;
+      uint64_t acc = 0;
+      uint32_t cnt = 0;
+    };
+
+
+    class BitReader {
+      public:
+      BitReader(const uint8_t* in, size_t len) : in(in), end(in+len) { }
+
+      uint32_t Get(uint32_t bits) {
+        Fill(bits);
+        cnt -= bits;
+        return uint32_t(acc >> cnt) & uint32_t((uint64_t(1) << bits) - 1);
+      }
+
+      /// Count ones up to a zero, at most limit, consuming the zero.
+      uint32_t GetOnes(uint32_t limit) {
+        uint32_t n = 0;
+        while (n < limit) {
+          if (Get(1) == 0) {
+            return n;
+          }
+          n++;
+        }
+        return n;
+      }
+
+      void AlignByte() { cnt -= cnt % 8; }
+
+      protected:
+      void Fill(uint32_t bits) {
+        while (cnt < bits) {
+          if (in >= end) {
+            Damaged();
+          }
+          acc = (acc << 8) | *in++;
+          cnt += 8;
+        }
+      }
+
+      const uint8_t* in;
+      const uint8_t* end;
+      uint64_t acc = 0;
+      uint32_t cnt = 0;
+    };
+
+
+    // Residuals of the fixed predictors, first computed at warmup.
+    inline int32_t Residual(const int16_t* x, size_t i, uint32_t order) {
+      switch (order) {
+        case 0: return x[i];
+        case 1: return int32_t(x[i]) - x[i-1];
+        default: return int32_t(x[i]) - 2*int32_t(x[i-1]) + x[i-2];
+      }
+    }
+
+    uint32_t BestOrder(const int16_t* x, size_t n) {
+      uint64_t sum[3] = {0, 0, 0};
+      // Kept branch free so it vectorizes.
+      for (size_t i=2; i<n; i++) {
+        int32_t r0 = x[i];
+        int32_t r1 = r0 - x[i-1];
+        int32_t r2 = r1 - (int32_t(x[i-1]) - x[i-2]);
+        sum[0] += uint32_t(r0 < 0 ? -r0 : r0);
+        sum[1] += uint32_t(r1 < 0 ? -r1 : r1);
+        sum[2] += uint32_t(r2 < 0 ? -r2 : r2);
+      }
+      uint32_t best = 0;
+      for (uint32_t o=1; o<3; o++) {
+        if (sum[o] < sum[best]) {
+          best = o;
+        }
+      }
+      return (n > best) ? best : 0;
+    }
+
+    uint32_t RiceParam(const uint32_t* u, size_t n) {
+      uint64_t sum = 0;
+      for (size_t i=0; i<n; i++) {
+        sum += u[i];
+      }
+      uint32_t k = 0;
+      while (k < max_k && (uint64_t(n) << (k+1)) <= sum) {
+        k++;
+      }
+      return k;
+    }
+  }
+
+
+  void EEGCodec::Encode(const int16_t* samples, size_t chan_count,
+      size_t sample_count, std::vector<uint8_t>& out) {
+    size_t start = out.size();
+    PutLE<uint32_t>(out, 0);  // total_bytes, filled in below.
+    PutLE<uint32_t>(out, uint32_t(sample_count));
+    PutLE<uint16_t>(out, uint16_t(chan_count));
+    PutLE<uint16_t>(out, 0);
+
+    std::vector<uint32_t> u(sample_count);
+    BitWriter bits(out);
+
+    for (size_t c=0; c<chan_count; c++) {
+      const int16_t* x = samples + c*sample_count;
+      uint32_t order = BestOrder(x, sample_count);
+
+      bits.Put(order, 2);
+      for (size_t i=0; i<order; i++) {
+        bits.Put(uint16_t(x[i]), 16);
+      }
+
+      for (size_t i=order; i<sample_count; i++) {
+        u[i] = ZigZag(Residual(x, i, order));
+      }
+
+      for (size_t p=order; p<sample_count; p+=partition_len) {
+        size_t p_end = std::min(p + partition_len, sample_count);
+        uint32_t k = RiceParam(u.data() + p, p_end - p);
+        bits.Put(k, 5);
+        for (size_t i=p; i<p_end; i++) {
+          uint32_t q = u[i] >> k;
+          if (q < escape_q) {
+            bits.PutOnes(q);
+            bits.Put(0, 1);
+            bits.Put(u[i], k);
+          }
+          else {
+            bits.PutOnes(escape_q);
+            bits.Put(u[i], escape_bits);
+          }
+        }
+      }
+      bits.Flush();
+    }
+
+    uint32_t total = uint32_t(out.size() - start);
+    for (size_t i=0; i<4; i++) {
+      out[start+i] = uint8_t(total >> (8*i));
+    }
+  }
+
+
+  size_t EEGCodec::BlockBytes(const uint8_t* in, size_t len) {
+    if (len < header_bytes) {
+      return 0;
+    }
+    return GetLE<uint32_t>(in);
+  }
+
+
+  size_t EEGCodec::Decode(const uint8_t* in, size_t len,
+      RC::Data1D<int16_t>& samples, size_t& chan_count,
+      size_t& sample_count) {
+    size_t total = BlockBytes(in, len);
+    if (total < header_bytes || total > len) {
+      Damaged();
+    }
+    sample_count = GetLE<uint32_t>(in + 4);
+    chan_count = GetLE<uint16_t>(in + 8);
+    // Every sample takes at least one bit, so a damaged count is caught
+    // before it can size the allocation.
+    if (uint64_t(chan_count) * sample_count >
+        8 * uint64_t(total - header_bytes)) {
+      Damaged();
+    }
+    samples.Resize(chan_count * sample_count);
+
+    BitReader bits(in + header_bytes, total - header_bytes);
+
+    for (size_t c=0; c<chan_count; c++) {
+      int16_t* x = samples.Raw() + c*sample_count;
+      uint32_t order = bits.Get(2);
+      if (order > 2 || order > sample_count) {
+        Damaged();
+      }
+      for (size_t i=0; i<order; i++) {
+        x[i] = int16_t(bits.Get(16));
+      }
+
+      for (size_t p=order; p<sample_count; p+=partition_len) {
+        size_t p_end = std::min(p + partition_len, sample_count);
+        uint32_t k = bits.Get(5);
+        if (k > max_k) {
+          Damaged();
+        }
+        for (size_t i=p; i<p_end; i++) {
+          uint32_t q = bits.GetOnes(escape_q);
+          uint32_t u = (q < escape_q) ? ((q << k) | bits.Get(k)) :
+            bits.Get(escape_bits);
+          int32_t r = UnZigZag(u);
+          switch (order) {
+            case 0: x[i] = int16_t(r); break;
+            case 1: x[i] = int16_t(r + x[i-1]); break;
+            default: x[i] = int16_t(r + 2*int32_t(x[i-1]) - x[i-2]); break;
+          }
+        }
+      }
+      bits.AlignByte();
+    }
+
+    return total;
+  }
+
+
+  void EEGCodec::EncodeEEG(const EEGData& data, std::vector<uint8_t>& out) {
+    // Checked before anything is appended to out.
+    std::vector<uint8_t> enabled((data.data.size() + 7) / 8, 0);
+    size_t active = 0;
+    for (size_t c=0; c<data.data.size(); c++) {
+      if ( ! data.data[c].IsEmpty() ) {
+        if (data.data[c].size() != data.sample_len) {
+          Throw_RC_Type(Bounds, ("EncodeEEG channel " + RC::RStr(c) +
+                " has " + RC::RStr(data.data[c].size()) + " samples, not " +
+                RC::RStr(data.sample_len)).c_str());
+        }
+        enabled[c/8] |= uint8_t(1 << (c%8));
+        active++;
+      }
+    }
+
+    PutLE<uint32_t>(out, eeg_magic);
+    PutLE<uint32_t>(out, uint32_t(data.sampling_rate));
+    PutLE<uint32_t>(out, uint32_t(data.data.size()));
+    out.insert(out.end(), enabled.begin(), enabled.end());
+
+    RC::Data1D<int16_t> packed(active * data.sample_len);
+    size_t a = 0;
+    for (size_t c=0; c<data.data.size(); c++) {
+      if (data.data[c].IsEmpty()) {
+        continue;
+      }
+      std::memcpy(packed.Raw() + a*data.sample_len, data.data[c].Raw(),
+          data.sample_len * sizeof(int16_t));
+      a++;
+    }
+    Encode(packed.Raw(), active, data.sample_len, out);
+  }
+
+
+  RC::APtr<EEGData> EEGCodec::DecodeEEG(const uint8_t* in, size_t len) {
+    if (len < 12 || GetLE<uint32_t>(in) != eeg_magic) {
+      Damaged();
+    }
+    size_t sampling_rate = GetLE<uint32_t>(in + 4);
+    size_t chans = GetLE<uint32_t>(in + 8);
+    size_t mask_bytes = (chans + 7) / 8;
+    if (len < 12 + mask_bytes) {
+      Damaged();
+    }
+    const uint8_t* enabled = in + 12;
+    const uint8_t* block = enabled + mask_bytes;
+
+    RC::Data1D<int16_t> packed;
+    size_t active;
+    size_t sample_len;
+    Decode(block, len - 12 - mask_bytes, packed, active, sample_len);
+
+    RC::APtr<EEGData> data = new EEGData(sampling_rate, sample_len);
+    data->data.Resize(chans);
+    size_t a = 0;
+    for (size_t c=0; c<chans; c++) {
+      if ( ! (enabled[c/8] & (1 << (c%8))) ) {
+        continue;
+      }
+      if (a >= active) {
+        Damaged();
+      }
+      data->EnableChan(c);
+      std::memcpy(data->data[c].Raw(), packed.Raw() + a*sample_len,
+          sample_len * sizeof(int16_t));
+      a++;
+    }
+    if (a != active) {
+      Damaged();
+    }
+    return data;
+  }
+}
+
@@ -0,0 +1,59 @@
+#ifndef EEGCODEC_H
+#define EEGCODEC_H
+
+#include "EEGData.h"
+#include "RC/APtr.h"
+#include "RC/Data1D.h"
+#include <cstdint>
+#include <vector>
+
+namespace CML {
+  /// Lossless compression of int16 eeg blocks.
+  /** Each channel is predicted with the best of the fixed polynomial
+   *  predictors of order 0 to 2, as in FLAC, and the residuals are Rice
+   *  coded in partitions of partition_len samples, each with its own Rice
+   *  parameter.  The residual loops run over contiguous channel-major
+   *  samples and vectorize, and coding is one pass with no tables, so a
+   *  single core encodes well over 256 channels at 30kHz.
+   *
+   *  A block is self-delimiting, so the same bytes serve as a storage
+   *  payload or a wire format:
+   *  \code
+   *  uint32 total_bytes, uint32 sample_count, uint16 chan_count,
+   *  uint16 flags, then for each channel a bitstream of:
+   *    2 bits order, order x 16 bits warmup samples,
+   *    per partition: 5 bits Rice parameter, then the coded residuals
+   *  \endcode
+   *  The bitstream of each channel starts on a byte boundary.
+   */
+  class EEGCodec {
+    public:
+    static const size_t partition_len = 256;
+    static const size_t header_bytes = 12;
+
+    /// Append the encoding of sample_count samples of chan_count channels.
+    /** @param samples Channel-major, sample_count per channel. */
+    static void Encode(const int16_t* samples, size_t chan_count,
+        size_t sample_count, std::vector<uint8_t>& out);
+
+    /// Decode one block from the start of in.
+    /** Throws a File error if the block is damaged.
+     *  @return The number of bytes consumed.
+     */
+    static size_t Decode(const uint8_t* in, size_t len,
+        RC::Data1D<int16_t>& samples, size_t& chan_count,
+        size_t& sample_count);
+
+    /// The total_bytes field of an encoded block, or 0 if len is too short.
+    static size_t BlockBytes(const uint8_t* in, size_t len);
+
+    /// Encode EEGData with its sampling rate and channel layout, for
+    /// streaming.  Empty channels cost one bit each.
+    static void EncodeEEG(const EEGData& data, std::vector<uint8_t>& out);
+    /// The inverse of EncodeEEG.  Throws a File error if damaged.
+    static RC::APtr<EEGData> DecodeEEG(const uint8_t* in, size_t len);
+  };
+}
+
+#endif // EEGCODEC_H
+
@@ -110,12 +110,56 @@ namespace CML {
     }
   }
 
-  void EEGDisplay::UpdateData_Handler(RC::APtr<const EEGDataDouble>& new_data_ptr) {
-    auto& new_data = new_data_ptr->data;
+  /// Queue incoming for the next update, keeping at most one display
+  /// window.
+  /** This runs in the calling thread, so only queues the block.  Blocks
+    * that cannot follow the queued ones replace them.
+    */
+  void EEGDisplay::QueueData(EEGBlocks& pending,
+      RC::APtr<const EEGDataDouble>& incoming) {
+    if ( ! pending.empty() &&
+        (pending.back()->sampling_rate != incoming->sampling_rate ||
+         pending.back()->data.size() != incoming->data.size()) ) {
+      pending.clear();
+    }
+    pending.push_back(incoming);
+
+    size_t max_len = window_seconds * incoming->sampling_rate;
+    size_t total = 0;
+    for (auto& block : pending) {
+      total += block->sample_len;
+    }
+    while (pending.size() > 1 &&
+        total - pending.front()->sample_len >= max_len) {
+      total -= pending.front()->sample_len;
+      pending.pop_front();
+    }
+  }
+
+
+  void EEGDisplay::UpdateData_Handler(EEGBlocks& blocks) {
+    for (auto& block : blocks) {
+      AddData(*block);
+    }
+
+    auto tdiff = timer.SinceStart();
+    if (tdiff >= 0.03) {
+      timer.Start();
+      update_cnt++;
+      // Alternate frames if running slow.
+      if (tdiff < 0.045 || ((update_cnt & 1) == 1)) {
+        ReDraw();
+      }
+    }
+  }
+
+
+  void EEGDisplay::AddData(const EEGDataDouble& new_data_blk) {
+    auto& new_data = new_data_blk.data;
 
     // Switch display to new sampling rate.
-    if (new_data_ptr->sampling_rate != data.sampling_rate) {
-      SetSamplingRate(new_data_ptr->sampling_rate);
+    if (new_data_blk.sampling_rate != data.sampling_rate) {
+      SetSamplingRate(new_data_blk.sampling_rate);
     }
 
     // EEGAcq now guarantees all the same size.  This could be simplified.
@@ -153,16 +197,6 @@ namespace CML {
 
     data_offset += max_len;
     data_offset = data_offset % data.sample_len;
-
-    auto tdiff = timer.SinceStart();
-    if (tdiff >= 0.03) {
-      timer.Start();
-      update_cnt++;
-      // Alternate frames if running slow.
-      if (tdiff < 0.045 || ((update_cnt & 1) == 1)) {
-        ReDraw();
-      }
-    }
   }
 
 
@@ -4,6 +4,7 @@
 #include "CImage.h"
 #include "EEGData.h"
 #include "RC/Data1D.h"
+#include <deque>
 #include <vector>
 #include <variant>
 #include "ChannelConf.h"
@@ -16,8 +17,13 @@ namespace CML {
     EEGDisplay(int width, int height);
     virtual ~EEGDisplay();
 
-    RCqt::TaskCaller<RC::APtr<const EEGDataDouble>> UpdateData =
-      TaskHandler(EEGDisplay::UpdateData_Handler);
+    using EEGBlocks = std::deque<RC::APtr<const EEGDataDouble>>;
+
+    // Blocks arriving while the GUI is busy are delivered in one update.
+    RCqt::TaskCoalescer<RC::APtr<const EEGDataDouble>, EEGBlocks>
+      UpdateData =
+      CoalescingHandler(EEGDisplay::UpdateData_Handler,
+                        RC::MakeCaller(this, &EEGDisplay::QueueData));
 
     RCqt::TaskCaller<EEGChan> SetChannel =
       TaskHandler(EEGDisplay::SetChannel_Handler);
@@ -30,11 +36,15 @@ namespace CML {
 
     protected:
 
-    void UpdateData_Handler(RC::APtr<const EEGDataDouble>& new_data);
+    void UpdateData_Handler(EEGBlocks& blocks);
     void SetChannel_Handler(EEGChan& chan);
     void UnsetChannel_Handler(EEGChan& chan);
     void Clear_Handler();
 
+    void QueueData(EEGBlocks& pending,
+                   RC::APtr<const EEGDataDouble>& incoming);
+    void AddData(const EEGDataDouble& new_data);
+
     void SetSamplingRate(size_t sampling_rate);
 
     virtual void DrawBackground();
@@ -64,6 +64,8 @@ int main (int argc, char *argv[]) {
       CML::ErrorWin(errormsg);
     }
 
+    hndl->ApplyThreadScheduling();
+
     main_window.RegisterEEGDisplay();
     main_window.show();
 
@@ -1,22 +1,325 @@
 #include "EventLog.h"
+#include "EEGAcq.h"
+#include <cstring>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace CML {
-  void EventLog::StartFile_Handler(const RC::RStr& filename) {
+  namespace {
+    const size_t queue_capacity = 4096;
+    const char index_magic[8] = {'E', 'L', 'E', 'V', 'I', 'D', 'X', '1'};
+
+    void SyncFile(RC::FileWrite& fw) {
+#ifdef WIN32
+      _commit(_fileno(fw.Raw()));
+#else
+      fsync(fileno(fw.Raw()));
+#endif
+    }
+  }
+
+
+  void EventLogPolicy::Load(const JSONFile& sys_config) {
+    *this = EventLogPolicy();
+    sys_config.TryGet(flush_ms, "event_log", "flush_ms");
+    sys_config.TryGet(flush_bytes, "event_log", "flush_bytes");
+    sys_config.TryGet(sync_critical, "event_log", "sync_critical");
+
+    if (flush_ms == 0) {
+      Throw_RC_Type(File, "sys_config event_log flush_ms must be at least "
+          "1.");
+    }
+  }
+
+
+  EventLog::EventLog()
+    : queue(queue_capacity) {
+    AddToThread(this);
+  }
+
+
+  EventLog::~EventLog() {
+    ExitWait();
+    Record* record;
+    while (queue.TryPop(record)) {
+      delete record;
+    }
+  }
+
+
+  void EventLog::Log(JSONFile event, bool critical) {
+    Record* record = new Record();
+    record->event.json = std::move(event.json);
+    record->critical = critical;
+    Enqueue(record);
+  }
+
+
+  void EventLog::Log(const RC::RStr& line, bool critical) {
+    if (line.empty()) {
+      return;
+    }
+    Record* record = new Record();
+    record->line = line;
+    record->critical = critical;
+    Enqueue(record);
+  }
+
+
+  void EventLog::LogReceived(std::string_view json_text, JSONFile extra,
+      bool critical) {
+    Record* record = new Record();
+    record->event.json = std::move(extra.json);
+    record->line = RC::RStr(json_text.data(), json_text.size());
+    record->stamp = true;
+    record->critical = critical;
+    Enqueue(record);
+  }
+
+
+  void EventLog::LogReceivedMsgpack(std::string_view frame, JSONFile extra,
+      bool critical) {
+    Record* record = new Record();
+    record->event.json = std::move(extra.json);
+    record->line = RC::RStr(frame.data(), frame.size());
+    record->stamp = true;
+    record->msgpack = true;
+    record->critical = critical;
+    Enqueue(record);
+  }
+
+
+  void EventLog::Enqueue(Record* record) {
+    record->generation = file_generation.load();
+    record->time_ms = RC::Time::Get()*1e3;
+    if (eeg_acq.IsSet()) {
+      record->eeg_sample = eeg_acq->SampleCount();
+    }
+
+    // Once one record has overflowed, later ones follow it through the
+    // task queue until it is written, so they cannot be drained first.
+    if (overflowing.load() > 0 || ! queue.TryPush(record) ) {
+      // Full, so fall back to the ordinary task queue.
+      overflowing++;
+      RC::APtr<Record> overflow(record);
+      Overflow(overflow);
+      return;
+    }
+
+    // One Drain is enough for any number of records pushed before it runs.
+    if ( ! drain_posted.exchange(true) ) {
+      Drain();
+    }
+  }
+
+
+  void EventLog::StartFile_Handler(const RC::RStr& filename,
+      const uint64_t& generation) {
+    CloseCurrent();
+
     fw = RC::FileWrite(filename);
+    index_fw = RC::FileWrite(filename + ".idx");
+    RC::Data1D<char> magic(sizeof(index_magic));
+    std::memcpy(magic.Raw(), index_magic, sizeof(index_magic));
+    index_fw.Write(magic);
+    index_fw.Flush();
+
+    bytes_written = 0;
+    index_count = 0;
+    batch.clear();
+
+    BeAllocatedTimer();
+    flush_timer->start(int(policy.flush_ms));
+
+    open_generation = generation;
+    ReleasePending();
   }
 
-  void EventLog::Log_Handler(const RC::RStr& event) {
+
+  void EventLog::CloseFile_Handler(const uint64_t& generation) {
+    CloseCurrent();
+    open_generation = generation;
+    // Anything logged after the close has no file, so is dropped.
+    ReleasePending();
+  }
+
+
+  void EventLog::CloseCurrent() {
+    Drain_Handler();
+    if (flush_timer.IsSet()) {
+      flush_timer->stop();
+    }
     if (fw.IsOpen()) {
-      fw.Put(event);
-      if (last_flush.SinceStart() > 5) {
-        fw.Flush();
-        last_flush.Start();
+      WriteBatch(false);
+    }
+    fw.Close();
+    index_fw.Close();
+  }
+
+
+  void EventLog::SetPolicy_Handler(const EventLogPolicy& new_policy) {
+    policy = new_policy;
+    if (flush_timer.IsSet() && flush_timer->isActive()) {
+      flush_timer->start(int(policy.flush_ms));
+    }
+  }
+
+
+  void EventLog::Drain_Handler() {
+    // Cleared first, so a record pushed during the loop posts a new Drain.
+    drain_posted = false;
+
+    Record* record;
+    while (queue.TryPop(record)) {
+      RC::APtr<Record> owned(record);
+      Receive(owned);
+    }
+    PublishObserved();
+  }
+
+
+  void EventLog::Overflow_Handler(RC::APtr<Record>& record) {
+    Receive(record);
+    overflowing--;
+    Drain_Handler();
+  }
+
+
+  // A Drain queued ahead of StartFile can see records logged after it, so
+  // those wait, in order, until the file they belong to is open.
+  void EventLog::Receive(RC::APtr<Record>& record) {
+    if ( ! pending.empty() || record->generation > open_generation ) {
+      pending.push_back(record);
+    }
+    else {
+      Append(*record);
+    }
+  }
+
+
+  void EventLog::ReleasePending() {
+    while ( ! pending.empty() &&
+        pending.front()->generation <= open_generation ) {
+      Append(*pending.front());
+      pending.pop_front();
+    }
+    PublishObserved();
+  }
+
+
+  void EventLog::PublishObserved() {
+    if (observed.empty()) {
+      return;
+    }
+    observer(observed);
+    observed.clear();
+  }
+
+
+  void EventLog::Append(Record& record) {
+    if ( ! fw.IsOpen() ) {
+      return;
+    }
+
+    if (index_count >= index_batch.size()) {
+      index_batch.Resize(std::max(size_t(64), index_batch.size()*2));
+    }
+    EventIndexEntry& entry = index_batch[index_count++];
+    entry.offset = bytes_written + batch.size();
+    entry.eeg_sample = record.eeg_sample;
+    entry.time_ms = record.time_ms;
+
+    if (record.stamp) {
+      try {
+        JSONFile received;
+        if (record.msgpack) {
+          const std::string& frame = record.line.Raw();
+          received.json = nlohmann::json::from_msgpack(frame.begin(),
+              frame.end());
+        }
+        else {
+          received.Parse(std::string_view(record.line.c_str(),
+                record.line.size()));
+        }
+        if (record.event.json.is_object()) {
+          received.json.update(record.event.json);
+        }
+        received.Set(record.time_ms, "time");
+        record.event.json = std::move(received.json);
+        record.line.clear();
+      }
+      catch (...) {
+        if (record.msgpack) {
+          // Not text, so only note that it arrived.
+          record.event.json = nlohmann::json::object();
+          record.event.json["type"] = "UNPARSED_MSGPACK";
+          record.event.json["bytes"] = record.line.size();
+          record.event.json["time"] = record.time_ms;
+          record.line.clear();
+        }
+        else {
+          // Keep the message as received.
+          record.line += "\n";
+        }
       }
     }
+
+    if (record.line.empty()) {
+      record.line = record.event.Line();
+    }
+    batch += record.line;
+    if (observer.IsSet()) {
+      observed += record.line;
+    }
+
+    if (record.critical) {
+      WriteBatch(policy.sync_critical);
+    }
+    else if (batch.size() >= policy.flush_bytes) {
+      WriteBatch(false);
+    }
   }
 
-  void EventLog::CloseFile_Handler() {
-    fw.Close();
+
+  void EventLog::WriteBatch(bool sync) {
+    if (batch.empty() || ! fw.IsOpen() ) {
+      return;
+    }
+
+    // The log goes first, so the index never points past it.
+    fw.WriteStr(batch);
+    fw.Flush();
+    bytes_written += batch.size();
+    batch.clear();
+
+    index_fw.Write(index_batch, index_count);
+    index_fw.Flush();
+    index_count = 0;
+
+    if (sync) {
+      SyncFile(fw);
+      SyncFile(index_fw);
+    }
+  }
+
+
+  void EventLog::Flush_Slot() {
+    Drain_Handler();
+    WriteBatch(false);
+  }
+
+
+  void EventLog::BeAllocatedTimer() {
+    if (flush_timer.IsNull()) {
+      flush_timer = new QTimer();
+      AddToThread(flush_timer);
+
+      QObject::connect(flush_timer.Raw(), &QTimer::timeout, this,
+                       &EventLog::Flush_Slot);
+    }
   }
 }
 
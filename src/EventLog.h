@@ -1,29 +1,168 @@
 #ifndef EVENTLOG_H
 #define EVENTLOG_H
 
+#include "ConfigFile.h"
+#include "RC/APtr.h"
+#include "RC/Ptr.h"
 #include "RC/RStr.h"
 #include "RC/File.h"
+#include "RCqt/TaskQueue.h"
 #include "RCqt/Worker.h"
+#include <QTimer>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <string_view>
 
 namespace CML {
-  class EventLog : public RCqt::WorkerThread {
+  class EEGAcq;
+  using EventLineCallback = RCqt::TaskCaller<const RC::RStr>;
+
+  /// When buffered events are written, from the sys_config "event_log"
+  /// section.
+  class EventLogPolicy {
     public:
-    EventLog() { }
+    uint64_t flush_ms = 5000;       // Write at least this often.
+    uint64_t flush_bytes = 1 << 20; // Or once this much is buffered.
+    bool sync_critical = true;      // fsync after each critical event.
+
+    void Load(const JSONFile& sys_config);
+  };
+
+
+  #pragma pack(push, 1)
+  /// One entry of the event log index, "event.log.idx".
+  /** The index starts with the 8 bytes "ELEVIDX1", then has one entry per
+   *  event, in file order, so it can be binary searched by time.
+   */
+  struct EventIndexEntry {
+    double time_ms;       // When the event was logged, ms since 1970 UTC.
+    uint64_t offset;      // Byte offset of the event line in the log.
+    uint64_t eeg_sample;  // Samples acquired when the event was logged.
+  };
+  #pragma pack(pop)
+
+
+  /// Writes the session event log and its time index.
+  /** Events are queued from any thread through a lock-free queue, and
+   *  serialized and written in batches on this thread, so logging costs the
+   *  network and decision threads only a copy and a push.
+   */
+  class EventLog : public RCqt::WorkerThread, public QObject {
+    public:
+    EventLog();
+    ~EventLog();
+
+    // Rule of 3.
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    /// Any thread.  Events logged from here on go to filename.
+    void StartFile(const RC::RStr& filename) {
+      StartFileTask(filename, ++file_generation);
+    }
+    /// Any thread.  Write everything logged before this and close the file.
+    void CloseFile() {
+      CloseFileTask(++file_generation);
+    }
+    RCqt::TaskCaller<const EventLogPolicy> SetPolicy =
+      TaskHandler(EventLog::SetPolicy_Handler);
+    /// Also pass each drained group of logged lines to observer, as they
+    /// are logged rather than when written.
+    RCqt::TaskCaller<const EventLineCallback> SetObserver =
+      TaskHandler(EventLog::SetObserver_Handler);
 
-    RCqt::TaskCaller<const RC::RStr> StartFile =
+    /// Any thread.  Queue an event, serialized on the EventLog thread.
+    /** @param critical If true, written and synced to disk right away, as
+     *  the policy allows.
+     */
+    void Log(JSONFile event, bool critical=false);
+    /// Any thread.  Queue a pre-serialized line, ending in a newline.
+    void Log(const RC::RStr& line, bool critical=false);
+    /// Any thread.  Queue a received json message, without a newline, to
+    /// be parsed here and logged with "time" set to when it was queued.
+    /** @param extra Fields to add to the message, if an object.
+     */
+    void LogReceived(std::string_view json_text, JSONFile extra=JSONFile(),
+        bool critical=false);
+    /// Any thread.  The same for a received MessagePack frame.
+    void LogReceivedMsgpack(std::string_view frame,
+        JSONFile extra=JSONFile(), bool critical=false);
+
+    /// Supplies the eeg sample counts for the index.  Set before use.
+    void SetEEGAcq(RC::Ptr<const EEGAcq> new_eeg_acq) {
+      eeg_acq = new_eeg_acq;
+    }
+
+    protected slots:
+
+    void Flush_Slot();
+
+    protected:
+
+    class Record {
+      public:
+      JSONFile event;
+      RC::RStr line;  // Used if event is empty.
+      // line is json to parse, add "time" and event to, and log instead.
+      bool stamp = false;
+      // For stamp, line is MessagePack rather than json text.
+      bool msgpack = false;
+      double time_ms = 0;
+      uint64_t eeg_sample = 0;
+      bool critical = false;
+      // The StartFile or CloseFile call this was logged after.
+      uint64_t generation = 0;
+    };
+
+    void StartFile_Handler(const RC::RStr& filename,
+        const uint64_t& generation);
+    void CloseFile_Handler(const uint64_t& generation);
+    void SetPolicy_Handler(const EventLogPolicy& new_policy);
+    void SetObserver_Handler(const EventLineCallback& new_observer) {
+      observer = new_observer;
+    }
+    void Drain_Handler();
+    void Overflow_Handler(RC::APtr<Record>& record);
+
+    RCqt::TaskCaller<const RC::RStr, const uint64_t> StartFileTask =
       TaskHandler(EventLog::StartFile_Handler);
-    RCqt::TaskCaller<const RC::RStr> Log =
-      TaskHandler(EventLog::Log_Handler);
-    RCqt::TaskCaller<> CloseFile =
+    RCqt::TaskCaller<const uint64_t> CloseFileTask =
       TaskHandler(EventLog::CloseFile_Handler);
+    RCqt::TaskCaller<> Drain = TaskHandler(EventLog::Drain_Handler);
+    RCqt::TaskCaller<RC::APtr<Record>> Overflow =
+      TaskHandler(EventLog::Overflow_Handler);
 
-    protected:
-    void StartFile_Handler(const RC::RStr& filename);
-    void Log_Handler(const RC::RStr& event);
-    void CloseFile_Handler();
+    void Enqueue(Record* record);
+    void Receive(RC::APtr<Record>& record);
+    void ReleasePending();
+    void CloseCurrent();
+    void Append(Record& record);
+    void WriteBatch(bool sync);
+    void PublishObserved();
+    void BeAllocatedTimer();
+
+    RCqt::TaskQueue<Record*> queue;
+    std::atomic<bool> drain_posted{false};
+    // Records sent through Overflow and not yet written.
+    std::atomic<size_t> overflowing{0};
+    std::atomic<uint64_t> file_generation{0};
+    // Records logged after a StartFile or CloseFile this thread has not
+    // reached yet, held so they go to the right file.
+    uint64_t open_generation = 0;
+    std::deque<RC::APtr<Record>> pending;
+    RC::Ptr<const EEGAcq> eeg_acq;
 
+    EventLogPolicy policy;
     RC::FileWrite fw;
-    RC::Time last_flush;
+    RC::FileWrite index_fw;
+    RC::RStr batch;
+    EventLineCallback observer;
+    RC::RStr observed;
+    RC::Data1D<EventIndexEntry> index_batch;
+    size_t index_count = 0;
+    uint64_t bytes_written = 0;
+    RC::APtr<QTimer> flush_timer;
   };
 }
 
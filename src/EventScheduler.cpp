@@ -0,0 +1,132 @@
+#include "EventScheduler.h"
+#include "Popup.h"
+#include <chrono>
+#ifdef __linux__
+#include <cerrno>
+#include <time.h>
+#endif
+
+namespace CML {
+  EventScheduler::~EventScheduler() {
+    Stop();
+  }
+
+
+  void EventScheduler::Schedule(uint64_t target_ns, uint64_t id,
+      RC::Caller<> func) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      events.push(Event{target_ns, next_seq++, id, func});
+    }
+    wake.notify_one();
+  }
+
+
+  void EventScheduler::Start() {
+    if (thread.joinable()) {
+      return;
+    }
+    jitter.Reset();
+    stopping = false;
+    thread = std::thread([this]{ Run(); });
+  }
+
+
+  void EventScheduler::Stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+      events = decltype(events)();
+    }
+    wake.notify_one();
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+
+  void EventScheduler::SetCallback(const EventTimingCallback& new_callback) {
+    std::lock_guard<std::mutex> lock(mutex);
+    callback = new_callback;
+  }
+
+
+  void EventScheduler::SetThreadSchedule(const ThreadSchedule& new_schedule) {
+    std::lock_guard<std::mutex> lock(mutex);
+    thread_schedule = new_schedule;
+  }
+
+
+  void EventScheduler::Run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (thread_schedule.configured) {
+      // Validate has already warned about any failure.
+      thread_schedule.ApplyToCurrentThread();
+    }
+
+    while ( ! stopping ) {
+      if (events.empty()) {
+        wake.wait(lock);
+        continue;
+      }
+
+      uint64_t target_ns = events.top().target_ns;
+      uint64_t now_ns = RCqt::TaskClockNs();
+      if (target_ns > now_ns + wake_ns) {
+        // Woken early by new events or Stop.
+        wake.wait_for(lock,
+            std::chrono::nanoseconds(target_ns - now_ns - wake_ns));
+        continue;
+      }
+
+      Event event = events.top();
+      events.pop();
+      EventTimingCallback cur_callback = callback;
+      lock.unlock();
+
+      if (target_ns > spin_ns) {
+        SleepUntil(target_ns - spin_ns);
+      }
+      while (RCqt::TaskClockNs() < target_ns) { }
+
+      EventTiming timing;
+      timing.target_ns = target_ns;
+      timing.fired_ns = RCqt::TaskClockNs();
+      if ( ! stopping ) {
+        try {
+          event.func();
+        }
+        catch (std::exception& ex) {
+          ErrorWin(RC::RStr("Scheduled event failed: ") + ex.what(),
+              "Event Scheduler");
+        }
+
+        jitter.Record(timing.fired_ns - target_ns);
+        if (cur_callback.IsSet()) {
+          cur_callback(event.id, timing);
+        }
+      }
+
+      lock.lock();
+    }
+  }
+
+
+  void EventScheduler::SleepUntil(uint64_t target_ns) {
+    if (RCqt::TaskClockNs() >= target_ns) {
+      return;
+    }
+#ifdef __linux__
+    // steady_clock, and so TaskClockNs, is CLOCK_MONOTONIC on Linux.
+    timespec ts;
+    ts.tv_sec = time_t(target_ns / 1000000000);
+    ts.tv_nsec = long(target_ns % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) ==
+           EINTR) { }
+#else
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+          std::chrono::nanoseconds(target_ns)));
+#endif
+  }
+}
+
@@ -0,0 +1,107 @@
+#ifndef EVENTSCHEDULER_H
+#define EVENTSCHEDULER_H
+
+#include "RC/Caller.h"
+#include "RCqt/TaskStats.h"
+#include "RCqt/Worker.h"
+#include "ThreadSchedule.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace CML {
+  /// When a scheduled event was due, and when it ran, in RCqt::TaskClockNs.
+  class EventTiming {
+    public:
+    uint64_t target_ns = 0;
+    uint64_t fired_ns = 0;
+
+    int64_t JitterNs() const { return int64_t(fired_ns - target_ns); }
+  };
+
+  using EventTimingCallback =
+    RCqt::TaskCaller<const uint64_t, const EventTiming>;
+
+
+  /// Runs events at precise times on a dedicated thread.
+  /** Pending events wait in a min-heap on the monotonic RCqt::TaskClockNs
+   *  clock.  The thread waits, interruptibly, until wake_ns before the
+   *  earliest one, sleeps with an absolute clock_nanosleep until spin_ns
+   *  before it, and spins for the remainder, so that events run within
+   *  microseconds of their targets whatever the load of the event loops.
+   *  Events due at the same time run in the order scheduled, so a
+   *  preparation event scheduled ahead of its main event always runs
+   *  first.
+   *
+   *  Event functions run on the scheduler thread, so they must be brief
+   *  and thread-safe, such as queueing a task.  After each one the timing
+   *  callback is sent its id and timing, and its lateness is added to the
+   *  jitter histogram.  Events scheduled less than wake_ns ahead may be
+   *  held behind one already being waited for.
+   */
+  class EventScheduler {
+    public:
+    EventScheduler() = default;
+    ~EventScheduler();
+
+    // Rule of 3.
+    EventScheduler(const EventScheduler&) = delete;
+    EventScheduler& operator=(const EventScheduler&) = delete;
+
+    /// Run func at target_ns, reporting its timing under id.
+    void Schedule(uint64_t target_ns, uint64_t id, RC::Caller<> func);
+
+    /// Start the thread, if not running.
+    void Start();
+    /// Stop the thread, discarding any pending events.
+    void Stop();
+
+    void SetCallback(const EventTimingCallback& new_callback);
+    /// Applied to the scheduler thread when next started.
+    void SetThreadSchedule(const ThreadSchedule& new_schedule);
+
+    /// How late events ran, since the last Start.
+    RCqt::LatencySummary Jitter() const { return jitter.Summary(); }
+
+    static constexpr uint64_t wake_ns = 2000000;
+    static constexpr uint64_t spin_ns = 1000000;
+
+    protected:
+    class Event {
+      public:
+      uint64_t target_ns;
+      uint64_t seq;
+      uint64_t id;
+      RC::Caller<> func;
+    };
+
+    class EventLater {
+      public:
+      bool operator()(const Event& a, const Event& b) const {
+        return (a.target_ns != b.target_ns) ? (a.target_ns > b.target_ns)
+                                            : (a.seq > b.seq);
+      }
+    };
+
+    void Run();
+    static void SleepUntil(uint64_t target_ns);
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::priority_queue<Event, std::vector<Event>, EventLater> events;
+    uint64_t next_seq = 0;
+    EventTimingCallback callback;
+    ThreadSchedule thread_schedule;
+
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+    RCqt::LatencyHistogram jitter;
+  };
+}
+
+#endif // EVENTSCHEDULER_H
+
@@ -2,6 +2,7 @@
 #define EXPEVENT_H
 
 #include "RC/Caller.h"
+#include "RC/RStr.h"
 
 namespace CML {
   class ExpEvent {
@@ -10,6 +11,7 @@ namespace CML {
     RC::Caller<> event;  // Parameters pre-bound with Bind.
     uint64_t active_ms;  // active duration
     uint64_t event_ms;  // total event time
+    RC::RStr name;  // For timing logs.
   };
 }
 
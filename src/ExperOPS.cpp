@@ -4,13 +4,21 @@
 #include "Popup.h"
 #include "StatusPanel.h"
 #include "RC/Data1D.h"
+#include <algorithm>
 
 using namespace RC;
 
 namespace CML {
+  namespace {
+    // The least time to configure the stimulator ahead of a stim event,
+    // unless the prior event is still active then.
+    const uint64_t min_pre_event_lead_ms = 500;
+  }
+
+
   ExperOPS::ExperOPS(RC::Ptr<Handler> hndl)
     : hndl(hndl) {
-    AddToThread(this);
+    scheduler.SetCallback(EventTimed);
   }
 
   ExperOPS::~ExperOPS() {
@@ -44,6 +52,7 @@ namespace CML {
         ev.event = MakeFunctor<void>(
             MakeCaller(this, &ExperOPS::DoStimEvent).Bind(
             hndl->stim_worker.Stimulate.ToCaller()));
+        ev.name = "STIM";
 
         exp_events += ev;
       }
@@ -54,7 +63,9 @@ namespace CML {
       ExpEvent ev;
       ev.active_ms = 0;
       ev.event_ms = ops_specs.sham_duration_ms;
-      ev.event = MakeCaller(this, &ExperOPS::DoShamEvent);
+      ev.event = MakeCaller(this, &ExperOPS::DoShamEvent).Bind(
+          ops_specs.sham_duration_ms);
+      ev.name = "SHAM";
 
       exp_events += ev;
     }
@@ -65,37 +76,55 @@ namespace CML {
 
 
   void ExperOPS::DoConfigEvent(RC::Caller<>event) {
-    status_panel->SetEvent("PRESET");
+    ShowEvent("PRESET");
     event();
   }
 
 
   void ExperOPS::DoStimEvent(RC::Caller<> event) {
-    status_panel->SetEvent("STIM");
     event();
+    ShowEvent("STIM");
   }
 
 
-  void ExperOPS::DoShamEvent() {
+  void ExperOPS::DoShamEvent(uint64_t duration_ms) {
     JSONFile sham_event = MakeResp("SHAM");
-    sham_event.Set(ops_specs.sham_duration_ms, "data", "duration");
-    hndl->event_log.Log(sham_event.Line());
-    status_panel->SetEvent("SHAM");
+    sham_event.Set(duration_ms, "data", "duration");
+    hndl->event_log.Log(std::move(sham_event));
+    ShowEvent("SHAM");
+  }
+
+
+  void ExperOPS::ShowEvent_Handler(const RC::RStr& name) {
+    if (status_panel.IsSet()) {
+      status_panel->SetEvent(name);
+    }
   }
 
 
   void ExperOPS::Start_Handler() {
-    BeAllocatedTimer();
-    cur_ev = 0;
-    pre_ev = true;
-    event_time = 0;
-    next_event_time = 2000;
+    Stop_Handler();
 
-    // Calculate total run time.
-    uint64_t total_time = next_event_time;
+    // Lay out the timeline.  Each pre-event runs a third of the way
+    // through the idle time after the prior event, or earlier to lead its
+    // event by min_pre_event_lead_ms, but not before the prior event's
+    // active time ends.  The first runs at once, two seconds ahead.
+    RC::Data1D<uint64_t> pre_ms(exp_events.size());
+    RC::Data1D<uint64_t> event_ms(exp_events.size());
+    uint64_t total_time = 2000;
     for (size_t i=0; i<exp_events.size(); i++) {
+      event_ms[i] = total_time;
       total_time += exp_events[i].event_ms;
+      if (i == 0) {
+        pre_ms[i] = 0;
+        continue;
+      }
+      uint64_t idle_start = event_ms[i-1] + exp_events[i-1].active_ms;
+      pre_ms[i] = std::min(idle_start + (event_ms[i] - idle_start)/3,
+          std::max(idle_start, event_ms[i] - min_pre_event_lead_ms));
     }
+
+    // Calculate total run time.
     uint64_t seconds = (total_time + 500)/1000;
     uint64_t minutes = seconds / 60;
     seconds = seconds % 60;
@@ -107,97 +136,80 @@ namespace CML {
       return;
     }
 
-    exp_start = RC::Time::Get();
+    start_ns = RCqt::TaskClockNs();
+    running = true;
 
     JSONFile startlog = MakeResp("START");
-    hndl->event_log.Log(startlog.Line());
+    hndl->event_log.Log(std::move(startlog));
 
-    RunEvent();
+    if (exp_events.size() == 0) {
+      InternalStop();
+      return;
+    }
+
+    for (size_t i=0; i<exp_events.size(); i++) {
+      if (exp_events[i].pre_event.IsSet()) {
+        scheduler.Schedule(start_ns + pre_ms[i]*1000000, 2*i,
+            exp_events[i].pre_event);
+      }
+      if (exp_events[i].event.IsSet()) {
+        scheduler.Schedule(start_ns + event_ms[i]*1000000, 2*i+1,
+            exp_events[i].event);
+      }
+    }
+    scheduler.Schedule(start_ns + total_time*1000000, 2*exp_events.size(),
+        MakeCaller(this, &ExperOPS::DoEndEvent));
+
+    scheduler.Start();
   }
 
 
   void ExperOPS::Stop_Handler() {
-    if (timer.IsSet()) {
-      timer->stop();
-    }
+    scheduler.Stop();
+    running = false;
   }
 
 
   void ExperOPS::InternalStop() {
+    // Joins the scheduler thread, so its jitter record is complete.
+    Stop_Handler();
+
+    RCqt::LatencySummary jitter = scheduler.Jitter();
+    JSONFile jitterlog = MakeResp("EVENT_JITTER");
+    jitterlog.Set(jitter.count, "data", "count");
+    jitterlog.Set(jitter.p50_ns*1e-3, "data", "p50_us");
+    jitterlog.Set(jitter.p99_ns*1e-3, "data", "p99_us");
+    jitterlog.Set(jitter.max_ns*1e-3, "data", "max_us");
+    hndl->event_log.Log(std::move(jitterlog));
+
     JSONFile stoplog = MakeResp("EXIT");
-    hndl->event_log.Log(stoplog.Line());
+    hndl->event_log.Log(std::move(stoplog));
 
-    Stop_Handler();
     hndl->StopExperiment();
   }
 
 
-  void ExperOPS::RunEvent() {
-    if (cur_ev >= exp_events.size()) {
-      InternalStop();
+  void ExperOPS::EventTimed_Handler(const uint64_t& id,
+      const EventTiming& timing) {
+    if ( ! running ) {
       return;
     }
 
-    auto& cur = exp_events[cur_ev];
-
-    if (pre_ev) {
-      if (cur.pre_event.IsSet()) {
-        cur.pre_event();
-      }
-
-      pre_ev = false;
-      // Do regular event.
-      TriggerAt(next_event_time);
+    size_t index = size_t(id / 2);
+    RC::RStr name = "END";
+    if (index < exp_events.size()) {
+      name = (id % 2) ? exp_events[index].name : RC::RStr("PRESET");
     }
-    else {
-      if (cur.event.IsSet()) {
-        cur.event();
-      }
-
-      pre_ev = true;
-      cur_ev++;
 
-      next_event_time = event_time + cur.event_ms;
+    JSONFile timinglog = MakeResp("EVENT_TIMING");
+    timinglog.Set(name, "data", "event");
+    timinglog.Set((timing.target_ns - start_ns)*1e-6, "data", "target_ms");
+    timinglog.Set(timing.JitterNs()*1e-3, "data", "jitter_us");
+    hndl->event_log.Log(std::move(timinglog));
 
-      // Do pre-event.
-      if (cur_ev < exp_events.size()) {
-        uint64_t pre_del = cur.active_ms + (cur.event_ms - cur.active_ms)/3;
-        TriggerAt(event_time + pre_del);
-      }
-      // Final Stop_Handler event.
-      else {
-        TriggerAt(next_event_time);
-      }
-    }
-  }
-
-  void ExperOPS::TriggerAt(uint64_t target_ms) {
-    f64 cur_time = RC::Time::Get();
-    uint64_t current_time_ms = uint64_t(1000*(cur_time - exp_start)+0.5);
-
-    event_time = target_ms;
-
-    uint64_t delay;
-    if (target_ms <= current_time_ms) {
-      delay = 0;
-    } else {
-      delay = target_ms - current_time_ms;
-    }
-
-    timer->start(delay);
-  }
-
-
-  void ExperOPS::BeAllocatedTimer() {
-    if (timer.IsNull()) {
-      timer = new QTimer();
-      timer->setTimerType(Qt::PreciseTimer);
-      timer->setSingleShot(true);
-
-      QObject::connect(timer.Raw(), &QTimer::timeout, this,
-                     &ExperOPS::RunEvent);
+    if (index >= exp_events.size()) {
+      InternalStop();
     }
   }
-
 }
 
@@ -8,16 +8,23 @@
 #include "RCqt/Worker.h"
 #include "ConfigFile.h"
 #include "CereStim.h"
+#include "EventScheduler.h"
 #include "ExpEvent.h"
 #include "OPSSpecs.h"
-#include <QTimer>
+#include "ThreadSchedule.h"
 
 namespace CML {
   class Handler;
   class StatusPanel;
 
 
-  class ExperOPS : public RCqt::WorkerThread, public QObject {
+  /// Runs an open-loop parameter search, stimulating each grid profile in
+  /// a shuffled order among sham events.
+  /** The whole timeline is laid out at Start on an EventScheduler, so each
+   *  event runs at its planned time independent of this thread's load, and
+   *  every event's lateness is logged as EVENT_TIMING.
+   */
+  class ExperOPS : public RCqt::WorkerThread {
     public:
 
     ExperOPS(RC::Ptr<Handler> hndl);
@@ -42,6 +49,10 @@ namespace CML {
     RCqt::TaskBlocker<> Stop =
       TaskHandler(ExperOPS::Stop_Handler);
 
+    /// The scheduling of the event timing thread, from the next Start.
+    RCqt::TaskCaller<const ThreadSchedule> SetSchedulerSchedule =
+      TaskHandler(ExperOPS::SetSchedulerSchedule_Handler);
+
     protected:
     void SetOPSSpecs_Handler(const OPSSpecs& new_ops_specs) {
       ops_specs = new_ops_specs;
@@ -55,19 +66,30 @@ namespace CML {
       status_panel = set_panel;
     }
 
+    // These run on the scheduler thread, so they read no members that
+    // change, and pass status updates back through ShowEvent.
     void DoConfigEvent(RC::Caller<> event);
     void DoStimEvent(RC::Caller<> event);
-    void DoShamEvent();
+    void DoShamEvent(uint64_t duration_ms);
+    // The end is handled once its timing is logged, in EventTimed.
+    void DoEndEvent() { }
+
+    RCqt::TaskCaller<const RC::RStr> ShowEvent =
+      TaskHandler(ExperOPS::ShowEvent_Handler);
+    void ShowEvent_Handler(const RC::RStr& name);
 
     void Start_Handler();
     void Stop_Handler();
+    void SetSchedulerSchedule_Handler(const ThreadSchedule& schedule) {
+      scheduler.SetThreadSchedule(schedule);
+    }
     void InternalStop();
 
-    protected slots:
-    void RunEvent();
-    protected:
-    void TriggerAt(uint64_t target_ms);
-    void BeAllocatedTimer();
+    // Scheduled event ids are 2*index for the pre-event, 2*index+1 for the
+    // event, and 2*exp_events.size() for the end.
+    RCqt::TaskCaller<const uint64_t, const EventTiming> EventTimed =
+      TaskHandler(ExperOPS::EventTimed_Handler);
+    void EventTimed_Handler(const uint64_t& id, const EventTiming& timing);
 
     RC::Ptr<Handler> hndl;
     RC::Ptr<StatusPanel> status_panel;
@@ -75,16 +97,13 @@ namespace CML {
 
     RC::Data1D<StimProfile> stim_profiles;
     RC::Data1D<ExpEvent> exp_events;
-    uint64_t event_time;
-    f64 exp_start;
-    size_t cur_ev;
-    bool pre_ev;
-    uint64_t next_event_time;
+    uint64_t start_ns = 0;
+    bool running = false;
 
     OPSSpecs ops_specs;
 
     RC::RND rng;
-    RC::APtr<QTimer> timer;
+    EventScheduler scheduler;
   };
 }
 
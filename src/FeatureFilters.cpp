@@ -1,4 +1,5 @@
 #include "FeatureFilters.h"
+#include "DecisionTrace.h"
 #include "Popup.h"
 #include "Utils.h"
 #include <cmath>
@@ -483,6 +484,53 @@ namespace CML {
     return out_data;
   }
 
+  /// Find the channels with artifacting, reading straight from the ring
+  /** @param in_data The view to be evaluated for artifacting
+    * @param threshold The number of events where the order derivative is equal to 0
+    * @param order The number of events to use in the derivative
+    * @return A boolean mask over the channels which specifies which channels show artifacts
+    */
+  RC::APtr<RC::Data1D<bool>> FeatureFilters::FindArtifactChannels(const EEGCircularView& in_data, size_t threshold, size_t order) {
+    if (order >= in_data.sample_len) {
+      Throw_RC_Error(("The order (" + RC::RStr(order) + ") " +
+            "is greater than or equal to the number of samples in the data "
+            "(" + RC::RStr(in_data.sample_len) + ")").c_str());
+    }
+
+    if (threshold >= (in_data.sample_len - order)) {
+      Throw_RC_Error(("The threshold (" + RC::RStr(threshold) + ") " +
+            "is greater than or equal to the number of samples in the data minus the order"
+            "(" + RC::RStr(in_data.sample_len - order) + "), " +
+            "making it impossible for the threshold to occur.").c_str());
+    }
+
+    auto out_data = RC::MakeAPtr<RC::Data1D<bool>>();
+    auto& out_datar = *out_data;
+    size_t chanlen = in_data.ChanCount();
+    out_data->Resize(chanlen);
+
+    auto accum_eq_zero_plus = [](size_t sum, double val) { return std::move(sum) + static_cast<size_t>(val == 0); };
+
+    // One channel at a time, so only a single channel is ever copied.
+    RC::Data1D<double> in_events;
+    RC_ForRange(i, 0, chanlen) { // Iterate over channels
+      auto& out_event = out_datar[i];
+
+      if (in_data.IsEmpty(i)) { // Set empty channels to True
+        out_event = true;
+        continue;
+      }
+
+      in_data.CopyChan(i, in_events);
+      auto deriv_data = Differentiate<double>(in_events, order);
+
+      size_t eq_zero = std::accumulate(&deriv_data[0], &deriv_data[deriv_data.size()-1]+1, size_t(0), accum_eq_zero_plus);
+      out_event = eq_zero > threshold;
+    }
+
+    return out_data;
+  }
+
   /// Zero the channels with artifacts using a privided artifact mask
   /** @param in_data The data to be evaluated for artifacting
     * @param artifact_channel_mask The indicator for each channel if it had artifacts or not
@@ -574,6 +622,55 @@ namespace CML {
     return out_data;
   }
 
+  /// Mirrors both ends of a ring view for the provided number of seconds
+  /** This reads the window straight from the EEGCircularData ring, so it
+    * is only copied once, into the mirrored output.
+    * @param The view to be mirrored
+    * @param Duration to mirror each side for
+    * @return The mirrored EEGDataDouble
+    */
+  RC::APtr<EEGDataDouble> FeatureFilters::MirrorEnds(const EEGCircularView& in_data, size_t mirrored_duration_ms) {
+    size_t num_mirrored_samples = mirrored_duration_ms * in_data.sampling_rate / 1000;
+    size_t in_sample_len = in_data.sample_len;
+    size_t out_sample_len = in_sample_len + num_mirrored_samples * 2;
+
+    if (num_mirrored_samples >= in_sample_len) {
+      Throw_RC_Error(("The number of samples to be mirrored "
+            "(" + RC::RStr(num_mirrored_samples) + ") " +
+            "is greater than or equal to the number of samples in the data "
+            "(" + RC::RStr(in_sample_len) + ")").c_str());
+    }
+
+    auto out_data = RC::MakeAPtr<EEGDataDouble>(in_data.sampling_rate, out_sample_len);
+    auto& out_datar = out_data->data;
+    size_t chanlen = in_data.ChanCount();
+    out_datar.Resize(chanlen);
+
+    RC_ForRange(c, 0, chanlen) { // Iterate over channels
+      if (in_data.IsEmpty(c)) { continue; } // Skip empty channels
+      out_data->EnableChan(c);
+      double* out_events = out_datar[c].Raw();
+
+      // Copy starting samples in reverse, skipping the first item
+      RC_ForRange(i, 0, num_mirrored_samples) {
+        out_events[i] = in_data.At(c, num_mirrored_samples-i);
+      }
+
+      // Copy all original samples verbatim for the middle
+      auto span = in_data.Chan(c);
+      std::copy(span.ptr, span.ptr + span.len,
+          out_events + num_mirrored_samples);
+
+      // Copy ending samples in reverse, skipping the last item
+      size_t start_pos = num_mirrored_samples + in_sample_len;
+      RC_ForRange(i, 0, num_mirrored_samples) {
+        out_events[start_pos+i] = in_data.At(c, in_sample_len-i-2);
+      }
+    }
+
+    return out_data;
+  }
+
   /// Remove mirrored data from both ends of the EEGPowers for the provided number of seconds
   /** @param The data to be un-mirrored
     * @param Duration to mirror each side for
@@ -686,7 +783,7 @@ namespace CML {
   /** @param data The EEGDataDouble to be run through all the filters
     * @param task_classifier_settings The settings for this classification chain
     */
-  void FeatureFilters::Process_Handler(RC::APtr<const EEGDataDouble>& data, const TaskClassifierSettings& task_classifier_settings) {
+  void FeatureFilters::Process_Handler(const EEGCircularView& data, const TaskClassifierSettings& task_classifier_settings) {
     if (!callback.IsSet()) Throw_RC_Error("FeatureFilters callback not set");
 
     // This calculates the mirroring duration based on the minimum statistical morlet duration 
@@ -723,12 +820,26 @@ namespace CML {
 //
 //    auto mirrored_data = MirrorEnds(selected_data, mirroring_duration_ms).ExtractConst();
 
-    auto mirrored_data = MirrorEnds(data, mirroring_duration_ms).ExtractConst();
-    auto morlet_data = morlet_transformer.Filter(mirrored_data).ExtractConst();
-    auto unmirrored_data = RemoveMirrorEnds(morlet_data, mirroring_duration_ms).ExtractConst();
+    RC::APtr<const EEGPowers> avg_data;
+    EraseStalePartials();
+    auto partial = partial_features.find(task_classifier_settings.window_id);
+    DecisionTrace::Span powers_span(TraceStage::POWERS,
+        task_classifier_settings);
+    if (partial != partial_features.end()) {
+      // Most of this window was already transformed by ProcessPrefix.
+      avg_data = FinishPartial(data, MirroredSampleCount(data.sampling_rate),
+          partial->second).ExtractConst();
+      partial_features.erase(partial);
+    }
+    else {
+      auto mirrored_data = MirrorEnds(data, mirroring_duration_ms).ExtractConst();
+      auto morlet_data = morlet_transformer.Filter(mirrored_data).ExtractConst();
+      auto unmirrored_data = RemoveMirrorEnds(morlet_data, mirroring_duration_ms).ExtractConst();
 
-    auto log_data = Log10Transform(unmirrored_data, log_min_power_clamp, false).ExtractConst();
-    auto avg_data = AvgOverTime(log_data, true).ExtractConst();
+      auto log_data = Log10Transform(unmirrored_data, log_min_power_clamp, false).ExtractConst();
+      avg_data = AvgOverTime(log_data, true).ExtractConst();
+    }
+    powers_span.End();
 
     //data->Print(2);
     //bipolar_ref_data->Print(2);
@@ -747,11 +858,14 @@ namespace CML {
       case ClassificationType::STIM:
       case ClassificationType::SHAM:
       {
+        DecisionTrace::Span normalize_span(TraceStage::NORMALIZE,
+            task_classifier_settings);
         auto norm_data = normalize_powers.ZScore(avg_data, true).ExtractConst();
 
         // Perform 10th derivative test to find and remove artifact channels
         auto artifact_channel_mask = FindArtifactChannels(data, 10, 10).ExtractConst();
         auto cleaned_data = ZeroArtifactChannels(norm_data, artifact_channel_mask).ExtractConst();
+        normalize_span.End();
 
         //norm_data->Print(1, 10);
         //cleaned_data->Print(2, 10);
@@ -763,6 +877,138 @@ namespace CML {
     }
   }
 
+  /// Transform the completed part of a classification window that is still filling
+  /** Powers are summed only for samples at least one mirroring duration
+    * back from the newest sample, as those already have all of the data
+    * their wavelets reach, and so come out the same as in the full window.
+    * @param data The window's samples so far, starting at the window start
+    * @param task_classifier_settings The settings for this classification chain
+    */
+  void FeatureFilters::ProcessPrefix_Handler(const EEGCircularView& data, const TaskClassifierSettings& task_classifier_settings) {
+    size_t num_mirrored_samples = MirroredSampleCount(data.sampling_rate);
+    // The start is mirrored from the prefix, so it must be long enough.
+    if (data.sample_len <= num_mirrored_samples) { return; }
+
+    DecisionTrace::Span prefix_span(TraceStage::PREFIX, task_classifier_settings);
+    EraseStalePartials();
+    auto& partial = partial_features[task_classifier_settings.window_id];
+    if (partial.stale_ns == 0) {
+      partial.stale_ns = task_classifier_settings.requested_ns +
+        2 * uint64_t(task_classifier_settings.duration_ms) * 1000000;
+    }
+    AccumulateLogPowers(data, num_mirrored_samples,
+        data.sample_len - num_mirrored_samples, partial);
+  }
+
+  /// Drop the partial features of windows that were cancelled or dropped
+  /** A window completes within its duration of being requested, so one
+    * still unfinished after twice that never will.
+    */
+  void FeatureFilters::EraseStalePartials() {
+    uint64_t now_ns = DecisionTrace::Now();
+    for (auto it = partial_features.begin(); it != partial_features.end(); ) {
+      if (it->second.stale_ns < now_ns) {
+        it = partial_features.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+  }
+
+  size_t FeatureFilters::MirroredSampleCount(size_t sampling_rate) {
+    size_t mirroring_duration_ms = morlet_transformer.CalcAvgMirroringDurationMs();
+    return mirroring_duration_ms * sampling_rate / 1000;
+  }
+
+  /// Add the log powers of window samples [partial.done, end) to partial
+  /** The transformed segment reaches num_mirrored_samples either side of
+    * those samples, mirroring the window ends exactly as MirrorEnds does.
+    * Sums are accumulated in sample order, as AvgOverTime does.
+    */
+  void FeatureFilters::AccumulateLogPowers(const EEGCircularView& data,
+      size_t num_mirrored_samples, size_t end, PartialFeatures& partial) {
+    size_t in_sample_len = data.sample_len;
+    if (num_mirrored_samples >= in_sample_len) {
+      Throw_RC_Error(("The number of samples to be mirrored "
+            "(" + RC::RStr(num_mirrored_samples) + ") " +
+            "is greater than or equal to the number of samples in the data "
+            "(" + RC::RStr(in_sample_len) + ")").c_str());
+    }
+    if (end <= partial.done) { return; }
+
+    int64_t first = int64_t(partial.done) - int64_t(num_mirrored_samples);
+    size_t seg_len = end - partial.done + num_mirrored_samples * 2;
+    // Window sample i, with the ends reflected as in MirrorEnds.
+    auto Reflect = [&](int64_t i) {
+      if (i < 0) { return size_t(-i); }
+      if (i >= int64_t(in_sample_len)) { return size_t(2*int64_t(in_sample_len) - i - 2); }
+      return size_t(i);
+    };
+
+    auto seg_data = RC::MakeAPtr<EEGDataDouble>(data.sampling_rate, seg_len);
+    auto& seg_datar = seg_data->data;
+    size_t chanlen = data.ChanCount();
+    seg_datar.Resize(chanlen);
+    RC_ForRange(c, 0, chanlen) { // Iterate over channels
+      if (data.IsEmpty(c)) { continue; } // Skip empty channels
+      seg_data->EnableChan(c);
+      double* seg_events = seg_datar[c].Raw();
+      RC_ForRange(i, 0, seg_len) {
+        seg_events[i] = data.At(c, Reflect(first + int64_t(i)));
+      }
+    }
+
+    auto seg_const = seg_data.ExtractConst();
+    auto morlet_data = morlet_transformer.Filter(seg_const).ExtractConst();
+    auto& morlet_datar = morlet_data->data;
+    size_t freqlen = morlet_datar.size3();
+
+    bool first_block = partial.sums.IsNull();
+    if (first_block) {
+      partial.sums = RC::MakeAPtr<EEGPowers>(data.sampling_rate, 1, chanlen, freqlen);
+    }
+    auto& sumsr = partial.sums->data;
+
+    size_t new_len = end - partial.done;
+    RC_ForRange(i, 0, freqlen) { // Iterate over frequencies
+      RC_ForRange(j, 0, chanlen) { // Iterate over channels
+        auto& in_events = morlet_datar[i][j];
+        double sum = first_block ? 0.0 : sumsr[i][j][0];
+        RC_ForRange(k, num_mirrored_samples, num_mirrored_samples + new_len) {
+          sum += log10(std::max(log_min_power_clamp, in_events[k]));
+        }
+        sumsr[i][j][0] = sum;
+      }
+    }
+
+    partial.done = end;
+  }
+
+  /// Sum the rest of the window into partial, and return the time averages
+  /** Equivalent to the MirrorEnds through AvgOverTime chain in Process.
+    */
+  RC::APtr<EEGPowers> FeatureFilters::FinishPartial(const EEGCircularView& data,
+      size_t num_mirrored_samples, PartialFeatures& partial) {
+    AccumulateLogPowers(data, num_mirrored_samples, data.sample_len, partial);
+
+    auto out_data = partial.sums;
+    auto& out_datar = out_data->data;
+    RC_ForRange(i, 0, out_datar.size3()) { // Iterate over frequencies
+      RC_ForRange(j, 0, out_datar.size2()) { // Iterate over channels
+        auto& out_events = out_datar[i][j];
+        out_events[0] /= static_cast<double>(data.sample_len);
+        if (!std::isfinite(out_events[0])) {
+          out_events[0] = 0;
+          RC::RStr inf_nan_error = RC::RStr("The value at frequency ") + i + " and channel " + j + " is not finite";
+          DEBLOG_OUT(inf_nan_error);
+        }
+      }
+    }
+
+    return out_data;
+  }
+
   /// Handler that sets the callback on the feature generator results
   /** @param The callback on the classifier results
    */
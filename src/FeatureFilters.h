@@ -2,6 +2,7 @@
 #define FEATUREFILTERS_H
 
 #include <complex>
+#include "EEGCircularData.h"
 #include "EEGData.h"
 #include "EEGPowers.h"
 #include "TaskClassifierSettings.h"
@@ -11,10 +12,11 @@
 #include "RC/APtr.h"
 #include "RCqt/Worker.h"
 #include "ChannelConf.h"
+#include <map>
 
 
 namespace CML {
-  using TaskClassifierCallback = RCqt::TaskCaller<RC::APtr<const EEGDataDouble>, const TaskClassifierSettings>;
+  using TaskClassifierCallback = RCqt::TaskCaller<const EEGCircularView, const TaskClassifierSettings>;
   using FeatureCallback = RCqt::TaskCaller<RC::APtr<const EEGPowers>, const TaskClassifierSettings>;
 
   struct BinnedData {
@@ -31,6 +33,12 @@ namespace CML {
 
     TaskClassifierCallback Process =
       TaskHandler(FeatureFilters::Process_Handler);
+    /// Start computing features on a window that is still filling.
+    /** Takes the window's samples so far.  The matching Process call then
+     *  only needs to transform the remaining samples.
+     */
+    TaskClassifierCallback ProcessPrefix =
+      TaskHandler(FeatureFilters::ProcessPrefix_Handler);
 
     RCqt::TaskCaller<const FeatureCallback> SetCallback =
       TaskHandler(FeatureFilters::SetCallback_Handler);
@@ -45,6 +53,7 @@ namespace CML {
     static RC::APtr<EEGDataDouble> ChannelSelector(RC::APtr<const EEGDataDouble>& in_data, RC::Data1D<size_t> indices={});
 
     static RC::APtr<EEGDataDouble> MirrorEnds(RC::APtr<const EEGDataDouble>& in_data, size_t duration_ms);
+    static RC::APtr<EEGDataDouble> MirrorEnds(const EEGCircularView& in_data, size_t duration_ms);
     static RC::APtr<EEGPowers> RemoveMirrorEnds(RC::APtr<const EEGPowers>& in_data, size_t mirrored_duration_ms);
 
     static RC::APtr<EEGPowers> Log10Transform(RC::APtr<const EEGPowers>& in_data, double epsilon);
@@ -52,6 +61,7 @@ namespace CML {
     static RC::APtr<EEGPowers> AvgOverTime(RC::APtr<const EEGPowers>& in_data, bool ignore_inf_and_nan);
 
     static RC::APtr<RC::Data1D<bool>> FindArtifactChannels(RC::APtr<const EEGDataDouble>& in_data, size_t threshold, size_t order);
+    static RC::APtr<RC::Data1D<bool>> FindArtifactChannels(const EEGCircularView& in_data, size_t threshold, size_t order);
     static RC::APtr<EEGPowers> ZeroArtifactChannels(RC::APtr<const EEGPowers>& in_data, RC::APtr<const RC::Data1D<bool>>& artifact_channel_mask);
 
     // This is only public for testing purposes
@@ -60,7 +70,8 @@ namespace CML {
 
 
     protected:
-    void Process_Handler(RC::APtr<const EEGDataDouble>&, const TaskClassifierSettings&);
+    void Process_Handler(const EEGCircularView&, const TaskClassifierSettings&);
+    void ProcessPrefix_Handler(const EEGCircularView&, const TaskClassifierSettings&);
     void SetCallback_Handler(const FeatureCallback &new_callback);
 
     MorletTransformer morlet_transformer;
@@ -70,6 +81,22 @@ namespace CML {
 
     FeatureCallback callback;
 
+    // Running sums of log powers for a window processed ahead of completion.
+    struct PartialFeatures {
+      size_t done = 0;  // Leading window samples already summed.
+      RC::APtr<EEGPowers> sums;  // One event per frequency and channel.
+      uint64_t stale_ns = 0;  // When an unfinished window was dropped.
+    };
+    // Keyed by TaskClassifierSettings::window_id.
+    std::map<uint64_t, PartialFeatures> partial_features;
+
+    size_t MirroredSampleCount(size_t sampling_rate);
+    void EraseStalePartials();
+    void AccumulateLogPowers(const EEGCircularView& data,
+        size_t num_mirrored_samples, size_t end, PartialFeatures& partial);
+    RC::APtr<EEGPowers> FinishPartial(const EEGCircularView& data,
+        size_t num_mirrored_samples, PartialFeatures& partial);
+
     // Minimum power clamp (just before taking log) to avoid log singularity in case we get zero power
     // A power could be zero due to constant signal across two electrodes that are part of bipolar pair
     const double log_min_power_clamp = 1e-16;
@@ -7,12 +7,12 @@
 #include "EEGAcq.h"
 #include "Handler.h"
 #include "ConfigFile.h"
+#include <algorithm>
 
 
 namespace CML {
-  void HDF5Save::StartFile_Handler(const RC::RStr& filename) {
-    auto conf = hndl->GetConfig();
-
+  void HDF5Save::StartFile_Handler(const RC::RStr& filename,
+                                   const FullConf& conf) {
     if (conf.elec_config.IsNull()) {
       Throw_RC_Error("Cannot save data with no channels set");
     }
@@ -20,86 +20,109 @@ namespace CML {
       Throw_RC_Error("Cannot save data with no experiment config");
     }
 
+    StopSaving_Handler();
+
+    HDF5FileSpec spec;
+    spec.filename = filename;
+    spec.options = options;
+    spec.sampling_rate = sampling_rate;
+
     channels.Resize(conf.elec_config->data.size2());
+    spec.labels.Resize(channels.size());
     for (size_t c=0; c<channels.size(); c++) {
       channels[c] = uint8_t(conf.elec_config->data[c][1].Get_u32() - 1);
+      spec.labels[c] = conf.elec_config->data[c][0];
     }
 
-    StopSaving_Handler();
-
-    hdf_hdl = new H5::H5File(filename.c_str(), H5F_ACC_TRUNC);
-
-    int fill_value = 0;
-    H5::DSetCreatPropList prop_list;
-    prop_list.setFillValue(H5::PredType::NATIVE_INT16, &fill_value);
+    // Chunks end on the same data record boundaries as EDFSave uses.
+    size_t datarecord_len = (sampling_rate <= 10000) ? sampling_rate :
+      sampling_rate / 10;
+    chunk_len = std::max(size_t(1), datarecord_len) * options.chunk_records;
+    spec.chunk_len = chunk_len;
 
-    const size_t num_dims = 2;
-    hsize_t cur_dims[num_dims] = {channels.size(), 0};
-    hsize_t max_dims[num_dims] = {channels.size(), H5S_UNLIMITED};
+    spare_blocks.clear();
+    NewBlock();
 
-    hdf_dataspace = new H5::DataSpace(num_dims, cur_dims, max_dims);
-    hdf_data = new H5::DataSet(hdf_hdl->createDataSet("data",
-          H5::PredType::NATIVE_INT16, *hdf_dataspace, prop_list));
-    H5::Attribute sr_attr = hdf_data->createAttribute("samplerate",
-        H5::PredType::NATIVE_DOUBLE, H5::DataSpace(H5S_SCALAR));
-    f64 sr_f64 = sampling_rate;
-    sr_attr.write(H5::PredType::NATIVE_DOUBLE, &sr_f64);
+    writer.Open(spec, RecycleBlock);
+    saving = true;
 
-    hndl->eeg_acq.RegisterCallback(callback_ID, SaveData);
+    hndl->eeg_acq.RegisterEEGMonoCallback(callback_ID, SaveData);
   }
 
 
   void HDF5Save::StopSaving_Handler() {
-    hndl->eeg_acq.RemoveCallback(callback_ID);
+    hndl->eeg_acq.RemoveEEGMonoCallback(callback_ID);
 
-    if (hdf_hdl.IsSet()) {
-      hdf_data.Delete();
-      hdf_dataspace.Delete();
-      hdf_hdl.Delete();
+    if (saving) {
+      saving = false;
+      if (block_fill > 0) {
+        writer.Write(block, block_fill);
+        block_fill = 0;
+      }
+      writer.Close();
     }
   }
 
 
   void HDF5Save::SaveData_Handler(RC::APtr<const EEGData>& data) {
     auto& datar = data->data;
-    if (hdf_hdl < 0) {
+    if ( ! saving || writer.Failed() ) {
       StopSaving_Handler();
       return;
     }
 
     size_t amnt_avail = 0;
     for (size_t c=0; c<channels.size(); c++) {
-      if (amnt_avail == 0) {
+      if (channels[c] >= datar.size()) {
+        StopSaving_Handler();
+        Throw_RC_Type(File, ("HDF5 save, configured channel " +
+              RC::RStr(c+1) + " out of bounds").c_str());
+      }
+      if (c == 0) {
         amnt_avail = datar[channels[c]].size();
       }
-      else {
-        if (amnt_avail != datar[channels[c]].size()) {
-          Throw_RC_Type(File,
-              ("Data missing on hdf save, channel " + RC::RStr(c+1)).c_str());
-        }
+      else if (amnt_avail != datar[channels[c]].size()) {
+        StopSaving_Handler();
+        Throw_RC_Type(File,
+            ("Data missing on hdf save, channel " + RC::RStr(c+1)).c_str());
       }
     }
 
-    if (amnt_avail == 0) {
-      return;
-    }
+    // Write data in the order of the montage CSV, one chunk at a time.
+    size_t pos = 0;
+    while (pos < amnt_avail) {
+      size_t amnt = std::min(amnt_avail - pos, chunk_len - block_fill);
+      for (size_t c=0; c<channels.size(); c++) {
+        const int16_t* src = datar[channels[c]].Raw() + pos;
+        std::copy(src, src + amnt, block->Raw() + c*chunk_len + block_fill);
+      }
+      pos += amnt;
+      block_fill += amnt;
 
-    serialize.Resize(amnt_avail*channels.size());
-    size_t si=0;
-    // Write data in the order of the montage CSV.
-    for (size_t c=0; c<channels.size(); c++) {
-      for (size_t i=0; i<amnt_avail; i++) {
-        serialize[si++] = datar[channels[c]][i];
+      if (block_fill == chunk_len) {
+        writer.Write(block, block_fill);
+        NewBlock();
       }
     }
+  }
+
+
+  void HDF5Save::RecycleBlock_Handler(RC::APtr<HDF5Block>& done) {
+    if (spare_blocks.size() < max_spare_blocks &&
+        done->size() == channels.size() * chunk_len) {
+      spare_blocks.push_back(done);
+    }
+  }
 
-    const size_t num_dims = 2;
-    hsize_t cur_dims[num_dims] = {channels.size(), amnt_avail};
-    hsize_t max_dims[num_dims] = {channels.size(), amnt_avail};
 
-    H5::DataSpace mem_space(num_dims, cur_dims, max_dims);
-    hdf_data->write(serialize.Raw(), H5::PredType::NATIVE_INT16, mem_space,
-        *hdf_dataspace);
+  void HDF5Save::NewBlock() {
+    block_fill = 0;
+    if ( ! spare_blocks.empty() ) {
+      block = spare_blocks.back();
+      spare_blocks.pop_back();
+      return;
+    }
+    block = new HDF5Block(channels.size() * chunk_len);
   }
 }
 
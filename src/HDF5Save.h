@@ -3,20 +3,26 @@
 #ifndef NO_HDF5
 
 #include "EEGFileSave.h"
-#include <H5Cpp.h>
+#include "HDF5Writer.h"
+#include <vector>
 
 
 namespace CML {
   class Handler;
 
+  /// Saves EEG data as HDF5, laid out and compressed per HDF5Options.
+  /** Samples are copied once into chunk sized blocks, which an HDF5Writer
+   *  thread compresses and writes while the next block fills.
+   */
   class HDF5Save : public EEGFileSave {
     public:
-    HDF5Save(RC::Ptr<Handler> hndl, size_t sampling_rate)
-      : EEGFileSave(hndl), sampling_rate(sampling_rate) {
+    HDF5Save(RC::Ptr<Handler> hndl, size_t sampling_rate,
+             const HDF5Options& options)
+      : EEGFileSave(hndl), options(options), sampling_rate(sampling_rate) {
       callback_ID = RC::RStr("HDF5Save_") + RC::RStr(sampling_rate);
     }
 
-    RC::RStr GetExt() const { return "h5"; }
+    RC::RStr GetExt() const override { return "h5"; }
 
     protected:
     void StartFile_Handler(const RC::RStr& filename,
@@ -27,12 +33,24 @@ namespace CML {
     void StopSaving_Handler() override;
     void SaveData_Handler(RC::APtr<const EEGData>& data) override;
 
-    RC::APtr<H5::H5File> hdf_hdl;
-    RC::APtr<H5::DataSet> hdf_data;
-    RC::APtr<H5::DataSpace> hdf_dataspace;
+    RCqt::TaskCaller<RC::APtr<HDF5Block>> RecycleBlock =
+      TaskHandler(HDF5Save::RecycleBlock_Handler);
+    void RecycleBlock_Handler(RC::APtr<HDF5Block>& done);
+
+    void NewBlock();
+
+    HDF5Options options;
+    HDF5Writer writer;
+    bool saving = false;
     RC::Data1D<uint8_t> channels;
-    RC::Data1D<int16_t> serialize;
+    RC::APtr<HDF5Block> block;
+    size_t chunk_len = 0;
+    size_t block_fill = 0;
+    // Written blocks, for reuse.  One spare double buffers the writer.
+    std::vector<RC::APtr<HDF5Block>> spare_blocks;
+    static const size_t max_spare_blocks = 2;
     size_t sampling_rate;
+    RC::RStr callback_ID;
   };
 }
 
@@ -0,0 +1,216 @@
+#ifndef NO_HDF5
+
+#include "HDF5Writer.h"
+#include "RC/Errors.h"
+
+namespace CML {
+  namespace {
+    // Registered id of the HDF5 LZ4 filter plugin.
+    const H5Z_filter_t lz4_filter_id = 32004;
+
+    RC::RStr DatasetName(const RC::RStr& label, size_t c) {
+      RC::RStr name = label;
+      for (auto& ch : name.Raw()) {
+        if (ch == '/' || ch == '.') {
+          ch = '_';
+        }
+      }
+      if (name.empty()) {
+        name = "chan" + RC::RStr(c+1);
+      }
+      return name;
+    }
+  }
+
+
+  void HDF5Options::Load(const JSONFile& sys_config) {
+    *this = HDF5Options();
+
+    sys_config.TryGet(layout, "hdf5", "layout");
+    sys_config.TryGet(chunk_records, "hdf5", "chunk_records");
+    sys_config.TryGet(compression, "hdf5", "compression");
+    sys_config.TryGet(deflate_level, "hdf5", "deflate_level");
+    sys_config.TryGet(shuffle, "hdf5", "shuffle");
+
+    layout.ToLower();
+    compression.ToLower();
+
+    if (layout != "matrix" && layout != "channels") {
+      Throw_RC_Type(File, ("sys_config hdf5 layout \"" + layout +
+            "\" unknown.  Use \"matrix\" or \"channels\".").c_str());
+    }
+    if (chunk_records < 1) {
+      Throw_RC_Type(File, "sys_config hdf5 chunk_records must be at least "
+          "1.");
+    }
+    if (compression != "none" && compression != "deflate" &&
+        compression != "lz4") {
+      Throw_RC_Type(File, ("sys_config hdf5 compression \"" + compression +
+            "\" unknown.  Use \"none\", \"deflate\", or \"lz4\".").c_str());
+    }
+    if (deflate_level < 0 || deflate_level > 9) {
+      Throw_RC_Type(File, "sys_config hdf5 deflate_level must be from 0 to "
+          "9.");
+    }
+  }
+
+
+  void HDF5Writer::Open_Handler(const HDF5FileSpec& new_spec,
+      const HDF5BlockCallback& new_recycle) {
+    Close_Handler();
+
+    spec = new_spec;
+    recycle = new_recycle;
+    amount_written = 0;
+    failed = false;
+
+    if (spec.options.compression == "lz4" &&
+        H5Zfilter_avail(lz4_filter_id) <= 0) {
+      failed = true;
+      Throw_RC_Type(File, "The HDF5 LZ4 filter plugin was not found.  Set "
+          "HDF5_PLUGIN_PATH to its directory, or use deflate compression.");
+    }
+
+    try {
+      hdf_file = new H5::H5File(spec.filename.c_str(), H5F_ACC_TRUNC);
+
+      hsize_t chan_count = spec.labels.size();
+      hsize_t chunk_len = spec.chunk_len;
+
+      if (spec.options.PerChannel()) {
+        H5::Group group = hdf_file->createGroup("channels");
+        AddSampleRate(group);
+
+        hsize_t cur_dims[1] = {0};
+        hsize_t max_dims[1] = {H5S_UNLIMITED};
+        hsize_t chunk_dims[1] = {chunk_len};
+        H5::DSetCreatPropList prop_list = MakePropList(chunk_dims, 1);
+        H5::DataSpace dataspace(1, cur_dims, max_dims);
+
+        for (size_t c=0; c<spec.labels.size(); c++) {
+          datasets.push_back(group.createDataSet(
+                DatasetName(spec.labels[c], c).c_str(),
+                H5::PredType::NATIVE_INT16, dataspace, prop_list));
+        }
+      }
+      else {
+        hsize_t cur_dims[2] = {chan_count, 0};
+        hsize_t max_dims[2] = {chan_count, H5S_UNLIMITED};
+        // Time-major, all channels of one chunk_len span together.
+        hsize_t chunk_dims[2] = {chan_count, chunk_len};
+        H5::DSetCreatPropList prop_list = MakePropList(chunk_dims, 2);
+        H5::DataSpace dataspace(2, cur_dims, max_dims);
+
+        datasets.push_back(hdf_file->createDataSet("data",
+              H5::PredType::NATIVE_INT16, dataspace, prop_list));
+        AddSampleRate(datasets.back());
+      }
+    }
+    catch (...) {
+      failed = true;
+      datasets.clear();
+      hdf_file.Delete();
+      throw;
+    }
+  }
+
+
+  void HDF5Writer::Write_Handler(RC::APtr<HDF5Block>& block,
+      const size_t& len) {
+    if (hdf_file.IsNull() || Failed() || len == 0) {
+      return;
+    }
+
+    hsize_t chan_count = spec.labels.size();
+    hsize_t chunk_len = spec.chunk_len;
+    hsize_t end = amount_written + len;
+
+    try {
+      if (spec.options.PerChannel()) {
+        hsize_t mem_dims[1] = {len};
+        H5::DataSpace mem_space(1, mem_dims);
+        hsize_t start[1] = {amount_written};
+        hsize_t count[1] = {len};
+
+        for (size_t c=0; c<datasets.size(); c++) {
+          datasets[c].extend(&end);
+          H5::DataSpace file_space = datasets[c].getSpace();
+          file_space.selectHyperslab(H5S_SELECT_SET, count, start);
+          datasets[c].write(block->Raw() + c*chunk_len,
+              H5::PredType::NATIVE_INT16, mem_space, file_space);
+        }
+      }
+      else {
+        hsize_t new_dims[2] = {chan_count, end};
+        datasets[0].extend(new_dims);
+
+        // The block keeps its full chunk_len stride when len is short.
+        hsize_t mem_dims[2] = {chan_count, chunk_len};
+        H5::DataSpace mem_space(2, mem_dims);
+        hsize_t mem_start[2] = {0, 0};
+        hsize_t count[2] = {chan_count, len};
+        mem_space.selectHyperslab(H5S_SELECT_SET, count, mem_start);
+
+        H5::DataSpace file_space = datasets[0].getSpace();
+        hsize_t file_start[2] = {0, amount_written};
+        file_space.selectHyperslab(H5S_SELECT_SET, count, file_start);
+
+        datasets[0].write(block->Raw(), H5::PredType::NATIVE_INT16,
+            mem_space, file_space);
+      }
+    }
+    catch (...) {
+      failed = true;
+      throw;
+    }
+
+    amount_written = end;
+
+    if (recycle.IsSet()) {
+      recycle(block);
+    }
+  }
+
+
+  void HDF5Writer::Close_Handler() {
+    datasets.clear();
+    if (hdf_file.IsSet()) {
+      hdf_file->close();
+      hdf_file.Delete();
+    }
+  }
+
+
+  H5::DSetCreatPropList HDF5Writer::MakePropList(const hsize_t* chunk_dims,
+      int num_dims) const {
+    int fill_value = 0;
+    H5::DSetCreatPropList prop_list;
+    prop_list.setFillValue(H5::PredType::NATIVE_INT16, &fill_value);
+    prop_list.setChunk(num_dims, chunk_dims);
+
+    // Shuffle groups the high and low bytes, which compress very
+    // differently for eeg.
+    if (spec.options.shuffle && spec.options.compression != "none") {
+      prop_list.setShuffle();
+    }
+    if (spec.options.compression == "deflate") {
+      prop_list.setDeflate(spec.options.deflate_level);
+    }
+    else if (spec.options.compression == "lz4") {
+      prop_list.setFilter(lz4_filter_id, H5Z_FLAG_MANDATORY);
+    }
+
+    return prop_list;
+  }
+
+
+  void HDF5Writer::AddSampleRate(H5::H5Object& obj) const {
+    H5::Attribute sr_attr = obj.createAttribute("samplerate",
+        H5::PredType::NATIVE_DOUBLE, H5::DataSpace(H5S_SCALAR));
+    f64 sr_f64 = spec.sampling_rate;
+    sr_attr.write(H5::PredType::NATIVE_DOUBLE, &sr_f64);
+  }
+}
+
+#endif // NO_HDF5
+
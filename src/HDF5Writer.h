@@ -0,0 +1,109 @@
+#ifndef HDF5WRITER_H
+#define HDF5WRITER_H
+#ifndef NO_HDF5
+
+#include "ConfigFile.h"
+#include "RC/APtr.h"
+#include "RC/Data1D.h"
+#include "RC/RStr.h"
+#include "RCqt/Worker.h"
+#include <H5Cpp.h>
+#include <atomic>
+#include <vector>
+
+namespace CML {
+  /// The sys_config "hdf5" settings for eeg files.
+  /** For example:
+   *  \code
+   *  "hdf5": {
+   *    "layout": "channels",
+   *    "chunk_records": 1,
+   *    "compression": "deflate",
+   *    "deflate_level": 4,
+   *    "shuffle": true
+   *  }
+   *  \endcode
+   */
+  class HDF5Options {
+    public:
+    /// "matrix" for one channels by samples "data" dataset, or "channels"
+    /// for one dataset per channel, for fast single channel reads.
+    RC::RStr layout = "matrix";
+    /// Data records (1s, or 0.1s above 10kHz) of samples per chunk.
+    size_t chunk_records = 1;
+    RC::RStr compression = "none";  // "none", "deflate", or "lz4".
+    int deflate_level = 4;
+    bool shuffle = false;
+
+    /// Throws a File error for malformed entries.
+    void Load(const JSONFile& sys_config);
+
+    bool PerChannel() const { return layout == "channels"; }
+  };
+
+
+  /// The layout of one HDF5 eeg file.
+  class HDF5FileSpec {
+    public:
+    RC::RStr filename;
+    HDF5Options options;
+    size_t sampling_rate = 0;
+    size_t chunk_len = 0;  // Samples per channel in each chunk.
+    RC::Data1D<RC::RStr> labels;
+  };
+
+
+  /// chunk_len samples of each channel in turn.
+  using HDF5Block = RC::Data1D<int16_t>;
+  using HDF5BlockCallback = RCqt::TaskCaller<RC::APtr<HDF5Block>>;
+
+  /// Owns an HDF5 eeg file, and makes every HDF5 call for it on its own
+  /// thread.
+  /** HDF5Save fills one block while this thread compresses and writes the
+   *  previous, and each write is exactly one chunk, so the library never
+   *  has to read back and recompress a partial chunk.
+   */
+  class HDF5Writer : public RCqt::WorkerThread {
+    public:
+    HDF5Writer() { }
+
+    /// Create the file.  Written blocks go to recycle.
+    /** Blocks, so Failed is cleared, or set if the file could not be
+     *  created, before the caller saves again.
+     */
+    RCqt::TaskBlocker<const HDF5FileSpec, const HDF5BlockCallback> Open =
+      TaskHandler(HDF5Writer::Open_Handler);
+
+    /// Append the first len samples of each channel in block.
+    RCqt::TaskCaller<RC::APtr<HDF5Block>, const size_t> Write =
+      TaskHandler(HDF5Writer::Write_Handler);
+
+    /// Write everything queued and close the file.
+    RCqt::TaskBlocker<> Close =
+      TaskHandler(HDF5Writer::Close_Handler);
+
+    /// True after an error, until the next Open.
+    bool Failed() const { return failed.load(std::memory_order_relaxed); }
+
+    protected:
+    void Open_Handler(const HDF5FileSpec& new_spec,
+                      const HDF5BlockCallback& new_recycle);
+    void Write_Handler(RC::APtr<HDF5Block>& block, const size_t& len);
+    void Close_Handler();
+
+    H5::DSetCreatPropList MakePropList(const hsize_t* chunk_dims,
+        int num_dims) const;
+    void AddSampleRate(H5::H5Object& obj) const;
+
+    HDF5FileSpec spec;
+    HDF5BlockCallback recycle;
+    RC::APtr<H5::H5File> hdf_file;
+    std::vector<H5::DataSet> datasets;
+    hsize_t amount_written = 0;
+    std::atomic<bool> failed{false};
+  };
+}
+
+#endif // NO_HDF5
+#endif // HDF5WRITER_H
+
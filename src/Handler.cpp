@@ -1,15 +1,19 @@
 #include "ChannelSelector.h"
 #include "ConfigFile.h"
+#include "DecisionTrace.h"
 #include "Handler.h"
-#ifdef NO_HDF5
 #include "EDFSave.h"
-#else
+#ifndef NO_HDF5
 #include "HDF5Save.h"
 #endif
+#include "RawSave.h"
 #ifdef CEREBUS_HW
 #include "Cerebus.h"
 #endif
 #include "CerebusSim.h"
+#ifdef CERESTIM_SIMULATOR
+#include "CereStimSim.h"
+#endif
 #include "StimNetWorker.h"
 #include "ClassifierLogReg.h"
 #include "EDFReplay.h"
@@ -50,6 +54,7 @@ namespace CML {
     : stim_worker(this),
       task_net_worker(this),
       exper_ops(this) {
+    event_log.SetEEGAcq(&eeg_acq);
     // For error management, everything that could error must go into
     // Initialize_Handler()
   }
@@ -72,6 +77,19 @@ namespace CML {
     }
 
     settings.LoadSystemConfig();
+    thread_scheduler.Load(*settings.sys_config);
+
+    bool worker_stats = true;
+    settings.sys_config->TryGet(worker_stats, "worker_stats");
+    RCqt::Worker::SetStatsEnabled(worker_stats);
+
+    bool closed_loop_trace = true;
+    settings.sys_config->TryGet(closed_loop_trace, "closed_loop_trace");
+    DecisionTrace::SetEnabled(closed_loop_trace);
+
+    EventLogPolicy event_log_policy;
+    event_log_policy.Load(*settings.sys_config);
+    event_log.SetPolicy(event_log_policy);
 
     // EEG System
     RC::RStr eeg_system;
@@ -105,7 +123,14 @@ namespace CML {
     RC::RStr stim_system;
     settings.sys_config->Get(stim_system, "stim_system");
     RC::APtr<StimInterface> stim_interface;
-    if (stim_system == "CereStim") {
+    if (stim_system == "CereStim" || stim_system == "CereStimSim") {
+#ifdef CERESTIM_SIMULATOR
+      RC::RStr sim_profile;
+      if (settings.sys_config->TryGet(sim_profile, "cerestim_sim_profile")) {
+        sim_profile = settings.sys_config->GetPath("cerestim_sim_profile");
+        CereStimSim::LoadProfile(sim_profile.Raw());
+      }
+#endif
       stim_interface = new CereStim();
     }
     else if (stim_system == "StimNetWorker") {
@@ -151,6 +176,25 @@ namespace CML {
     #endif
   }
 
+  void Handler::ApplyThreadScheduling_Handler() {
+    RC::RStr warnings = thread_scheduler.Validate();
+    if ( ! warnings.empty() ) {
+      ErrorWin("Some sys_config thread_scheduling settings could not be "
+          "applied, so the closed-loop pipeline may see extra latency:\n\n" +
+          warnings, "Thread Scheduling");
+    }
+
+    thread_scheduler.Apply(*this, "Handler");
+    thread_scheduler.Apply(eeg_acq, "EEGAcq");
+    thread_scheduler.Apply(*eeg_save, "EEGSave");
+    thread_scheduler.Apply(event_log, "EventLog");
+    thread_scheduler.Apply(stim_worker, "StimWorker");
+    thread_scheduler.Apply(task_net_worker, "TaskNetWorker");
+    thread_scheduler.Apply(observer_server, "ObserverServer");
+    thread_scheduler.Apply(exper_ops, "ExperOPS");
+    exper_ops.SetSchedulerSchedule(thread_scheduler.Get("EventScheduler"));
+  }
+
   void Handler::CerebusTest_Handler() {
     if (experiment_running) {
       ErrorWin("Attempted CerebusTest while experiment running!");
@@ -331,7 +375,13 @@ namespace CML {
   }
 
   void Handler::InitializeChannels_Handler() {
-    eeg_acq.InitializeChannels(settings.sampling_rate, settings.binned_sampling_rate);
+    channels_ready = false;
+    eeg_acq.InitializeChannels.Then(ChannelsInitialized,
+        settings.sampling_rate, settings.binned_sampling_rate);
+  }
+
+  void Handler::ChannelsInitialized_Handler() {
+    channels_ready = true;
   }
 
   // SelectStim_Handler goes through settings.stimconf and extracts values
@@ -342,13 +392,7 @@ namespace CML {
           "stimulation experiment.");
     }
 
-    StimProfile profile;
-    for (size_t c=0; c<settings.stimconf.size(); c++) {
-      if (settings.stimconf[c].approved &&
-          (settings.stimconf[c].stimtag == stimtag)) {
-        profile += settings.stimconf[c].params;
-      }
-    }
+    StimProfile profile = StimTagProfile(stimtag);
 
     if (profile.size() == 0) {
       ErrorWin("No approved stim configurations match stim tag '" +
@@ -356,16 +400,41 @@ namespace CML {
       StopExperiment_Handler();
     }
 
+    // Stim tags uploaded at the start only need their slot armed.
+    size_t slot = stim_slot_tags.Find(stimtag);
+    if (slot != Data1D<RStr>::npos) {
+      stim_worker.SelectSlot(slot);
+      return;
+    }
+
     stim_worker.ConfigureStimulation(profile);
   }
 
+  StimProfile Handler::StimTagProfile(const RC::RStr& stimtag) {
+    StimProfile profile;
+    for (size_t c=0; c<settings.stimconf.size(); c++) {
+      if (settings.stimconf[c].approved &&
+          (settings.stimconf[c].stimtag == stimtag)) {
+        profile += settings.stimconf[c].params;
+      }
+    }
+    return profile;
+  }
+
   void Handler::StartExperiment_Handler() {
     if (settings.exp_config.IsNull() || settings.elec_config.IsNull()) {
       ErrorWin("You must load a valid experiment configuration file before "
                "starting an experiment session.", "Unconfigured");
       return;
     }
+    if ( ! channels_ready ) {
+      ErrorWin("The EEG channels are not initialized yet.  If this "
+               "persists, reload the experiment configuration.",
+               "EEG not ready");
+      return;
+    }
 
+    stim_slot_tags.Clear();
     if (settings.grid_exper) {
       size_t grid_size = settings.GridSize();
       if (grid_size == 0) {
@@ -399,16 +468,23 @@ namespace CML {
         return;
       }
 
-      // But default select only those with no stimtag.
-      StimProfile profile;
+      // Upload every stim tag into a slot ahead of time, so that
+      // selecting one only arms it.  But default select only those with no
+      // stimtag.
+      stim_slot_tags += RC::RStr();
       for (size_t c=0; c<settings.stimconf.size(); c++) {
         if (settings.stimconf[c].approved &&
-            settings.stimconf[c].stimtag.empty()) {
-          profile += settings.stimconf[c].params;
+            ! stim_slot_tags.Contains(settings.stimconf[c].stimtag) &&
+            stim_slot_tags.size() < StimInterface::max_slots) {
+          stim_slot_tags += settings.stimconf[c].stimtag;
         }
       }
 
-      stim_worker.ConfigureStimulation(profile);
+      stim_worker.ClearSlots();
+      for (size_t slot=0; slot<stim_slot_tags.size(); slot++) {
+        stim_worker.ConfigureSlot(slot, StimTagProfile(stim_slot_tags[slot]));
+      }
+      stim_worker.SelectSlot(0);
     }
 
     if (stim_mode == StimMode::CLOSED) {
@@ -453,9 +529,19 @@ namespace CML {
     eeg_acq.StartingExperiment();  // notify, replay needs this.
     event_log.StartFile(File::FullPath(session_dir, "event.log"));
 
+    DecisionTrace::Reset();
+
+    uint64_t worker_metrics_interval_ms = 10000;
+    settings.sys_config->TryGet(worker_metrics_interval_ms,
+        "worker_metrics_interval_ms");
+    if (RCqt::Worker::StatsEnabled() && worker_metrics_interval_ms > 0) {
+      worker_metrics.StartFile(File::FullPath(session_dir,
+            "worker_metrics.jsonl"), worker_metrics_interval_ms);
+    }
+
     JSONFile version_info;
     version_info.Set(ElememVersion(), "version");
-    event_log.Log(MakeResp("ELEMEM", 0, version_info).Line());
+    event_log.Log(MakeResp("ELEMEM", 0, version_info));
 
     // Start acqusition
     eeg_save->StartFile(File::FullPath(session_dir,
@@ -464,7 +550,7 @@ namespace CML {
     // Mark when eeg file started in event log.
     JSONFile evlog_start_data;
     evlog_start_data.Set(sub_dir, "sub_dir");
-    event_log.Log(MakeResp("EEGSTART", 0, evlog_start_data).Line());
+    event_log.Log(MakeResp("EEGSTART", 0, evlog_start_data));
 
     if (settings.grid_exper) {
       exper_ops.Start();
@@ -480,7 +566,28 @@ namespace CML {
       settings.sys_config->Get(ipaddress, "taskcom_ip");
       settings.sys_config->Get(port, "taskcom_port");
 
+      bool binary_framing = true;
+      settings.sys_config->TryGet(binary_framing, "task_binary_framing");
+      task_net_worker.AllowBinaryFraming(binary_framing);
+
+      uint64_t sync_interval_ms = 1000;
+      settings.sys_config->TryGet(sync_interval_ms, "task_sync_interval_ms");
+      task_net_worker.SetSyncInterval(sync_interval_ms);
+
       task_net_worker.Listen(ipaddress, port);
+
+      uint16_t observer_port = 0;
+      if (settings.sys_config->TryGet(observer_port, "observer_port")) {
+        std::string observer_ip = ipaddress;
+        settings.sys_config->TryGet(observer_ip, "observer_ip");
+        size_t observer_queue_lines = 1000;
+        settings.sys_config->TryGet(observer_queue_lines,
+            "observer_queue_lines");
+        observer_server.SetQueueLimit(observer_queue_lines);
+        observer_server.Listen(observer_ip, observer_port);
+        // Only then is each event log line copied out for observers.
+        event_log.SetObserver(observer_server.Publish);
+      }
       main_window->GetStatusPanel()->SetEvent("WAITING");
     }
   }
@@ -600,8 +707,12 @@ namespace CML {
         RStr classif_json =
           settings.exp_config->GetPath("experiment", "classifier",
             "classifier_file");
+        bool compile_weights = false;
+        settings.sys_config->TryGet(compile_weights,
+            "compile_classifier_weights");
         settings.weight_manager = MakeAPtr<WeightManager>(
-            File::FullPath(base_dir, classif_json), settings.elec_config);
+            File::FullPath(base_dir, classif_json), *settings.montage_index,
+            compile_weights);
       }
     }
     catch (ErrorMsg&) {
@@ -678,11 +789,45 @@ namespace CML {
   }
 
   void Handler::NewEEGSave() {
+    RC::RStr eeg_format = "default";
+    size_t raw_block_ms = 100;
+    bool raw_compression = false;
+    if (settings.sys_config.IsSet()) {
+      settings.sys_config->TryGet(eeg_format, "eeg_format");
+      settings.sys_config->TryGet(raw_block_ms, "raw_block_ms");
+      settings.sys_config->TryGet(raw_compression, "raw_compression");
+    }
+
+    if (eeg_format != "default" && eeg_format != "raw" &&
+        eeg_format != "edf" && eeg_format != "hdf5") {
+      Throw_RC_Type(File, ("sys_config.json eeg_format set to \"" +
+            eeg_format + "\", but it must be \"edf\", \"raw\", or "
+            "\"hdf5\".").c_str());
+    }
+
+    if (eeg_format == "raw") {
+      eeg_save = new RawSave(this, settings.sampling_rate, raw_block_ms,
+          raw_compression);
+    }
+    else if (eeg_format == "edf") {
+      eeg_save = new EDFSave(this, settings.sampling_rate);
+    }
+    else {
 #ifdef NO_HDF5
-    eeg_save = new EDFSave(this, settings.sampling_rate);
+      if (eeg_format == "hdf5") {
+        Throw_RC_Type(File, "sys_config.json eeg_format set to \"hdf5\", "
+            "but this build does not have HDF5 support.");
+      }
+      eeg_save = new EDFSave(this, settings.sampling_rate);
 #else
-    eeg_save = new HDF5Save(this, settings.sampling_rate);
+      HDF5Options hdf5_options;
+      if (settings.sys_config.IsSet()) {
+        hdf5_options.Load(*settings.sys_config);
+      }
+      eeg_save = new HDF5Save(this, settings.sampling_rate, hdf5_options);
 #endif
+    }
+    thread_scheduler.Apply(*eeg_save, "EEGSave");
   }
 
 
@@ -787,8 +932,23 @@ namespace CML {
 
     task_stim_manager = new TaskStimManager(this);
 
+    thread_scheduler.Apply(*task_classifier_manager, "TaskClassifierManager");
+    // The wavelet threads start from FeatureFilters and inherit its
+    // schedule, so a Morlet entry is applied there once.
+    thread_scheduler.Apply(*feature_filters,
+        thread_scheduler.Get("Morlet").configured ? "Morlet" :
+        "FeatureFilters");
+    thread_scheduler.Apply(*classifier, "Classifier");
+    thread_scheduler.Apply(*task_stim_manager, "TaskStimManager");
+
     // Register the callbacks.
     task_classifier_manager->SetCallback(feature_filters->Process);
+    size_t prefix_block_ms = 0;
+    settings.sys_config->TryGet(prefix_block_ms, "classifier_prefix_block_ms");
+    if (prefix_block_ms > 0) {
+      task_classifier_manager->SetPrefixCallback(feature_filters->ProcessPrefix,
+          prefix_block_ms);
+    }
     feature_filters->SetCallback(classifier->Classify);
     classifier->RegisterCallback("ClassifierDecision",
         task_stim_manager->StimDecision);
@@ -832,11 +992,18 @@ namespace CML {
 
   void Handler::CloseExperimentComponents() {
     ShutdownClassifier();
+    if ( ! session_dir.empty() ) {
+      DecisionTrace::WriteFile(File::FullPath(session_dir,
+            "closed_loop_trace.json"));
+    }
     task_net_worker.Close();
+    event_log.SetObserver(EventLineCallback());
+    observer_server.Close();
     exper_ops.Stop();
 
     eeg_save->StopSaving();
     event_log.CloseFile();
+    worker_metrics.CloseFile();
   }
 }
 
@@ -9,12 +9,15 @@
 #include "TaskClassifierManager.h"
 #include "TaskStimManager.h"
 #include "FeatureFilters.h"
+#include "ObserverServer.h"
 #include "Classifier.h"
 #include "EventLog.h"
 #include "ExperOPS.h"
 #include "TaskNetWorker.h"
 #include "Settings.h"
 #include "StimWorker.h"
+#include "ThreadSchedule.h"
+#include "WorkerMetrics.h"
 #include "LocGUIConfig.h"
 #include "StimGUIConfig.h"
 #include <QObject>
@@ -45,6 +48,10 @@ namespace CML {
       TaskHandler(Handler::LoadSysConfig_Handler);
     RCqt::TaskBlocker<> Initialize =
       TaskHandler(Handler::Initialize_Handler);
+    // Must be called after worker threads are running, outside of
+    // DirectCallingScope.
+    RCqt::TaskCaller<> ApplyThreadScheduling =
+      TaskHandler(Handler::ApplyThreadScheduling_Handler);
 
     RCqt::TaskCaller<> CerebusTest =
       TaskHandler(Handler::CerebusTest_Handler);
@@ -80,6 +87,8 @@ namespace CML {
 
     RCqt::TaskCaller<> InitializeChannels =
       TaskHandler(Handler::InitializeChannels_Handler);
+    RCqt::TaskCaller<> ChannelsInitialized =
+      TaskHandler(Handler::ChannelsInitialized_Handler);
     RCqt::TaskCaller<const RC::RStr> SelectStim =
       TaskHandler(Handler::SelectStim_Handler);
 
@@ -109,7 +118,9 @@ namespace CML {
     RC::APtr<Classifier> classifier;
     RC::APtr<TaskStimManager> task_stim_manager;
     TaskNetWorker task_net_worker;
+    ObserverServer observer_server;
     EventLog event_log;
+    WorkerMetrics worker_metrics;
 
     private:
 
@@ -117,6 +128,7 @@ namespace CML {
 
     void LoadSysConfig_Handler();
     void Initialize_Handler();
+    void ApplyThreadScheduling_Handler();
 
     void CerebusTest_Handler();
     void CereStimTest_Handler();
@@ -137,7 +149,9 @@ namespace CML {
     void SetLocDurApproved_Handler(const RC::Data1D<bool>& approved);
 
     void InitializeChannels_Handler();
+    void ChannelsInitialized_Handler();
     void SelectStim_Handler(const RC::RStr& stimtag);
+    StimProfile StimTagProfile(const RC::RStr& stimtag);
 
     void StartExperiment_Handler();
     void StopExperiment_Handler();
@@ -160,6 +174,7 @@ namespace CML {
     void CloseExperimentComponents();
 
     Settings settings;
+    ThreadScheduler thread_scheduler;
 
     RC::RStr elemem_dir;
     RC::RStr non_session_dir;
@@ -167,10 +182,14 @@ namespace CML {
 
     ExperOPS exper_ops;
     StimMode stim_mode = StimMode::NONE;
+    // The stim tag of each StimWorker slot, with slot 0 untagged.
+    RC::Data1D<RC::RStr> stim_slot_tags;
 
     RC::APtr<QTimer> exit_timer;
     bool do_exit = false;
 
+    // Cleared until EEGAcq reports the channels initialized.
+    bool channels_ready = false;
     bool experiment_running = false;
     bool classifier_running = false;
     bool stim_api_test_warning = true;
@@ -0,0 +1,82 @@
+#include "LineFramer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace CML {
+  LineFramer::LineFramer(size_t initial_capacity)
+    : buf(std::max(initial_capacity, size_t(1))) {
+  }
+
+
+  char* LineFramer::Reserve(size_t len) {
+    if (buf.size() - end < len) {
+      Compact();
+      if (buf.size() - end < len) {
+        buf.resize(std::max(buf.size()*2, end + len));
+      }
+    }
+    return buf.data() + end;
+  }
+
+
+  bool LineFramer::NextLine(std::string_view& line) {
+    const char* found = static_cast<const char*>(
+        std::memchr(buf.data() + scan, '\n', end - scan));
+    if ( ! found ) {
+      scan = end;
+      return false;
+    }
+
+    size_t nl = size_t(found - buf.data());
+    line = std::string_view(buf.data() + start, nl - start);
+    start = scan = nl + 1;
+    if (start == end) {
+      // Everything consumed, so the next read starts at the front for free.
+      Clear();
+    }
+    return true;
+  }
+
+
+  bool LineFramer::PeekFrameLength(size_t& len) const {
+    if (end - start < 4) {
+      return false;
+    }
+    const uint8_t* len_bytes =
+      reinterpret_cast<const uint8_t*>(buf.data() + start);
+    len = size_t(len_bytes[0]) | (size_t(len_bytes[1]) << 8) |
+      (size_t(len_bytes[2]) << 16) | (size_t(len_bytes[3]) << 24);
+    return true;
+  }
+
+
+  bool LineFramer::NextFrame(std::string_view& frame) {
+    size_t len;
+    if ( ! PeekFrameLength(len) ) {
+      return false;
+    }
+    if (end - start - 4 < len) {
+      return false;
+    }
+
+    frame = std::string_view(buf.data() + start + 4, len);
+    start = scan = start + 4 + len;
+    if (start == end) {
+      Clear();
+    }
+    return true;
+  }
+
+
+  void LineFramer::Compact() {
+    if (start == 0) {
+      return;
+    }
+    std::memmove(buf.data(), buf.data() + start, end - start);
+    scan -= start;
+    end -= start;
+    start = 0;
+  }
+}
+
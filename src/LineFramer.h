@@ -0,0 +1,63 @@
+#ifndef LINEFRAMER_H
+#define LINEFRAMER_H
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace CML {
+  /// Splits a byte stream into newline terminated lines, or length
+  /// prefixed frames, without copying.
+  /** Bytes are read straight into the buffer with Reserve() and Commit(),
+   *  and NextLine() returns views into it, found with memchr and never
+   *  rescanning a partial line.  NextFrame() may be used instead at any
+   *  point, for a stream that switches framing.  Consumed bytes are only
+   *  moved when more space is needed, and then only the unfinished tail, so
+   *  a burst of lines costs time linear in its size.
+   */
+  class LineFramer {
+    public:
+    LineFramer(size_t initial_capacity = 64*1024);
+
+    /// Space for at least len more bytes, to be filled and then committed.
+    char* Reserve(size_t len);
+    /// Mark len bytes written at the last Reserve() pointer.
+    void Commit(size_t len) { end += len; }
+
+    /// Get the next complete line, without its '\n'.
+    /** @return False if no complete line is buffered.  The view stays
+     *  valid until the next Reserve().
+     */
+    bool NextLine(std::string_view& line);
+
+    /// Get the next frame, a 4 byte little-endian payload length followed
+    /// by the payload.
+    /** @return False if no complete frame is buffered.  The view stays
+     *  valid until the next Reserve().
+     */
+    bool NextFrame(std::string_view& frame);
+
+    /// The payload length of the next frame, as soon as its 4 byte length
+    /// is buffered.
+    /** @return False if the length has not all arrived.
+     */
+    bool PeekFrameLength(size_t& len) const;
+
+    /// Drop all buffered bytes, keeping the allocation.
+    void Clear() { start = scan = end = 0; }
+
+    /// Bytes received but not yet returned as lines.
+    size_t Buffered() const { return end - start; }
+
+    protected:
+    void Compact();
+
+    std::vector<char> buf;
+    size_t start = 0;  // First byte not yet returned.
+    size_t scan = 0;   // First byte not yet searched for '\n'.
+    size_t end = 0;    // One past the last committed byte.
+  };
+}
+
+#endif // LINEFRAMER_H
+
@@ -1,5 +1,6 @@
 #include "About.h"
 #include "ChannelSelector.h"
+#include "DecisionTrace.h"
 #include "EEGDisplay.h"
 #include "GuiParts.h"
 #include "MainWindow.h"
@@ -7,6 +8,7 @@
 #include "LocGUIConfig.h"
 #include "StimGUIConfig.h"
 #include "Utils.h"
+#include "WorkerMetrics.h"
 #include <QAction>
 #include <QCloseEvent>
 #include <QDir>
@@ -61,7 +63,13 @@ namespace CML {
                  &MainWindow::close, QKeySequence::Quit);
 
     Ptr<QMenu> setup_menu = menuBar()->addMenu(tr("&Setup"));
-    RC::UnusedVar(setup_menu);
+
+    SubMenuEntry(setup_menu, "&Worker Metrics",
+                 "Show task queue depths and latencies",
+                 &MainWindow::SetupWorkerMetricsClicked);
+    SubMenuEntry(setup_menu, "&Closed-Loop Timing",
+                 "Show closed-loop decision stage latencies",
+                 &MainWindow::SetupClosedLoopTimingClicked);
 
     Ptr<QMenu> help_menu = menuBar()->addMenu(tr("&Help"));
 
@@ -201,6 +209,17 @@ namespace CML {
   }
 
 
+  void MainWindow::SetupWorkerMetricsClicked() {
+    PopupWin(WorkerMetrics::FormatSummaries(
+          RCqt::Worker::AllStatsSummaries()), "Worker Metrics");
+  }
+
+
+  void MainWindow::SetupClosedLoopTimingClicked() {
+    PopupWin(DecisionTrace::Summary(), "Closed-Loop Timing");
+  }
+
+
   void MainWindow::HelpAboutClicked() {
     AboutWin();
   }
@@ -225,15 +244,37 @@ namespace CML {
 
 
   void MainWindow::closeEvent(QCloseEvent *event) {
-    if (ConfirmWin("Are you sure you want to quit?", "Quit Elemem?")) {
-      hndl->Shutdown();
-      hndl->eeg_acq.RemoveEEGCallback("EEGDisplay");
-      Worker::ExitAllWorkers();
+    if (quit_ready) {
       event->accept();
+      return;
+    }
+
+    // Closed by FinishQuit once the EEG display is detached, so the GUI
+    // thread does not wait on EEGAcq.
+    event->ignore();
+    if ( ! quit_pending &&
+        ConfirmWin("Are you sure you want to quit?", "Quit Elemem?")) {
+      quit_pending = true;
+      hndl->Shutdown();
+      hndl->eeg_acq.RemoveEEGCallback.Then(FinishQuit,
+          RC::RStr("EEGDisplay"));
+
+      // Quit anyway if EEGAcq never replies.
+      quit_timer.setSingleShot(true);
+      connect(&quit_timer, &QTimer::timeout, this,
+          &MainWindow::FinishQuit_Handler);
+      quit_timer.start(int(quit_timeout_ms));
     }
-    else {
-      event->ignore();
+  }
+
+  void MainWindow::FinishQuit_Handler() {
+    if (quit_ready) {
+      return;
     }
+    quit_timer.stop();
+    Worker::ExitAllWorkers();
+    quit_ready = true;
+    close();
   }
 }
 
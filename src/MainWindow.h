@@ -7,6 +7,7 @@
 #include "OpenConfigDialog.h"
 #include "StatusPanel.h"
 #include <QMainWindow>
+#include <QTimer>
 
 class QGroupBox;
 class QGridLayout;
@@ -74,9 +75,14 @@ namespace CML {
     RCqt::TaskCaller<> SwitchToStimPanelLoc =
       TaskHandler(MainWindow::SwitchToStimPanelLoc_Handler);
 
+    RCqt::TaskCaller<> FinishQuit =
+      TaskHandler(MainWindow::FinishQuit_Handler);
+
     public slots:
 
     void FileOpenClicked();
+    void SetupWorkerMetricsClicked();
+    void SetupClosedLoopTimingClicked();
     void HelpAboutClicked();
 
     protected:
@@ -101,6 +107,8 @@ namespace CML {
     void SwitchToStimPanelFR_Handler();
     void SwitchToStimPanelLoc_Handler();
 
+    void FinishQuit_Handler();
+
     RC::Ptr<EEGDisplay> eeg_disp;
     RC::Ptr<StatusPanel> status_panel;
     RC::Ptr<Button> start_button;
@@ -116,6 +124,13 @@ namespace CML {
     RC::Ptr<LocConfigBox> loc_config_dur;
 
     RC::RStr last_open_dir;
+
+    // Set while waiting for the EEG display to be detached, and once all
+    // workers have exited so the window may close.
+    bool quit_pending = false;
+    bool quit_ready = false;
+    QTimer quit_timer;
+    const uint64_t quit_timeout_ms = 5000;
   };
 }
 
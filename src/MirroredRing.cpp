@@ -0,0 +1,126 @@
+#include "MirroredRing.h"
+#include "RC/Errors.h"
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace CML {
+  MirroredMemory::MirroredMemory(size_t region_cnt, size_t region_bytes)
+    : region_cnt(region_cnt), region_bytes(region_bytes) {
+    if (region_bytes % PageSize() != 0) {
+      Throw_RC_Error("Mirrored region size must be a multiple of the page "
+          "size.");
+    }
+
+    if (region_cnt == 0 || MapMirrored()) {
+      return;
+    }
+
+    // Fallback, two plain copies of each region.
+    base = new uint8_t[region_cnt*2*region_bytes]();
+  }
+
+  MirroredMemory::~MirroredMemory() {
+    Release();
+  }
+
+  MirroredMemory::MirroredMemory(MirroredMemory&& other)
+    : base(other.base), region_cnt(other.region_cnt),
+      region_bytes(other.region_bytes), mapped(other.mapped) {
+    other.base = nullptr;
+    other.region_cnt = 0;
+  }
+
+  MirroredMemory& MirroredMemory::operator=(MirroredMemory&& other) {
+    if (this != &other) {
+      Release();
+      base = other.base;
+      region_cnt = other.region_cnt;
+      region_bytes = other.region_bytes;
+      mapped = other.mapped;
+      other.base = nullptr;
+      other.region_cnt = 0;
+    }
+    return *this;
+  }
+
+  size_t MirroredMemory::PageSize() {
+#ifdef __linux__
+    static const size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+    return page_size;
+#else
+    return 4096;
+#endif
+  }
+
+  void MirroredMemory::Release() {
+    if (base == nullptr) {
+      return;
+    }
+#ifdef __linux__
+    if (mapped) {
+      munmap(base, region_cnt*2*region_bytes);
+    }
+    else {
+      delete[] base;
+    }
+#else
+    delete[] base;
+#endif
+    base = nullptr;
+    mapped = false;
+  }
+
+  // Returns false, leaving nothing allocated, if this cannot be done here.
+  bool MirroredMemory::MapMirrored() {
+#ifdef __linux__
+    int fd = memfd_create("EEGRing", MFD_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+
+    size_t file_bytes = region_cnt*region_bytes;
+    size_t virt_bytes = 2*file_bytes;
+    void* reserved = MAP_FAILED;
+    if (ftruncate(fd, off_t(file_bytes)) == 0) {
+      // Reserve the whole address range, then map each region into it twice.
+      reserved = mmap(nullptr, virt_bytes, PROT_NONE,
+          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (reserved == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+
+    uint8_t* reserved_base = static_cast<uint8_t*>(reserved);
+    bool success = true;
+    for (size_t r=0; r<region_cnt && success; r++) {
+      for (size_t copy=0; copy<2; copy++) {
+        void* addr = reserved_base + (2*r + copy)*region_bytes;
+        void* map = mmap(addr, region_bytes, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_FIXED, fd, off_t(r*region_bytes));
+        if (map != addr) {
+          success = false;
+          break;
+        }
+      }
+    }
+
+    // The mappings keep the memory alive.
+    close(fd);
+
+    if ( ! success ) {
+      munmap(reserved, virt_bytes);
+      return false;
+    }
+
+    base = reserved_base;
+    mapped = true;
+    return true;
+#else
+    return false;
+#endif
+  }
+}
+
@@ -0,0 +1,137 @@
+#ifndef MIRROREDRING_H
+#define MIRROREDRING_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace CML {
+  /// Page aligned memory in which each region appears twice, back to back.
+  /** On Linux the two copies are the same memfd pages mapped twice, so a
+   *  write to Region(r)[i] is also visible at Region(r)[i+RegionBytes()].
+   *  Elsewhere, or if mapping fails, IsMapped() is false and a plain
+   *  buffer of twice the size is used, which the owner must keep mirrored.
+   *  Memory starts zeroed.
+   */
+  class MirroredMemory {
+    public:
+    MirroredMemory() { }
+    /** @param region_cnt The number of independent mirrored regions.
+     *  @param region_bytes The size of one copy of a region, a multiple of
+     *  PageSize().
+     */
+    MirroredMemory(size_t region_cnt, size_t region_bytes);
+    ~MirroredMemory();
+
+    MirroredMemory(MirroredMemory&& other);
+    MirroredMemory& operator=(MirroredMemory&& other);
+    MirroredMemory(const MirroredMemory&) = delete;
+    MirroredMemory& operator=(const MirroredMemory&) = delete;
+
+    uint8_t* Region(size_t r) const { return base + r*2*region_bytes; }
+    size_t RegionBytes() const { return region_bytes; }
+    bool IsMapped() const { return mapped; }
+
+    static size_t PageSize();
+
+    protected:
+    void Release();
+    bool MapMirrored();
+
+    uint8_t* base = nullptr;
+    size_t region_cnt = 0;
+    size_t region_bytes = 0;
+    bool mapped = false;
+  };
+
+
+  /// Per-channel ring buffers where any run of up to Capacity() samples is
+  /// one contiguous pointer range.
+  /** Capacity() is a power of two of at least the requested length, so a
+   *  running sample count maps to its slot with Mask().  Writes of up to
+   *  Capacity() samples are a single copy when the memory is mirrored by
+   *  the MMU.
+   */
+  template<class T>
+  class MirroredRing {
+    public:
+    MirroredRing() { }
+
+    /// Allocate zeroed storage for the enabled channels.
+    void Setup(const std::vector<bool>& enabled, size_t min_len) {
+      size_t min_cap = MirroredMemory::PageSize() / sizeof(T);
+      cap = 1;
+      while (cap < min_len || cap < min_cap) {
+        cap <<= 1;
+      }
+
+      size_t region_cnt = 0;
+      for (bool e : enabled) {
+        region_cnt += e;
+      }
+      mem = MirroredMemory(region_cnt, cap*sizeof(T));
+
+      chans.assign(enabled.size(), nullptr);
+      size_t r = 0;
+      for (size_t c=0; c<enabled.size(); c++) {
+        if (enabled[c]) {
+          chans[c] = reinterpret_cast<T*>(mem.Region(r));
+          r++;
+        }
+      }
+    }
+
+    /// Allocate the same layout as other, and copy its running samples
+    /// from first up to end, which must be at most Capacity() apart.
+    void CopyFrom(const MirroredRing& other, uint64_t first, uint64_t end) {
+      std::vector<bool> enabled(other.chans.size());
+      for (size_t c=0; c<enabled.size(); c++) {
+        enabled[c] = ! other.IsEmpty(c);
+      }
+      Setup(enabled, other.cap);
+      if (end <= first) {
+        return;
+      }
+      for (size_t c=0; c<chans.size(); c++) {
+        if (chans[c]) {
+          Write(c, first, other.At(c, first), size_t(end - first));
+        }
+      }
+    }
+
+    size_t Capacity() const { return cap; }
+    size_t Mask() const { return cap - 1; }
+    size_t ChanCount() const { return chans.size(); }
+    bool IsEmpty(size_t c) const { return chans[c] == nullptr; }
+
+    /// The ring for channel c, readable from 0 to 2*Capacity().
+    const T* Chan(size_t c) const { return chans[c]; }
+    /// The run of samples starting at running sample count pos.
+    const T* At(size_t c, uint64_t pos) const {
+      return chans[c] + (pos & Mask());
+    }
+
+    /// Write n <= Capacity() samples at running sample count pos.
+    void Write(size_t c, uint64_t pos, const T* src, size_t n) {
+      T* ring = chans[c];
+      size_t p = pos & Mask();
+      std::memcpy(ring + p, src, n*sizeof(T));
+      if ( ! mem.IsMapped() ) {
+        // Keep the second copy in step by hand.
+        size_t lower = (p + n <= cap) ? n : cap - p;
+        std::memcpy(ring + p + cap, ring + p, lower*sizeof(T));
+        if (lower < n) {
+          std::memcpy(ring, ring + cap, (n - lower)*sizeof(T));
+        }
+      }
+    }
+
+    protected:
+    MirroredMemory mem;
+    std::vector<T*> chans;
+    size_t cap = 0;
+  };
+}
+
+#endif // MIRROREDRING_H
+
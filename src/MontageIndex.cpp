@@ -0,0 +1,44 @@
+#include "MontageIndex.h"
+#include "ConfigFile.h"
+
+namespace CML {
+  MontageIndex::MontageIndex(const CSVFile& elec_config) {
+    auto& datar = elec_config.data;
+
+    if (datar.size2() != 0 && datar.size1() < 2) {
+      Throw_RC_Type(File, "Electrode configuration does not contain label "
+          "and channel number entries.");
+    }
+
+    index.reserve(datar.size2());
+    for (size_t e=0; e<datar.size2(); e++) {
+      int64_t chan = -1;
+      datar[e][1].Get(chan);
+      auto res = index.emplace(datar[e][0], chan);
+      if (!res.second) {
+        // Duplicates only fail when they are actually looked up.
+        res.first->second = DUPLICATE;
+      }
+    }
+  }
+
+
+  int64_t MontageIndex::Find(const RC::RStr& label) const {
+    auto it = index.find(label);
+    if (it == index.end()) {
+      Throw_RC_Type(File, ("Could not find " + label + " in montage "
+            "file.").c_str());
+    }
+    if (it->second == DUPLICATE) {
+      Throw_RC_Type(File, ("Multiple entries for " + label + " in "
+          "montage file.").c_str());
+    }
+    return it->second;
+  }
+
+
+  bool MontageIndex::Contains(const RC::RStr& label) const {
+    return index.find(label) != index.end();
+  }
+}
+
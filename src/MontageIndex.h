@@ -0,0 +1,34 @@
+#ifndef MONTAGEINDEX_H
+#define MONTAGEINDEX_H
+
+#include "RC/RStr.h"
+#include <unordered_map>
+
+namespace CML {
+  class CSVFile;
+
+  /// A label to channel number hash index over a montage CSV file.
+  /** Build this once per loaded montage, and then look up contacts in
+   *  constant time rather than scanning every montage row per lookup.
+   */
+  class MontageIndex {
+    public:
+    MontageIndex(const CSVFile& elec_config);
+
+    /// Returns the channel number for the contact label.
+    /** Throws a File error if the label is absent or is listed more than
+     *  once in the montage.
+     */
+    int64_t Find(const RC::RStr& label) const;
+    bool Contains(const RC::RStr& label) const;
+
+    size_t size() const { return index.size(); }
+
+    protected:
+    static constexpr int64_t DUPLICATE = -2;
+    std::unordered_map<RC::RStr, int64_t> index;
+  };
+}
+
+#endif // MONTAGEINDEX_H
+
@@ -61,6 +61,8 @@ namespace CML {
   void NetWorker::NewConnection() {
     NewConnectionBefore();
     configured = false;
+    binary_frames = false;
+    framer.Clear();
     if (server.IsNull()) {
       return;
     }
@@ -76,20 +78,49 @@ namespace CML {
 
   void NetWorker::DataReady() {
     DataReadyBefore();
-    auto new_data = con->readAll();
-    buffer += RStr(new_data.data(), size_t(new_data.size()));
-    Data1D<RStr> split;
-    while (buffer.Contains("\n")) {
-      split = buffer.SplitFirst('\n');
-      buffer = split[1];
-      ProcessCommand(split[0]);
+    // Read straight into the framer rather than through a QByteArray.
+    qint64 avail;
+    while ((avail = con->bytesAvailable()) > 0) {
+      qint64 got = con->read(framer.Reserve(size_t(avail)), avail);
+      if (got <= 0) {
+        break;
+      }
+      framer.Commit(size_t(got));
+    }
+
+    // Checked per message, as a message can switch the framing.
+    std::string_view msg;
+    while (true) {
+      if (binary_frames) {
+        // Rejected from the length alone, before buffering the payload.
+        size_t len;
+        if (framer.PeekFrameLength(len) && len > max_frame_bytes) {
+          connected = false;
+          Close_Handler();
+          hndl->StopExperiment();
+          ErrorWin(netWorkerType + " sent a frame over " +
+                   RC::RStr(max_frame_bytes) + " bytes.  Experiment stopped.");
+          return;
+        }
+        if ( ! framer.NextFrame(msg) ) {
+          break;
+        }
+        ProcessFrame(msg);
+      }
+      else {
+        if ( ! framer.NextLine(msg) ) {
+          break;
+        }
+        ProcessCommand(msg);
+      }
     }
     DataReadyAfter();
   }
 
   void NetWorker::Disconnected() {
     DisconnectedBefore();
-    buffer.clear();
+    framer.Clear();
+    binary_frames = false;
     // Message required, unplanned disconnect.
     if (connected) {
       connected = false;
@@ -105,6 +136,18 @@ namespace CML {
     DisconnectedAfter();
   }
 
+  void NetWorker::SendFrame(const std::vector<uint8_t>& payload) {
+    uint32_t len = uint32_t(payload.size());
+    RC::RStr frame;
+    frame.reserve(4 + payload.size());
+    for (size_t i=0; i<4; i++) {
+      frame += char(uint8_t(len >> (8*i)));
+    }
+    frame += RC::RStr(reinterpret_cast<const char*>(payload.data()),
+        payload.size());
+    Send(frame);
+  }
+
   void NetWorker::Send(const RC::RStr& msg) {
     if ( ! IsConnected_Handler() ) {
       hndl->StopExperiment();
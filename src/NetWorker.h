@@ -1,12 +1,15 @@
 #ifndef NETWORKER_H
 #define NETWORKER_H
 
+#include "LineFramer.h"
 #include "RC/APtr.h"
 #include "RC/RStr.h"
 #include "RC/Ptr.h"
 #include "RCqt/Worker.h"
 #include <QTcpServer>
 #include <QTcpSocket>
+#include <string_view>
+#include <vector>
 
 
 namespace CML {
@@ -54,13 +57,22 @@ namespace CML {
     bool IsConnected_Handler();
     void StopOnDisconnect_Handler(const bool& stop);
 
-    virtual void ProcessCommand(RC::RStr cmd) = 0;
+    /// One received line, without the '\n', valid only during the call.
+    virtual void ProcessCommand(std::string_view cmd) = 0;
+    /// One received frame payload, while binary_frames is set.
+    virtual void ProcessFrame(std::string_view /*frame*/) { }
     void Send(const RC::RStr& msg);
+    /// Send payload with the 4 byte little-endian length prefix.
+    void SendFrame(const std::vector<uint8_t>& payload);
 
     RC::Ptr<Handler> hndl;
     RC::APtr<QTcpServer> server;
     RC::APtr<QTcpSocket> con;
-    RC::RStr buffer;
+    LineFramer framer;
+    // Set by a subclass once the peer agrees to length prefixed frames.
+    // Cleared for each new connection.
+    bool binary_frames = false;
+    static constexpr size_t max_frame_bytes = 1 << 20;
     bool stop_on_disconnect = false;
     bool configured = false;
     bool connected = false;
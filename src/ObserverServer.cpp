@@ -0,0 +1,142 @@
+#include "ObserverServer.h"
+#include "JSONLines.h"
+#include <algorithm>
+
+namespace CML {
+  ObserverServer::ObserverServer() {
+    AddToThread(this);
+  }
+
+
+  ObserverServer::~ObserverServer() {
+    Close_Handler();
+  }
+
+
+  void ObserverServer::Listen_Handler(const RC::RStr& address,
+                                      const uint16_t& port) {
+    Close_Handler();
+    server = new QTcpServer();
+    connect(server, &QTcpServer::newConnection, this,
+        &ObserverServer::NewConnection);
+
+    auto qt_address = QHostAddress(address.ToQString());
+    if ( qt_address.toString() != address.ToQString() ||
+        qt_address.isNull() || ! server->listen(qt_address, port) ) {
+      server.Delete();
+      Throw_RC_Type(Net, (RC::RStr("Could not setup observer server on "
+            "address ") + address + " port " + RC::RStr(port)).c_str());
+    }
+    // Qt requires this to come after the "listen" call.
+    AddToThread(server);
+  }
+
+
+  void ObserverServer::Close_Handler() {
+    for (auto& obs : observers) {
+      QObject::disconnect(obs->con, nullptr, this, nullptr);
+      obs->con->close();
+      delete obs->con;
+    }
+    observers.clear();
+
+    if (server.IsSet()) {
+      server->close();
+      server.Delete();
+    }
+  }
+
+
+  void ObserverServer::Publish_Handler(const RC::RStr& lines) {
+    if (observers.empty()) {
+      return;
+    }
+    const std::string& text = lines.Raw();
+    size_t count = size_t(std::count(text.begin(), text.end(), '\n'));
+    for (auto& obs : observers) {
+      obs->queue.push_back({lines, count});
+      obs->queued_lines += count;
+      Pump(*obs);
+      Trim(*obs);
+    }
+  }
+
+
+  void ObserverServer::NewConnection() {
+    if (server.IsNull()) {
+      return;
+    }
+
+    QTcpSocket* con;
+    while ((con = server->nextPendingConnection()) != nullptr) {
+      RC::APtr<Observer> obs = new Observer();
+      obs->con = con;
+      Observer* obs_ptr = obs.Raw();
+
+      connect(con, &QTcpSocket::readyRead, this,
+          [con]() { con->readAll(); });
+      connect(con, &QTcpSocket::bytesWritten, this,
+          [this, obs_ptr]() { Pump(*obs_ptr); });
+      connect(con, &QTcpSocket::disconnected, this,
+          [this, con]() { Remove(con); });
+
+      observers.push_back(obs);
+    }
+  }
+
+
+  void ObserverServer::Pump(Observer& obs) {
+    if (obs.dropped > 0 && obs.con->bytesToWrite() < write_watermark) {
+      JSONFile notice = MakeResp("OBSERVER_DROPPED");
+      notice.Set(obs.dropped, "data", "count");
+      RC::RStr line = notice.Line();
+      obs.con->write(line.c_str(), qint64(line.size()));
+      obs.dropped = 0;
+    }
+
+    while ( ! obs.queue.empty() &&
+        obs.con->bytesToWrite() < write_watermark ) {
+      auto& lines = obs.queue.front();
+      obs.con->write(lines.text.c_str(), qint64(lines.text.size()));
+      obs.queued_lines -= lines.count;
+      obs.queue.pop_front();
+    }
+  }
+
+
+  void ObserverServer::Trim(Observer& obs) {
+    while (obs.queued_lines > queue_limit) {
+      auto& oldest = obs.queue.front();
+      size_t excess = obs.queued_lines - queue_limit;
+      if (oldest.count <= excess) {
+        obs.dropped += oldest.count;
+        obs.queued_lines -= oldest.count;
+        obs.queue.pop_front();
+      }
+      else {
+        // Keep the newer lines of a group that is only partly over.
+        std::string& text = oldest.text.Raw();
+        size_t pos = 0;
+        for (size_t i=0; i<excess; i++) {
+          pos = text.find('\n', pos) + 1;
+        }
+        text.erase(0, pos);
+        oldest.count -= excess;
+        obs.dropped += excess;
+        obs.queued_lines -= excess;
+      }
+    }
+  }
+
+
+  void ObserverServer::Remove(QTcpSocket* con) {
+    for (size_t i=0; i<observers.size(); i++) {
+      if (observers[i]->con == con) {
+        observers.erase(observers.begin() + long(i));
+        con->deleteLater();
+        return;
+      }
+    }
+  }
+}
+
@@ -0,0 +1,89 @@
+#ifndef OBSERVERSERVER_H
+#define OBSERVERSERVER_H
+
+#include "RC/APtr.h"
+#include "RC/RStr.h"
+#include "RCqt/Worker.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace CML {
+  /// Serves the live event log to read-only observer connections.
+  /** Any number of dashboards or QA monitors may connect, and each
+   *  receives every event log line from then on, including the stim
+   *  decisions.  This runs on its own thread, apart from the task
+   *  connection in TaskNetWorker, and each observer has its own bounded
+   *  queue that drops its oldest lines when full, so a slow observer
+   *  never holds up the task connection or the other observers.  After a
+   *  drop the observer is sent {"type": "OBSERVER_DROPPED", "data":
+   *  {"count": n}}.  Anything observers send is discarded.
+   */
+  class ObserverServer : public RCqt::WorkerThread, public QObject {
+    public:
+    ObserverServer();
+    ~ObserverServer();
+
+    // Rule of 3.
+    ObserverServer(const ObserverServer&) = delete;
+    ObserverServer& operator=(const ObserverServer&) = delete;
+
+    RCqt::TaskCaller<const RC::RStr, const uint16_t> Listen =
+      TaskHandler(ObserverServer::Listen_Handler);
+
+    /// Close the server and all observer connections.
+    RCqt::TaskBlocker<> Close =
+      TaskHandler(ObserverServer::Close_Handler);
+
+    /// Send newline terminated lines to every observer.
+    RCqt::TaskCaller<const RC::RStr> Publish =
+      TaskHandler(ObserverServer::Publish_Handler);
+
+    /// The most lines held for each observer before dropping the oldest.
+    RCqt::TaskCaller<const size_t> SetQueueLimit =
+      TaskHandler(ObserverServer::SetQueueLimit_Handler);
+
+    protected slots:
+    void NewConnection();
+
+    protected:
+    class Lines {
+      public:
+      RC::RStr text;
+      size_t count;
+    };
+
+    class Observer {
+      public:
+      // Owned.  Freed with deleteLater when removed by its own signal.
+      QTcpSocket* con = nullptr;
+      std::deque<Lines> queue;
+      size_t queued_lines = 0;
+      uint64_t dropped = 0;
+    };
+
+    void Listen_Handler(const RC::RStr& address, const uint16_t& port);
+    void Close_Handler();
+    void Publish_Handler(const RC::RStr& lines);
+    void SetQueueLimit_Handler(const size_t& limit) {
+      queue_limit = limit > 0 ? limit : 1;
+    }
+
+    void Pump(Observer& obs);
+    /// Drop the oldest lines over queue_limit.
+    void Trim(Observer& obs);
+    void Remove(QTcpSocket* con);
+
+    // Socket writes are held back above this, so queues stay bounded.
+    static constexpr int64_t write_watermark = 64*1024;
+
+    RC::APtr<QTcpServer> server;
+    std::vector<RC::APtr<Observer>> observers;
+    size_t queue_limit = 1000;
+  };
+}
+
+#endif // OBSERVERSERVER_H
+
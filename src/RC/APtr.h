@@ -105,6 +105,21 @@ namespace RC {
       return retptr;
     }
 
+    /// Extract the raw pointer and revoke ownership from this object.
+    /** Note, the object returned becomes the responsibility of the calling
+     *  function, and should be deleted externally!  All linked APtr's are
+     *  NULL after calling this.
+     */
+    inline T* Extract() {
+#ifdef CPP11
+      return helper->t_ptr.exchange(NULL);
+#else
+      T* retval = helper->t_ptr;
+      helper->t_ptr = NULL;
+      return retval;
+#endif
+    }
+
 #include "PtrSharedCommon.h"
 #include "PtrCommon.h"
 
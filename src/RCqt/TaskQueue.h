@@ -0,0 +1,181 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RCqt Library
+//
+// Distributed under the Boost Software License, v1.0. (LICENSE.txt)
+//
+// TaskQueue - The lock-free task queue and command pools used by Worker
+// when built with RCQT_TASK_QUEUE.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef TASKQUEUE_H
+#define TASKQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+
+namespace RCqt {
+  /// A bounded multi-producer, single-consumer FIFO queue.
+  /** Each cell carries a sequence number telling producers and the
+   *  consumer whose turn it is, so pushes only contend on one atomic
+   *  increment and pops take no locks at all.  T must be cheap to copy.
+   */
+  template<class T>
+  class TaskQueue {
+    public:
+    TaskQueue(size_t min_capacity) {
+      size_t cap = 2;
+      while (cap < min_capacity) {
+        cap <<= 1;
+      }
+      mask = cap - 1;
+      cells = std::vector<Cell>(cap);
+      for (size_t i=0; i<cap; i++) {
+        cells[i].seq.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    size_t Capacity() const { return mask + 1; }
+
+    /// Any thread.  Returns false if the queue is full.
+    bool TryPush(const T& item) {
+      size_t pos = tail.load(std::memory_order_relaxed);
+      Cell* cell;
+      while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(seq) - intptr_t(pos);
+        if (diff == 0) {
+          if (tail.compare_exchange_weak(pos, pos+1,
+                std::memory_order_relaxed)) {
+            break;
+          }
+        }
+        else if (diff < 0) {
+          return false;
+        }
+        else {
+          pos = tail.load(std::memory_order_relaxed);
+        }
+      }
+
+      cell->item = item;
+      cell->seq.store(pos+1, std::memory_order_release);
+      return true;
+    }
+
+    /// Consumer thread only.  Returns false if the queue is empty.
+    bool TryPop(T& item) {
+      Cell& cell = cells[head & mask];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      if (intptr_t(seq) - intptr_t(head+1) < 0) {
+        return false;
+      }
+
+      item = cell.item;
+      cell.seq.store(head + mask + 1, std::memory_order_release);
+      head++;
+      return true;
+    }
+
+    protected:
+    struct Cell {
+      std::atomic<size_t> seq;
+      T item;
+    };
+
+    std::vector<Cell> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) size_t head = 0;
+  };
+
+
+  /// A free list of blocks for the command type T.
+  /** Commands are allocated by the calling thread and freed by the worker
+   *  thread, so the list is shared, under a spinlock held only to swap a
+   *  pointer.  Blocks are never returned to the system.
+   */
+  template<class T>
+  class CommandPool {
+    public:
+    static void* Alloc(size_t size) {
+      if (size != sizeof(T)) {
+        return ::operator new(size);
+      }
+
+      Pool& pool = Get();
+      pool.Lock();
+      Block* block = pool.free;
+      if (block) {
+        pool.free = block->next;
+        pool.free_cnt--;
+      }
+      pool.Unlock();
+
+      if (block) {
+        return block;
+      }
+      return ::operator new(BlockSize());
+    }
+
+    static void Free(void* ptr, size_t size) {
+      if (size != sizeof(T)) {
+        ::operator delete(ptr);
+        return;
+      }
+
+      Pool& pool = Get();
+      pool.Lock();
+      bool keep = pool.free_cnt < max_free;
+      if (keep) {
+        Block* block = static_cast<Block*>(ptr);
+        block->next = pool.free;
+        pool.free = block;
+        pool.free_cnt++;
+      }
+      pool.Unlock();
+
+      if ( ! keep ) {
+        ::operator delete(ptr);
+      }
+    }
+
+    protected:
+    struct Block {
+      Block* next;
+    };
+
+    struct Pool {
+      void Lock() {
+        while (lock.test_and_set(std::memory_order_acquire)) { }
+      }
+      void Unlock() { lock.clear(std::memory_order_release); }
+
+      std::atomic_flag lock = ATOMIC_FLAG_INIT;
+      Block* free = nullptr;
+      size_t free_cnt = 0;
+    };
+
+    static const size_t max_free = 256;
+
+    static constexpr size_t BlockSize() {
+      return sizeof(T) > sizeof(Block) ? sizeof(T) : sizeof(Block);
+    }
+
+    // Never destructed, as commands can be freed during static destruction.
+    static Pool& Get() {
+      static Pool* pool = new Pool();
+      return *pool;
+    }
+  };
+}
+
+
+#endif // TASKQUEUE_H
+
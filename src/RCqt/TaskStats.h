@@ -0,0 +1,168 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RCqt Library
+//
+// Distributed under the Boost Software License, v1.0. (LICENSE.txt)
+//
+// TaskStats - Lock-free latency histograms recording how long each Worker
+// task waited in the queue and how long its handler ran.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef TASKSTATS_H
+#define TASKSTATS_H
+
+#include "../RC/RStr.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+
+namespace RCqt {
+  /// Monotonic nanoseconds, for task timing.
+  inline uint64_t TaskClockNs() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+
+  struct LatencySummary {
+    uint64_t count = 0;
+    double mean_ns = 0;
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+    uint64_t max_ns = 0;
+  };
+
+
+  /// A log-linear histogram of nanosecond durations.
+  /** Each power of two is split into 8 linear bins, so any reported
+   *  percentile is within 12.5% of the true value, from 1ns up to about 30
+   *  minutes.  Recording is a handful of relaxed atomic operations and may
+   *  be done from any thread.
+   */
+  class LatencyHistogram {
+    public:
+    void Record(uint64_t ns) {
+      bins[BinOf(ns)].fetch_add(1, std::memory_order_relaxed);
+      count.fetch_add(1, std::memory_order_relaxed);
+      total_ns.fetch_add(ns, std::memory_order_relaxed);
+      uint64_t prev = max_ns.load(std::memory_order_relaxed);
+      while (ns > prev && ! max_ns.compare_exchange_weak(prev, ns,
+            std::memory_order_relaxed)) { }
+    }
+
+    uint64_t Count() const { return count.load(std::memory_order_relaxed); }
+    uint64_t Max() const { return max_ns.load(std::memory_order_relaxed); }
+
+    /// The upper edge of the bin holding fraction frac of the samples.
+    uint64_t Percentile(double frac) const {
+      uint64_t cnt = Count();
+      if (cnt == 0) {
+        return 0;
+      }
+      uint64_t target = uint64_t(frac * double(cnt));
+      if (target >= cnt) {
+        target = cnt - 1;
+      }
+      uint64_t seen = 0;
+      for (size_t b=0; b<bin_cnt; b++) {
+        seen += bins[b].load(std::memory_order_relaxed);
+        if (seen > target) {
+          uint64_t edge = BinUpper(b);
+          uint64_t max = Max();
+          return edge < max ? edge : max;
+        }
+      }
+      return Max();
+    }
+
+    /// Not atomic as a whole, so only for use between sessions.
+    void Reset() {
+      for (auto& bin : bins) {
+        bin.store(0, std::memory_order_relaxed);
+      }
+      count.store(0, std::memory_order_relaxed);
+      total_ns.store(0, std::memory_order_relaxed);
+      max_ns.store(0, std::memory_order_relaxed);
+    }
+
+    LatencySummary Summary() const {
+      LatencySummary sum;
+      sum.count = Count();
+      if (sum.count) {
+        sum.mean_ns = double(total_ns.load(std::memory_order_relaxed)) /
+          double(sum.count);
+      }
+      sum.p50_ns = Percentile(0.50);
+      sum.p99_ns = Percentile(0.99);
+      sum.max_ns = Max();
+      return sum;
+    }
+
+    protected:
+    static const unsigned sub_bits = 3;
+    static const unsigned max_msb = 40;
+    static const size_t bin_cnt = (max_msb - sub_bits + 2) << sub_bits;
+
+    static size_t BinOf(uint64_t ns) {
+      if (ns < (uint64_t(1) << sub_bits)) {
+        return size_t(ns);
+      }
+      unsigned msb = 63 - unsigned(__builtin_clzll(ns));
+      if (msb > max_msb) {
+        return bin_cnt - 1;
+      }
+      unsigned group = msb - sub_bits + 1;
+      size_t sub = size_t(ns >> (msb - sub_bits)) & ((1u << sub_bits) - 1);
+      return (size_t(group) << sub_bits) + sub;
+    }
+
+    static uint64_t BinUpper(size_t bin) {
+      size_t group = bin >> sub_bits;
+      uint64_t sub = bin & ((1u << sub_bits) - 1);
+      if (group == 0) {
+        return sub;
+      }
+      unsigned shift = unsigned(group) - 1;
+      return (((uint64_t(1) << sub_bits) + sub + 1) << shift) - 1;
+    }
+
+    std::atomic<uint64_t> bins[bin_cnt] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+  };
+
+
+  /// The timing of one task on one Worker.
+  class TaskStats {
+    public:
+    TaskStats(const RC::RStr& name) : name(name) { }
+
+    const RC::RStr name;
+    LatencyHistogram wait;  // From the call until the handler started.
+    LatencyHistogram run;   // Handler execution.
+    std::atomic<uint64_t> coalesced{0};  // Calls merged by a TaskCoalescer.
+  };
+
+
+  struct TaskStatsSummary {
+    RC::RStr name;
+    LatencySummary wait;
+    LatencySummary run;
+    uint64_t coalesced = 0;
+  };
+
+  struct WorkerStatsSummary {
+    RC::RStr name;
+    uint64_t queue_depth = 0;
+    uint64_t max_queue_depth = 0;
+    std::vector<TaskStatsSummary> tasks;
+  };
+}
+
+
+#endif // TASKSTATS_H
+
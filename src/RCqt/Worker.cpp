@@ -8,11 +8,17 @@
 
 #include "Worker.h"
 #include <QCoreApplication>
+#include <QMutexLocker>
 #include <QMetaType>
 #include <QObject>
+#ifdef RCQT_TASK_QUEUE
+#include <memory>
+#include <mutex>
+#endif
 
 
 namespace RCqt {
+  std::atomic<bool> Worker::stats_enabled{false};
   QMutex Worker::safe_delete;
   QMutex Worker::worker_map_mutex;
   Worker::MapType Worker::worker_map;
@@ -39,11 +45,18 @@ namespace RCqt {
 
     connect(this, &WorkerQObject::TerminateIfEmptySignal,
             this, &WorkerQObject::TerminateIfEmptySlot, Qt::QueuedConnection);
+
+    connect(this, &WorkerQObject::QueueReady,
+            this, &WorkerQObject::RunQueue, Qt::QueuedConnection);
   }
 
 
   Worker::Worker(bool run_as_new_thread)
-    : worker_qobject(this) {
+    : worker_qobject(this)
+#ifdef RCQT_TASK_QUEUE
+    , task_queue(task_queue_len)
+#endif
+    {
 
     worker_map_mutex.lock();
     worker_map.insert(MapPair(this, this));
@@ -58,6 +71,11 @@ namespace RCqt {
 
   Worker::~Worker() {
     ExitWait();
+#ifdef RCQT_TASK_QUEUE
+    // Also covers Workers never run as a thread, which CallExit skips.
+    abort_level.Disable();
+    DrainQueue();
+#endif
 
     worker_map_mutex.lock();
     worker_map.erase(this);
@@ -74,6 +92,146 @@ namespace RCqt {
   }
 
 
+#ifdef RCQT_TASK_QUEUE
+  void Worker::CommandEmitter(WorkerCommand* cmd,
+                              TaskType task_type) const {
+    std::unique_ptr<WorkerCommand> owned(cmd);
+
+    bool in_worker_thread =
+      QThread::currentThread() == worker_qobject.thread();
+    if ((direct_calling && KeepGoing()) || in_worker_thread) {
+      // Run now, as Qt's automatic connections do within one thread.
+      if (KeepGoing()) {
+        owned->Execute();
+      }
+      return;
+    }
+
+    if (IsDisabled()) {
+      return;  // Exited, so nothing would run it.
+    }
+
+    QSemaphore done;
+    if (task_type == BLOCKTASK) {
+      owned->done = &done;
+    }
+
+    // Back-pressure on the caller if the worker has fallen this far behind.
+    while ( ! task_queue.TryPush(owned.get()) ) {
+      if (IsDisabled()) {
+        return;  // Exiting, so owned is dropped, releasing done.
+      }
+      QThread::yieldCurrentThread();
+    }
+    owned.release();
+
+    if (IsDisabled()) {
+      // Exit may have drained the queue just before this push.
+      DrainQueue();
+    }
+    else {
+      ArmQueue();
+    }
+
+    if (task_type == BLOCKTASK) {
+      done.acquire();
+    }
+  }
+
+
+  void Worker::DrainQueue() const {
+    std::lock_guard<std::recursive_mutex> lock(queue_pop_mutex);
+    WorkerCommand* raw;
+    while (task_queue.TryPop(raw)) {
+      delete raw;  // Releases any blocked caller.
+    }
+  }
+
+
+  void Worker::ArmQueue() const {
+    // Only one wakeup is needed until RunQueue starts draining.
+    if ( ! queue_armed.exchange(true) ) {
+      worker_qobject.EmitQueueReady();
+    }
+  }
+#endif
+
+
+  TaskStats* Worker::RegisterTask(const char* handler_name) const {
+    if (handler_name == nullptr) {
+      return nullptr;
+    }
+
+    std::string full(handler_name);
+    std::string task_name = full;
+    size_t sep = full.rfind("::");
+    if (sep != std::string::npos) {
+      task_name = full.substr(sep+2);
+    }
+    const std::string suffix = "_Handler";
+    if (task_name.size() > suffix.size() &&
+        task_name.compare(task_name.size() - suffix.size(), suffix.size(),
+          suffix) == 0) {
+      task_name.resize(task_name.size() - suffix.size());
+    }
+
+    QMutexLocker lock(&stats_mutex);
+    if (stats_name.empty() && sep != std::string::npos) {
+      stats_name = full.substr(0, sep);
+    }
+    auto& entry = task_stats[task_name];
+    if ( ! entry ) {
+      entry.reset(new TaskStats(task_name));
+    }
+    return entry.get();
+  }
+
+
+  RC::RStr Worker::StatsName() const {
+    QMutexLocker lock(&stats_mutex);
+    return stats_name;
+  }
+
+
+  WorkerStatsSummary Worker::StatsSummary() const {
+    WorkerStatsSummary summary;
+    summary.queue_depth = task_count.Count();
+    summary.max_queue_depth = task_count.MaxCount();
+
+    QMutexLocker lock(&stats_mutex);
+    summary.name = stats_name;
+    for (auto& entry : task_stats) {
+      TaskStatsSummary task;
+      task.name = entry.second->name;
+      task.wait = entry.second->wait.Summary();
+      task.run = entry.second->run.Summary();
+      task.coalesced = entry.second->coalesced.load(std::memory_order_relaxed);
+      if (task.run.count > 0) {
+        summary.tasks.push_back(task);
+      }
+    }
+    return summary;
+  }
+
+
+  std::vector<WorkerStatsSummary> Worker::AllStatsSummaries() {
+    std::vector<WorkerStatsSummary> summaries;
+    safe_delete.lock();  // Do not destruct anything while iterating.
+    worker_map_mutex.lock();     // LOCK
+    MapType local_map = worker_map;
+    worker_map_mutex.unlock();   // UNLOCK
+
+    for (auto& entry : local_map) {
+      WorkerStatsSummary summary = entry.second->StatsSummary();
+      if ( ! summary.tasks.empty() ) {
+        summaries.push_back(summary);
+      }
+    }
+    safe_delete.unlock();
+    return summaries;
+  }
+
+
   void Worker::ExitAllWorkers() {
     bool empty = false;
     while (!empty) {
@@ -145,10 +303,15 @@ namespace RCqt {
 
   void WorkerQObject::CommandEmitter(RC::APtr<WorkerCommand> &cmd,
                                      TaskType task_type) const {
+#ifdef RCQT_TASK_QUEUE
+    // Keep these in order with the queued tasks.  The queue takes the
+    // command itself rather than a holder around it.
+    worker->CommandEmitter(cmd.Extract(), task_type);
+#else
     if (Worker::direct_calling && worker->KeepGoing()) {
       // To happen only if multithreading not active yet.
       // Enabled with Worker::DirectCallingScope
-      cmd->Run();
+      cmd->Execute();
     }
     else {
       switch(task_type) {
@@ -164,16 +327,51 @@ namespace RCqt {
         default:  Throw_RC_Error("Invalid emitter case");
       }
     }
+#endif
   }
 
 
   void WorkerQObject::CommandSlot(RC::APtr<WorkerCommand> cmd) const {
     if (worker->KeepGoing()) {
-      cmd->Run();
+      cmd->Execute();
     }
   }
 
 
+  void WorkerQObject::RunQueue() const {
+#ifdef RCQT_TASK_QUEUE
+    // Pair with the exchange in ArmQueue, so any push this drain misses
+    // raises a new QueueReady.
+    worker->queue_armed.exchange(false);
+
+    // Only against DrainQueue from an exiting caller.
+    std::lock_guard<std::recursive_mutex> lock(worker->queue_pop_mutex);
+
+    // Drain at most one queue length before yielding to other events.
+    size_t remaining = worker->task_queue.Capacity();
+    WorkerCommand* raw;
+    while (remaining > 0 && worker->task_queue.TryPop(raw)) {
+      remaining--;
+      std::unique_ptr<WorkerCommand> cmd(raw);
+      if (worker->KeepGoing()) {
+        try {
+          cmd->Execute();
+        }
+        catch (...) {
+          // Leave the rest of the queue to a later pass.
+          worker->ArmQueue();
+          throw;
+        }
+      }
+    }
+
+    if (remaining == 0) {
+      worker->ArmQueue();
+    }
+#endif
+  }
+
+
   void WorkerQObject::DoneAbort() {
     worker->abort_level.Lower();
   }
@@ -182,6 +380,10 @@ namespace RCqt {
   void WorkerQObject::CallExit() {
     bool do_terminate = false;
     worker->abort_level.Disable();
+#ifdef RCQT_TASK_QUEUE
+    // Nothing queued will run now, so free it and wake blocked callers.
+    worker->DrainQueue();
+#endif
     Worker::worker_map_mutex.lock();
     Worker::worker_map.erase(worker);
     if (Worker::terminate_when_done && Worker::worker_map.empty()) {
@@ -226,8 +428,26 @@ namespace RCqt {
     }
   }
 
+  void WorkerCommand::Execute() {
+    if (stats == nullptr) {
+      Run();
+      return;
+    }
+
+    uint64_t start_ns = TaskClockNs();
+    stats->wait.Record(start_ns - called_ns);
+    Run();
+    stats->run.Record(TaskClockNs() - start_ns);
+  }
+
+
   WorkerCommand::~WorkerCommand() {
     worker->task_count.Dec();
+#ifdef RCQT_TASK_QUEUE
+    if (done) {
+      done->release();
+    }
+#endif
   }
 }
 
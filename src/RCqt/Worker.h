@@ -50,6 +50,44 @@
 // TaskCaller<ParameterTypes...>              // This is asynchronous.
 // TaskBlocker<ParameterTypes...>             // This blocks until completion.
 // TaskGetter<ReturnType, ParameterTypes...>  // This blocks with return value.
+// TaskCoalescer<ParameterType>               // Asynchronous, merging calls.
+//
+// A TaskCoalescer is a TaskCaller with one by-value parameter for updates
+// where only the newest value matters.  While a call is still queued, later
+// calls replace its value instead of queuing again, or are merged into it
+// by a combine function, combine(pending, incoming), when one is given:
+//
+//   TaskCoalescer<const string> SetLabel =
+//     TaskHandler(MyWorker::SetLabel_Handler);
+//   TaskCoalescer<Block> AddBlock =
+//     CoalescingHandler(MyWorker::AddBlock_Handler,
+//                       RC::MakeCaller(&MyWorker::AppendBlock));
+//
+// The merged call runs at the queue position of the first call.  Copies of
+// a TaskCoalescer, including as a TaskCaller, share the pending value.
+// A second type parameter gives a different pending type, such as a list of
+// blocks to join in the handler, which then takes that type and is always
+// given a combine function:
+//
+//   TaskCoalescer<Block, std::vector<Block>> AddBlocks =
+//     CoalescingHandler(MyWorker::AddBlocks_Handler,
+//                       RC::MakeCaller(&MyWorker::QueueBlock));
+//
+// To avoid blocking on a busy Worker, TaskBlocker and TaskGetter also offer
+// Then(reply, params...), which returns immediately and later calls reply,
+// usually a TaskCaller of the calling Worker, with the return value (or no
+// value for TaskBlocker) once the handler has run:
+//
+//   TaskCaller<const string> GotString =
+//     TaskHandler(OtherWorker::GotString_Handler);
+//   ...
+//   my_worker.GetString.Then(GotString, 5);
+//
+// The reply then runs in the caller's own thread, in order with its other
+// tasks.  Parameters passed to Then must be by value.  If the handler
+// throws, the exception is reported as for any other task and the reply is
+// never called, so a caller that must know of a failure should treat the
+// work as not done until the reply arrives.
 //
 // Each caller must then be initialized to a handler with the TaskHandler
 // convenience macro, which takes a non-overloaded fully qualified member
@@ -86,6 +124,26 @@
 //   When TaskGetter's ReturnType is a reference, no copy constructors or
 //   assignment operators are called.
 //
+// Task queue backend:
+//
+//   By default each task is a heap allocated command emitted through a
+//   queued Qt signal.  Defining RCQT_TASK_QUEUE instead pushes commands,
+//   allocated from per-signature pools, onto a bounded lock-free queue
+//   owned by the target Worker.  A single queued Qt signal wakes the
+//   Worker's event loop when its queue goes from idle to busy, and the
+//   Worker then runs everything queued in order.  Tasks and handlers are
+//   written identically either way.
+//
+// Task statistics:
+//
+//   Tasks declared with TaskHandler are registered by name with their
+//   Worker.  While Worker::SetStatsEnabled(true) is in effect, each call
+//   records the time from the call until its handler starts and the time
+//   the handler runs, in lock-free histograms (see TaskStats.h).  These,
+//   with the current and maximum number of queued tasks, are available from
+//   Worker::StatsSummary and Worker::AllStatsSummaries.  When disabled, the
+//   cost per call is one relaxed atomic load.
+//
 ////////////////////////////////////////////////////////////////////////////
 
 
@@ -98,16 +156,29 @@
 #include "../RC/Caller.h"
 #include "../RC/RTime.h"
 #include "../RC/Tuple.h"
+#include "TaskStats.h"
+#include <atomic>
 #include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
 #include <QMutex>
 #include <QThread>
+#ifdef RCQT_TASK_QUEUE
+#include "TaskQueue.h"
+#include <mutex>
+#include <QSemaphore>
+#endif
 
 #ifndef CPP11
 #error "Error, C++11 is required."
 #endif
 
 
-#define TaskHandler(func) {this, RC::MakeCaller(this, &func)}
+#define TaskHandler(func) {this, RC::MakeCaller(this, &func), #func}
+#define CoalescingHandler(func, combine) \
+  {this, RC::MakeCaller(this, &func), combine, #func}
 
 namespace RCqt {
   enum TaskType { AUTOTASK, BLOCKTASK };
@@ -143,6 +214,11 @@ namespace RCqt {
     private slots:  void CallExit();
                     void TerminateIfEmptySlot();
 
+    // Used only with RCQT_TASK_QUEUE.
+    public:  void EmitQueueReady() const { emit QueueReady(); }
+    private: signals:  void QueueReady() const;
+    private slots:  void RunQueue() const;
+
     private:  RC::Ptr<Worker> worker;
   };
 
@@ -197,14 +273,21 @@ namespace RCqt {
 
     class TaskCount {
       public:
-      TaskCount() : count(0) {}
-      void Inc() { mutex.lock(); count++; mutex.unlock(); }
-      void Dec() { mutex.lock(); count--; mutex.unlock(); }
-      u64 Count() const {
-        u64 ret; mutex.lock(); ret=count; mutex.unlock(); return ret; }
+      TaskCount() : count(0), max_count(0) {}
+      void Inc() {
+        u64 now = count.fetch_add(1, std::memory_order_relaxed) + 1;
+        u64 prev = max_count.load(std::memory_order_relaxed);
+        while (now > prev && ! max_count.compare_exchange_weak(prev, now,
+              std::memory_order_relaxed)) { }
+      }
+      void Dec() { count.fetch_sub(1, std::memory_order_relaxed); }
+      u64 Count() const { return count.load(std::memory_order_relaxed); }
+      u64 MaxCount() const {
+        return max_count.load(std::memory_order_relaxed);
+      }
       private:
-      mutable QMutex mutex;
-      u64 count;
+      std::atomic<u64> count;
+      std::atomic<u64> max_count;
     };
 
 
@@ -213,8 +296,14 @@ namespace RCqt {
     Worker(bool run_as_new_thread=false);
     ~Worker();
 
+    // With RCQT_TASK_QUEUE, extracts cmd, leaving every copy of it NULL.
     void CommandEmitter(RC::APtr<WorkerCommand> &cmd,
                         TaskType task_type=AUTOTASK) const;
+#ifdef RCQT_TASK_QUEUE
+    // Takes ownership of cmd.
+    void CommandEmitter(WorkerCommand* cmd,
+                        TaskType task_type=AUTOTASK) const;
+#endif
 
     private:  // Disallow
     inline Worker(const Worker& other);
@@ -255,6 +344,30 @@ namespace RCqt {
     u64 NumTasks() const {
       return task_count.Count();
     }
+    u64 MaxNumTasks() const {
+      return task_count.MaxCount();
+    }
+
+    static void SetStatsEnabled(bool enabled) {
+      stats_enabled.store(enabled, std::memory_order_relaxed);
+    }
+    static bool StatsEnabled() {
+      return stats_enabled.load(std::memory_order_relaxed);
+    }
+
+    /// Find or create the statistics for the task with this handler name.
+    /** Names are of the form "Class::Method_Handler", as produced by
+     *  TaskHandler.  Returns nullptr for a nullptr name.
+     */
+    TaskStats* RegisterTask(const char* handler_name) const;
+
+    /// The name of this Worker, taken from its registered tasks.
+    RC::RStr StatsName() const;
+
+    /// The queue depth and the timing of each task called so far.
+    WorkerStatsSummary StatsSummary() const;
+    /// StatsSummary for every running Worker which has called a task.
+    static std::vector<WorkerStatsSummary> AllStatsSummaries();
 
 
     private:
@@ -267,6 +380,26 @@ namespace RCqt {
     TaskCount task_count;
     WorkerQObject worker_qobject;
 
+#ifdef RCQT_TASK_QUEUE
+    void ArmQueue() const;
+    // Deletes every queued command without running it.
+    void DrainQueue() const;
+
+    // Leftover commands are deleted by CallExit and the destructor.
+    mutable TaskQueue<WorkerCommand*> task_queue;
+    // Keeps DrainQueue from popping alongside RunQueue.  Recursive, as a
+    // task may exit its own Worker, which drains within RunQueue.
+    mutable std::recursive_mutex queue_pop_mutex;
+    // True while a QueueReady signal is pending.
+    mutable std::atomic<bool> queue_armed{false};
+    static const size_t task_queue_len = 4096;
+#endif
+
+    mutable QMutex stats_mutex;
+    mutable RC::RStr stats_name;
+    mutable std::map<std::string, std::unique_ptr<TaskStats>> task_stats;
+
+    static std::atomic<bool> stats_enabled;
     static QMutex safe_delete;
     static QMutex worker_map_mutex;
     static MapType worker_map;
@@ -283,13 +416,44 @@ namespace RCqt {
     }
     virtual ~WorkerCommand();
     virtual void Run() = 0;
+
+    /// Record the call time, if statistics are enabled.
+    void SetStats(TaskStats* task_stats) {
+      if (task_stats && Worker::StatsEnabled()) {
+        stats = task_stats;
+        called_ns = TaskClockNs();
+      }
+    }
+    /// Run, recording the statistics.
+    void Execute();
+
     private:
     WorkerCommand(const WorkerCommand& other);
     WorkerCommand& operator=(const WorkerCommand& other);
     RC::Ptr<Worker> worker;
+    TaskStats* stats = nullptr;
+    uint64_t called_ns = 0;
+#ifdef RCQT_TASK_QUEUE
+    friend Worker;
+    // Released on destruction, to wake a blocked caller.
+    QSemaphore* done = nullptr;
+#endif
   };
 
 
+#ifdef RCQT_TASK_QUEUE
+#define RCQT_POOLED_COMMAND(T) \
+    static void* operator new(size_t size) { \
+      return CommandPool<T>::Alloc(size); \
+    } \
+    static void operator delete(void* ptr, size_t size) { \
+      CommandPool<T>::Free(ptr, size); \
+    }
+#else
+#define RCQT_POOLED_COMMAND(T)
+#endif
+
+
   // Template for WorkerCommands containing parameters and handlers
 
   template<class RetType, class... Params>
@@ -307,6 +471,8 @@ namespace RCqt {
       retval = parameters.Apply(handler);
     }
 
+    RCQT_POOLED_COMMAND(CommandTempl)
+
     protected:
     u32 x;
     RC::Caller<RetType, Params&...> handler;
@@ -329,6 +495,8 @@ namespace RCqt {
       retval = &(parameters.Apply(handler));
     }
 
+    RCQT_POOLED_COMMAND(CommandTempl)
+
     protected:
     u32 x;
     RC::Caller<RetType&, Params&...> handler;
@@ -350,6 +518,8 @@ namespace RCqt {
       parameters.Apply(handler);
     }
 
+    RCQT_POOLED_COMMAND(CommandTempl)
+
     protected:
     bool tmp;
     u32 x;
@@ -358,6 +528,208 @@ namespace RCqt {
   };
 
 
+  // Commands for Then, which pass the handler's result on to a reply task.
+
+  template<class RetType, class Reply, class... Params>
+  class ReplyCommandTempl : public WorkerCommand {
+    public:
+    ReplyCommandTempl(RC::Ptr<Worker> worker, RC::Caller<RetType,
+                      Params&...> handler, const Reply& reply,
+                      Params&... params)
+      : WorkerCommand(worker)
+      , handler(handler)
+      , reply(reply)
+      , parameters(params...) {
+    }
+
+    virtual void Run() {
+      RetType retval = parameters.Apply(handler);
+      reply(retval);
+    }
+
+    RCQT_POOLED_COMMAND(ReplyCommandTempl)
+
+    protected:
+    RC::Caller<RetType, Params&...> handler;
+    Reply reply;
+    RC::Tuple<Params...> parameters;
+  };
+
+  template<class Reply, class... Params>
+  class ReplyCommandTempl<void, Reply, Params...> : public WorkerCommand {
+    public:
+    ReplyCommandTempl(RC::Ptr<Worker> worker, RC::Caller<void, Params&...>
+                      handler, const Reply& reply, Params&... params)
+      : WorkerCommand(worker)
+      , handler(handler)
+      , reply(reply)
+      , parameters(params...) {
+    }
+
+    virtual void Run() {
+      parameters.Apply(handler);
+      reply();
+    }
+
+    RCQT_POOLED_COMMAND(ReplyCommandTempl)
+
+    protected:
+    RC::Caller<void, Params&...> handler;
+    Reply reply;
+    RC::Tuple<Params...> parameters;
+  };
+
+  // True if any of the types is a reference.
+  template<class... Types>
+  struct AnyReference : std::false_type { };
+  template<class Type, class... Types>
+  struct AnyReference<Type, Types...>
+    : std::integral_constant<bool, std::is_reference<Type>::value ||
+                                   AnyReference<Types...>::value> { };
+
+  template<class RetType, class Reply, class... Params>
+  void EmitReplyCommand(const RC::Ptr<Worker>& worker, TaskStats* stats,
+      const RC::Caller<RetType, Params&...>& handler, const Reply& reply,
+      Params&... params) {
+    static_assert( ! AnyReference<Params...>::value,
+        "Then requires a Task with all parameters by value.");
+#ifdef RCQT_TASK_QUEUE
+    auto cmd = new ReplyCommandTempl<RetType, Reply, Params...>
+            (worker, handler, reply, params...);
+    cmd->SetStats(stats);
+    worker->CommandEmitter(cmd, AUTOTASK);
+#else
+    RC::APtr<WorkerCommand> cmd =
+      new ReplyCommandTempl<RetType, Reply, Params...>
+            (worker, handler, reply, params...);
+    cmd->SetStats(stats);
+    worker->CommandEmitter(cmd, AUTOTASK);
+#endif
+  }
+
+
+  // The shared pending value of a TaskCoalescer.
+
+  template<class... Params>
+  class CoalesceState {
+    public:
+    virtual ~CoalesceState() { }
+
+    // Only single parameter tasks coalesce, so this is never reached.
+    virtual void Call(const RC::Ptr<Worker>&, TaskStats*, Params&...) { }
+
+    u64 CoalescedCount() const {
+      return coalesced.load(std::memory_order_relaxed);
+    }
+
+    protected:
+    std::atomic<u64> coalesced{0};
+  };
+
+  template<class T, class Pending>
+  class CoalesceQueue
+    : public CoalesceState<T>
+    , public std::enable_shared_from_this<CoalesceQueue<T, Pending>> {
+    public:
+    // The handler takes T itself when the pending value is just the
+    // newest T.
+    typedef typename std::conditional<std::is_same<Pending,
+      typename std::remove_const<T>::type>::value, T, Pending>::type
+      Delivered;
+    typedef RC::Caller<void, Delivered&> Handler;
+    typedef RC::Caller<void, Pending&, T&> Combiner;
+
+    CoalesceQueue(const Handler& handler, const Combiner& combine)
+      : handler(handler), combine(combine) { }
+
+    void Call(const RC::Ptr<Worker>& worker, TaskStats* stats,
+              T& param) override;
+
+    /// Take the pending value, leaving it empty, so later calls queue
+    /// again.
+    Pending Take() {
+      mutex.lock();
+      Pending taken = std::move(value);
+      value = Pending();
+      pending = false;
+      mutex.unlock();
+      return taken;
+    }
+
+    void Run(Pending& value) {
+      handler(value);
+    }
+
+    protected:
+    // A first value is stored as is when it can be, and later ones are
+    // combined into it, or replace it without a combine function.
+    void Merge(T& param, bool first) {
+      if constexpr (std::is_assignable<Pending&, T&>::value) {
+        if (first || ! combine.IsSet()) {
+          value = param;
+          return;
+        }
+      }
+      combine(value, param);
+    }
+
+    QMutex mutex;
+    bool pending = false;
+    Pending value;
+    Handler handler;
+    Combiner combine;
+  };
+
+  template<class T, class Pending>
+  class CoalesceCommand : public WorkerCommand {
+    public:
+    CoalesceCommand(RC::Ptr<Worker> worker,
+                    std::shared_ptr<CoalesceQueue<T, Pending>> state)
+      : WorkerCommand(worker)
+      , state(state) {
+    }
+
+    virtual void Run() {
+      Pending value = state->Take();
+      state->Run(value);
+    }
+
+    RCQT_POOLED_COMMAND(CoalesceCommand)
+
+    protected:
+    std::shared_ptr<CoalesceQueue<T, Pending>> state;
+  };
+
+  template<class T, class Pending>
+  void CoalesceQueue<T, Pending>::Call(const RC::Ptr<Worker>& worker,
+      TaskStats* stats, T& param) {
+    mutex.lock();
+    Merge(param, ! pending);
+    if (pending) {
+      mutex.unlock();
+      this->coalesced.fetch_add(1, std::memory_order_relaxed);
+      if (stats) {
+        stats->coalesced.fetch_add(1, std::memory_order_relaxed);
+      }
+      return;
+    }
+    pending = true;
+    mutex.unlock();
+
+#ifdef RCQT_TASK_QUEUE
+    auto cmd = new CoalesceCommand<T, Pending>(worker,
+        this->shared_from_this());
+    cmd->SetStats(stats);
+    worker->CommandEmitter(cmd, AUTOTASK);
+#else
+    RC::APtr<WorkerCommand> cmd = new CoalesceCommand<T, Pending>(worker,
+        this->shared_from_this());
+    cmd->SetStats(stats);
+    worker->CommandEmitter(cmd, AUTOTASK);
+#endif
+  }
+
+
   // The TaskCaller, TaskBlocker, and TaskGetter template classes.
 
   template<TaskType task_type, class... Params>
@@ -365,23 +737,37 @@ namespace RCqt {
     public:
     BaseTaskClass() { }
     BaseTaskClass(const RC::Ptr<Worker>& worker,
-                  const RC::Caller<void, Params&...>& handler)
+                  const RC::Caller<void, Params&...>& handler,
+                  const char* name=nullptr)
       : worker(worker)
-      , handler(handler) {
+      , handler(handler)
+      , name(name)
+      , stats(worker->RegisterTask(name)) {
     }
 
     virtual void operator()(Params&... params) const {
+      if (coalesce) {
+        coalesce->Call(worker, stats, params...);
+        return;
+      }
+#ifdef RCQT_TASK_QUEUE
+      auto cmd = new CommandTempl<void, Params...>(worker, handler, params...);
+      cmd->SetStats(stats);
+      worker->CommandEmitter(cmd, task_type);
+#else
       RC::APtr<WorkerCommand> cmd =
         new CommandTempl<void, Params...>(worker, handler, params...);
+      cmd->SetStats(stats);
       worker->CommandEmitter(cmd, task_type);
+#endif
     }
 
     virtual RC::CallerBase<void, Params&...>* Copy() const {
-      return new BaseTaskClass<task_type, Params...>(worker, handler);
+      return new BaseTaskClass<task_type, Params...>(*this);
     }
 
     /// Call the referenced function.
-    virtual bool IsSet() { return handler.IsSet(); }
+    virtual bool IsSet() { return handler.IsSet() || coalesce; }
     
     // TODO: JPB: (feature) Fix Use and Bind
     ///// Call the referenced function with the parameters given as RC::Tuple
@@ -402,19 +788,52 @@ namespace RCqt {
     protected:
     RC::Ptr<Worker> worker;
     RC::Caller<void, Params&...> handler;
+    const char* name = nullptr;
+    TaskStats* stats = nullptr;
+    // Set only by TaskCoalescer.
+    std::shared_ptr<CoalesceState<Params...>> coalesce;
   };
 
   template<class... Params>
   class TaskCaller : public BaseTaskClass<AUTOTASK, Params...> {
     public:
     TaskCaller() { }
-    TaskCaller(RC::Ptr<Worker> worker, RC::Caller<void, Params&...> handler)
-      : BaseTaskClass<AUTOTASK, Params...>(worker, handler) {
+    TaskCaller(RC::Ptr<Worker> worker, RC::Caller<void, Params&...> handler,
+               const char* name=nullptr)
+      : BaseTaskClass<AUTOTASK, Params...>(worker, handler, name) {
     }
     virtual RC::CallerBase<void, Params&...>* Copy() const {
-      return new TaskCaller<Params...>(
-          BaseTaskClass<AUTOTASK, Params...>::worker,
-          BaseTaskClass<AUTOTASK, Params...>::handler);
+      return new TaskCaller<Params...>(*this);
+    }
+  };
+
+  template<class T, class Pending = typename std::remove_const<T>::type>
+  class TaskCoalescer : public TaskCaller<T> {
+    public:
+    typedef CoalesceQueue<T, Pending> Queue;
+
+    TaskCoalescer() { }
+    /// The newest call's value wins.
+    TaskCoalescer(RC::Ptr<Worker> worker,
+                  typename Queue::Handler handler,
+                  const char* name=nullptr)
+      : TaskCoalescer(worker, handler, typename Queue::Combiner(), name) {
+    }
+    /// Calls are merged with combine(pending, incoming).
+    TaskCoalescer(RC::Ptr<Worker> worker,
+                  typename Queue::Handler handler,
+                  typename Queue::Combiner combine,
+                  const char* name=nullptr)
+      : TaskCaller<T>(worker, RC::Caller<void, T&>(), name) {
+      this->coalesce = std::make_shared<Queue>(handler, combine);
+    }
+    virtual RC::CallerBase<void, T&>* Copy() const {
+      return new TaskCoalescer<T, Pending>(*this);
+    }
+
+    /// The number of calls merged into an already queued call.
+    u64 CoalescedCount() const {
+      return this->coalesce ? this->coalesce->CoalescedCount() : 0;
     }
   };
 
@@ -422,13 +841,22 @@ namespace RCqt {
   class TaskBlocker : public BaseTaskClass<BLOCKTASK, Params...> {
     public:
     TaskBlocker() { }
-    TaskBlocker(RC::Ptr<Worker> worker, RC::Caller<void, Params&...> handler)
-      : BaseTaskClass<BLOCKTASK, Params...>(worker, handler) {
+    TaskBlocker(RC::Ptr<Worker> worker, RC::Caller<void, Params&...> handler,
+               const char* name=nullptr)
+      : BaseTaskClass<BLOCKTASK, Params...>(worker, handler, name) {
     }
     virtual RC::CallerBase<void, Params&...>* Copy() const {
-      return new TaskBlocker<Params...>(
+      return new TaskBlocker<Params...>(*this);
+    }
+
+    /// Without blocking, run the handler and then call done().
+    /** done is not called if the handler throws. */
+    template<class Reply>
+    void Then(const Reply& done, Params&... params) const {
+      EmitReplyCommand<void, Reply, Params...>(
           BaseTaskClass<BLOCKTASK, Params...>::worker,
-          BaseTaskClass<BLOCKTASK, Params...>::handler);
+          BaseTaskClass<BLOCKTASK, Params...>::stats,
+          BaseTaskClass<BLOCKTASK, Params...>::handler, done, params...);
     }
   };
 
@@ -436,24 +864,45 @@ namespace RCqt {
   class TaskGetter : public RC::CallerBase<RetType, Params&...> {
     public:
     TaskGetter() { }
-    TaskGetter(RC::Ptr<Worker> worker, RC::Caller<RetType, Params&...> handler)
+    TaskGetter(RC::Ptr<Worker> worker, RC::Caller<RetType, Params&...> handler,
+               const char* name=nullptr)
       : worker(worker)
-      , handler(handler) {
+      , handler(handler)
+      , name(name)
+      , stats(worker->RegisterTask(name)) {
     }
     virtual RetType operator()(Params&... params) const {
       RetType retval;
+#ifdef RCQT_TASK_QUEUE
+      auto cmd = new CommandTempl<RetType, Params...>
+              (worker, handler, retval, params...);
+      cmd->SetStats(stats);
+      worker->CommandEmitter(cmd, BLOCKTASK);
+#else
       RC::APtr<WorkerCommand> cmd =
         new CommandTempl<RetType, Params...>
               (worker, handler, retval, params...);
+      cmd->SetStats(stats);
       worker->CommandEmitter(cmd, BLOCKTASK);
+#endif
       return retval;
     }
     virtual RC::CallerBase<RetType, Params&...>* Copy() const {
-      return new TaskGetter<RetType, Params...>(worker, handler);
+      return new TaskGetter<RetType, Params...>(*this);
+    }
+
+    /// Without blocking, run the handler and then call reply(retval).
+    /** reply is not called if the handler throws. */
+    template<class Reply>
+    void Then(const Reply& reply, Params&... params) const {
+      EmitReplyCommand<RetType, Reply, Params...>(worker, stats, handler,
+          reply, params...);
     }
     protected:
     RC::Ptr<Worker> worker;
     RC::Caller<RetType, Params&...> handler;
+    const char* name = nullptr;
+    TaskStats* stats = nullptr;
   };
 
 
@@ -462,24 +911,37 @@ namespace RCqt {
       : public RC::CallerBase<RetType&, Params&...> {
     public:
     TaskGetter() { }
-    TaskGetter(RC::Ptr<Worker> worker, RC::Caller<RetType&, Params&...> handler)
+    TaskGetter(RC::Ptr<Worker> worker, RC::Caller<RetType&, Params&...> handler,
+               const char* name=nullptr)
       : worker(worker)
-      , handler(handler) {
+      , handler(handler)
+      , name(name)
+      , stats(worker->RegisterTask(name)) {
     }
     virtual RetType& operator()(Params&... params) const {
       RC::Ptr<RetType> retval;
+#ifdef RCQT_TASK_QUEUE
+      auto cmd = new CommandTempl<RetType&, Params...>
+              (worker, handler, retval, params...);
+      cmd->SetStats(stats);
+      worker->CommandEmitter(cmd, BLOCKTASK);
+#else
       RC::APtr<WorkerCommand> cmd =
         new CommandTempl<RetType&, Params...>
               (worker, handler, retval, params...);
+      cmd->SetStats(stats);
       worker->CommandEmitter(cmd, BLOCKTASK);
+#endif
       return *retval;
     }
     virtual RC::CallerBase<RetType&, Params&...>* Copy() const {
-      return new TaskGetter<RetType&, Params...>(worker, handler);
+      return new TaskGetter<RetType&, Params...>(*this);
     }
     protected:
     RC::Ptr<Worker> worker;
     RC::Caller<RetType&, Params&...> handler;
+    const char* name = nullptr;
+    TaskStats* stats = nullptr;
   };
 
 
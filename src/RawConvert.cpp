@@ -0,0 +1,249 @@
+// elemem_rawconvert - Converts an Elemem raw session file to EDF or HDF5.
+//
+// Usage:  elemem_rawconvert eeg_data.elraw eeg_data.edf
+//         elemem_rawconvert eeg_data.elraw eeg_data.h5
+//
+// Gaps between blocks are filled with zeros and marked, and a damaged or
+// unfinished final block ends the conversion with a warning.
+
+#include "edflib/edflib.h"
+#include "RawSession.h"
+#include "RC/RC.h"
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#ifndef NO_HDF5
+#include <H5Cpp.h>
+#endif
+
+using namespace CML;
+
+namespace {
+  /// Calls back with every block in order, with gaps zero filled.
+  /** @return The total number of samples per channel. */
+  template<class F>
+  uint64_t ForEachSpan(RawSessionReader& reader, F func) {
+    const RawSessionInfo& info = reader.Info();
+    RawBlock block;
+    RC::Data1D<int16_t> zeros;
+    uint64_t next_sample = 0;
+
+    while (reader.ReadBlock(block)) {
+      if (block.first_sample > next_sample) {
+        uint64_t gap = block.first_sample - next_sample;
+        std::cerr << "Warning:  " << gap << " samples missing before sample "
+          << block.first_sample << ", filled with zeros." << std::endl;
+        zeros.Resize(size_t(gap) * info.ChanCount());
+        zeros.Zero();
+        func(zeros.Raw(), size_t(gap), true);
+        next_sample = block.first_sample;
+      }
+      else if (block.first_sample < next_sample) {
+        Throw_RC_Type(File, ("Block " + RC::RStr(block.seq) + " overlaps "
+              "earlier data").c_str());
+      }
+      func(block.samples.Raw(), block.sample_count, false);
+      next_sample += block.sample_count;
+    }
+
+    if (reader.Truncated()) {
+      std::cerr << "Warning:  The file ends in a damaged or incomplete "
+        "block, which was skipped." << std::endl;
+    }
+    return next_sample;
+  }
+
+
+  /// Closes an edflib handle on leaving scope, including by exception.
+  class EDFCloser {
+    public:
+    explicit EDFCloser(int edf_hdl) : edf_hdl(edf_hdl) { }
+    ~EDFCloser() { edfclose_file(edf_hdl); }
+
+    // Rule of 3.
+    EDFCloser(const EDFCloser&) = delete;
+    EDFCloser& operator=(const EDFCloser&) = delete;
+
+    private:
+    int edf_hdl;
+  };
+
+
+  void ToEDF(RawSessionReader& reader, const RC::RStr& out_file) {
+    const RawSessionInfo& info = reader.Info();
+    size_t chan_count = info.ChanCount();
+    size_t sampling_rate = info.sampling_rate;
+
+    int edf_hdl = edfopen_file_writeonly(out_file.c_str(),
+        EDFLIB_FILETYPE_EDFPLUS, int(chan_count));
+    if (edf_hdl < 0) {
+      Throw_RC_Type(File,
+          (RC::RStr("Could not open ")+out_file+" for edf writing").c_str());
+    }
+    EDFCloser closer(edf_hdl);
+
+    // Matches the header EDFSave writes.
+    size_t datarecord_len = sampling_rate;
+    if (sampling_rate > 10000) {
+      datarecord_len = sampling_rate / 10;
+      if (edf_set_datarecord_duration(edf_hdl, 10000)) {
+        Throw_RC_Type(File, "Could not set edf data record duration");
+      }
+    }
+
+    // In local time, as edflib dates the files EDFSave writes.
+    time_t start_sec = time_t(info.start_time_ns / 1000000000ull);
+    struct tm start_tm = *localtime(&start_sec);
+    edf_set_startdatetime(edf_hdl, start_tm.tm_year + 1900,
+        start_tm.tm_mon + 1, start_tm.tm_mday, start_tm.tm_hour,
+        start_tm.tm_min, start_tm.tm_sec);
+
+    for (size_t c=0; c<chan_count; c++) {
+      int ci = int(c);
+      if (edf_set_samplefrequency(edf_hdl, ci, int(datarecord_len)) ||
+          edf_set_digital_maximum(edf_hdl, ci, 32767) ||
+          edf_set_digital_minimum(edf_hdl, ci, -32768) ||
+          edf_set_physical_maximum(edf_hdl, ci, 32767) ||
+          edf_set_physical_minimum(edf_hdl, ci, -32768) ||
+          edf_set_physical_dimension(edf_hdl, ci, "250nV") ||
+          edf_set_label(edf_hdl, ci, info.labels[c].c_str())) {
+        Throw_RC_Type(File, "Could not set edf channel parameters");
+      }
+    }
+    edf_set_equipment(edf_hdl, "Elemem using Blackrock NeuroPort");
+    edf_set_patientname(edf_hdl, info.subject.c_str());
+    edfwrite_annotation_utf8(edf_hdl, 0LL, -1LL,
+        (RC::RStr("Sampling rate: ")+RC::RStr(sampling_rate)).c_str());
+    edfwrite_annotation_utf8(edf_hdl, 0LL, -1LL, "Recording starts");
+
+    RC::Data1D<int16_t> record(chan_count * datarecord_len);
+    size_t fill = 0;
+    uint64_t total = 0;
+
+    auto write_record = [&]() {
+      if (edf_blockwrite_digital_short_samples(edf_hdl, record.Raw())) {
+        Throw_RC_Type(File, "Could not save data to edf file");
+      }
+      fill = 0;
+    };
+
+    uint64_t amount = ForEachSpan(reader,
+        [&](const int16_t* samples, size_t count, bool gap) {
+      if (gap) {
+        edfwrite_annotation_utf8(edf_hdl,
+            static_cast<long long>(total * 10000 / sampling_rate), -1LL,
+            "Samples missing");
+      }
+      size_t pos = 0;
+      while (pos < count) {
+        size_t amnt = std::min(count - pos, datarecord_len - fill);
+        for (size_t c=0; c<chan_count; c++) {
+          const int16_t* src = samples + c*count + pos;
+          std::copy(src, src + amnt,
+              record.Raw() + c*datarecord_len + fill);
+        }
+        pos += amnt;
+        fill += amnt;
+        total += amnt;
+        if (fill == datarecord_len) {
+          write_record();
+        }
+      }
+    });
+
+    // EDF only holds whole records, so zero pad the last one.
+    if (fill > 0) {
+      for (size_t c=0; c<chan_count; c++) {
+        std::fill(record.Raw() + c*datarecord_len + fill,
+            record.Raw() + (c+1)*datarecord_len, int16_t(0));
+      }
+      write_record();
+    }
+
+    edfwrite_annotation_utf8(edf_hdl,
+        static_cast<long long>(amount * 10000 / sampling_rate), -1LL,
+        "Recording ends");
+  }
+
+
+#ifndef NO_HDF5
+  void ToHDF5(RawSessionReader& reader, const RC::RStr& out_file) {
+    const RawSessionInfo& info = reader.Info();
+    hsize_t chan_count = info.ChanCount();
+
+    H5::H5File hdf_file(out_file.c_str(), H5F_ACC_TRUNC);
+
+    const size_t num_dims = 2;
+    hsize_t cur_dims[num_dims] = {chan_count, 0};
+    hsize_t max_dims[num_dims] = {chan_count, H5S_UNLIMITED};
+    hsize_t chunk_dims[num_dims] = {chan_count,
+      std::max(hsize_t(1), hsize_t(info.sampling_rate))};
+
+    int fill_value = 0;
+    H5::DSetCreatPropList prop_list;
+    prop_list.setFillValue(H5::PredType::NATIVE_INT16, &fill_value);
+    prop_list.setChunk(num_dims, chunk_dims);
+
+    H5::DataSpace file_space(num_dims, cur_dims, max_dims);
+    H5::DataSet data_set = hdf_file.createDataSet("data",
+        H5::PredType::NATIVE_INT16, file_space, prop_list);
+    H5::Attribute sr_attr = data_set.createAttribute("samplerate",
+        H5::PredType::NATIVE_DOUBLE, H5::DataSpace(H5S_SCALAR));
+    f64 sr_f64 = info.sampling_rate;
+    sr_attr.write(H5::PredType::NATIVE_DOUBLE, &sr_f64);
+
+    hsize_t total = 0;
+    ForEachSpan(reader,
+        [&](const int16_t* samples, size_t count, bool /*gap*/) {
+      hsize_t new_dims[num_dims] = {chan_count, total + count};
+      data_set.extend(new_dims);
+
+      H5::DataSpace dest = data_set.getSpace();
+      hsize_t start[num_dims] = {0, total};
+      hsize_t span[num_dims] = {chan_count, count};
+      dest.selectHyperslab(H5S_SELECT_SET, span, start);
+      H5::DataSpace src(num_dims, span);
+      data_set.write(samples, H5::PredType::NATIVE_INT16, src, dest);
+
+      total += count;
+    });
+  }
+#endif // NO_HDF5
+}
+
+
+int main(int argc, char* argv[]) {
+  try {
+    if (argc != 3) {
+      std::cerr << "Usage:  " << argv[0] << " input.elraw output.edf|"
+        "output.h5" << std::endl;
+      return 1;
+    }
+
+    RC::RStr in_file = argv[1];
+    RC::RStr out_file = argv[2];
+    RC::RStr ext = out_file.substr(out_file.find_last_of(".") + 1);
+    ext.ToLower();
+
+    RawSessionReader reader;
+    reader.Open(in_file);
+
+    if (ext == "edf") {
+      ToEDF(reader, out_file);
+    }
+    else if (ext == "h5" || ext == "hdf5") {
+#ifndef NO_HDF5
+      ToHDF5(reader, out_file);
+#else
+      Throw_RC_Type(File, "This build does not have HDF5 support.");
+#endif
+    }
+    else {
+      Throw_RC_Type(File, "The output file must end in .edf or .h5");
+    }
+  }
+  Catch_RC_Error_Exit();
+
+  return 0;
+}
+
@@ -0,0 +1,145 @@
+#include "RawSave.h"
+#include "EEGAcq.h"
+#include "Handler.h"
+#include "ConfigFile.h"
+#include <algorithm>
+#include <chrono>
+
+namespace CML {
+  namespace {
+    uint64_t UnixTimeNs() {
+      return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+  }
+
+
+  void RawSave::StartFile_Handler(const RC::RStr& filename,
+                                  const FullConf& conf) {
+    if (conf.elec_config.IsNull()) {
+      Throw_RC_Error("Cannot save data with no channels set");
+    }
+    if (conf.exp_config.IsNull()) {
+      Throw_RC_Error("Cannot save data with no experiment config");
+    }
+
+    StopSaving_Handler();
+
+    RawSessionInfo info;
+    info.sampling_rate = uint32_t(sampling_rate);
+    info.start_time_ns = UnixTimeNs();
+    info.codec = compress ? RawSession::codec_lossless :
+      RawSession::codec_none;
+    std::string sub_name;
+    conf.exp_config->Get(sub_name, "subject");
+    info.subject = sub_name;
+
+    channels.Resize(conf.elec_config->data.size2());
+    info.sources.Resize(channels.size());
+    info.labels.Resize(channels.size());
+    for (size_t c=0; c<channels.size(); c++) {
+      channels[c] = uint8_t(conf.elec_config->data[c][1].Get_u32() - 1);
+      info.sources[c] = channels[c];
+      info.labels[c] = conf.elec_config->data[c][0];
+    }
+
+    writer.Open(filename, info);
+
+    block_len = std::max(size_t(1), sampling_rate * block_ms / 1000);
+    block.Resize(channels.size() * block_len);
+    block_fill = 0;
+    amount_saved = 0;
+
+    hndl->eeg_acq.RegisterEEGMonoCallback(callback_ID, SaveData);
+  }
+
+
+  void RawSave::StopSaving_Handler() {
+    hndl->eeg_acq.RemoveEEGMonoCallback(callback_ID);
+
+    if (writer.IsOpen()) {
+      // The final block may be short.
+      try {
+        WriteBlock();
+      }
+      catch (...) {
+        // Can be a destructor cleanup call.  Earlier blocks are intact.
+      }
+      writer.Close();
+    }
+  }
+
+
+  void RawSave::SaveData_Handler(RC::APtr<const EEGData>& data) {
+    auto& datar = data->data;
+    if ( ! writer.IsOpen() ) {
+      StopSaving_Handler();
+      return;
+    }
+
+    size_t block_amnt = 0;
+    for (size_t c=0; c<channels.size(); c++) {
+      if (channels[c] >= datar.size()) {
+        StopSaving_Handler();
+        Throw_RC_Type(File, ("Raw save, configured channel " +
+              RC::RStr(c+1) + " out of bounds").c_str());
+      }
+      block_amnt = std::max(block_amnt, datar[channels[c]].size());
+    }
+    for (size_t c=0; c<channels.size(); c++) {
+      if (datar[channels[c]].size() != block_amnt) {
+        StopSaving_Handler();
+        Throw_RC_Type(File,
+            ("Data missing on raw save, channel " + RC::RStr(c+1)).c_str());
+      }
+    }
+
+    size_t pos = 0;
+    while (pos < block_amnt) {
+      if (block_fill == 0) {
+        block_first = amount_saved;
+        block_time_ns = UnixTimeNs();
+      }
+
+      size_t amnt = std::min(block_amnt - pos, block_len - block_fill);
+      for (size_t c=0; c<channels.size(); c++) {
+        const int16_t* src = datar[channels[c]].Raw() + pos;
+        std::copy(src, src + amnt, block.Raw() + c*block_len + block_fill);
+      }
+      pos += amnt;
+      block_fill += amnt;
+      amount_saved += amnt;
+
+      if (block_fill == block_len) {
+        try {
+          WriteBlock();
+        }
+        catch (...) {
+          StopSaving_Handler();
+          throw;
+        }
+      }
+    }
+  }
+
+
+  void RawSave::WriteBlock() {
+    if (block_fill == 0) {
+      return;
+    }
+
+    if (block_fill < block_len) {
+      // Close up the channel stride for a short final block.
+      for (size_t c=1; c<channels.size(); c++) {
+        std::copy(block.Raw() + c*block_len,
+            block.Raw() + c*block_len + block_fill,
+            block.Raw() + c*block_fill);
+      }
+    }
+
+    size_t fill = block_fill;
+    block_fill = 0;
+    writer.WriteBlock(block.Raw(), fill, block_first, block_time_ns);
+  }
+}
+
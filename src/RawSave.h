@@ -0,0 +1,55 @@
+#ifndef RAWSAVE_H
+#define RAWSAVE_H
+
+#include "EEGFileSave.h"
+#include "RawSession.h"
+#include "RC/Ptr.h"
+
+namespace CML {
+  class Handler;
+
+  /// Saves EEG data in the Elemem raw session format.
+  /** Samples are gathered into blocks of block_ms, and each block is
+   *  written and flushed as one aligned, checksummed frame, optionally
+   *  compressed losslessly with EEGCodec.  Convert to EDF or HDF5
+   *  afterwards with elemem_rawconvert.
+   */
+  class RawSave : public EEGFileSave {
+    public:
+    RawSave(RC::Ptr<Handler> hndl, size_t sampling_rate, size_t block_ms,
+            bool compress)
+      : EEGFileSave(hndl), sampling_rate(sampling_rate),
+        block_ms(block_ms), compress(compress) {
+      callback_ID = RC::RStr("RawSave_") + RC::RStr(sampling_rate);
+    }
+
+    RC::RStr GetExt() const override { return "elraw"; }
+
+    protected:
+    void StartFile_Handler(const RC::RStr& filename,
+                           const FullConf& conf) override;
+    // Thread ordering constraint:
+    // Must call Stop after Start, before this destructor, and before
+    // hndl->eeg_acq is deleted.
+    void StopSaving_Handler() override;
+    void SaveData_Handler(RC::APtr<const EEGData>& data) override;
+
+    void WriteBlock();
+
+    RawSessionWriter writer;
+    RC::Data1D<uint8_t> channels;
+    RC::Data1D<int16_t> block;  // Channel-major, block_len per channel.
+    size_t block_len = 0;
+    size_t block_fill = 0;
+    uint64_t block_first = 0;
+    uint64_t block_time_ns = 0;
+    uint64_t amount_saved = 0;
+    size_t sampling_rate;
+    size_t block_ms;
+    bool compress;
+    RC::RStr callback_ID;
+  };
+}
+
+#endif // RAWSAVE_H
+
@@ -0,0 +1,439 @@
+#include "RawSession.h"
+#include "EEGCodec.h"
+#include "RC/Errors.h"
+#include <array>
+#include <cerrno>
+#include <cstring>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace CML {
+  namespace RawSession {
+    uint32_t CRC32(const void* data, size_t len, uint32_t crc) {
+      static const auto table = []() {
+        std::array<uint32_t, 256> tbl;
+        for (uint32_t i=0; i<256; i++) {
+          uint32_t c = i;
+          for (int k=0; k<8; k++) {
+            c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+          }
+          tbl[i] = c;
+        }
+        return tbl;
+      }();
+
+      const uint8_t* bytes = static_cast<const uint8_t*>(data);
+      crc = ~crc;
+      for (size_t i=0; i<len; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+      }
+      return ~crc;
+    }
+  }
+
+
+  namespace {
+    void SeekTo(FILE* fp, uint64_t offset) {
+#ifdef WIN32
+      _fseeki64(fp, int64_t(offset), SEEK_SET);
+#else
+      fseeko(fp, off_t(offset), SEEK_SET);
+#endif
+    }
+
+    uint64_t FileSize(FILE* fp) {
+#ifdef WIN32
+      _fseeki64(fp, 0, SEEK_END);
+      return uint64_t(_ftelli64(fp));
+#else
+      fseeko(fp, 0, SEEK_END);
+      return uint64_t(ftello(fp));
+#endif
+    }
+
+    void CopyStr(char* dest, const RC::RStr& src, size_t len) {
+      std::memset(dest, 0, len);
+      std::strncpy(dest, src.c_str(), len-1);
+    }
+
+    RC::RStr ReadStr(const char* src, size_t len) {
+      return RC::RStr(std::string(src, strnlen(src, len)));
+    }
+  }
+
+
+  RawSessionWriter::~RawSessionWriter() {
+    Close();
+  }
+
+
+  void RawSessionWriter::Open(const RC::RStr& new_filename,
+      const RawSessionInfo& info) {
+    Close();
+    filename = new_filename;
+
+    if (info.labels.size() != info.sources.size()) {
+      Throw_RC_Error("Raw session labels and channels do not match");
+    }
+    if (info.codec != RawSession::codec_none &&
+        info.codec != RawSession::codec_lossless) {
+      Throw_RC_Error("Unknown raw session codec");
+    }
+
+#ifdef __linux__
+    fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0664);
+    if (fd < 0) {
+#else
+    fp = fopen(filename.c_str(), "wb");
+    if (fp == nullptr) {
+#endif
+      Throw_RC_Type(File,
+          (RC::RStr("Could not open ")+filename+" for raw writing").c_str());
+    }
+    is_open = true;
+
+    chan_count = info.ChanCount();
+    codec = info.codec;
+    seq = 0;
+    offset = 0;
+    reserved = 0;
+
+    size_t entries_end = sizeof(RawFileHeader) +
+      chan_count * sizeof(RawChannelEntry);
+    size_t header_bytes = RawSession::AlignUp(entries_end);
+    RC::Data1D<uint8_t> header_buf(header_bytes);
+    header_buf.Zero();
+
+    RawFileHeader& hdr = *reinterpret_cast<RawFileHeader*>(header_buf.Raw());
+    std::memcpy(hdr.magic, RawSession::magic, sizeof(hdr.magic));
+    hdr.version = RawSession::version;
+    hdr.header_bytes = uint32_t(header_bytes);
+    hdr.sampling_rate = info.sampling_rate;
+    hdr.channel_count = uint32_t(chan_count);
+    hdr.start_time_ns = info.start_time_ns;
+    hdr.codec = info.codec;
+    CopyStr(hdr.subject, info.subject, sizeof(hdr.subject));
+
+    RawChannelEntry* entries = reinterpret_cast<RawChannelEntry*>(
+        header_buf.Raw() + sizeof(RawFileHeader));
+    for (size_t c=0; c<chan_count; c++) {
+      entries[c].source = info.sources[c];
+      CopyStr(entries[c].label, info.labels[c], sizeof(entries[c].label));
+    }
+
+    hdr.crc = RawSession::CRC32(header_buf.Raw(), entries_end);
+
+    Reserve(header_bytes);
+    WriteAt(header_buf.Raw(), header_bytes);
+  }
+
+
+  void RawSessionWriter::WriteBlock(const int16_t* samples,
+      size_t sample_count, uint64_t first_sample, uint64_t host_time_ns) {
+    if ( ! is_open ) {
+      Throw_RC_Error("Raw session block written with no file open");
+    }
+    if (sample_count == 0) {
+      return;
+    }
+
+    const uint8_t* stored = reinterpret_cast<const uint8_t*>(samples);
+    size_t payload = chan_count * sample_count * sizeof(int16_t);
+    if (codec == RawSession::codec_lossless) {
+      encoded.clear();
+      EEGCodec::Encode(samples, chan_count, sample_count, encoded);
+      stored = encoded.data();
+      payload = encoded.size();
+    }
+
+    size_t frame_bytes = RawSession::AlignUp(sizeof(RawBlockHeader) +
+        payload);
+    if (frame.size() < frame_bytes) {
+      frame.Resize(frame_bytes);
+    }
+
+    RawBlockHeader hdr;
+    hdr.magic = RawSession::block_magic;
+    hdr.frame_bytes = uint32_t(frame_bytes);
+    hdr.seq = seq;
+    hdr.first_sample = first_sample;
+    hdr.host_time_ns = host_time_ns;
+    hdr.sample_count = uint32_t(sample_count);
+    hdr.crc = 0;
+
+    uint8_t* dest = frame.Raw();
+    std::memcpy(dest + sizeof(hdr), stored, payload);
+    std::memset(dest + sizeof(hdr) + payload, 0,
+        frame_bytes - sizeof(hdr) - payload);
+    hdr.crc = RawSession::CRC32(&hdr, sizeof(hdr));
+    hdr.crc = RawSession::CRC32(stored, payload, hdr.crc);
+    std::memcpy(dest, &hdr, sizeof(hdr));
+
+    Reserve(offset + frame_bytes);
+    WriteAt(dest, frame_bytes);
+    seq++;
+  }
+
+
+  void RawSessionWriter::Close() {
+    if ( ! is_open ) {
+      return;
+    }
+    is_open = false;
+
+#ifdef __linux__
+    // Trim the preallocated zero fill.  No error check, can be a destructor
+    // cleanup call, and readers stop at the zero fill anyway.
+    if (ftruncate(fd, off_t(offset)) == 0) {
+      fsync(fd);
+    }
+    close(fd);
+    fd = -1;
+#else
+    fclose(fp);
+    fp = nullptr;
+#endif
+  }
+
+
+  void RawSessionWriter::WriteAt(const uint8_t* data, size_t len) {
+#ifdef __linux__
+    size_t done = 0;
+    while (done < len) {
+      ssize_t amnt = pwrite(fd, data + done, len - done,
+          off_t(offset + done));
+      if (amnt < 0 && errno == EINTR) {
+        continue;
+      }
+      if (amnt <= 0) {
+        Throw_RC_Type(File, (RC::RStr("Could not write to ") + filename +
+              ", " + std::strerror(errno)).c_str());
+      }
+      done += size_t(amnt);
+    }
+    // The space is preallocated, so this flushes data without metadata.
+    if (fdatasync(fd)) {
+      Throw_RC_Type(File, (RC::RStr("Could not flush ") + filename +
+            ", " + std::strerror(errno)).c_str());
+    }
+#else
+    if (fwrite(data, 1, len, fp) != len || fflush(fp)) {
+      Throw_RC_Type(File, (RC::RStr("Could not write to ") + filename)
+          .c_str());
+    }
+#endif
+    offset += len;
+  }
+
+
+  void RawSessionWriter::Reserve(uint64_t end) {
+    if (end <= reserved) {
+      return;
+    }
+#ifdef __linux__
+    uint64_t new_reserved = (end + prealloc_step - 1) / prealloc_step *
+      prealloc_step;
+    // Zero filled, so readers see a clean end.  Where fallocate is not
+    // supported, the writes extend the file instead.
+    if (fallocate(fd, 0, off_t(reserved), off_t(new_reserved - reserved))
+        == 0) {
+      reserved = new_reserved;
+      return;
+    }
+#endif
+    reserved = end;
+  }
+
+
+  RawSessionReader::~RawSessionReader() {
+    Close();
+  }
+
+
+  void RawSessionReader::Open(const RC::RStr& filename) {
+    Close();
+
+    fp = fopen(filename.c_str(), "rb");
+    if (fp == nullptr) {
+      Throw_RC_Type(File,
+          (RC::RStr("Could not open ")+filename+" for reading").c_str());
+    }
+    // Unbuffered, so blocks written after an earlier read are not hidden
+    // behind stale buffered zero fill.
+    setvbuf(fp, nullptr, _IONBF, 0);
+
+    RawFileHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        std::memcmp(hdr.magic, RawSession::magic, sizeof(hdr.magic)) != 0) {
+      Close();
+      Throw_RC_Type(File, (filename + " is not an Elemem raw session "
+            "file").c_str());
+    }
+    if (hdr.version != RawSession::version ||
+        (hdr.codec != RawSession::codec_none &&
+         hdr.codec != RawSession::codec_lossless)) {
+      Close();
+      Throw_RC_Type(File, (filename + " has unsupported raw session "
+            "version " + RC::RStr(hdr.version)).c_str());
+    }
+
+    // A damaged channel_count must not size an allocation, so the header
+    // size and the file length are checked first, then the CRC.
+    uint64_t entries_bytes = uint64_t(hdr.channel_count) *
+      sizeof(RawChannelEntry);
+    uint64_t entries_end = sizeof(hdr) + entries_bytes;
+    if (hdr.header_bytes != RawSession::AlignUp(size_t(entries_end))) {
+      Close();
+      Throw_RC_Type(File, (filename + " has a damaged header").c_str());
+    }
+    if (FileSize(fp) < entries_end) {
+      Close();
+      Throw_RC_Type(File, (filename + " has an incomplete header").c_str());
+    }
+    SeekTo(fp, sizeof(hdr));
+
+    frame.Resize(size_t(entries_bytes));
+    if (entries_bytes > 0 &&
+        fread(frame.Raw(), 1, frame.size(), fp) != frame.size()) {
+      Close();
+      Throw_RC_Type(File, (filename + " has an incomplete header").c_str());
+    }
+
+    uint32_t crc = hdr.crc;
+    hdr.crc = 0;
+    uint32_t check = RawSession::CRC32(&hdr, sizeof(hdr));
+    check = RawSession::CRC32(frame.Raw(), frame.size(), check);
+    if (check != crc) {
+      Close();
+      Throw_RC_Type(File, (filename + " has a damaged header").c_str());
+    }
+
+    RC::Data1D<RawChannelEntry> entries(hdr.channel_count);
+    if (entries_bytes > 0) {
+      std::memcpy(entries.Raw(), frame.Raw(), frame.size());
+    }
+
+    info = RawSessionInfo();
+    info.sampling_rate = hdr.sampling_rate;
+    info.start_time_ns = hdr.start_time_ns;
+    info.codec = hdr.codec;
+    info.subject = ReadStr(hdr.subject, sizeof(hdr.subject));
+    info.sources.Resize(entries.size());
+    info.labels.Resize(entries.size());
+    for (size_t c=0; c<entries.size(); c++) {
+      info.sources[c] = entries[c].source;
+      info.labels[c] = ReadStr(entries[c].label, sizeof(entries[c].label));
+    }
+
+    offset = hdr.header_bytes;
+    next_seq = 0;
+    truncated = false;
+  }
+
+
+  void RawSessionReader::Close() {
+    if (fp) {
+      fclose(fp);
+      fp = nullptr;
+    }
+  }
+
+
+  bool RawSessionReader::ReadBlock(RawBlock& block) {
+    truncated = false;
+    if (fp == nullptr) {
+      return false;
+    }
+
+    // Seeking also clears any end of file from an earlier call.
+    SeekTo(fp, offset);
+
+    RawBlockHeader hdr;
+    size_t got = fread(&hdr, 1, sizeof(hdr), fp);
+    if (got < sizeof(hdr)) {
+      truncated = (got > 0);
+      return false;
+    }
+    if (hdr.magic != RawSession::block_magic) {
+      truncated = (hdr.magic != 0);
+      return false;
+    }
+
+    if (info.codec == RawSession::codec_lossless) {
+      if ( ! ReadCompressed(hdr, block) ) {
+        truncated = true;
+        return false;
+      }
+    }
+    else {
+      size_t payload = info.ChanCount() * size_t(hdr.sample_count) *
+        sizeof(int16_t);
+      if (hdr.seq != next_seq || hdr.frame_bytes % RawSession::align != 0 ||
+          hdr.frame_bytes < sizeof(hdr) + payload) {
+        truncated = true;
+        return false;
+      }
+
+      block.samples.Resize(info.ChanCount() * hdr.sample_count);
+      if (payload > 0 && fread(block.samples.Raw(), 1, payload, fp) !=
+          payload) {
+        truncated = true;
+        return false;
+      }
+
+      uint32_t crc = hdr.crc;
+      hdr.crc = 0;
+      uint32_t check = RawSession::CRC32(&hdr, sizeof(hdr));
+      check = RawSession::CRC32(block.samples.Raw(), payload, check);
+      if (check != crc) {
+        truncated = true;
+        return false;
+      }
+    }
+
+    block.seq = hdr.seq;
+    block.first_sample = hdr.first_sample;
+    block.host_time_ns = hdr.host_time_ns;
+    block.sample_count = hdr.sample_count;
+
+    offset += hdr.frame_bytes;
+    next_seq++;
+    return true;
+  }
+
+
+  bool RawSessionReader::ReadCompressed(RawBlockHeader& hdr, RawBlock& block) {
+    if (hdr.seq != next_seq || hdr.frame_bytes % RawSession::align != 0 ||
+        hdr.frame_bytes < sizeof(hdr) + EEGCodec::header_bytes) {
+      return false;
+    }
+
+    size_t stored_max = hdr.frame_bytes - sizeof(hdr);
+    frame.Resize(stored_max);
+    if (fread(frame.Raw(), 1, stored_max, fp) != stored_max) {
+      return false;
+    }
+    size_t stored = EEGCodec::BlockBytes(frame.Raw(), stored_max);
+    if (stored < EEGCodec::header_bytes || stored > stored_max) {
+      return false;
+    }
+
+    uint32_t crc = hdr.crc;
+    hdr.crc = 0;
+    uint32_t check = RawSession::CRC32(&hdr, sizeof(hdr));
+    check = RawSession::CRC32(frame.Raw(), stored, check);
+    if (check != crc) {
+      return false;
+    }
+
+    size_t chan_count;
+    size_t sample_count;
+    EEGCodec::Decode(frame.Raw(), stored, block.samples, chan_count,
+        sample_count);
+    return chan_count == info.ChanCount() &&
+      sample_count == hdr.sample_count;
+  }
+}
@@ -0,0 +1,185 @@
+#ifndef RAWSESSION_H
+#define RAWSESSION_H
+
+#include "RC/Data1D.h"
+#include "RC/RStr.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace CML {
+  /// The Elemem raw session format, with the extension "elraw".
+  /** All values are little-endian.  A file is a header followed by a stream
+   *  of blocks, each starting on a multiple of RawSession::align bytes:
+   *  \code
+   *  RawFileHeader                     (fixed size)
+   *  RawChannelEntry[channel_count]    (montage order)
+   *  zero padding to header_bytes
+   *  { RawBlockHeader, int16 samples[channel_count][sample_count],
+   *    zero padding to frame_bytes }   (repeated)
+   *  \endcode
+   *  Samples within a block are channel-major, in montage order.  When the
+   *  header codec is RawSession::codec_lossless they are stored as one
+   *  EEGCodec block instead.  Both the header and every block carry a
+   *  CRC-32, and the file beyond the last block is zero, so a reader stops
+   *  cleanly at the first incomplete block whether the file is finished,
+   *  still being written, or cut short.
+   */
+  namespace RawSession {
+    const char magic[8] = {'E', 'L', 'E', 'M', 'R', 'A', 'W', '1'};
+    const uint32_t version = 1;
+    const uint32_t block_magic = 0x314B4C42;  // "BLK1"
+    const size_t align = 4096;
+    const size_t label_len = 28;
+    const size_t subject_len = 64;
+
+    const uint32_t codec_none = 0;
+    const uint32_t codec_lossless = 1;  // EEGCodec.
+
+    /// CRC-32 (IEEE 802.3), continuing from crc.
+    uint32_t CRC32(const void* data, size_t len, uint32_t crc=0);
+
+    inline size_t AlignUp(size_t bytes) {
+      return (bytes + align - 1) / align * align;
+    }
+  }
+
+  #pragma pack(push, 1)
+  struct RawFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_bytes;   // Offset of the first block.
+    uint32_t sampling_rate;
+    uint32_t channel_count;
+    uint64_t start_time_ns;  // Unix time of the first sample.
+    char subject[RawSession::subject_len];
+    uint32_t codec;  // How block samples are stored.
+    uint32_t crc;  // Of this header and the channel entries, with crc 0.
+  };
+
+  struct RawChannelEntry {
+    uint32_t source;  // Zero-based acquisition channel.
+    char label[RawSession::label_len];
+  };
+
+  struct RawBlockHeader {
+    uint32_t magic;
+    uint32_t frame_bytes;    // This header, the samples, and padding.
+    uint64_t seq;            // Counts up from 0 with each block.
+    uint64_t first_sample;   // Sample index since the start of the file.
+    uint64_t host_time_ns;   // Unix time when the first sample arrived.
+    uint32_t sample_count;
+    uint32_t crc;  // Of this header and the stored samples, with crc 0.
+  };
+  #pragma pack(pop)
+
+
+  /// The header contents of a raw session file.
+  class RawSessionInfo {
+    public:
+    uint32_t sampling_rate = 0;
+    uint64_t start_time_ns = 0;
+    uint32_t codec = RawSession::codec_none;
+    RC::RStr subject;
+    RC::Data1D<uint32_t> sources;
+    RC::Data1D<RC::RStr> labels;
+
+    size_t ChanCount() const { return sources.size(); }
+  };
+
+
+  /// One block of a raw session file.
+  class RawBlock {
+    public:
+    uint64_t seq = 0;
+    uint64_t first_sample = 0;
+    uint64_t host_time_ns = 0;
+    size_t sample_count = 0;
+    RC::Data1D<int16_t> samples;  // Channel-major, in montage order.
+  };
+
+
+  /// Writes a raw session file, one aligned write per block.
+  /** Space is preallocated in large steps where the platform allows, and
+   *  each block is flushed to the device before the next, so a crash or
+   *  power cut loses at most the block being written.
+   */
+  class RawSessionWriter {
+    public:
+    RawSessionWriter() { }
+    ~RawSessionWriter();
+
+    // Rule of 3.
+    RawSessionWriter(const RawSessionWriter&) = delete;
+    RawSessionWriter& operator=(const RawSessionWriter&) = delete;
+
+    void Open(const RC::RStr& filename, const RawSessionInfo& info);
+    /// Write sample_count samples of every channel, channel-major.
+    void WriteBlock(const int16_t* samples, size_t sample_count,
+        uint64_t first_sample, uint64_t host_time_ns);
+    /// Trims the preallocated space and closes the file.
+    void Close();
+
+    bool IsOpen() const { return is_open; }
+    uint64_t BytesWritten() const { return offset; }
+
+    protected:
+    void WriteAt(const uint8_t* data, size_t len);
+    void Reserve(uint64_t end);
+
+    static const uint64_t prealloc_step = 64ull << 20;
+
+    bool is_open = false;
+    RC::RStr filename;
+    int fd = -1;
+    FILE* fp = nullptr;
+    size_t chan_count = 0;
+    uint32_t codec = RawSession::codec_none;
+    uint64_t seq = 0;
+    uint64_t offset = 0;
+    uint64_t reserved = 0;
+    RC::Data1D<uint8_t> frame;
+    std::vector<uint8_t> encoded;
+  };
+
+
+  /// Reads a raw session file, including one still being written.
+  class RawSessionReader {
+    public:
+    RawSessionReader() { }
+    ~RawSessionReader();
+
+    // Rule of 3.
+    RawSessionReader(const RawSessionReader&) = delete;
+    RawSessionReader& operator=(const RawSessionReader&) = delete;
+
+    /// Throws a File error if the header is missing or damaged.
+    void Open(const RC::RStr& filename);
+    void Close();
+
+    const RawSessionInfo& Info() const { return info; }
+
+    /// Read the next valid block.
+    /** @return False at the end of the written data.  Call again later to
+     *  pick up blocks written since, if the file is still being recorded.
+     */
+    bool ReadBlock(RawBlock& block);
+
+    /// True if reading stopped at a block that was partly written or
+    /// damaged, rather than at clean zero fill or the end of the file.
+    bool Truncated() const { return truncated; }
+
+    protected:
+    bool ReadCompressed(RawBlockHeader& hdr, RawBlock& block);
+
+    FILE* fp = nullptr;
+    RawSessionInfo info;
+    uint64_t offset = 0;
+    uint64_t next_seq = 0;
+    bool truncated = false;
+    RC::Data1D<uint8_t> frame;
+  };
+}
+
+#endif // RAWSESSION_H
+
@@ -33,6 +33,7 @@ namespace CML {
     exp_config = nullptr;
     elec_config = nullptr;
     bipolar_config = nullptr;
+    montage_index = nullptr;
     stimconf.Clear();
     min_stimconf.Clear();
     max_stimconf.Clear();
@@ -72,6 +73,7 @@ namespace CML {
       elec_config.Delete();
       Throw_RC_Type(Note, "Montage CSV file has insufficient columns.");
     }
+    montage_index = RC::MakeAPtr<MontageIndex>(*elec_config).ExtractConst();
     RC::Data1D<EEGChan> new_chans(elec_config->data.size2());
     for (size_t r=0; r<elec_config->data.size2(); r++) {
       uint32_t chan = elec_config->data[r][1].Get_u32();
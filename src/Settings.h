@@ -5,6 +5,7 @@
 #include "RC/Data1D.h"
 #include "RC/RStr.h"
 #include "ChannelConf.h"
+#include "MontageIndex.h"
 #include "OPSSpecs.h"
 #include "WeightManager.h"
 
@@ -53,6 +54,8 @@ namespace CML {
     RC::APtr<const JSONFile> exp_config;
     RC::APtr<const CSVFile> elec_config;
     RC::APtr<const CSVFile> bipolar_config;
+    // Label lookups into elec_config, rebuilt with each montage load.
+    RC::APtr<const MontageIndex> montage_index;
 
     RC::Data1D<StimSettings> stimconf;
     RC::Data1D<StimSettings> min_stimconf;
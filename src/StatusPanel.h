@@ -20,13 +20,14 @@ namespace CML {
       TaskHandler(StatusPanel::SetExperiment_Handler);
     RCqt::TaskCaller<const bool> SetStimList =
       TaskHandler(StatusPanel::SetStimList_Handler);
-    RCqt::TaskCaller<const RC::RStr> SetEvent =
+    // Called for every task message, so only the newest value is shown.
+    RCqt::TaskCoalescer<const RC::RStr> SetEvent =
       TaskHandler(StatusPanel::SetEvent_Handler);
-    RCqt::TaskCaller<const uint32_t> SetStimming =
+    RCqt::TaskCoalescer<const uint32_t> SetStimming =
       TaskHandler(StatusPanel::SetStimming_Handler);
     RCqt::TaskCaller<const int64_t> SetSession =
       TaskHandler(StatusPanel::SetSession_Handler);
-    RCqt::TaskCaller<const int64_t> SetTrial =
+    RCqt::TaskCoalescer<const int64_t> SetTrial =
       TaskHandler(StatusPanel::SetTrial_Handler);
     RCqt::TaskCaller<> Clear =
       TaskHandler(StatusPanel::Clear_Handler);
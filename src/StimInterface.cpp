@@ -67,11 +67,9 @@ namespace CML {
     Stimulate_Helper();
   }
 
-  void StimInterface::ConfigureStimulation_Handler(const StimProfile& profile) {
-    // Reset defaults.
-    burst_slow_freq = 0;
-    burst_frac = 1;
-    burst_duration_us = 0;
+  StimSlot StimInterface::CheckProfile(const StimProfile& profile) {
+    StimSlot checked;
+    checked.profile = profile;
 
     struct FreqDurAmp {
     uint32_t frequency;
@@ -108,13 +106,13 @@ namespace CML {
       uniqueness_check.at(prof.electrode_neg) = 1;
 
       if (i==0) {  // Save first burst setting.
-        burst_slow_freq = prof.burst_slow_freq;
-        burst_frac = prof.burst_frac;
-        burst_duration_us = prof.duration;
+        checked.burst_slow_freq = prof.burst_slow_freq;
+        checked.burst_frac = prof.burst_frac;
+        checked.burst_duration_us = prof.duration;
       }  // All burst settings must be identical.
-      else if ((burst_slow_freq != prof.burst_slow_freq) ||
-               (std::abs(burst_frac - prof.burst_frac) > 0.001) ||
-               (burst_duration_us != prof.duration)) {
+      else if ((checked.burst_slow_freq != prof.burst_slow_freq) ||
+               (std::abs(checked.burst_frac - prof.burst_frac) > 0.001) ||
+               (checked.burst_duration_us != prof.duration)) {
         throw std::runtime_error("Simultaneous stim channels must be all "
             "identical duration and burst stim settings, or all not burst "
             "stim.");
@@ -122,18 +120,18 @@ namespace CML {
     }
 
     // Sensible burst settings only.
-    if (burst_frac > 1) {
+    if (checked.burst_frac > 1) {
       throw std::runtime_error("Attempted to configure stim burst fraction "
           "greater than 1.");
     }
-    if (burst_frac < 1) {
-      if (burst_slow_freq == 0) {
+    if (checked.burst_frac < 1) {
+      if (checked.burst_slow_freq == 0) {
         throw std::runtime_error("Attempted burst fraction less than 1 at "
             "0 Hz.");
       }
     }
-    if (burst_frac == 1) {
-      burst_slow_freq = 0;  // Triggers no burst in stim worker.
+    if (checked.burst_frac == 1) {
+      checked.burst_slow_freq = 0;  // Triggers no burst in stim worker.
     }
 
     std::vector<size_t> pattern_index(prof_size);
@@ -158,10 +156,10 @@ namespace CML {
     for (size_t i=0; i<fda_vec.size(); i++) {
       auto& afd = fda_vec[i];
       uint64_t pulses_64 = (uint64_t(afd.duration) * afd.frequency) / 1000000;
-      if (burst_frac < 1) {
+      if (checked.burst_frac < 1) {
         // Configure stim profile for burst-on period only.
-        pulses_64 = uint64_t(round(afd.frequency * burst_frac /
-                                   burst_slow_freq));
+        pulses_64 = uint64_t(round(afd.frequency * checked.burst_frac /
+                                   checked.burst_slow_freq));
       }
 
       if (pulses_64 < 1) {
@@ -174,11 +172,84 @@ namespace CML {
       }
     }
 
+    checked.is_set = true;
+    return checked;
+  }
+
+  void StimInterface::ConfigureStimulation_Handler(const StimProfile& profile) {
+    StimSlot checked = CheckProfile(profile);
+    burst_slow_freq = checked.burst_slow_freq;
+    burst_frac = checked.burst_frac;
+    burst_duration_us = checked.burst_duration_us;
+
+    armed_slot = no_slot;
     ConfigureStimulation_Helper(profile);
 
     is_configured = true;
   }
 
+  void StimInterface::ConfigureSlot_Handler(const size_t& slot,
+      const StimProfile& profile) {
+    if (slot >= max_slots) {
+      throw std::runtime_error("Stim slot " + std::to_string(slot) +
+          " requested, but only " + std::to_string(max_slots) +
+          " are available.");
+    }
+
+    StimSlot checked = CheckProfile(profile);
+    if (stim_slots.size() <= slot) {
+      stim_slots.resize(slot+1);
+    }
+
+    // The stimulator may hold the armed pattern in shared storage.
+    is_configured = false;
+    armed_slot = no_slot;
+
+    StimSlot prev = stim_slots[slot];
+    stim_slots[slot] = checked;
+    try {
+      ConfigureSlot_Helper(slot);
+    }
+    catch (...) {
+      stim_slots[slot] = prev;
+      throw;
+    }
+  }
+
+  void StimInterface::ClearSlots_Handler() {
+    stim_slots.clear();
+    if (armed_slot != no_slot) {
+      is_configured = false;
+      armed_slot = no_slot;
+    }
+  }
+
+  void StimInterface::ArmSlot_Handler(const size_t& slot) {
+    if (slot >= stim_slots.size() || ! stim_slots[slot].is_set) {
+      throw std::runtime_error("Stim slot " + std::to_string(slot) +
+          " was armed before being configured.");
+    }
+
+    if (is_configured && armed_slot == slot) {
+      return;
+    }
+
+    burst_slow_freq = stim_slots[slot].burst_slow_freq;
+    burst_frac = stim_slots[slot].burst_frac;
+    burst_duration_us = stim_slots[slot].burst_duration_us;
+
+    armed_slot = no_slot;
+    ArmSlot_Helper(slot);
+
+    armed_slot = slot;
+    is_configured = true;
+  }
+
+  void StimInterface::StimulateSlot_Handler(const size_t& slot) {
+    ArmSlot_Handler(slot);
+    Stimulate_Handler();
+  }
+
   uint32_t StimInterface::GetBurstSlowFreq_Handler() {
     return burst_slow_freq;
   }
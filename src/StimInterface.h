@@ -45,6 +45,16 @@ namespace CML {
     std::vector<StimChannel> stim_profile;
   };
 
+  /// A profile stored ahead of time in a numbered slot, once checked.
+  class StimSlot {
+    public:
+    StimProfile profile;
+    uint32_t burst_slow_freq = 0;
+    float burst_frac = 1;
+    uint32_t burst_duration_us = 0;
+    bool is_set = false;
+  };
+
   class StimInterface {
     public:
     StimInterface() = default;
@@ -65,6 +75,14 @@ namespace CML {
     virtual void CloseInterface() = 0;
     virtual void Stimulate() = 0;
 
+    // Slots hold profiles uploaded ahead of time, so that stimulating an
+    // armed slot is only a trigger.  Configuring any slot disarms.
+    static constexpr size_t max_slots = 16;
+    virtual void ConfigureSlot(size_t slot, StimProfile profile) = 0;
+    virtual void ClearSlots() = 0;
+    virtual void ArmSlot(size_t slot) = 0;
+    virtual void StimulateSlot(size_t slot) = 0;
+
     virtual uint32_t GetBurstSlowFreq() = 0;
     virtual uint32_t GetBurstDuration_us() = 0;
 
@@ -74,11 +92,20 @@ namespace CML {
     virtual void OpenInterface_Helper() = 0;
     virtual void CloseInterface_Helper() = 0;
     virtual void Stimulate_Helper() = 0;
+    // By default slots are only stored, and arming configures the profile.
+    virtual void ConfigureSlot_Helper(size_t /*slot*/) { }
+    virtual void ArmSlot_Helper(size_t slot) {
+      ConfigureStimulation_Helper(stim_slots[slot].profile);
+    }
 
     void ConfigureStimulation_Handler(const StimProfile& profile);
     void OpenInterface_Handler();
     void CloseInterface_Handler();
     void Stimulate_Handler();
+    void ConfigureSlot_Handler(const size_t& slot, const StimProfile& profile);
+    void ClearSlots_Handler();
+    void ArmSlot_Handler(const size_t& slot);
+    void StimulateSlot_Handler(const size_t& slot);
     uint32_t GetBurstSlowFreq_Handler();
     uint32_t GetBurstDuration_us_Handler();
 
@@ -89,8 +116,15 @@ namespace CML {
     void ShannonAssert(float area_mmsq, uint16_t amplitude_uA);
     void ShannonAssert(const StimChannel& chan);
 
+    /// Check a profile can be stimulated, and find its burst settings.
+    StimSlot CheckProfile(const StimProfile& profile);
+
     bool is_configured = false;
 
+    static constexpr size_t no_slot = size_t(-1);
+    std::vector<StimSlot> stim_slots;
+    size_t armed_slot = no_slot;
+
     uint32_t burst_slow_freq = 0; // Unit Hz.  Slower envelope freq of bursts.
     float burst_frac = 1; // Fraction of 1/burst_slow_freq to stimulate for.
     uint32_t burst_duration_us = 0;
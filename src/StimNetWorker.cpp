@@ -21,7 +21,7 @@ namespace CML {
   void StimNetWorker::LogAndSend(const RC::RStr &msg) {
     JSONFile response = MakeResp("STIMNETMSG");
     response.Set(msg, "data", "msg");
-    hndl->event_log.Log(response.Line());
+    hndl->event_log.Log(std::move(response));
 
     Send(msg);
   }
@@ -91,14 +91,16 @@ namespace CML {
     Close(); // Network device
   }
 
-  void StimNetWorker::ProcessCommand(RC::RStr cmd) {
+  void StimNetWorker::ProcessCommand(std::string_view cmd_view) {
 #ifdef NETWORKER_TIMING
     timer.Start();
 #endif // NETWORKER_TIMING
 
+    RC::RStr cmd(cmd_view.data(), cmd_view.size());
+
     JSONFile cmdJson = MakeResp("STIMNETMSG");
     cmdJson.Set(cmd, "data", "msg");
-    hndl->event_log.Log(cmdJson.Line());
+    hndl->event_log.Log(std::move(cmdJson));
 
     Data1D<RC::RStr> cmdParts = cmd.Chomp().SplitFirst(",");
     RC::RStr& cmdName = cmdParts[0];
@@ -27,6 +27,25 @@ namespace CML {
     void OpenInterface() override { RCqt::TaskCaller<> open = TaskHandler(StimNetWorker::OpenInterface_Handler); open(); }
     void CloseInterface() override { RCqt::TaskCaller<> close = TaskHandler(StimNetWorker::CloseInterface_Handler); close(); }
     void Stimulate() override { RCqt::TaskCaller<> stim = TaskHandler(StimNetWorker::Stimulate_Handler); stim(); }
+    void ConfigureSlot(size_t slot, StimProfile profile) override {
+      RCqt::TaskCaller<const size_t, const StimProfile> configure =
+        TaskHandler(StimNetWorker::ConfigureSlot_Handler);
+      configure(slot, profile);
+    }
+    void ClearSlots() override {
+      RCqt::TaskCaller<> clear = TaskHandler(StimNetWorker::ClearSlots_Handler);
+      clear();
+    }
+    void ArmSlot(size_t slot) override {
+      RCqt::TaskCaller<const size_t> arm =
+        TaskHandler(StimNetWorker::ArmSlot_Handler);
+      arm(slot);
+    }
+    void StimulateSlot(size_t slot) override {
+      RCqt::TaskCaller<const size_t> stim =
+        TaskHandler(StimNetWorker::StimulateSlot_Handler);
+      stim(slot);
+    }
 
     uint32_t GetBurstSlowFreq() override { RCqt::TaskGetter<uint32_t> getFreq = TaskHandler(StimNetWorker::GetBurstSlowFreq_Handler); return getFreq(); }
     uint32_t GetBurstDuration_us() override { RCqt::TaskGetter<uint32_t> getDur = TaskHandler(StimNetWorker::GetBurstDuration_us_Handler); return getDur(); }
@@ -45,12 +64,22 @@ namespace CML {
     // This is a temporary redeclaration
     void ConfigureStimulation_Handler(const StimProfile& profile) { StimInterface::ConfigureStimulation_Handler(profile); }
     void Stimulate_Handler() { StimInterface::Stimulate_Handler(); }
+    void ConfigureSlot_Handler(const size_t& slot, const StimProfile& profile) {
+      StimInterface::ConfigureSlot_Handler(slot, profile);
+    }
+    void ClearSlots_Handler() { StimInterface::ClearSlots_Handler(); }
+    void ArmSlot_Handler(const size_t& slot) {
+      StimInterface::ArmSlot_Handler(slot);
+    }
+    void StimulateSlot_Handler(const size_t& slot) {
+      StimInterface::StimulateSlot_Handler(slot);
+    }
     void OpenInterface_Handler() { StimInterface::OpenInterface_Handler(); }
     void CloseInterface_Handler() { StimInterface::CloseInterface_Handler(); }
     uint32_t GetBurstSlowFreq_Handler() { return StimInterface::GetBurstSlowFreq_Handler(); }
     uint32_t GetBurstDuration_us_Handler() { return StimInterface::GetBurstDuration_us_Handler(); }
 
-    void ProcessCommand(RC::RStr cmd) override;
+    void ProcessCommand(std::string_view cmd_view) override;
     void DisconnectedAfter() override;
 
     void LogAndSend(const RC::RStr& msg);
@@ -1,5 +1,6 @@
 #include "StimWorker.h"
 #include "ConfigFile.h"
+#include "DecisionTrace.h"
 #include "EventLog.h"
 #include "Handler.h"
 #include "JSONLines.h"
@@ -37,8 +38,56 @@ namespace CML {
       Throw_RC_Error("The stim_interface in StimWorker is null on Configure");
     }
 
-    cur_profile = profile;
     stim_interface->ConfigureStimulation(profile);
+    SetCurrent(profile);
+    cur_slot = no_slot;
+  }
+
+  void StimWorker::ConfigureSlot_Handler(const size_t& slot,
+      const StimProfile& profile) {
+    if (stim_interface.IsNull()) {
+      Throw_RC_Error("The stim_interface in StimWorker is null on "
+          "ConfigureSlot");
+    }
+
+    stim_interface->ConfigureSlot(slot, profile);
+    if (slot_profiles.size() <= slot) {
+      slot_profiles.resize(slot+1);
+    }
+    slot_profiles[slot] = profile;
+    // Configuring any slot disarms the stimulator.
+    cur_slot = no_slot;
+  }
+
+  void StimWorker::ClearSlots_Handler() {
+    if (stim_interface.IsNull()) {
+      Throw_RC_Error("The stim_interface in StimWorker is null on "
+          "ClearSlots");
+    }
+
+    stim_interface->ClearSlots();
+    slot_profiles.clear();
+    cur_slot = no_slot;
+    trigger_latency.Reset();
+  }
+
+  void StimWorker::SelectSlot_Handler(const size_t& slot) {
+    if (stim_interface.IsNull()) {
+      Throw_RC_Error("The stim_interface in StimWorker is null on "
+          "SelectSlot");
+    }
+    if (slot >= slot_profiles.size()) {
+      Throw_RC_Error(("Stim slot " + RC::RStr(slot) + " selected before "
+          "being configured.").c_str());
+    }
+
+    stim_interface->ArmSlot(slot);
+    SetCurrent(slot_profiles[slot]);
+    cur_slot = slot;
+  }
+
+  void StimWorker::SetCurrent(const StimProfile& profile) {
+    cur_profile = profile;
 
     max_duration = 0;
     for (size_t i=0; i<profile.size(); i++) {
@@ -48,6 +97,22 @@ namespace CML {
 
 
   void StimWorker::Stimulate_Handler() {
+    StimulateTraced(nullptr);
+  }
+
+  void StimWorker::StimulateDecision_Handler(
+      const TaskClassifierSettings& settings, const uint64_t& queued_ns) {
+    DecisionTrace::Record(TraceStage::STIM_HOP, settings, queued_ns,
+        DecisionTrace::Now());
+    StimulateTraced(&settings, queued_ns);
+    DecisionTrace::Record(TraceStage::TOTAL, settings, settings.requested_ns,
+        DecisionTrace::Now());
+  }
+
+  /// Stimulate, recording a STIMULATE span for trace if it is set, and
+  /// the trigger latency from decided_ns.
+  void StimWorker::StimulateTraced(const TaskClassifierSettings* trace,
+      uint64_t decided_ns) {
     if (stim_interface.IsNull()) {
       Throw_RC_Error("The stim_interface in StimWorker is null on Stimulate");
     }
@@ -61,10 +126,34 @@ namespace CML {
     }
 
     RC::Time timer;
-    stim_interface->Stimulate();
+    uint64_t stim_begin_ns = DecisionTrace::Now();
+    if (trace) {
+      trigger_latency.Record(stim_begin_ns - decided_ns);
+    }
+    if (cur_slot != no_slot) {
+      // Only a trigger while the slot stays armed.
+      stim_interface->StimulateSlot(cur_slot);
+    }
+    else {
+      stim_interface->Stimulate();
+    }
+    if (trace) {
+      DecisionTrace::Record(TraceStage::STIMULATE, *trace, stim_begin_ns,
+          DecisionTrace::Now());
+    }
     status_panel->SetStimming(max_duration);
 
     JSONFile event_base = MakeResp("STIMMING");
+    if (trace) {
+      event_base.Set((stim_begin_ns - decided_ns)*1e-6, "data",
+          "trigger_latency_ms");
+      event_base.Set(trigger_latency.Percentile(0.5)*1e-6, "data",
+          "trigger_latency_p50_ms");
+      event_base.Set(trigger_latency.Percentile(0.99)*1e-6, "data",
+          "trigger_latency_p99_ms");
+      event_base.Set(trigger_latency.Max()*1e-6, "data",
+          "trigger_latency_max_ms");
+    }
     for (size_t i=0; i<cur_profile.size(); i++) {
       JSONFile event = event_base;
       event.Set(uint32_t(cur_profile[i].electrode_pos), "data",
@@ -82,7 +171,7 @@ namespace CML {
         event.Set(cur_profile[i].burst_frac, "data", "burst_fraction");
       }
 
-      hndl->event_log.Log(event.Line());
+      hndl->event_log.Log(std::move(event), true);
     }
 
     // Theta-burst stimulation loop
@@ -2,8 +2,11 @@
 #define STIMWORKER_H
 
 #include "CereStim.h"
+#include "TaskClassifierSettings.h"
 #include "RC/Ptr.h"
+#include "RCqt/TaskStats.h"
 #include "RCqt/Worker.h"
+#include <vector>
 
 namespace CML {
   enum class StimulatorType { CereStim, Simulator };
@@ -27,9 +30,26 @@ namespace CML {
     RCqt::TaskCaller<const StimProfile> ConfigureStimulation =
       TaskHandler(StimWorker::ConfigureStimulation_Handler);
 
+    /// Upload a profile ahead of time into a numbered slot.
+    RCqt::TaskCaller<const size_t, const StimProfile> ConfigureSlot =
+      TaskHandler(StimWorker::ConfigureSlot_Handler);
+
+    /// Forget all slots, for a new session.
+    RCqt::TaskCaller<> ClearSlots =
+      TaskHandler(StimWorker::ClearSlots_Handler);
+
+    /// Arm a configured slot, so Stimulate only triggers it.
+    RCqt::TaskCaller<const size_t> SelectSlot =
+      TaskHandler(StimWorker::SelectSlot_Handler);
+
     RCqt::TaskCaller<> Stimulate =
       TaskHandler(StimWorker::Stimulate_Handler);
 
+    /// Stimulate for a closed-loop decision, queued at the given
+    /// DecisionTrace::Now() time, tracing the time taken.
+    RCqt::TaskCaller<const TaskClassifierSettings, const uint64_t>
+      StimulateDecision = TaskHandler(StimWorker::StimulateDecision_Handler);
+
     RCqt::TaskBlocker<> CloseStim =
       TaskHandler(StimWorker::CloseStim_Handler);
 
@@ -43,7 +63,16 @@ namespace CML {
     void Open_Handler();
     void SetStimInterface_Handler(RC::APtr<StimInterface>& new_interface);
     void ConfigureStimulation_Handler(const StimProfile& profile);
+    void ConfigureSlot_Handler(const size_t& slot,
+                               const StimProfile& profile);
+    void ClearSlots_Handler();
+    void SelectSlot_Handler(const size_t& slot);
     void Stimulate_Handler();
+    void StimulateDecision_Handler(const TaskClassifierSettings& settings,
+                                   const uint64_t& queued_ns);
+    void StimulateTraced(const TaskClassifierSettings* trace,
+                         uint64_t decided_ns=0);
+    void SetCurrent(const StimProfile& profile);
 
     void CloseStim_Handler();
 
@@ -52,8 +81,14 @@ namespace CML {
 
     RC::APtr<StimInterface> stim_interface;
     StimProfile cur_profile;
+    std::vector<StimProfile> slot_profiles;
+    static constexpr size_t no_slot = size_t(-1);
+    size_t cur_slot = no_slot;
 
     uint32_t max_duration = 0;
+
+    // From the stim decision until the stimulator trigger call.
+    RCqt::LatencyHistogram trigger_latency;
   };
 }
 
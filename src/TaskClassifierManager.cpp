@@ -1,9 +1,11 @@
 #include "TaskClassifierManager.h"
 #include "RC/Macros.h"
 #include "Classifier.h"
+#include "DecisionTrace.h"
 #include "EEGAcq.h"
 #include "Handler.h"
 #include "JSONLines.h"
+#include <algorithm>
 
 namespace CML {
   TaskClassifierManager::TaskClassifierManager(RC::Ptr<Handler> hndl,
@@ -25,65 +27,126 @@ namespace CML {
     }
   }
 
-  void TaskClassifierManager::StartClassification() {
+  void TaskClassifierManager::DispatchCompleted() {
     if (!callback.IsSet()) {
       Throw_RC_Error("Start classification callback not set");
     }
 
-    stim_event_waiting = false;
-    num_eeg_events_before_stim = 0;
+    // Windows of equal length ending together get the same view.
+    size_t prev_samples = size_t(-1);
+    EEGCircularView data;
 
-    size_t num_samples = task_classifier_settings.duration_ms *
-      sampling_rate / 1000;
-    RC::APtr<const EEGDataDouble> data =
-      circular_data.GetRecentData(num_samples).ExtractConst();
+    while (!pending_windows.empty() &&
+        pending_windows.begin()->first == samples_received) {
+      auto& settings = pending_windows.begin()->second.settings;
+      size_t num_samples = settings.duration_ms * sampling_rate / 1000;
+      if (num_samples != prev_samples) {
+        data = circular_data.GetRecentView(num_samples);
+        prev_samples = num_samples;
+      }
 
-    callback(data, task_classifier_settings);
+      DecisionTrace::Record(TraceStage::WINDOW, settings, settings.requested_ns,
+          DecisionTrace::Now());
+      callback(data, settings);
+      pending_windows.erase(pending_windows.begin());
+    }
   }
 
   void TaskClassifierManager::ClassifyData_Handler(
       RC::APtr<const EEGDataDouble>& data) {
+    // Split the incoming block at each pending window end, so every window
+    // is dispatched with exactly its own data.
+    size_t offset = 0;
+    while (!pending_windows.empty()) {
+      uint64_t next_end = pending_windows.begin()->first;
+      if (next_end > samples_received + (data->sample_len - offset)) {
+        break;
+      }
+
+      size_t amnt = next_end - samples_received;
+      circular_data.Append(data, offset, amnt);
+      offset += amnt;
+      samples_received += amnt;
+      DispatchCompleted();
+    }
+
+    // TODO: JPB: (feature) This can likely be removed to reduce overhead
+    //            If there is no stim event waiting, then don't update data
+    size_t amnt = data->sample_len - offset;
+    circular_data.Append(data, offset, amnt);
+    samples_received += amnt;
+
+    DispatchPrefixes();
+  }
+
+  void TaskClassifierManager::DispatchPrefixes() {
+    if (!prefix_callback.IsSet() || prefix_block_samples == 0) {
+      return;
+    }
 
-    if (stim_event_waiting) {
-      if (num_eeg_events_before_stim <= data->sample_len) {
-        circular_data.Append(data, 0, num_eeg_events_before_stim);
-        StartClassification();
-        circular_data.Append(data, num_eeg_events_before_stim);
-      } else { // num_eeg_events_before_stim > datar.size()
-        circular_data.Append(data);
-        num_eeg_events_before_stim -= data->sample_len;
+    for (auto& pw : pending_windows) {
+      auto& window = pw.second;
+      size_t received = samples_received - window.start_sample;
+      if (received < window.prefix_sent + prefix_block_samples) {
+        continue;
       }
-    } else {
-      // TODO: JPB: (feature) This can likely be removed to reduce overhead
-      //            If there is no stim event waiting, then don't update data
-      circular_data.Append(data);
+
+      prefix_callback(circular_data.GetRecentView(received), window.settings);
+      window.prefix_sent = received;
     }
   }
 
   void TaskClassifierManager::ProcessClassifierEvent_Handler(
         const ClassificationType& cl_type, const uint64_t& duration_ms,
-        const uint64_t& classif_id) {
+        const uint64_t& classif_id, const uint64_t& lead_us) {
     if (duration_ms > circular_data.duration_ms) {
       Throw_RC_Error(("Classification duration (" + RC::RStr(duration_ms) +
             ") is greater than the circular buffer duration (" +
             RC::RStr(circular_data.duration_ms) + ")").c_str());
     }
 
-    if (!stim_event_waiting) {
-      stim_event_waiting = true;
-      num_eeg_events_before_stim = duration_ms * sampling_rate / 1000;
-      task_classifier_settings.cl_type = cl_type;
-      task_classifier_settings.duration_ms = duration_ms;
-      task_classifier_settings.classif_id = classif_id;
-    } else {
-      // TODO: JPB: (feature) Allow classifier to start gather EEGData at the same time as another gathering?  Requires id queue.
-      hndl->event_log.Log("Skipping stim event, another stim event is "
-          "already waiting (collecting EEGData)");
+    if (classif_id != uint64_t(-1)) {
+      for (auto& pw : pending_windows) {
+        if (pw.second.settings.classif_id == classif_id) {
+          hndl->event_log.Log("Skipping classifier event, id " +
+                RC::RStr(classif_id) + " is already waiting (collecting "
+                "EEGData)\n");
+          return;
+        }
+      }
     }
+
+    TaskClassifierSettings settings;
+    settings.cl_type = cl_type;
+    settings.duration_ms = duration_ms;
+    settings.classif_id = classif_id;
+    settings.window_id = next_window_id++;
+    settings.requested_ns = DecisionTrace::Now();
+
+    // Start back when the event happened, while leaving at least one
+    // sample to come, so the window completes through ClassifyData.
+    uint64_t num_samples = duration_ms * sampling_rate / 1000;
+    uint64_t lead_samples = std::min(lead_us * sampling_rate / 1000000,
+        samples_received);
+    lead_samples = std::min(lead_samples,
+        num_samples > 0 ? num_samples - 1 : 0);
+
+    PendingWindow window;
+    window.settings = settings;
+    window.start_sample = samples_received - lead_samples;
+
+    uint64_t end_sample = window.start_sample + num_samples;
+    pending_windows.emplace(end_sample, window);
   }
 
   void TaskClassifierManager::SetCallback_Handler(
       const TaskClassifierCallback& new_callback) {
     callback = new_callback;
   }
+
+  void TaskClassifierManager::SetPrefixCallback_Handler(
+      const TaskClassifierCallback& new_callback, const size_t& block_ms) {
+    prefix_callback = new_callback;
+    prefix_block_samples = block_ms * sampling_rate / 1000;
+  }
 }
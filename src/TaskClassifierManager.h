@@ -7,13 +7,14 @@
 #include "RC/Ptr.h"
 #include "RC/RStr.h"
 #include "RCqt/Worker.h"
+#include <map>
 
 namespace CML {
   class Handler;
 
-  using ClassifierEvent = RCqt::TaskCaller<const ClassificationType, const uint64_t, const uint64_t>;
+  using ClassifierEvent = RCqt::TaskCaller<const ClassificationType, const uint64_t, const uint64_t, const uint64_t>;
   using ClassifierCallback = RCqt::TaskCaller<const double, const TaskClassifierSettings>;
-  using TaskClassifierCallback = RCqt::TaskCaller<RC::APtr<const EEGDataDouble>, const TaskClassifierSettings>;
+  using TaskClassifierCallback = RCqt::TaskCaller<const EEGCircularView, const TaskClassifierSettings>;
 
   class TaskClassifierManager : public RCqt::WorkerThread {
     public:
@@ -25,11 +26,19 @@ namespace CML {
     TaskClassifierManager(const TaskClassifierManager&) = delete;
     TaskClassifierManager& operator=(const TaskClassifierManager&) = delete;
 
+    /// Classify duration_ms of data, starting lead_us before the request
+    /// arrives, when the task laptop sent it.
     ClassifierEvent ProcessClassifierEvent =
       TaskHandler(TaskClassifierManager::ProcessClassifierEvent_Handler);
 
     RCqt::TaskCaller<const TaskClassifierCallback> SetCallback =
       TaskHandler(TaskClassifierManager::SetCallback_Handler);
+    /// Send each pending window's data so far to prefix_callback every
+    /// block_ms, so feature computation can start before it completes.
+    /** A block_ms of 0 disables this. */
+    RCqt::TaskCaller<const TaskClassifierCallback, const size_t>
+      SetPrefixCallback =
+      TaskHandler(TaskClassifierManager::SetPrefixCallback_Handler);
 
     RCqt::TaskBlocker<> Shutdown =
       TaskHandler(TaskClassifierManager::Shutdown_Handler);
@@ -41,13 +50,17 @@ namespace CML {
     void ClassifyData_Handler(RC::APtr<const EEGDataDouble>& data);
 
     void ProcessClassifierEvent_Handler(const ClassificationType& cl_type,
-        const uint64_t& duration_ms, const uint64_t& classif_id);
+        const uint64_t& duration_ms, const uint64_t& classif_id,
+        const uint64_t& lead_us);
 
     void SetCallback_Handler(const TaskClassifierCallback& new_callback);
+    void SetPrefixCallback_Handler(const TaskClassifierCallback& new_callback,
+        const size_t& block_ms);
 
     void Shutdown_Handler();
 
-    void StartClassification();
+    void DispatchCompleted();
+    void DispatchPrefixes();
 
     RC::Ptr<Handler> hndl;
     RC::RStr callback_ID;
@@ -55,12 +68,22 @@ namespace CML {
     EEGCircularData circular_data;
 
     size_t sampling_rate = 0;
-    TaskClassifierSettings task_classifier_settings;
 
-    bool stim_event_waiting = false;
-    size_t num_eeg_events_before_stim = 0;
+    // Total samples appended to circular_data.
+    uint64_t samples_received = 0;
+    struct PendingWindow {
+      TaskClassifierSettings settings;
+      uint64_t start_sample;
+      size_t prefix_sent = 0;  // Samples already passed to prefix_callback.
+    };
+    // Classification windows waiting for data, keyed by the end sample.
+    // These all share circular_data, and are copied out only on completion.
+    std::multimap<uint64_t, PendingWindow> pending_windows;
+    uint64_t next_window_id = 0;
 
     TaskClassifierCallback callback;
+    TaskClassifierCallback prefix_callback;
+    size_t prefix_block_samples = 0;
   };
 }
 
@@ -27,6 +27,10 @@ namespace CML {
     ClassificationType cl_type;
     size_t duration_ms;
     uint64_t classif_id = uint64_t(-1);
+    // Unique per classification window, assigned by TaskClassifierManager.
+    uint64_t window_id = uint64_t(-1);
+    // When the classification was requested, for DecisionTrace.
+    uint64_t requested_ns = 0;
   };
 }
 
@@ -0,0 +1,557 @@
+#include "TaskMessage.h"
+#include "nlohmann/json.hpp"
+#include <cstddef>
+#include <cstring>
+
+namespace CML {
+  namespace {
+    struct TypeName {
+      std::string_view name;
+      TaskMsgType type;
+    };
+
+    constexpr TypeName type_names[] = {
+      {"CONNECTED", TaskMsgType::CONNECTED},
+      {"CONFIGURE", TaskMsgType::CONFIGURE},
+      {"READY", TaskMsgType::READY},
+      {"HEARTBEAT", TaskMsgType::HEARTBEAT},
+      {"WORD", TaskMsgType::WORD},
+      {"STIM", TaskMsgType::STIM},
+      {"CLSTIM", TaskMsgType::CLSTIM},
+      {"CLSHAM", TaskMsgType::CLSHAM},
+      {"CLNORMALIZE", TaskMsgType::CLNORMALIZE},
+      {"STIMSELECT", TaskMsgType::STIMSELECT},
+      {"SESSION", TaskMsgType::SESSION},
+      {"TRIAL", TaskMsgType::TRIAL},
+      {"EXIT", TaskMsgType::EXIT},
+      {"SYNC_OK", TaskMsgType::SYNC_OK},
+      {"ORIENT", TaskMsgType::ORIENT},
+      {"COUNTDOWN", TaskMsgType::COUNTDOWN},
+      {"DISTRACT", TaskMsgType::DISTRACT},
+      {"RECALL", TaskMsgType::RECALL},
+      {"REST", TaskMsgType::REST},
+      {"INSTRUCT", TaskMsgType::INSTRUCT},
+      {"TRIALEND", TaskMsgType::TRIALEND},
+      {"MATH", TaskMsgType::MATH},
+    };
+    constexpr size_t type_count = sizeof(type_names) / sizeof(type_names[0]);
+
+    // Coefficients found by search to be collision free for type_names.
+    constexpr size_t hash_size = 32;
+    constexpr size_t TypeHash(std::string_view s) {
+      return (size_t(uint8_t(s[0]))*3 + size_t(uint8_t(s[s.size()-1]))*3 +
+              size_t(uint8_t(s[s.size()/2]))*5 + s.size()) % hash_size;
+    }
+
+    struct TypeTable {
+      int8_t slot[hash_size];
+      bool perfect;
+    };
+
+    constexpr TypeTable MakeTypeTable() {
+      TypeTable table{};
+      for (size_t h=0; h<hash_size; h++) {
+        table.slot[h] = -1;
+      }
+      table.perfect = true;
+      for (size_t i=0; i<type_count; i++) {
+        size_t h = TypeHash(type_names[i].name);
+        if (table.slot[h] >= 0) {
+          table.perfect = false;
+        }
+        table.slot[h] = int8_t(i);
+      }
+      return table;
+    }
+
+    constexpr TypeTable type_table = MakeTypeTable();
+    static_assert(type_table.perfect,
+        "Task message type hash has a collision, choose new coefficients.");
+
+
+    // A minimal json scanner for the fields Scan() needs.  Each function
+    // advances p past what it read, or returns false.
+    class Scanner {
+      public:
+      Scanner(std::string_view line)
+        : p(line.data()), end(line.data() + line.size()) { }
+
+      void SkipWS() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' ||
+               *p == '\n')) {
+          p++;
+        }
+      }
+
+      bool Expect(char c) {
+        SkipWS();
+        if (p < end && *p == c) {
+          p++;
+          return true;
+        }
+        return false;
+      }
+
+      bool Peek(char c) {
+        SkipWS();
+        return p < end && *p == c;
+      }
+
+      bool AtEnd() {
+        SkipWS();
+        return p == end;
+      }
+
+      /// A string with no escapes, as a view without the quotes.
+      bool PlainString(std::string_view& str) {
+        if ( ! Expect('"') ) {
+          return false;
+        }
+        const char* start = p;
+        while (p < end && *p != '"') {
+          if (*p == '\\' || uint8_t(*p) < 0x20) {
+            return false;
+          }
+          p++;
+        }
+        if (p == end) {
+          return false;
+        }
+        str = std::string_view(start, size_t(p - start));
+        p++;
+        return true;
+      }
+
+      bool UInt(uint64_t& val) {
+        SkipWS();
+        const char* start = p;
+        val = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+          uint64_t digit = uint64_t(*p - '0');
+          if (val > (uint64_t(-1) - digit) / 10) {
+            return false;
+          }
+          val = val*10 + digit;
+          p++;
+        }
+        // Leave fractions, exponents, and signs to the full parser.
+        return p != start && (p == end || (*p != '.' && *p != 'e' &&
+              *p != 'E'));
+      }
+
+      bool Number(double& val) {
+        SkipWS();
+        const char* start = p;
+        while (p < end && ((*p >= '0' && *p <= '9') || *p == '-' ||
+               *p == '+' || *p == '.' || *p == 'e' || *p == 'E')) {
+          p++;
+        }
+        if (p == start) {
+          return false;
+        }
+        // Not from_chars, which some standard libraries lack for double.
+        auto num = nlohmann::json::parse(start, p, nullptr, false);
+        if ( ! num.is_number() ) {
+          return false;
+        }
+        val = num.get<double>();
+        return true;
+      }
+
+      /// Skip any json value, checking only that brackets and strings
+      /// close.
+      bool SkipValue() {
+        SkipWS();
+        size_t depth = 0;
+        do {
+          if (p == end) {
+            return false;
+          }
+          char c = *p;
+          if (c == '"') {
+            p++;
+            while (p < end && *p != '"') {
+              if (*p == '\\' && ++p == end) {
+                return false;
+              }
+              p++;
+            }
+            if (p == end) {
+              return false;
+            }
+            p++;
+          }
+          else if (c == '{' || c == '[') {
+            depth++;
+            p++;
+          }
+          else if (c == '}' || c == ']') {
+            if (depth == 0) {
+              return false;
+            }
+            depth--;
+            p++;
+          }
+          else if (depth == 0) {
+            // A number, true, false, or null.
+            const char* start = p;
+            while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+                   *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+              p++;
+            }
+            return p != start;
+          }
+          else {
+            p++;
+          }
+        } while (depth > 0);
+        return true;
+      }
+
+      /// Calls field(key) for each member of an object, which must read
+      /// the value.
+      template<class F>
+      bool Object(F field) {
+        if ( ! Expect('{') ) {
+          return false;
+        }
+        if (Expect('}')) {
+          return true;
+        }
+        do {
+          std::string_view key;
+          if ( ! PlainString(key) || ! Expect(':') || ! field(key) ) {
+            return false;
+          }
+        } while (Expect(','));
+        return Expect('}');
+      }
+
+      protected:
+      const char* p;
+      const char* end;
+    };
+
+
+    // The same for a MessagePack frame.
+    class MsgpackScanner {
+      public:
+      MsgpackScanner(std::string_view frame)
+        : p(reinterpret_cast<const uint8_t*>(frame.data()))
+        , end(p + frame.size()) { }
+
+      bool AtEnd() const { return p == end; }
+
+      bool PeekMap() const {
+        return p < end && ((*p & 0xf0) == 0x80 || *p == 0xde || *p == 0xdf);
+      }
+
+      /// A str, as a view of its bytes.
+      bool String(std::string_view& str) {
+        if (p == end) {
+          return false;
+        }
+        uint8_t tag = *p;
+        uint64_t len;
+        if ((tag & 0xe0) == 0xa0) {
+          p++;
+          len = tag & 0x1f;
+        }
+        else if (tag == 0xd9 || tag == 0xda || tag == 0xdb) {
+          p++;
+          if ( ! BigEndian(size_t(1) << (tag - 0xd9), len) ) {
+            return false;
+          }
+        }
+        else {
+          return false;
+        }
+        if (uint64_t(end - p) < len) {
+          return false;
+        }
+        str = std::string_view(reinterpret_cast<const char*>(p), len);
+        p += len;
+        return true;
+      }
+
+      /// A non-negative integer.
+      bool UInt(uint64_t& val) {
+        if (p == end) {
+          return false;
+        }
+        uint8_t tag = *p;
+        if (tag < 0x80) {
+          p++;
+          val = tag;
+          return true;
+        }
+        if (tag >= 0xcc && tag <= 0xcf) {
+          p++;
+          return BigEndian(size_t(1) << (tag - 0xcc), val);
+        }
+        if (tag >= 0xd0 && tag <= 0xd3) {
+          p++;
+          size_t bytes = size_t(1) << (tag - 0xd0);
+          if ( ! BigEndian(bytes, val) ) {
+            return false;
+          }
+          // Negative values are left to the full parser.
+          return (val >> (8*bytes - 1)) == 0;
+        }
+        return false;
+      }
+
+      bool Number(double& val) {
+        if (p == end) {
+          return false;
+        }
+        uint8_t tag = *p;
+        if (tag == 0xca || tag == 0xcb) {
+          p++;
+          uint64_t bits;
+          if (tag == 0xca) {
+            if ( ! BigEndian(4, bits) ) {
+              return false;
+            }
+            uint32_t bits32 = uint32_t(bits);
+            float f;
+            std::memcpy(&f, &bits32, sizeof(f));
+            val = f;
+          }
+          else {
+            if ( ! BigEndian(8, bits) ) {
+              return false;
+            }
+            std::memcpy(&val, &bits, sizeof(val));
+          }
+          return true;
+        }
+        uint64_t u;
+        if ( ! UInt(u) ) {
+          return false;
+        }
+        val = double(u);
+        return true;
+      }
+
+      /// Skip any value, checking only that it fits in the frame.
+      bool SkipValue() {
+        uint64_t pending = 1;
+        while (pending > 0) {
+          pending--;
+          if (p == end) {
+            return false;
+          }
+          uint8_t tag = *p++;
+          uint64_t len = 0;
+          uint64_t items = 0;
+          if (tag < 0x80 || tag >= 0xe0 || tag == 0xc0 || tag == 0xc2 ||
+              tag == 0xc3) {
+            // fixint, nil, or bool.
+          }
+          else if (tag < 0x90) {
+            items = 2 * uint64_t(tag & 0x0f);
+          }
+          else if (tag < 0xa0) {
+            items = tag & 0x0f;
+          }
+          else if (tag < 0xc0) {
+            len = tag & 0x1f;
+          }
+          else if (tag >= 0xc4 && tag <= 0xc6) {  // bin
+            if ( ! BigEndian(size_t(1) << (tag - 0xc4), len) ) {
+              return false;
+            }
+          }
+          else if (tag >= 0xc7 && tag <= 0xc9) {  // ext
+            if ( ! BigEndian(size_t(1) << (tag - 0xc7), len) ) {
+              return false;
+            }
+            len++;
+          }
+          else if (tag == 0xca) {
+            len = 4;
+          }
+          else if (tag == 0xcb) {
+            len = 8;
+          }
+          else if (tag >= 0xcc && tag <= 0xcf) {
+            len = size_t(1) << (tag - 0xcc);
+          }
+          else if (tag >= 0xd0 && tag <= 0xd3) {
+            len = size_t(1) << (tag - 0xd0);
+          }
+          else if (tag >= 0xd4 && tag <= 0xd8) {  // fixext
+            len = (size_t(1) << (tag - 0xd4)) + 1;
+          }
+          else if (tag >= 0xd9 && tag <= 0xdb) {  // str
+            if ( ! BigEndian(size_t(1) << (tag - 0xd9), len) ) {
+              return false;
+            }
+          }
+          else if (tag == 0xdc || tag == 0xdd) {  // array
+            if ( ! BigEndian(tag == 0xdc ? 2 : 4, items) ) {
+              return false;
+            }
+          }
+          else if (tag == 0xde || tag == 0xdf) {  // map
+            if ( ! BigEndian(tag == 0xde ? 2 : 4, items) ) {
+              return false;
+            }
+            items *= 2;
+          }
+          else {
+            return false;  // 0xc1, never used.
+          }
+
+          if (uint64_t(end - p) < len) {
+            return false;
+          }
+          p += len;
+          // Every item takes at least a byte.
+          pending += items;
+          if (pending > uint64_t(end - p)) {
+            return false;
+          }
+        }
+        return true;
+      }
+
+      /// Calls field(key) for each member of a map with str keys, which
+      /// must read the value.
+      template<class F>
+      bool Map(F field) {
+        if ( ! PeekMap() ) {
+          return false;
+        }
+        uint8_t tag = *p++;
+        uint64_t count;
+        if (tag == 0xde || tag == 0xdf) {
+          if ( ! BigEndian(tag == 0xde ? 2 : 4, count) ) {
+            return false;
+          }
+        }
+        else {
+          count = tag & 0x0f;
+        }
+        for (uint64_t i=0; i<count; i++) {
+          std::string_view key;
+          if ( ! String(key) || ! field(key) ) {
+            return false;
+          }
+        }
+        return true;
+      }
+
+      protected:
+      bool BigEndian(size_t bytes, uint64_t& val) {
+        if (size_t(end - p) < bytes) {
+          return false;
+        }
+        val = 0;
+        for (size_t i=0; i<bytes; i++) {
+          val = (val << 8) | *p++;
+        }
+        return true;
+      }
+
+      const uint8_t* p;
+      const uint8_t* end;
+    };
+  }
+
+
+  TaskMsgType ToTaskMsgType(std::string_view name) {
+    if (name.empty()) {
+      return TaskMsgType::UNKNOWN;
+    }
+    int8_t slot = type_table.slot[TypeHash(name)];
+    if (slot < 0 || type_names[slot].name != name) {
+      return TaskMsgType::UNKNOWN;
+    }
+    return type_names[slot].type;
+  }
+
+
+  bool TaskMessage::Scan(std::string_view line) {
+    *this = TaskMessage();
+    Scanner scan(line);
+    bool has_type = false;
+
+    auto data_field = [&](std::string_view key) {
+      if (key == "classifyms") {
+        has_classifyms = scan.UInt(classifyms);
+        return has_classifyms;
+      }
+      return scan.SkipValue();
+    };
+
+    auto top_field = [&](std::string_view key) {
+      if (key == "type") {
+        has_type = scan.PlainString(type_name);
+        return has_type;
+      }
+      else if (key == "id") {
+        return scan.UInt(id);
+      }
+      else if (key == "task_time") {
+        has_task_time = scan.Number(task_time);
+        return has_task_time;
+      }
+      else if (key == "data" && scan.Peek('{')) {
+        has_classifyms = false;
+        return scan.Object(data_field);
+      }
+      return scan.SkipValue();
+    };
+
+    if ( ! scan.Object(top_field) || ! scan.AtEnd() || ! has_type ) {
+      return false;
+    }
+
+    type = ToTaskMsgType(type_name);
+    return true;
+  }
+
+
+  bool TaskMessage::ScanMsgpack(std::string_view frame) {
+    *this = TaskMessage();
+    MsgpackScanner scan(frame);
+    bool has_type = false;
+
+    auto data_field = [&](std::string_view key) {
+      if (key == "classifyms") {
+        has_classifyms = scan.UInt(classifyms);
+        return has_classifyms;
+      }
+      return scan.SkipValue();
+    };
+
+    auto top_field = [&](std::string_view key) {
+      if (key == "type") {
+        has_type = scan.String(type_name);
+        return has_type;
+      }
+      else if (key == "id") {
+        return scan.UInt(id);
+      }
+      else if (key == "task_time") {
+        has_task_time = scan.Number(task_time);
+        return has_task_time;
+      }
+      else if (key == "data" && scan.PeekMap()) {
+        has_classifyms = false;
+        return scan.Map(data_field);
+      }
+      return scan.SkipValue();
+    };
+
+    if ( ! scan.Map(top_field) || ! scan.AtEnd() || ! has_type ) {
+      return false;
+    }
+
+    type = ToTaskMsgType(type_name);
+    return true;
+  }
+}
+
@@ -0,0 +1,50 @@
+#ifndef TASKMESSAGE_H
+#define TASKMESSAGE_H
+
+#include <cstdint>
+#include <string_view>
+
+namespace CML {
+  /// The message types of the task laptop protocol.
+  enum class TaskMsgType {
+    UNKNOWN,
+    CONNECTED, CONFIGURE, READY, HEARTBEAT, WORD, STIM,
+    CLSTIM, CLSHAM, CLNORMALIZE, STIMSELECT, SESSION, TRIAL, EXIT,
+    SYNC_OK,
+    // Status events only.
+    ORIENT, COUNTDOWN, DISTRACT, RECALL, REST, INSTRUCT, TRIALEND, MATH
+  };
+
+  /// Look up a message type name, with a perfect hash.
+  TaskMsgType ToTaskMsgType(std::string_view name);
+
+
+  /// The routing fields of a task laptop message.
+  /** Scan() reads them straight from the received json line in one pass,
+   *  and ScanMsgpack() from a MessagePack frame, without building a DOM,
+   *  so the latency-critical messages can be dispatched before the full
+   *  parse.
+   */
+  class TaskMessage {
+    public:
+    std::string_view type_name;  // Points into the scanned line.
+    TaskMsgType type = TaskMsgType::UNKNOWN;
+    uint64_t id = uint64_t(-1);  // uint64_t(-1) if absent.
+    uint64_t classifyms = 0;     // From "data", if has_classifyms.
+    bool has_classifyms = false;
+    double task_time = 0;        // Task clock ms when sent.
+    bool has_task_time = false;
+
+    /// @return False unless line is a json object with a plain string
+    /// "type", and an integer "id", number "task_time", and integer "data"
+    /// "classifyms" if present.
+    /// Anything unusual fails, for the caller to use a full parse.
+    bool Scan(std::string_view line);
+    /// The same for a MessagePack frame, which must be a map with str
+    /// keys.
+    bool ScanMsgpack(std::string_view frame);
+  };
+}
+
+#endif // TASKMESSAGE_H
+
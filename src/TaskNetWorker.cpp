@@ -4,17 +4,28 @@
 #include "JSONLines.h"
 #include "Popup.h"
 #include "StatusPanel.h"
+#include "TaskMessage.h"
 #include "RC/Data1D.h"
+#include <algorithm>
 
 using namespace RC;
 
 namespace CML {
+  namespace {
+    // Never reach further back than this for a classification window.
+    const double max_lead_ms = 1000;
+  }
+
+
   TaskNetWorker::TaskNetWorker(RC::Ptr<Handler> hndl)
     : NetWorker(hndl, "Task"), hndl(hndl) {
   }
 
   void TaskNetWorker::DisconnectedBefore() {
+    StopSync();
     status_panel->Clear();
+    configure_pending = false;
+    held.clear();
   }
 
   void TaskNetWorker::SetStatusPanel_Handler(const RC::Ptr<StatusPanel>& set_panel) {
@@ -25,18 +36,70 @@ namespace CML {
     RC::RStr line = msg.Line();
     hndl->event_log.Log(line);
 
-    Send(line);
+    if (binary_frames) {
+      SendFrame(nlohmann::json::to_msgpack(msg.json));
+    }
+    else {
+      Send(line);
+    }
+  }
+
+  void TaskNetWorker::ProcessCommand(std::string_view cmd) {
+#ifdef NETWORKER_TIMING
+    timer.Start();
+#endif // NETWORKER_TIMING
+    double arrival_ms = Time::Get()*1e3;
+
+    if (configure_pending) {
+      Hold(cmd, false, arrival_ms);
+      return;
+    }
+    ReplayHeld();
+    ProcessText(cmd, arrival_ms);
   }
 
-  void TaskNetWorker::ProcessCommand(RC::RStr cmd) {
+
+  void TaskNetWorker::ProcessFrame(std::string_view frame) {
 #ifdef NETWORKER_TIMING
     timer.Start();
 #endif // NETWORKER_TIMING
+    double arrival_ms = Time::Get()*1e3;
+
+    if (configure_pending) {
+      Hold(frame, true, arrival_ms);
+      return;
+    }
+    ReplayHeld();
+    ProcessMsgpack(frame, arrival_ms);
+  }
+
+
+  void TaskNetWorker::ProcessText(std::string_view cmd, double arrival_ms) {
+    if (ProcessFast(cmd, false, arrival_ms)) {
+      return;
+    }
 
     JSONFile inp;
     inp.SetFilename("TaskLaptopCommand");
     inp.Parse(cmd);
+    ProcessMessage(inp, arrival_ms);
+  }
+
+
+  void TaskNetWorker::ProcessMsgpack(std::string_view frame,
+      double arrival_ms) {
+    if (ProcessFast(frame, true, arrival_ms)) {
+      return;
+    }
+
+    JSONFile inp;
+    inp.SetFilename("TaskLaptopCommand");
+    inp.json = nlohmann::json::from_msgpack(frame.begin(), frame.end());
+    ProcessMessage(inp, arrival_ms);
+  }
+
 
+  void TaskNetWorker::ProcessMessage(JSONFile& inp, double arrival_ms) {
     std::string type;
     uint64_t id = uint64_t(-1);
     if (!inp.TryGet(type, "type")) {
@@ -47,29 +110,44 @@ namespace CML {
       // Leave as uint64_t(-1) to disable.
     }
 
-    inp.Set(Time::Get()*1e3, "time");
+    double latency_ms = -1;
+    double task_time;
+    if (inp.TryGet(task_time, "task_time")) {
+      latency_ms = OneWayLatency(task_time, arrival_ms);
+      if (latency_ms >= 0) {
+        inp.Set(latency_ms, "latency_ms");
+      }
+    }
+
+    inp.Set(arrival_ms, "time");
+    // Serialized once here, as inp is still needed, rather than copied.
     hndl->event_log.Log(inp.Line());
 
-    if (type == "CONNECTED") {
+    TaskMsgType msg_type = ToTaskMsgType(type);
+    if (msg_type == TaskMsgType::CONNECTED) {
       JSONFile response = MakeResp("CONNECTED_OK");
       LogAndSend(response);
       status_panel->SetEvent(type);
+      return;
     }
-    else if (type == "CONFIGURE") {
+    if (msg_type == TaskMsgType::CONFIGURE) {
       ProtConfigure(inp);
+      return;
     }
-    else {
-      if (!configured) {
-        ErrorWin("Unapproved commands received from task laptop on "
-                 "connection without verified CONFIGURE.");
-        return;
-      }
-      if (type == "READY") {
+    if (!configured) {
+      ErrorWin("Unapproved commands received from task laptop on "
+               "connection without verified CONFIGURE.");
+      return;
+    }
+
+    switch (msg_type) {
+      case TaskMsgType::READY: {
         hndl->eeg_acq.StartingExperiment();  // notify, replay needs this.
         JSONFile response = MakeResp("START");
         LogAndSend(response);
+        break;
       }
-      else if (type == "HEARTBEAT") {
+      case TaskMsgType::HEARTBEAT: {
         JSONFile response = MakeResp("HEARTBEAT_OK");
         try {
           uint64_t count;
@@ -78,68 +156,260 @@ namespace CML {
         }
         catch (...) { }
         LogAndSend(response);
+        break;
       }
-      else if (type == "WORD") {
+      case TaskMsgType::WORD:
         ProtWord(inp);
         status_panel->SetEvent(type);
-      }
-      else if (type == "STIM") {
+        break;
+      case TaskMsgType::STIM:
         hndl->stim_worker.Stimulate();
-      }
-      else if (type == "CLSTIM") {
+        break;
+      case TaskMsgType::CLSTIM:
+      case TaskMsgType::CLSHAM:
+      case TaskMsgType::CLNORMALIZE: {
         uint64_t classifyms;
         inp.Get(classifyms, "data", "classifyms");
-        hndl->task_classifier_manager->ProcessClassifierEvent(
-            ClassificationType::STIM, classifyms, id);
+        ProcessClassify(msg_type, classifyms, id, latency_ms);
+        break;
       }
-      else if (type == "CLSHAM") {
-        uint64_t classifyms;
-        inp.Get(classifyms, "data", "classifyms");
-        hndl->task_classifier_manager->ProcessClassifierEvent(
-            ClassificationType::SHAM, classifyms, id);
-      }
-      else if (type == "CLNORMALIZE") {
-        uint64_t duration;
-        inp.Get(duration, "data", "classifyms");
-        hndl->task_classifier_manager->ProcessClassifierEvent(
-            ClassificationType::NORMALIZE, duration, id);
-      }
-      else if (type == "STIMSELECT") {
+      case TaskMsgType::STIMSELECT: {
         RC::RStr stimtag;
         inp.Get(stimtag, "data", "stimtag");
         hndl->SelectStim(stimtag);
+        break;
       }
-      else if (type == "SESSION") {
+      case TaskMsgType::SESSION: {
         int64_t session;
         inp.Get(session, "data", "session");
         status_panel->SetSession(session);
+        break;
       }
-      else if (type == "TRIAL") {
+      case TaskMsgType::TRIAL: {
         int64_t trial;
         bool stim;
         inp.Get(trial, "data", "trial");
         status_panel->SetTrial(trial);
         inp.Get(stim, "data", "stim");
         status_panel->SetStimList(stim);
+        break;
       }
-      else if (type == "EXIT") {
+      case TaskMsgType::EXIT:
         status_panel->SetEvent(type);
         hndl->ExperimentExit();
+        break;
+      case TaskMsgType::SYNC_OK:
+        ProtSyncOk(inp, arrival_ms);
+        break;
+      case TaskMsgType::ORIENT:
+      case TaskMsgType::COUNTDOWN:
+      case TaskMsgType::DISTRACT:
+      case TaskMsgType::RECALL:
+      case TaskMsgType::REST:
+      case TaskMsgType::INSTRUCT:
+      case TaskMsgType::TRIALEND:
+      case TaskMsgType::MATH:
+        status_panel->SetEvent(type);
+        break;
+      default:
+        break;
+    }
+  }
+
+
+  bool TaskNetWorker::ProcessFast(std::string_view cmd, bool binary,
+      double arrival_ms) {
+    if (!configured) {
+      return false;
+    }
+
+    TaskMessage msg;
+    if (binary ? !msg.ScanMsgpack(cmd) : !msg.Scan(cmd)) {
+      return false;
+    }
+
+    switch (msg.type) {
+      case TaskMsgType::CLSTIM:
+      case TaskMsgType::CLSHAM:
+      case TaskMsgType::CLNORMALIZE:
+        if (!msg.has_classifyms) {
+          return false;
+        }
+        break;
+      case TaskMsgType::STIM:
+        break;
+      default:
+        return false;
+    }
+
+    double latency_ms = -1;
+    JSONFile extra;
+    if (msg.has_task_time) {
+      latency_ms = OneWayLatency(msg.task_time, arrival_ms);
+      if (latency_ms >= 0) {
+        extra.Set(latency_ms, "latency_ms");
+      }
+    }
+
+    // Parsed in full and serialized on the EventLog thread.
+    if (binary) {
+      hndl->event_log.LogReceivedMsgpack(cmd, std::move(extra));
+    }
+    else {
+      hndl->event_log.LogReceived(cmd, std::move(extra));
+    }
+
+    if (msg.type == TaskMsgType::STIM) {
+      hndl->stim_worker.Stimulate();
+    }
+    else {
+      ProcessClassify(msg.type, msg.classifyms, msg.id, latency_ms);
+    }
+    return true;
+  }
+
+
+  void TaskNetWorker::ProcessClassify(TaskMsgType msg_type,
+      uint64_t classifyms, uint64_t id, double latency_ms) {
+    ClassificationType cl_type = ClassificationType::NORMALIZE;
+    if (msg_type == TaskMsgType::CLSTIM) {
+      cl_type = ClassificationType::STIM;
+    }
+    else if (msg_type == TaskMsgType::CLSHAM) {
+      cl_type = ClassificationType::SHAM;
+    }
+    // Align the window to when the task laptop sent the request.
+    uint64_t lead_us = 0;
+    if (latency_ms > 0) {
+      lead_us = uint64_t(std::min(latency_ms, max_lead_ms) * 1e3);
+    }
+    hndl->task_classifier_manager->ProcessClassifierEvent(cl_type,
+        classifyms, id, lead_us);
+  }
+
+
+  double TaskNetWorker::OneWayLatency(double task_time, double arrival_ms) {
+    if ( ! clock_sync.IsValid() ) {
+      return -1;
+    }
+    double latency_ms = std::max(0.0,
+        arrival_ms - clock_sync.ToLocal(task_time));
+    one_way_latency.Record(uint64_t(latency_ms * 1e6));
+    return latency_ms;
+  }
+
+
+  void TaskNetWorker::ProtSyncOk(const JSONFile& inp, double arrival_ms) {
+    double t0, t1, t2;
+    inp.Get(t0, "data", "t0");
+    inp.Get(t1, "data", "t1");
+    inp.Get(t2, "data", "t2");
+    bool accepted = clock_sync.AddExchange(t0, t1, t2, arrival_ms);
+
+    JSONFile sync_log = MakeResp("CLOCK_SYNC");
+    sync_log.Set(accepted, "data", "accepted");
+    sync_log.Set(clock_sync.LastDelay(), "data", "delay_ms");
+    sync_log.Set(clock_sync.MinDelay(), "data", "min_delay_ms");
+    sync_log.Set(clock_sync.Offset(arrival_ms), "data", "offset_ms");
+    sync_log.Set(clock_sync.DriftPPM(), "data", "drift_ppm");
+    sync_log.Set(one_way_latency.Count(), "data", "latency_count");
+    sync_log.Set(one_way_latency.Percentile(0.5)*1e-6, "data",
+        "latency_p50_ms");
+    sync_log.Set(one_way_latency.Percentile(0.99)*1e-6, "data",
+        "latency_p99_ms");
+    sync_log.Set(one_way_latency.Max()*1e-6, "data", "latency_max_ms");
+    hndl->event_log.Log(std::move(sync_log));
+  }
+
+
+  void TaskNetWorker::SyncTimer_Slot() {
+    if ( ! IsConnected_Handler() ) {
+      StopSync();
+      return;
+    }
+    JSONFile sync = MakeResp("SYNC", sync_id++);
+    sync.Set(Time::Get()*1e3, "data", "t0");
+    LogAndSend(sync);
+  }
+
+
+  void TaskNetWorker::StartSync() {
+    StopSync();
+    BeAllocatedTimer();
+    sync_timer->start(int(sync_interval_ms));
+    SyncTimer_Slot();
+  }
+
+
+  void TaskNetWorker::StopSync() {
+    if (sync_timer.IsSet()) {
+      sync_timer->stop();
+    }
+    clock_sync.Reset();
+    one_way_latency.Reset();
+  }
+
+
+  void TaskNetWorker::BeAllocatedTimer() {
+    if (sync_timer.IsNull()) {
+      sync_timer = new QTimer();
+      AddToThread(sync_timer);
+
+      QObject::connect(sync_timer.Raw(), &QTimer::timeout, this,
+                       &TaskNetWorker::SyncTimer_Slot);
+    }
+  }
+
+
+  void TaskNetWorker::Hold(std::string_view msg, bool binary,
+      double arrival_ms) {
+    held.push_back({std::string(msg), binary, arrival_ms});
+  }
+
+
+  void TaskNetWorker::ReplayHeld() {
+    // Stops at a held CONFIGURE, to resume from its ConfigReady.
+    while ( ! configure_pending && ! held.empty() ) {
+      HeldMessage msg = std::move(held.front());
+      held.pop_front();
+      if (msg.binary) {
+        ProcessMsgpack(msg.data, msg.arrival_ms);
       }
       else {
-        if (type ==
-            RC::OneOf("ORIENT", "COUNTDOWN", "DISTRACT", "RECALL", "REST",
-                      "INSTRUCT", "TRIALEND", "MATH")) {
-          status_panel->SetEvent(type);
-        }
+        ProcessText(msg.data, msg.arrival_ms);
       }
     }
   }
 
 
   void TaskNetWorker::ProtConfigure(const JSONFile& inp) {
+    pending_configure = inp;
+    configure_pending = true;
+    config_requests++;
+    hndl->GetConfig.Then(ConfigReady);
+  }
+
+
+  void TaskNetWorker::ConfigReady_Handler(const FullConf& conf) {
+    config_requests--;
+    if (config_requests > 0 || ! configure_pending) {
+      // Superseded by a later request, or the connection was lost.
+      return;
+    }
+    configure_pending = false;
+    FinishConfigure(pending_configure, conf);
+    ReplayHeld();
+  }
+
+
+  void TaskNetWorker::FinishConfigure(const JSONFile& inp,
+      const FullConf& conf) {
     Data1D<RStr> errors;
     Data1D<RStr> stimtags;
+    Data1D<RStr> framings;
+    bool framing_offered = false;
+    bool binary = false;
+    bool clock_sync_offered = false;
 
     std::string task_stim_mode;
     std::string task_experiment;
@@ -149,7 +419,6 @@ namespace CML {
     std::string host_subject;
 
     try {
-      auto conf = hndl->GetConfig();
       inp.Get(task_stim_mode, "data", "stim_mode");
       inp.Get(task_experiment, "data", "experiment");
       inp.Get(task_subject, "data", "subject");
@@ -165,6 +434,22 @@ namespace CML {
           hndl->SelectStim(stimtags[s]);
         }
       }
+
+      inp.TryGet(clock_sync_offered, "data", "clock_sync");
+
+      // Offered in order of preference.  Absent means json lines only.
+      framing_offered = inp.TryGet(framings, "data", "framing");
+      if (framing_offered) {
+        for (size_t f=0; f<framings.size(); f++) {
+          if (framings[f] == "msgpack") {
+            binary = allow_binary_framing;
+            break;
+          }
+          if (framings[f] == "json") {
+            break;
+          }
+        }
+      }
     }
     catch (ErrorMsg& e) {
       errors += RStr(e.what()).SplitFirst("\n")[0];
@@ -181,8 +466,20 @@ namespace CML {
     }
     else {
       JSONFile response = MakeResp("CONFIGURE_OK");
+      if (framing_offered) {
+        response.Set(binary ? "msgpack" : "json", "data", "framing");
+      }
+      bool sync = clock_sync_offered && sync_interval_ms > 0;
+      if (clock_sync_offered) {
+        response.Set(sync ? sync_interval_ms : 0, "data", "sync_interval_ms");
+      }
       configured = true;
+      // Sent in the framing used for the CONFIGURE, then switched.
       LogAndSend(response);
+      binary_frames = binary;
+      if (sync) {
+        StartSync();
+      }
     }
   }
 
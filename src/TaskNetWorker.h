@@ -1,11 +1,18 @@
 #ifndef TASKNETWORKER_H
 #define TASKNETWORKER_H
 
+#include "ClockSync.h"
+#include "ConfigFile.h"
 #include "NetWorker.h"
+#include "Settings.h"
+#include "TaskMessage.h"
+#include "RCqt/TaskStats.h"
+#include <QTimer>
+#include <deque>
+#include <string>
 
 namespace CML {
   class Handler;
-  class JSONFile;
   class StatusPanel;
 
   class TaskNetWorker : public NetWorker {
@@ -21,16 +28,66 @@ namespace CML {
     RCqt::TaskCaller<const RC::Ptr<StatusPanel>> SetStatusPanel =
       TaskHandler(TaskNetWorker::SetStatusPanel_Handler);
 
+    /// Whether to accept a task laptop offer of msgpack framing.
+    RCqt::TaskCaller<const bool> AllowBinaryFraming =
+      TaskHandler(TaskNetWorker::AllowBinaryFraming_Handler);
+
+    /// How often to send SYNC to a task laptop that accepts it, 0 to never.
+    RCqt::TaskCaller<const uint64_t> SetSyncInterval =
+      TaskHandler(TaskNetWorker::SetSyncInterval_Handler);
+
+    protected slots:
+    void SyncTimer_Slot();
+
     protected:
     void DisconnectedBefore() override;
 
     void LogAndSend(JSONFile& msg);
 
-    void ProcessCommand(RC::RStr cmd) override;
+    void ProcessCommand(std::string_view cmd) override;
+    void ProcessFrame(std::string_view frame) override;
+    void ProcessText(std::string_view cmd, double arrival_ms);
+    void ProcessMsgpack(std::string_view frame, double arrival_ms);
+    /** @param arrival_ms When the message was read, in ms since 1970 UTC.
+     */
+    void ProcessMessage(JSONFile& inp, double arrival_ms);
+    /// Dispatches the latency-critical messages from a single-pass scan,
+    /// leaving the full parse to the EventLog thread.
+    /** @param binary True if cmd is a MessagePack frame.
+     *  @return False if cmd needs the full parse.
+     */
+    bool ProcessFast(std::string_view cmd, bool binary, double arrival_ms);
+    void ProcessClassify(TaskMsgType msg_type, uint64_t classifyms,
+        uint64_t id, double latency_ms);
+
+    /// The one-way transit time of a message stamped "task_time", or a
+    /// negative value if it is not stamped or the clocks are not synced.
+    double OneWayLatency(double task_time, double arrival_ms);
+    void ProtSyncOk(const JSONFile& inp, double arrival_ms);
 
     void SetStatusPanel_Handler(const RC::Ptr<StatusPanel>& set_panel);
+    void AllowBinaryFraming_Handler(const bool& allow) {
+      allow_binary_framing = allow;
+    }
+    void SetSyncInterval_Handler(const uint64_t& interval_ms) {
+      sync_interval_ms = interval_ms;
+    }
 
+    void StartSync();
+    void StopSync();
+    void BeAllocatedTimer();
+
+    /// Asks the Handler for its config without blocking, and answers the
+    /// CONFIGURE from ConfigReady.
     void ProtConfigure(const JSONFile& inp);
+    RCqt::TaskCaller<const FullConf> ConfigReady =
+      TaskHandler(TaskNetWorker::ConfigReady_Handler);
+    void ConfigReady_Handler(const FullConf& conf);
+    void FinishConfigure(const JSONFile& inp, const FullConf& conf);
+    /// Keeps a message received while a CONFIGURE is unanswered, to be
+    /// processed in order after it.
+    void Hold(std::string_view msg, bool binary, double arrival_ms);
+    void ReplayHeld();
     void ProtWord(const JSONFile& inp);
 
     void Compare(RC::Data1D<RC::RStr>& errors, const RC::RStr& label,
@@ -38,6 +95,25 @@ namespace CML {
 
     RC::Ptr<StatusPanel> status_panel;
     RC::Ptr<Handler> hndl;
+    bool allow_binary_framing = true;
+
+    ClockSync clock_sync;
+    RCqt::LatencyHistogram one_way_latency;
+    RC::APtr<QTimer> sync_timer;
+    uint64_t sync_interval_ms = 1000;
+    uint64_t sync_id = 0;
+
+    struct HeldMessage {
+      std::string data;
+      bool binary;
+      double arrival_ms;
+    };
+    std::deque<HeldMessage> held;
+    JSONFile pending_configure;
+    bool configure_pending = false;
+    // GetConfig requests without a reply yet, as a disconnect can leave
+    // one outstanding when the next CONFIGURE asks again.
+    size_t config_requests = 0;
   };
 }
 
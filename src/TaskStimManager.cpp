@@ -1,6 +1,7 @@
 #include "TaskStimManager.h"
 #include "RC/Macros.h"
 #include "Classifier.h"
+#include "DecisionTrace.h"
 #include "EEGAcq.h"
 #include "Handler.h"
 #include "JSONLines.h"
@@ -12,6 +13,8 @@ namespace CML {
 
   void TaskStimManager::StimDecision_Handler(const double& result,
     const TaskClassifierSettings& task_classifier_settings) {
+    DecisionTrace::Span decision_span(TraceStage::DECISION,
+        task_classifier_settings);
 
     bool stim = result < 0.5;
     bool stim_type =
@@ -30,12 +33,17 @@ namespace CML {
     }();
 
     auto resp = MakeResp(type, task_classifier_settings.classif_id, data);
-    hndl->event_log.Log(resp.Line());
+    hndl->event_log.Log(std::move(resp), true);
 
     if (stim_type && stim) {
-      hndl->stim_worker.Stimulate();
+      decision_span.End();
+      hndl->stim_worker.StimulateDecision(task_classifier_settings,
+          DecisionTrace::Now());
       if (callback.IsSet()) { callback(true, task_classifier_settings); }
     } else {
+      decision_span.End();
+      DecisionTrace::Record(TraceStage::TOTAL, task_classifier_settings,
+          task_classifier_settings.requested_ns, DecisionTrace::Now());
       if (callback.IsSet()) { callback(false, task_classifier_settings); }
     }
   }
@@ -4,11 +4,21 @@
 #include "ChannelConf.h"
 #include "TaskClassifierManager.h"
 #include "EEGCircularData.h"
+#include "EEGCodec.h"
 #include "RollingStats.h"
 #include "NormalizePowers.h"
 #include "ClassifierLogReg.h"
 #include "WeightManager.h"
 #include "Handler.h"
+#include "EventScheduler.h"
+#include <QDir>
+#include <chrono>
+#include <thread>
+#ifdef CERESTIM_SIMULATOR
+#include "CereStim.h"
+#include "CereStimDLL.h"
+#include "CereStimSim.h"
+#endif
 
 
 namespace CML {
@@ -117,6 +127,40 @@ namespace CML {
 
     //circular_data.GetData()->Print();
     //circular_data.GetData(5)->Print();
+
+    // A view must keep its samples across appends that wrap over them,
+    // and the buffer must keep its own recent samples.  Sample s of
+    // channel c is 100*c + s.
+    size_t block_len = 100;
+    EEGCircularData wrap_data(sampling_rate, 3*block_len);
+    auto append_block = [&](size_t b) {
+      auto block = CreateTestingEEGDataDouble(sampling_rate, block_len, 5,
+          int16_t(b*block_len));
+      wrap_data.Append(block);
+    };
+    auto check_view = [&](const EEGCircularView& v, size_t first,
+        const RC::RStr& what) {
+      RC_ForRange(c, 0, v.ChanCount()) {
+        RC_ForRange(i, 0, v.sample_len) {
+          double expected = double(block_len*c + first + i);
+          if (v.At(c, i) != expected) {
+            Throw_RC_Error((what + " chan " + RC::RStr(c) + " sample " +
+                  RC::RStr(i) + " is " + RC::RStr(v.At(c, i)) +
+                  ", expected " + RC::RStr(expected)).c_str());
+          }
+        }
+      }
+    };
+
+    RC_ForRange(b, 0, 3) { append_block(b); }
+    auto view = wrap_data.GetRecentView(2*block_len);
+    check_view(view, block_len, "Fresh view");
+    // Enough to wrap the ring over the view's samples twice.
+    RC_ForRange(b, 3, 14) { append_block(b); }
+    check_view(view, block_len, "Pinned view");
+    check_view(wrap_data.GetRecentView(3*block_len), 11*block_len,
+        "Recent view");
+    RC_DEBOUT(RC::RStr("Circular data views passed\n"));
   }
 
   //void TestEEGBinning() {
@@ -214,6 +258,84 @@ namespace CML {
     binned_data->leftover_data->Print();
   }
 
+  void TestEEGCodec() {
+    // Spans several Rice partitions, with channel 1 left disabled.
+    size_t sampling_rate = 1000;
+    size_t sample_len = 700;
+    RC::APtr<EEGDataRaw> in_data = new EEGDataRaw(sampling_rate, sample_len);
+    in_data->data.Resize(4);
+    in_data->EnableChan(0);
+    in_data->EnableChan(2);
+    in_data->EnableChan(3);
+    RC_ForIndex(j, in_data->data[0]) {
+      in_data->data[0][j] = int16_t(int(j*37 % 2000) - 1000);
+      // Full scale swings, for the escaped residuals.
+      in_data->data[2][j] = (j % 2) ? 32767 : -32768;
+      in_data->data[3][j] = 5;
+    }
+
+    std::vector<uint8_t> encoded;
+    EEGCodec::EncodeEEG(*in_data, encoded);
+    RC::APtr<EEGData> out_data = EEGCodec::DecodeEEG(encoded.data(),
+        encoded.size());
+
+    if (out_data->sampling_rate != sampling_rate ||
+        out_data->sample_len != sample_len ||
+        out_data->data.size() != in_data->data.size()) {
+      Throw_RC_Error("EEGCodec round trip changed the layout.");
+    }
+    RC_ForIndex(c, in_data->data) {
+      if (out_data->data[c].size() != in_data->data[c].size()) {
+        Throw_RC_Error(("EEGCodec round trip changed channel " +
+              RC::RStr(c) + " size.").c_str());
+      }
+      RC_ForIndex(j, in_data->data[c]) {
+        if (out_data->data[c][j] != in_data->data[c][j]) {
+          Throw_RC_Error(("EEGCodec round trip changed channel " +
+                RC::RStr(c) + " sample " + RC::RStr(j) + ".").c_str());
+        }
+      }
+    }
+
+    // A damaged sample count must fail, not size a huge allocation.
+    std::vector<uint8_t> damaged = encoded;
+    size_t sample_count_at = 12 + 1 + 4;
+    for (size_t i=0; i<4; i++) {
+      damaged[sample_count_at + i] = 0xFF;
+    }
+    try {
+      EEGCodec::DecodeEEG(damaged.data(), damaged.size());
+      Throw_RC_Error("Failed to reject a damaged sample count.");
+    }
+    catch (RC::ErrorMsgFile&) {
+      // Expected test exception.
+    }
+
+    try {
+      EEGCodec::DecodeEEG(encoded.data(), encoded.size() - 1);
+      Throw_RC_Error("Failed to reject a truncated block.");
+    }
+    catch (RC::ErrorMsgFile&) {
+      // Expected test exception.
+    }
+
+    size_t encoded_size = encoded.size();
+    in_data->data[3].Resize(sample_len - 1);
+    try {
+      EEGCodec::EncodeEEG(*in_data, encoded);
+      Throw_RC_Error("Failed to reject a short channel.");
+    }
+    catch (RC::ErrorMsgBounds&) {
+      // Expected test exception.
+    }
+    if (encoded.size() != encoded_size) {
+      Throw_RC_Error("A rejected EncodeEEG appended to its output.");
+    }
+
+    RC_DEBOUT(RC::RStr("EEGCodec round trip passed, ") + encoded.size() +
+        " bytes\n");
+  }
+
   // Feature Filters
   void TestBipolarReference() {
     RC::APtr<const EEGDataRaw> in_data = CreateTestingEEGDataRaw();
@@ -491,6 +613,188 @@ namespace CML {
     avg_data->Print();
   }
 
+  // Exposes the prefix feature path.
+  class FeatureFiltersTester : public FeatureFilters {
+    public:
+    using FeatureFilters::FeatureFilters;
+    using FeatureFilters::ProcessPrefix_Handler;
+    using FeatureFilters::FinishPartial;
+    using FeatureFilters::MirroredSampleCount;
+    using FeatureFilters::partial_features;
+    using FeatureFilters::morlet_transformer;
+    using FeatureFilters::log_min_power_clamp;
+  };
+
+  void TestFeatureFiltersPrefix() {
+    size_t sampling_rate = 1000;
+    size_t chanlen = 2;
+    size_t eventlen = 400;
+    // Shorter than two mirroring durations of 75 samples, as in the
+    // typical windows where the mirroring covers most of the window.
+    size_t prefix_len = 120;
+    RC::Data1D<BipolarPair> channels = {BipolarPair{0,1}, BipolarPair{1,0}};
+    MorletSettings morlet_settings = {5, {50, 100}, channels, sampling_rate,
+      2, true};
+    ButterworthSettings butterworth_settings;
+    butterworth_settings.channels = channels;
+    FeatureFiltersTester feature_filters(channels, butterworth_settings,
+        morlet_settings, NormalizePowersSettings{2, chanlen, 1});
+    size_t num_mirrored = feature_filters.MirroredSampleCount(sampling_rate);
+
+    auto in_data = CreateTestingEEGDataDouble(sampling_rate, eventlen,
+        chanlen);
+    EEGCircularData circular_data(sampling_rate, 1000);
+    circular_data.Append(in_data, 0, prefix_len);
+    auto prefix_view = circular_data.GetRecentView(prefix_len);
+    circular_data.Append(in_data, prefix_len);
+    auto window_view = circular_data.GetRecentView(eventlen);
+
+    TaskClassifierSettings settings;
+    settings.cl_type = ClassificationType::STIM;
+    settings.duration_ms = eventlen;
+    settings.window_id = 7;
+    settings.requested_ns = RCqt::TaskClockNs();
+
+    // Samples up to one mirroring duration back are final in the prefix.
+    feature_filters.ProcessPrefix_Handler(prefix_view, settings);
+    auto partial = feature_filters.partial_features.find(7);
+    if (partial == feature_filters.partial_features.end() ||
+        partial->second.done != prefix_len - num_mirrored) {
+      Throw_RC_Error("The prefix block of the window was not transformed.");
+    }
+
+    size_t mirroring_duration_ms =
+      size_t(feature_filters.morlet_transformer.CalcAvgMirroringDurationMs());
+    auto mirrored_data = FeatureFilters::MirrorEnds(window_view,
+        mirroring_duration_ms).ExtractConst();
+    auto morlet_data = feature_filters.morlet_transformer.Filter(
+        mirrored_data).ExtractConst();
+    auto unmirrored_data = FeatureFilters::RemoveMirrorEnds(morlet_data,
+        mirroring_duration_ms).ExtractConst();
+    auto log_data = FeatureFilters::Log10Transform(unmirrored_data,
+        feature_filters.log_min_power_clamp, false).ExtractConst();
+    auto full_data = FeatureFilters::AvgOverTime(log_data, true).ExtractConst();
+
+    // Shift the stored prefix sums by one per sample, so the finished
+    // features are the full window's plus 1 only if the prefix block is
+    // reused rather than transformed again.
+    auto& sumsr = partial->second.sums->data;
+    RC_ForRange(i, 0, sumsr.size3()) { // Iterate over frequencies
+      RC_ForRange(j, 0, sumsr.size2()) { // Iterate over channels
+        sumsr[i][j][0] += double(eventlen);
+      }
+    }
+    auto finished_data = feature_filters.FinishPartial(window_view,
+        num_mirrored, partial->second).ExtractConst();
+    auto& finishedr = finished_data->data;
+    auto& fullr = full_data->data;
+    RC_ForRange(i, 0, fullr.size3()) { // Iterate over frequencies
+      RC_ForRange(j, 0, fullr.size2()) { // Iterate over channels
+        double diff = finishedr[i][j][0] - fullr[i][j][0] - 1;
+        if (std::abs(diff) > 1e-6) {
+          Throw_RC_Error(("Prefix features at frequency " + RC::RStr(i) +
+                " and channel " + RC::RStr(j) + " differ from the full "
+                "window by " + RC::RStr(diff)).c_str());
+        }
+      }
+    }
+
+    // A window that was dropped is erased by the next prefix.
+    TaskClassifierSettings dropped = settings;
+    dropped.window_id = 8;
+    dropped.requested_ns = 0;
+    feature_filters.ProcessPrefix_Handler(prefix_view, dropped);
+    settings.window_id = 9;
+    feature_filters.ProcessPrefix_Handler(prefix_view, settings);
+    if (feature_filters.partial_features.count(8) != 0 ||
+        feature_filters.partial_features.count(9) != 1) {
+      Throw_RC_Error("Prefix features of a dropped window were not erased.");
+    }
+
+    RC_DEBOUT(RC::RStr("Feature prefix reuse passed\n"));
+  }
+
+  // Exposes the compiled weights file functions.
+  class WeightManagerTester : public WeightManager {
+    public:
+    using WeightManager::RawWeights;
+    using WeightManager::ParseJSON;
+    using WeightManager::ReadCompiled;
+    using WeightManager::WriteCompiled;
+    using WeightManager::FileChecksum;
+  };
+
+  void TestWeightManagerCompiled() {
+    using WMT = WeightManagerTester;
+    RC::RStr dir = RC::RStr(QDir::tempPath().toStdString());
+    RC::RStr classif_json = RC::File::FullPath(dir,
+        "elemem_test_classifier.json");
+    RC::RStr montage_csv = RC::File::FullPath(dir,
+        "elemem_test_montage.csv");
+    RC::RStr compiled_file = WeightManager::CompiledFilename(classif_json);
+    {
+      RC::FileWrite fw(classif_json);
+      fw.WriteStr("{\"intercept_\": [0.25], "
+          "\"coef_\": [[1.5, -2, 3, 4, 5.5, -6]], "
+          "\"coords\": {\"frequency\": [6, 9, 15], "
+          "\"channel\": [\"A1_A2\", \"B1-B2\"]}, "
+          "\"dims\": [\"frequency\", \"channel\"]}\n");
+      RC::FileWrite mfw(montage_csv);
+      mfw.WriteStr("A1,1\nA2,2\nB1,3\nB2,4\n");
+    }
+
+    uint64_t checksum = WMT::FileChecksum(classif_json);
+    WMT::RawWeights parsed = WMT::ParseJSON(classif_json);
+    WMT::WriteCompiled(compiled_file, checksum, parsed);
+
+    WMT::RawWeights loaded;
+    if ( ! WMT::ReadCompiled(compiled_file, checksum, loaded) ) {
+      Throw_RC_Error("Could not read back compiled weights.");
+    }
+    auto& pw = *parsed.weights;
+    auto& lw = *loaded.weights;
+    bool same = pw.intercept == lw.intercept &&
+      pw.freqs.size() == lw.freqs.size() &&
+      pw.coef.size1() == lw.coef.size1() &&
+      pw.coef.size2() == lw.coef.size2() &&
+      parsed.chanstr.size() == loaded.chanstr.size();
+    for (size_t f=0; same && f<pw.freqs.size(); f++) {
+      same = pw.freqs[f] == lw.freqs[f];
+    }
+    for (size_t i=0; same && i<pw.coef.size2(); i++) {
+      for (size_t j=0; same && j<pw.coef.size1(); j++) {
+        same = pw.coef[i][j] == lw.coef[i][j];
+      }
+    }
+    for (size_t c=0; same && c<parsed.chanstr.size(); c++) {
+      same = parsed.chanstr[c] == loaded.chanstr[c];
+    }
+    if ( ! same ) {
+      Throw_RC_Error("Compiled weights differ from the parsed json.");
+    }
+
+    if (WMT::ReadCompiled(compiled_file, checksum + 1, loaded)) {
+      Throw_RC_Error("Used compiled weights for a different json.");
+    }
+
+    // A compiled file that cannot be written must not stop the load.
+    RC::File::Delete(compiled_file);
+    QDir().mkdir(compiled_file.ToQString());
+    CSVFile montage(montage_csv);
+    WeightManager manager(classif_json, MontageIndex(montage), true);
+    QDir().rmdir(compiled_file.ToQString());
+    RC::File::Delete(compiled_file + ".tmp");
+    if (manager.weights->chans.size() != 2 ||
+        manager.weights->chans[1].pos != 3 ||
+        manager.weights->chans[1].neg != 4) {
+      Throw_RC_Error("Weights loaded without a compiled file are wrong.");
+    }
+
+    RC::File::Delete(classif_json);
+    RC::File::Delete(montage_csv);
+    RC_DEBOUT(RC::RStr("Compiled classifier weights passed\n"));
+  }
+
   void TestClassification() {
     // Load classifier weights
     RC::RStr config_path = "/Users/jbruska/Desktop/ElememConfigs/";
@@ -524,6 +828,246 @@ namespace CML {
     RC_DEBOUT(result);
   }
 
+  // Collects the timing callbacks of an EventScheduler on its own thread.
+  class EventSchedulerTester : public RCqt::WorkerThread {
+    public:
+    EventTimingCallback Timed =
+      TaskHandler(EventSchedulerTester::Timed_Handler);
+    RCqt::TaskGetter<std::vector<uint64_t>> TimedIds =
+      TaskHandler(EventSchedulerTester::TimedIds_Handler);
+    RCqt::TaskGetter<bool> RanEarly =
+      TaskHandler(EventSchedulerTester::RanEarly_Handler);
+
+    // Waits up to timeout_ms for count callbacks.
+    std::vector<uint64_t> WaitForIds(size_t count, uint64_t timeout_ms) {
+      auto ids = TimedIds();
+      for (uint64_t ms=0; ids.size() < count && ms < timeout_ms; ms++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ids = TimedIds();
+      }
+      return ids;
+    }
+
+    protected:
+    void Timed_Handler(const uint64_t& id, const EventTiming& timing) {
+      timed_ids.push_back(id);
+      ran_early = ran_early || (timing.fired_ns < timing.target_ns);
+    }
+    std::vector<uint64_t> TimedIds_Handler() { return timed_ids; }
+    bool RanEarly_Handler() { return ran_early; }
+
+    std::vector<uint64_t> timed_ids;
+    bool ran_early = false;
+  };
+
+  void TestEventScheduler() {
+    EventSchedulerTester tester;
+    EventScheduler scheduler;
+    scheduler.SetCallback(tester.Timed);
+    scheduler.Start();
+
+    // Events at the same time run in the order scheduled.
+    uint64_t start_ns = RCqt::TaskClockNs() + 20000000;
+    scheduler.Schedule(start_ns + 5000000, 3, []{});
+    scheduler.Schedule(start_ns, 1, []{});
+    scheduler.Schedule(start_ns, 2, []{});
+    scheduler.Schedule(start_ns - 5000000, 0, []{});
+
+    auto ids = tester.WaitForIds(4, 1000);
+    if (ids != std::vector<uint64_t>{0, 1, 2, 3}) {
+      RC::RStr order;
+      for (auto id : ids) {
+        order += " " + RC::RStr(id);
+      }
+      Throw_RC_Error(("Scheduled events ran in the order" + order +
+            ", not 0 1 2 3.").c_str());
+    }
+    if (tester.RanEarly()) {
+      Throw_RC_Error("A scheduled event ran before its target time.");
+    }
+    if (scheduler.Jitter().count != 4) {
+      Throw_RC_Error(("Event jitter recorded " +
+            RC::RStr(scheduler.Jitter().count) + " events, not 4.").c_str());
+    }
+
+    // Stop discards pending events, so they do not run after a restart.
+    scheduler.Schedule(RCqt::TaskClockNs() + 20000000, 4, []{});
+    scheduler.Stop();
+    scheduler.Start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    if (tester.WaitForIds(5, 0).size() != 4) {
+      Throw_RC_Error("An event pending at Stop ran after a restart.");
+    }
+    if (scheduler.Jitter().count != 0) {
+      Throw_RC_Error("Event jitter was not reset by Start.");
+    }
+
+    scheduler.Stop();
+    RC_DEBOUT(RC::RStr("Event scheduler passed\n"));
+  }
+
+#ifdef CERESTIM_SIMULATOR
+  // Tests run after sys_config may have loaded a simulator profile, so
+  // this sets the default profile for the test, then restores the loaded
+  // one and resets the device the test left configured.
+  class CereStimSimRestore {
+    public:
+    CereStimSimRestore() : saved(CereStimSim::GetProfile()) {
+      CereStimSim::SetProfile(CereStimSim::Profile());
+      CereStimSim::Reset();
+    }
+    ~CereStimSimRestore() {
+      CereStimSim::SetProfile(saved);
+      CereStimSim::Reset();
+    }
+
+    // Rule of 3.
+    CereStimSimRestore(const CereStimSimRestore&) = delete;
+    CereStimSimRestore& operator=(const CereStimSimRestore&) = delete;
+
+    private:
+    CereStimSim::Profile saved;
+  };
+
+  void TestCereStimSim() {
+    CereStimSimRestore restore;
+
+    // 10 pulses at 100Hz make a 100ms burst.
+    if (CS_Connect() ||
+        CS_ConfigureStimulusPattern(1, 1, 10, 1000, 1000, 100, 100, 100,
+          53) ||
+        CS_BeginningOfSequence() ||
+        CS_AutoStimulus(1, 1) ||
+        CS_EndOfSequence() ||
+        CS_Play(1)) {
+      Throw_RC_Error("CereStim simulator rejected a valid sequence.");
+    }
+
+    // A trigger with the device unplugged must fail, and still be recorded.
+    CereStimSim::SetConnected(false);
+    if (CS_Play(1) != int(CS_Result::BDISCONNECTED)) {
+      Throw_RC_Error("CereStim simulator played while disconnected.");
+    }
+
+    auto triggers = CereStimSim::Triggers();
+    if (triggers.size() != 2) {
+      Throw_RC_Error(("CereStim simulator recorded " +
+            RC::RStr(triggers.size()) + " triggers, not 2.").c_str());
+    }
+    if (triggers[0].result != 0 || triggers[0].burst_us != 100000 ||
+        triggers[0].done_ns < triggers[0].call_ns) {
+      Throw_RC_Error("CereStim simulator recorded a wrong trigger.");
+    }
+    if (triggers[1].result != int(CS_Result::BDISCONNECTED) ||
+        triggers[1].burst_us != 0) {
+      Throw_RC_Error("CereStim simulator recorded a wrong failed trigger.");
+    }
+
+    CereStimSim::SetConnected(true);
+    CereStimSim::ClearTriggers();
+    if ( ! CereStimSim::Triggers().empty() ) {
+      Throw_RC_Error("CereStim simulator triggers were not cleared.");
+    }
+
+    RC_DEBOUT(RC::RStr("CereStim simulator triggers passed\n"));
+  }
+
+  void TestCereStimSlots() {
+    CereStimSimRestore restore;
+
+    // One bipolar pair at 100Hz, so the burst lasts duration_us.
+    auto pair_profile = [](uint8_t pos, uint16_t amplitude,
+        uint32_t duration_us) {
+      StimChannel chan;
+      chan.electrode_pos = pos;
+      chan.electrode_neg = uint8_t(pos+1);
+      chan.amplitude = amplitude;
+      chan.frequency = 100;
+      chan.duration = duration_us;
+      chan.area = 10;
+      StimProfile profile;
+      profile += chan;
+      return profile;
+    };
+    auto check_burst = [](uint64_t burst_us, const RC::RStr& what) {
+      auto triggers = CereStimSim::Triggers();
+      if (triggers.empty() || triggers.back().result != 0 ||
+          triggers.back().burst_us != burst_us) {
+        Throw_RC_Error(("Stim slot " + what + " did not play a " +
+              RC::RStr(burst_us) + "us burst.").c_str());
+      }
+    };
+
+    {
+      CereStim cerestim;
+      // Slots 0 and 2 share a pattern, so these store 2 of the 7 pairs.
+      cerestim.ConfigureSlot(0, pair_profile(1, 1000, 100000));
+      cerestim.ConfigureSlot(1, pair_profile(3, 1500, 50000));
+      cerestim.ConfigureSlot(2, pair_profile(5, 1000, 100000));
+
+      CereStimSim::ClearTriggers();
+      cerestim.StimulateSlot(1);
+      check_burst(50000, "1");
+      cerestim.StimulateSlot(1);
+      cerestim.StimulateSlot(0);
+      check_burst(100000, "0");
+      auto counts = CereStimSim::CommandCounts();
+      if (counts.configure != 0 || counts.sequence != 2) {
+        Throw_RC_Error(("Arming stim slots wrote " +
+              RC::RStr(counts.configure) + " patterns and " +
+              RC::RStr(counts.sequence) + " sequences, not 0 and 2.").c_str());
+      }
+
+      // Slots 3 to 7 fill the 7 pairs, so slot 8 falls back to a full
+      // configure.
+      for (uint8_t s=3; s<8; s++) {
+        cerestim.ConfigureSlot(s, pair_profile(uint8_t(2*s+1),
+              uint16_t(1500+100*s), 100000));
+      }
+      cerestim.ConfigureSlot(8, pair_profile(17, 2500, 200000));
+
+      CereStimSim::ClearTriggers();
+      cerestim.StimulateSlot(7);
+      if (CereStimSim::CommandCounts().configure != 0) {
+        Throw_RC_Error("Stim slot 7 was not stored as the seventh pair.");
+      }
+      cerestim.StimulateSlot(8);
+      check_burst(200000, "8");
+      if (CereStimSim::CommandCounts().configure != 2) {
+        Throw_RC_Error("Stim slot 8 did not fall back to a full configure.");
+      }
+      // The full configure overwrote the stored pairs, so they reload.
+      cerestim.StimulateSlot(1);
+      check_burst(50000, "1");
+
+      size_t trigger_count = CereStimSim::Triggers().size();
+      for (size_t slot : {size_t(9), size_t(StimInterface::max_slots)}) {
+        try {
+          cerestim.StimulateSlot(slot);
+          Throw_RC_Error(("Unconfigured stim slot " + RC::RStr(slot) +
+                " was stimulated.").c_str());
+        }
+        catch (std::runtime_error&) {
+          // Expected test exception.
+        }
+      }
+      cerestim.ClearSlots();
+      try {
+        cerestim.StimulateSlot(0);
+        Throw_RC_Error("Cleared stim slot 0 was stimulated.");
+      }
+      catch (std::runtime_error&) {
+        // Expected test exception.
+      }
+      if (CereStimSim::Triggers().size() != trigger_count) {
+        Throw_RC_Error("Unconfigured stim slots triggered the CereStim.");
+      }
+    }
+
+    RC_DEBOUT(RC::RStr("CereStim slots passed\n"));
+  }
+#endif
+
 //  void TestPyBind11() {
 //    auto& pythonInterface = PythonInterface::GetInstance();
 //    RC_DEBOUT(pythonInterface.Sqrt(2.0));
@@ -543,7 +1087,7 @@ namespace CML {
     //TestBipolarReference();
     //TestMorletTransformer();
     //TestMorletTransformerRealData();
-    //TestEEGCircularData();
+    TestEEGCircularData();
     // TODO: JPB: (need) test binning with negative values too
     //TestEEGBinning1();
     //TestEEGBinning2();
@@ -552,6 +1096,7 @@ namespace CML {
     //TestEEGBinningRollover2();
     //TestEEGBinningRollover3();
     //TestEEGBinningRollover4();
+    TestEEGCodec();
     //TestRollingStats();
     //TestNormalizePowers();
     //TestFindArtifactChannels();
@@ -559,7 +1104,14 @@ namespace CML {
     //TestDifferentiate();
     //TestProcess_Handler();
     //TestProcess_HandlerRandomData();
+    TestFeatureFiltersPrefix();
     //TestClassification();
+    TestWeightManagerCompiled();
+    TestEventScheduler();
+#ifdef CERESTIM_SIMULATOR
+    TestCereStimSim();
+    TestCereStimSlots();
+#endif
     //TestPyBind11();
     //TestPyButtfilt();
   }
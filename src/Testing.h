@@ -22,6 +22,7 @@ namespace CML {
   // Data Storage and Binning
   void TestEEGCircularData();
   void TestEEGBinning();
+  void TestEEGCodec();
 
   // Feature Filters
   void TestBipolarReference();  
@@ -31,6 +32,19 @@ namespace CML {
   void TestMorletTransformer();
   void TestRollingStats();
   void TestNormalizePowers();
+  void TestFeatureFiltersPrefix();
+
+  // Classification
+  void TestWeightManagerCompiled();
+
+  // Scheduling
+  void TestEventScheduler();
+
+  // Stimulation
+#ifdef CERESTIM_SIMULATOR
+  void TestCereStimSim();
+  void TestCereStimSlots();
+#endif
 
   void TestAllCode();
 
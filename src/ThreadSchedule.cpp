@@ -0,0 +1,289 @@
+#include "ThreadSchedule.h"
+#include "Popup.h"
+#include "RC/Caller.h"
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+namespace CML {
+  namespace {
+    RC::RStr PolicyToStr(SchedPolicy policy) {
+      switch (policy) {
+        case SchedPolicy::OTHER: return "other";
+        case SchedPolicy::FIFO: return "fifo";
+        case SchedPolicy::RR: return "rr";
+        default: Throw_RC_Error("Invalid scheduling policy.");
+      }
+    }
+
+#ifdef __linux__
+    int ToPosix(SchedPolicy policy) {
+      switch (policy) {
+        case SchedPolicy::OTHER: return SCHED_OTHER;
+        case SchedPolicy::FIFO: return SCHED_FIFO;
+        case SchedPolicy::RR: return SCHED_RR;
+        default: Throw_RC_Error("Invalid scheduling policy.");
+      }
+    }
+
+    RC::RStr PrivilegeHint(int err) {
+      if (err == EPERM) {
+        return "permission denied.  Grant CAP_SYS_NICE (setcap "
+          "cap_sys_nice,cap_ipc_lock+ep on the Elemem binary) or raise "
+          "the rtprio limit in /etc/security/limits.conf.";
+      }
+      return RC::RStr(std::strerror(err)) + ".";
+    }
+#endif
+  }
+
+
+  RC::RStr ThreadSchedule::ToStr() const {
+    RC::RStr str = PolicyToStr(policy);
+    if (policy != SchedPolicy::OTHER) {
+      str += " priority " + RC::RStr(priority);
+    }
+    if (cpus.size() > 0) {
+      str += " on cpus " + RC::RStr::Join(cpus, ",");
+    }
+    return str;
+  }
+
+
+  RC::RStr ThreadSchedule::ApplyToCurrentThread() const {
+    if ( ! configured ) {
+      return "";
+    }
+
+#ifdef __linux__
+    RC::RStr problems;
+
+    if (cpus.size() > 0) {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      for (auto cpu : cpus) {
+        CPU_SET(cpu, &cpu_set);
+      }
+      int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set),
+          &cpu_set);
+      if (err) {
+        problems += "Could not set cpu affinity, " + PrivilegeHint(err) +
+          "\n";
+      }
+    }
+
+    sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = (policy == SchedPolicy::OTHER) ? 0 : priority;
+    int err = pthread_setschedparam(pthread_self(), ToPosix(policy), &param);
+    if (err) {
+      problems += "Could not set " + PolicyToStr(policy) + " scheduling, " +
+        PrivilegeHint(err) + "\n";
+    }
+
+    return problems;
+#else
+    return "Thread scheduling settings are only supported on Linux.\n";
+#endif
+  }
+
+
+  ThreadSchedule ThreadSchedule::OfCurrentThread() {
+    ThreadSchedule current;
+#ifdef __linux__
+    int posix_policy;
+    sched_param param;
+    if (pthread_getschedparam(pthread_self(), &posix_policy, &param) != 0) {
+      return current;
+    }
+    current.configured = true;
+    current.policy = (posix_policy == SCHED_FIFO) ? SchedPolicy::FIFO :
+      (posix_policy == SCHED_RR) ? SchedPolicy::RR : SchedPolicy::OTHER;
+    current.priority = param.sched_priority;
+
+    cpu_set_t cpu_set;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set)
+        == 0) {
+      std::vector<uint32_t> cpu_list;
+      for (uint32_t c=0; c<CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &cpu_set)) {
+          cpu_list.push_back(c);
+        }
+      }
+      current.cpus.Resize(cpu_list.size());
+      for (size_t i=0; i<cpu_list.size(); i++) {
+        current.cpus[i] = cpu_list[i];
+      }
+    }
+#endif
+    return current;
+  }
+
+
+  const RC::Data1D<RC::RStr>& ThreadScheduler::KnownThreads() {
+    static const RC::Data1D<RC::RStr> known{"Handler", "EEGAcq", "EEGSave",
+      "EventLog", "StimWorker", "TaskNetWorker", "ObserverServer", "ExperOPS",
+      "EventScheduler", "TaskClassifierManager", "FeatureFilters",
+      "Classifier", "TaskStimManager", "Morlet"};
+    return known;
+  }
+
+
+  void ThreadScheduler::Load(const JSONFile& sys_config) {
+    Clear();
+
+    sys_config.TryGet(lock_memory, "thread_scheduling", "lock_memory");
+
+    auto section = sys_config.json.find("thread_scheduling");
+    if (section == sys_config.json.end()) {
+      return;
+    }
+    auto threads = section->find("threads");
+    if (threads == section->end()) {
+      return;
+    }
+
+    uint32_t cpu_count = std::thread::hardware_concurrency();
+
+    for (auto& item : threads->items()) {
+      std::string key = item.key();
+      RC::RStr name = key;
+      RC::RStr label = "sys_config thread_scheduling entry \"" + name + "\"";
+      if ( ! KnownThreads().Contains(name) ) {
+        Throw_RC_Type(File, (label + " is not a known thread.  Use one of: " +
+              RC::RStr::Join(KnownThreads(), ", ")).c_str());
+      }
+
+      ThreadSchedule schedule;
+      schedule.configured = true;
+
+      RC::RStr policy_str = "other";
+      sys_config.TryGet(policy_str, "thread_scheduling", "threads", key,
+          "policy");
+      policy_str.ToLower();
+      if (policy_str == "other") {
+        schedule.policy = SchedPolicy::OTHER;
+      }
+      else if (policy_str == "fifo") {
+        schedule.policy = SchedPolicy::FIFO;
+      }
+      else if (policy_str == "rr") {
+        schedule.policy = SchedPolicy::RR;
+      }
+      else {
+        Throw_RC_Type(File, (label + " has unknown policy \"" + policy_str +
+              "\".  Use \"other\", \"fifo\", or \"rr\".").c_str());
+      }
+
+      sys_config.TryGet(schedule.priority, "thread_scheduling", "threads",
+          key, "priority");
+      if (schedule.policy != SchedPolicy::OTHER &&
+          (schedule.priority < 1 || schedule.priority > 99)) {
+        Throw_RC_Type(File, (label + " priority must be from 1 to 99 for " +
+              policy_str + " scheduling.").c_str());
+      }
+
+      sys_config.TryGet(schedule.cpus, "thread_scheduling", "threads", key,
+          "cpus");
+      for (auto cpu : schedule.cpus) {
+        if (cpu_count > 0 && cpu >= cpu_count) {
+          Throw_RC_Type(File, (label + " cpu " + RC::RStr(cpu) + " does not "
+                "exist on this " + RC::RStr(cpu_count) + " cpu "
+                "system.").c_str());
+        }
+      }
+
+      schedules[name] = schedule;
+    }
+
+    if (schedules.count("Morlet") && schedules.count("FeatureFilters")) {
+      Throw_RC_Type(File, "sys_config thread_scheduling cannot configure "
+          "both \"Morlet\" and \"FeatureFilters\", as the wavelet threads "
+          "are started from the FeatureFilters thread and share its "
+          "schedule.");
+    }
+  }
+
+
+  void ThreadScheduler::Clear() {
+    schedules.clear();
+    lock_memory = false;
+    logged.clear();
+  }
+
+
+  RC::RStr ThreadScheduler::Validate() {
+    RC::RStr warnings;
+
+    if (lock_memory) {
+#ifdef __linux__
+      if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        int err = errno;
+        warnings += "lock_memory: Could not lock memory, " +
+          ((err == EPERM || err == ENOMEM) ?
+           RC::RStr("grant CAP_IPC_LOCK or raise the memlock limit in "
+             "/etc/security/limits.conf.") :
+           RC::RStr(std::strerror(err)) + ".") + "\n";
+      }
+#else
+      warnings += "lock_memory: Only supported on Linux.\n";
+#endif
+    }
+
+    // A scratch thread, so nothing real is left half configured.
+    std::thread probe([&]() {
+      for (auto& entry : schedules) {
+        RC::RStr problems = entry.second.ApplyToCurrentThread();
+        if ( ! problems.empty() ) {
+          warnings += entry.first + " (" + entry.second.ToStr() + "): " +
+            problems;
+        }
+      }
+    });
+    probe.join();
+
+    return warnings;
+  }
+
+
+  void ThreadScheduler::Apply(RCqt::Worker& worker, const RC::RStr& name) {
+    auto itr = schedules.find(name);
+    if (itr == schedules.end()) {
+      return;
+    }
+    // The task would run on the calling thread instead.
+    if (worker.DirectCallingMode()) {
+      return;
+    }
+
+    RCqt::TaskGetter<RC::RStr, const ThreadSchedule> apply_task(&worker,
+        RC::MakeCaller(&ThreadScheduler::ApplyHelper));
+    RC::RStr problems = apply_task(itr->second);
+
+    if ( ! problems.empty() && logged.count(name) == 0 ) {
+      logged.insert(name);
+      DebugLog("Thread scheduling for " + name + " (" + itr->second.ToStr() +
+          ") not applied: " + problems);
+    }
+  }
+
+
+  ThreadSchedule ThreadScheduler::Get(const RC::RStr& name) const {
+    auto itr = schedules.find(name);
+    if (itr == schedules.end()) {
+      return ThreadSchedule();
+    }
+    return itr->second;
+  }
+
+
+  RC::RStr ThreadScheduler::ApplyHelper(const ThreadSchedule& schedule) {
+    return schedule.ApplyToCurrentThread();
+  }
+}
+
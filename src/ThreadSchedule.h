@@ -0,0 +1,86 @@
+#ifndef THREADSCHEDULE_H
+#define THREADSCHEDULE_H
+
+#include "ConfigFile.h"
+#include "RC/Data1D.h"
+#include "RC/RStr.h"
+#include "RCqt/Worker.h"
+#include <map>
+#include <set>
+
+namespace CML {
+  enum class SchedPolicy {
+    OTHER,
+    FIFO,
+    RR
+  };
+
+  /// The scheduling class, priority, and cpu set for one thread.
+  class ThreadSchedule {
+    public:
+    bool configured = false;  // If false, the thread is left as it is.
+    SchedPolicy policy = SchedPolicy::OTHER;
+    int priority = 0;  // 1 to 99 for FIFO and RR.  Ignored for OTHER.
+    RC::Data1D<uint32_t> cpus;  // Empty for no affinity.
+
+    RC::RStr ToStr() const;
+
+    /// Apply to the calling thread.
+    /** @return An explanation of what could not be applied, or an empty
+     *  string on success.
+     */
+    RC::RStr ApplyToCurrentThread() const;
+
+    /// The settings of the calling thread, to restore later.
+    static ThreadSchedule OfCurrentThread();
+  };
+
+
+  /// Applies the sys_config "thread_scheduling" section to worker threads.
+  /** Entries are keyed by thread name, for example:
+   *  \code
+   *  "thread_scheduling": {
+   *    "lock_memory": true,
+   *    "threads": {
+   *      "EEGAcq": {"policy": "fifo", "priority": 80, "cpus": [2]},
+   *      "Morlet": {"policy": "fifo", "priority": 70, "cpus": [4, 5]}
+   *    }
+   *  }
+   *  \endcode
+   *  Missing privileges produce warnings rather than errors, so a
+   *  misconfigured system still runs, just without real-time guarantees.
+   */
+  class ThreadScheduler {
+    public:
+    /// The thread names that may be configured.
+    static const RC::Data1D<RC::RStr>& KnownThreads();
+
+    /// Parse and validate the settings, without applying them.
+    /** Throws a File error for malformed or unknown entries. */
+    void Load(const JSONFile& sys_config);
+    void Clear();
+
+    /// Try every configured schedule on a probe thread, and lock memory if
+    /// requested.
+    /** @return Warnings for settings that this process lacks the
+     *  privileges for, or an empty string.
+     */
+    RC::RStr Validate();
+
+    /// Apply the named schedule, if any, to worker's thread.
+    /** Failures are logged once per name, as Validate already warned. */
+    void Apply(RCqt::Worker& worker, const RC::RStr& name);
+
+    ThreadSchedule Get(const RC::RStr& name) const;
+
+    protected:
+    static RC::RStr ApplyHelper(const ThreadSchedule& schedule);
+
+    std::map<RC::RStr, ThreadSchedule> schedules;
+    bool lock_memory = false;
+    std::set<RC::RStr> logged;
+  };
+}
+
+#endif // THREADSCHEDULE_H
+
@@ -30,5 +30,15 @@ namespace CML {
   size_t CeilDiv(size_t dividend, size_t divisor) {
     return dividend / divisor + (dividend % divisor != 0); 
   }
-}
 
+  // 64-bit FNV-1a over len bytes.
+  uint64_t Checksum64(const void* data, size_t len, uint64_t seed) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed;
+    for (size_t i=0; i<len; i++) {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ull;
+    }
+    return hash;
+  }
+}
@@ -9,6 +9,10 @@ namespace CML {
   RC::RStr GetDesktop();
   int CeilDiv(int dividend, int divisor);
   size_t CeilDiv(size_t dividend, size_t divisor);
+
+  // 64-bit FNV-1a.  Pass a previous result as seed to continue a checksum.
+  uint64_t Checksum64(const void* data, size_t len,
+      uint64_t seed=0xcbf29ce484222325ull);
 }
 
 #endif // UTILS_H
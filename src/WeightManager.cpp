@@ -1,74 +1,182 @@
 #include "WeightManager.h"
+#include "Popup.h"
+#include "Utils.h"
+#include <cstring>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
 
 namespace CML {
+  namespace {
+    const char compiled_magic[8] = {'E','L','W','E','I','G','H','T'};
+    const uint32_t compiled_version = 1;
+
+    // Compiled weights file layout, all native endian:
+    //   CompiledHeader
+    //   double intercept
+    //   double freqs[freq_cnt]
+    //   double coef[freq_cnt][chan_cnt]
+    //   chan_cnt null terminated bipolar labels, label_bytes total.
+    struct CompiledHeader {
+      char magic[8];
+      uint32_t version;
+      uint32_t header_size;
+      uint64_t json_checksum;
+      uint64_t freq_cnt;
+      uint64_t chan_cnt;
+      uint64_t label_bytes;
+      uint64_t payload_checksum;  // Over everything after the header.
+    };
+
+    // Read-only view of a whole file, memory mapped where available.
+    class MappedFile {
+      public:
+      MappedFile(const RC::RStr& filename) {
+#ifdef WIN32
+        RC::FileRead fr;
+        if (fr.Open(filename)) {
+          fr.ReadAll(buf);
+          data = buf.Raw();
+          len = buf.size();
+        }
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+          return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+          void* map = mmap(nullptr, size_t(st.st_size), PROT_READ,
+              MAP_PRIVATE, fd, 0);
+          if (map != MAP_FAILED) {
+            data = static_cast<const uint8_t*>(map);
+            len = size_t(st.st_size);
+          }
+        }
+        close(fd);
+#endif
+      }
+
+      ~MappedFile() {
+#ifndef WIN32
+        if (data) {
+          munmap(const_cast<uint8_t*>(data), len);
+        }
+#endif
+      }
+
+      MappedFile(const MappedFile&) = delete;
+      MappedFile& operator=(const MappedFile&) = delete;
+
+      const uint8_t* data = nullptr;
+      size_t len = 0;
+
+      protected:
+#ifdef WIN32
+      RC::Data1D<uint8_t> buf;
+#endif
+    };
+  }
+
 
   WeightManager::WeightManager(RC::RStr classif_json, RC::APtr<const CSVFile> elec_config) {
-    auto jf = JSONFile(classif_json);
+    Load(classif_json, MontageIndex(*elec_config), false);
+  }
 
-    auto weights_mut = RC::MakeAPtr<FeatureWeights>();
-    RC::Data1D<double> coef1d;
-    RC::Data1D<RC::RStr> chanstr;
-    RC::Data1D<RC::RStr> dims;
 
-    jf.Get(weights_mut->intercept, "intercept_", 0);
-    jf.Get(coef1d, "coef_", 0);
-    jf.Get(weights_mut->freqs, "coords", "frequency");
-    jf.Get(chanstr, "coords", "channel");
-    jf.Get(dims, "dims");
+  WeightManager::WeightManager(RC::RStr classif_json,
+      const MontageIndex& montage, bool write_compiled) {
+    Load(classif_json, montage, write_compiled);
+  }
 
-    auto& chansr = weights_mut->chans;
-    chansr.Resize(chanstr.size());
 
-    // Look up bipolar pairs in montage and assign them in weights_mut.
-    for (size_t i=0; i<weights_mut->chans.size(); i++) {
-      auto pairs = chanstr[i].SplitAny("_-");
-      if (pairs.size() != 2) {
-        Throw_RC_Error(("Bipolar pairs must contain monopolar channel labels "
-            "split by an underscore (or dash), and \"" + chanstr[i] +
-            "\" does not.").c_str());
-      }
+  RC::RStr WeightManager::CompiledFilename(const RC::RStr& classif_json) {
+    return RC::File::NoExtension(classif_json) + ".weights";
+  }
 
-      auto& datar = elec_config->data;
 
-      if (datar.size2() == 0 || datar.size1() < 2) {
-        Throw_RC_Type(File, "Electrode configuration does not contain label "
-            "and channel number entries.");
-      }
+  void WeightManager::Compile(const RC::RStr& classif_json,
+      const RC::RStr& compiled_file) {
+    WriteCompiled(compiled_file, FileChecksum(classif_json),
+        ParseJSON(classif_json));
+  }
 
 
-      int64_t pos = -1;
-      int64_t neg = -1;
-      auto CompAsgn = [](const auto& check, const RC::RStr& contact,
-                          auto& pn) {
-        if (check[0] == contact) {
-          if (pn != -1) {
-            Throw_RC_Type(File, ("Multiple entries for " + contact + " in "
-                "montage file.").c_str());
-          }
-          check[1].Get(pn);
+  void WeightManager::Load(const RC::RStr& classif_json,
+      const MontageIndex& montage, bool write_compiled) {
+    // Hashing the raw json is far cheaper than parsing it, and tells us if
+    // the compiled weights are current.
+    uint64_t json_checksum = FileChecksum(classif_json);
+    RC::RStr compiled_file = CompiledFilename(classif_json);
+
+    RawWeights raw;
+    if ( ! ReadCompiled(compiled_file, json_checksum, raw) ) {
+      raw = ParseJSON(classif_json);
+      if (write_compiled) {
+        // Only a cache, so a failed write must not stop the load.
+        try {
+          WriteCompiled(compiled_file, json_checksum, raw);
+        }
+        catch (RC::ErrorMsg& err) {
+          DebugLog(RC::RStr("Could not write compiled classifier weights: ") +
+              err.GetError());
         }
-      };
-      for (size_t e=0; e<datar.size2(); e++) {
-        CompAsgn(datar[e], pairs[0], pos);
-        CompAsgn(datar[e], pairs[1], neg);
       }
+    }
+
+    // Look up bipolar pairs in montage and assign them in weights.
+    auto& chansr = raw.weights->chans;
+    chansr.Resize(raw.chanstr.size());
+    for (size_t i=0; i<chansr.size(); i++) {
+      auto pairs = raw.chanstr[i].SplitAny("_-");
+      if (pairs.size() != 2) {
+        Throw_RC_Error(("Bipolar pairs must contain monopolar channel labels "
+            "split by an underscore (or dash), and \"" + raw.chanstr[i] +
+            "\" does not.").c_str());
+      }
+
+      if ( ! (montage.Contains(pairs[0]) && montage.Contains(pairs[1])) ) {
+        Throw_RC_Type(File, ("Could not find bipolar pairs for " +
+              raw.chanstr[i] + " in montage file.").c_str());
+      }
+      int64_t pos = montage.Find(pairs[0]);
+      int64_t neg = montage.Find(pairs[1]);
 
       if (pos < 0 || neg < 0) {
-        Throw_RC_Type(File, ("Could not find bipolar pairs for " + chanstr[i] +
-              " in montage file.").c_str());
+        Throw_RC_Type(File, ("Could not find bipolar pairs for " +
+              raw.chanstr[i] + " in montage file.").c_str());
       }
       if (pos > 255 || neg > 255) {
         Throw_RC_Type(File, ("Channel out of 256 channel range when looking "
-              "up " + chanstr[i] + " in montage file.").c_str());
+              "up " + raw.chanstr[i] + " in montage file.").c_str());
       }
 
       chansr[i].pos = pos;
       chansr[i].neg = neg;
     }
 
+    weights = raw.weights.ExtractConst();
+  }
+
+
+  WeightManager::RawWeights WeightManager::ParseJSON(
+      const RC::RStr& classif_json) {
+    auto jf = JSONFile(classif_json);
+
+    RawWeights raw;
+    auto& weights_mut = raw.weights;
+    RC::Data1D<double> coef1d;
+    RC::Data1D<RC::RStr> dims;
+
+    jf.Get(weights_mut->intercept, "intercept_", 0);
+    jf.Get(coef1d, "coef_", 0);
+    jf.Get(weights_mut->freqs, "coords", "frequency");
+    jf.Get(raw.chanstr, "coords", "channel");
+    jf.Get(dims, "dims");
+
     // Convert coef1d to 2D coefficients;
     auto& coefr = weights_mut->coef;
-    size_t chancnt = chansr.size();
+    size_t chancnt = raw.chanstr.size();
     size_t freqcnt = weights_mut->freqs.size();
     coefr.Resize(chancnt, freqcnt);
     if (coef1d.size() != coefr.size1() * coefr.size2()) {
@@ -76,7 +184,7 @@ namespace CML {
             "incorrect length for the number of frequencies and "
             "channels.").c_str());
     }
-    
+
     if (!dims[0].compare("frequency")) {
       for (size_t i=0; i<coef1d.size(); i++) {
         coefr[i/chancnt][i%chancnt] = coef1d[i];
@@ -89,7 +197,129 @@ namespace CML {
       Throw_RC_Error(("Unknown outer dimension for coefficients: " + dims[0]).c_str());
     }
 
-    weights = weights_mut.ExtractConst();
+    return raw;
+  }
+
+
+  // Returns false if the compiled file is missing, stale, or damaged.
+  bool WeightManager::ReadCompiled(const RC::RStr& compiled_file,
+      uint64_t json_checksum, RawWeights& raw) {
+    MappedFile mf(compiled_file);
+    if (mf.data == nullptr || mf.len < sizeof(CompiledHeader)) {
+      return false;
+    }
+
+    CompiledHeader hdr;
+    std::memcpy(&hdr, mf.data, sizeof(hdr));
+    if (std::memcmp(hdr.magic, compiled_magic, sizeof(compiled_magic)) ||
+        hdr.version != compiled_version ||
+        hdr.header_size != sizeof(CompiledHeader) ||
+        hdr.json_checksum != json_checksum) {
+      return false;
+    }
+
+    size_t dbl_cnt = 1 + hdr.freq_cnt + hdr.freq_cnt * hdr.chan_cnt;
+    size_t payload_len = dbl_cnt * sizeof(double) + hdr.label_bytes;
+    if (mf.len != sizeof(CompiledHeader) + payload_len) {
+      return false;
+    }
+    const uint8_t* payload = mf.data + sizeof(CompiledHeader);
+    if (Checksum64(payload, payload_len) != hdr.payload_checksum) {
+      return false;
+    }
+
+    auto& weights_mut = raw.weights;
+    const uint8_t* pos = payload;
+    auto GetDoubles = [&](double* dest, size_t cnt) {
+      std::memcpy(dest, pos, cnt * sizeof(double));
+      pos += cnt * sizeof(double);
+    };
+
+    GetDoubles(&weights_mut->intercept, 1);
+    weights_mut->freqs.Resize(hdr.freq_cnt);
+    GetDoubles(weights_mut->freqs.Raw(), hdr.freq_cnt);
+    weights_mut->coef.Resize(hdr.chan_cnt, hdr.freq_cnt);
+    for (size_t f=0; f<hdr.freq_cnt; f++) {
+      GetDoubles(weights_mut->coef[f].Raw(), hdr.chan_cnt);
+    }
+
+    const char* labels = reinterpret_cast<const char*>(pos);
+    const char* labels_end = labels + hdr.label_bytes;
+    raw.chanstr.Resize(hdr.chan_cnt);
+    for (size_t c=0; c<hdr.chan_cnt; c++) {
+      const char* term = static_cast<const char*>(
+          std::memchr(labels, '\0', size_t(labels_end - labels)));
+      if (term == nullptr) {
+        return false;
+      }
+      raw.chanstr[c] = RC::RStr(std::string(labels, term));
+      labels = term + 1;
+    }
+
+    return true;
+  }
+
+
+  void WeightManager::WriteCompiled(const RC::RStr& compiled_file,
+      uint64_t json_checksum, const RawWeights& raw) {
+    auto& weights_mut = raw.weights;
+    size_t freq_cnt = weights_mut->freqs.size();
+    size_t chan_cnt = raw.chanstr.size();
+    size_t label_bytes = 0;
+    for (size_t c=0; c<chan_cnt; c++) {
+      label_bytes += raw.chanstr[c].size() + 1;
+    }
+    size_t dbl_cnt = 1 + freq_cnt + freq_cnt * chan_cnt;
+    size_t payload_len = dbl_cnt * sizeof(double) + label_bytes;
+
+    RC::Data1D<uint8_t> buf(sizeof(CompiledHeader) + payload_len);
+    uint8_t* pos = buf.Raw() + sizeof(CompiledHeader);
+    auto PutBytes = [&](const void* src, size_t len) {
+      std::memcpy(pos, src, len);
+      pos += len;
+    };
+
+    PutBytes(&weights_mut->intercept, sizeof(double));
+    PutBytes(weights_mut->freqs.Raw(), freq_cnt * sizeof(double));
+    for (size_t f=0; f<freq_cnt; f++) {
+      PutBytes(weights_mut->coef[f].Raw(), chan_cnt * sizeof(double));
+    }
+    for (size_t c=0; c<chan_cnt; c++) {
+      PutBytes(raw.chanstr[c].c_str(), raw.chanstr[c].size() + 1);
+    }
+
+    CompiledHeader hdr;
+    std::memcpy(hdr.magic, compiled_magic, sizeof(compiled_magic));
+    hdr.version = compiled_version;
+    hdr.header_size = sizeof(CompiledHeader);
+    hdr.json_checksum = json_checksum;
+    hdr.freq_cnt = freq_cnt;
+    hdr.chan_cnt = chan_cnt;
+    hdr.label_bytes = label_bytes;
+    hdr.payload_checksum = Checksum64(buf.Raw() + sizeof(CompiledHeader),
+        payload_len);
+    std::memcpy(buf.Raw(), &hdr, sizeof(hdr));
+
+    // Write aside and move into place so readers never see a partial file.
+    RC::RStr tmp_file = compiled_file + ".tmp";
+    {
+      RC::FileWrite fw;
+      if ( ! fw.Open(tmp_file) ) {
+        Throw_RC_Type(File, ("Could not open " + tmp_file +
+              " for writing.").c_str());
+      }
+      fw.Write(buf);
+    }
+    RC::File::Move(tmp_file, compiled_file);
+  }
+
+
+  uint64_t WeightManager::FileChecksum(const RC::RStr& filename) {
+    MappedFile mf(filename);
+    if (mf.data == nullptr) {
+      Throw_RC_Type(File, ("Could not open " + filename).c_str());
+    }
+    return Checksum64(mf.data, mf.len);
   }
 }
 
@@ -4,19 +4,51 @@
 #include "FeatureWeights.h"
 #include "ChannelConf.h"
 #include "ConfigFile.h"
+#include "MontageIndex.h"
 
 namespace CML {
   /// This class loads classification result json files and provides feature
   /// weights, bipolar channel numbers, and frequencies.
+  /** If a compiled weights file (see Compile) matching the json checksum
+   *  is found next to the json, it is loaded instead of parsing the json.
+   */
   class WeightManager {
     public:
     WeightManager(RC::RStr classif_json, RC::APtr<const CSVFile> elec_config);
+    /** @param classif_json The classifier json file.
+     *  @param montage A label index built once for the loaded montage.
+     *  @param write_compiled If true, (re)generate the compiled weights file
+     *  when it is missing or stale.
+     */
+    WeightManager(RC::RStr classif_json, const MontageIndex& montage,
+        bool write_compiled=false);
+
+    /// The compiled weights filename used for classif_json.
+    static RC::RStr CompiledFilename(const RC::RStr& classif_json);
+    /// Generate the compiled binary weights file from classif_json.
+    static void Compile(const RC::RStr& classif_json,
+        const RC::RStr& compiled_file);
 
     // This is an APtr to const so future experiments can atomically update
     // the values.
     RC::APtr<const FeatureWeights> weights;
+
+    protected:
+    // Montage independent contents of a classifier file.
+    struct RawWeights {
+      RC::APtr<FeatureWeights> weights = RC::MakeAPtr<FeatureWeights>();
+      RC::Data1D<RC::RStr> chanstr;
+    };
+
+    void Load(const RC::RStr& classif_json, const MontageIndex& montage,
+        bool write_compiled);
+    static RawWeights ParseJSON(const RC::RStr& classif_json);
+    static bool ReadCompiled(const RC::RStr& compiled_file,
+        uint64_t json_checksum, RawWeights& raw);
+    static void WriteCompiled(const RC::RStr& compiled_file,
+        uint64_t json_checksum, const RawWeights& raw);
+    static uint64_t FileChecksum(const RC::RStr& filename);
   };
 }
 
 #endif // WEIGHTMANAGER_H
-
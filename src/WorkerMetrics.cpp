@@ -0,0 +1,122 @@
+#include "WorkerMetrics.h"
+#include "ConfigFile.h"
+#include "JSONLines.h"
+
+namespace CML {
+  namespace {
+    nlohmann::json LatencyJSON(const RCqt::LatencySummary& sum) {
+      nlohmann::json j;
+      j["count"] = sum.count;
+      j["mean_ns"] = sum.mean_ns;
+      j["p50_ns"] = sum.p50_ns;
+      j["p99_ns"] = sum.p99_ns;
+      j["max_ns"] = sum.max_ns;
+      return j;
+    }
+
+    RC::RStr LatencyStr(const RCqt::LatencySummary& sum) {
+      auto ms = [](uint64_t ns) {
+        return RC::RStr(double(ns)*1e-6, RC::FIXED, 3);
+      };
+      return ms(sum.p50_ns) + " / " + ms(sum.p99_ns) + " / " +
+        ms(sum.max_ns);
+    }
+  }
+
+
+  WorkerMetrics::WorkerMetrics() {
+    AddToThread(this);
+  }
+
+
+  WorkerMetrics::~WorkerMetrics() {
+    ExitWait();
+  }
+
+
+  RC::RStr WorkerMetrics::FormatSummaries(
+      const std::vector<RCqt::WorkerStatsSummary>& summaries) {
+    if ( ! RCqt::Worker::StatsEnabled() ) {
+      return "Worker statistics are disabled by the sys_config "
+        "\"worker_stats\" setting.";
+    }
+
+    RC::RStr str = "Times in ms as p50 / p99 / max.\n";
+    for (auto& worker : summaries) {
+      str += "\n" + worker.name + ":  queued " +
+        RC::RStr(worker.queue_depth) + ", max " +
+        RC::RStr(worker.max_queue_depth) + "\n";
+      for (auto& task : worker.tasks) {
+        str += "  " + task.name + ":  " + RC::RStr(task.run.count) +
+          " calls, wait " + LatencyStr(task.wait) + ", run " +
+          LatencyStr(task.run);
+        if (task.coalesced) {
+          str += ", " + RC::RStr(task.coalesced) + " coalesced";
+        }
+        str += "\n";
+      }
+    }
+    return str;
+  }
+
+
+  void WorkerMetrics::Dump_Slot() {
+    if ( ! fw.IsOpen() ) {
+      return;
+    }
+
+    nlohmann::json workers = nlohmann::json::array();
+    for (auto& worker : RCqt::Worker::AllStatsSummaries()) {
+      nlohmann::json w;
+      w["name"] = worker.name.c_str();
+      w["queue_depth"] = worker.queue_depth;
+      w["max_queue_depth"] = worker.max_queue_depth;
+      w["tasks"] = nlohmann::json::array();
+      for (auto& task : worker.tasks) {
+        nlohmann::json t;
+        t["name"] = task.name.c_str();
+        t["wait"] = LatencyJSON(task.wait);
+        t["run"] = LatencyJSON(task.run);
+        t["coalesced"] = task.coalesced;
+        w["tasks"].push_back(t);
+      }
+      workers.push_back(w);
+    }
+
+    JSONFile data;
+    data.json["workers"] = workers;
+    fw.Put(MakeResp("WORKERMETRICS", uint64_t(-1), data).Line());
+    fw.Flush();
+  }
+
+
+  void WorkerMetrics::StartFile_Handler(const RC::RStr& filename,
+                                        const uint64_t& interval_ms) {
+    CloseFile_Handler();
+    fw = RC::FileWrite(filename);
+
+    BeAllocatedTimer();
+    dump_timer->start(int(interval_ms));
+  }
+
+
+  void WorkerMetrics::CloseFile_Handler() {
+    if (dump_timer.IsSet()) {
+      dump_timer->stop();
+    }
+    Dump_Slot();
+    fw.Close();
+  }
+
+
+  void WorkerMetrics::BeAllocatedTimer() {
+    if (dump_timer.IsNull()) {
+      dump_timer = new QTimer();
+      AddToThread(dump_timer);
+
+      QObject::connect(dump_timer.Raw(), &QTimer::timeout, this,
+                       &WorkerMetrics::Dump_Slot);
+    }
+  }
+}
+
@@ -0,0 +1,56 @@
+#ifndef WORKERMETRICS_H
+#define WORKERMETRICS_H
+
+#include "RC/APtr.h"
+#include "RC/File.h"
+#include "RC/RStr.h"
+#include "RCqt/Worker.h"
+#include <QTimer>
+#include <vector>
+
+namespace CML {
+  /// Periodically writes the RCqt task statistics of every worker to a file.
+  /** Each dump is one JSON line holding the queue depths and the wait and
+   *  run time percentiles for each task, so a session can be checked for
+   *  workers falling behind.
+   */
+  class WorkerMetrics : public RCqt::WorkerThread, public QObject {
+    public:
+
+    WorkerMetrics();
+    ~WorkerMetrics();
+
+    // Rule of 3.
+    WorkerMetrics(const WorkerMetrics&) = delete;
+    WorkerMetrics& operator=(const WorkerMetrics&) = delete;
+
+    /// Start dumping to filename every interval_ms milliseconds.
+    RCqt::TaskCaller<const RC::RStr, const uint64_t> StartFile =
+      TaskHandler(WorkerMetrics::StartFile_Handler);
+    /// Write a final dump and close the file.
+    RCqt::TaskCaller<> CloseFile =
+      TaskHandler(WorkerMetrics::CloseFile_Handler);
+
+    /// A readable table of the statistics, for display.
+    static RC::RStr FormatSummaries(
+        const std::vector<RCqt::WorkerStatsSummary>& summaries);
+
+    protected slots:
+
+    void Dump_Slot();
+
+    protected:
+
+    void StartFile_Handler(const RC::RStr& filename,
+                           const uint64_t& interval_ms);
+    void CloseFile_Handler();
+
+    void BeAllocatedTimer();
+
+    RC::FileWrite fw;
+    RC::APtr<QTimer> dump_timer;
+  };
+}
+
+#endif // WORKERMETRICS_H
+
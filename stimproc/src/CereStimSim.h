@@ -0,0 +1,87 @@
+#ifndef CERESTIMSIM_H
+#define CERESTIMSIM_H
+
+// The CereStim emulator behind stub_CereStimDLL.cpp, for simulator builds.
+//
+// Each CS_ call takes the time the device would, so the StimWorker path
+// runs with realistic latencies.  A triggered sequence keeps the device
+// busy for the length of its burst, the maximum amplitude, phase charge,
+// frequency, and optionally the Shannon limit are enforced as the device
+// would, and the device can be set to drop its connection.  Every
+// CS_Play is recorded for tests to check decision to stim latency and
+// stim rates against, and pattern and sequence writes are counted.
+//
+// Parameters come from a profile file of "name value" lines, with # for
+// comments, all times in microseconds:
+//   connect_us 200000       # CS_Connect
+//   configure_us 3000       # CS_ConfigureStimulusPattern
+//   sequence_us 1000        # Each sequence building command
+//   trigger_us 1500         # CS_Play
+//   stop_us 1000            # CS_Stop and CS_Pause
+//   status_us 1000          # Reads: CS_GetMaxValues, CS_ScanForDevices,
+//                           #   and CS_SetDevice
+//   jitter_us 0             # Uniform random extra time on every call
+//   busy_error 0            # 1: commands during a burst fail, not wait
+//   shannon_k 0             # Shannon k limit, or 0 to not check
+//   electrode_area_mm2 0    # Electrode area for the Shannon limit
+//   disconnect_after 0      # Triggers before disconnecting, 0 for never
+//   trigger_log             # Path for a csv of triggers on CS_Disconnect
+//   verbose 0               # Print each call to stdout
+//
+// The profile named by the CERESTIM_SIM_PROFILE environment variable is
+// loaded at the first call, and otherwise all latencies are 0.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace CereStimSim {
+  struct Profile {
+    uint64_t connect_us = 0;
+    uint64_t configure_us = 0;
+    uint64_t sequence_us = 0;
+    uint64_t trigger_us = 0;
+    uint64_t stop_us = 0;
+    uint64_t status_us = 0;
+    uint64_t jitter_us = 0;
+    bool busy_error = false;
+    double shannon_k = 0;
+    double electrode_area_mm2 = 0;
+    uint64_t disconnect_after = 0;
+    std::string trigger_log;
+    bool verbose = false;
+  };
+
+  struct Trigger {
+    // When CS_Play was called and returned, on the steady_clock in ns.
+    uint64_t call_ns;
+    uint64_t done_ns;
+    // The length of the triggered burst, 0 if it failed.
+    uint64_t burst_us;
+    int result;
+  };
+
+  struct Commands {
+    // CS_ConfigureStimulusPattern and CS_BeginningOfSequence calls.
+    uint64_t configure = 0;
+    uint64_t sequence = 0;
+  };
+
+  // Throws std::runtime_error if the file cannot be read or parsed.
+  void LoadProfile(const std::string& filename);
+  void SetProfile(const Profile& profile);
+  Profile GetProfile();
+
+  // Drop or restore the device connection, as if unplugged.
+  void SetConnected(bool connected);
+  // Return the device to its power-on state, keeping the profile.
+  void Reset();
+
+  std::vector<Trigger> Triggers();
+  // Counted since the last ClearTriggers.
+  Commands CommandCounts();
+  void ClearTriggers();
+}
+
+#endif // CERESTIMSIM_H
+
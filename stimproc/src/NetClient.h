@@ -13,6 +13,9 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 #endif
 #include <atomic>
 #include <cstdint>
@@ -174,6 +177,38 @@ namespace SP {
       }
 
 
+      inline size_t RecvAvailable(std::string& data) {
+        size_t start = data.size();
+        data.append(reinterpret_cast<char*>(buf.data()) + index,
+            full_to - index);
+        index = 0;
+        full_to = 0;
+
+        while (true) {
+          size_t at = data.size();
+          data.resize(at + buf.size());
+          Net_SockReturn bytes_recv = recv(socket, &data[at], buf.size(), 0);
+          if (bytes_recv == Net_SockErr) {
+            data.resize(at);
+            if (Net_SockErrorAt == Net_WouldBlock) {
+              break;
+            }
+            throw std::runtime_error("Socket receive error");
+          }
+          data.resize(at + size_t(bytes_recv));
+          if (bytes_recv == 0) {
+            // Closed, but return what arrived first.
+            if (data.size() == start) {
+              throw std::runtime_error("Socket closed");
+            }
+            break;
+          }
+        }
+
+        return data.size() - start;
+      }
+
+
       size_t SendData(const char* arr, size_t len, bool do_block = true) {
         const char *arr_current = arr;
         size_t len_left = len;
@@ -323,12 +358,21 @@ namespace SP {
       }
 
       str = inp;
-      std::cout << "Recv: " << str << std::endl;  // Testing
 
       return count;
     }
 
 
+    /// Appends all data received so far to data, without blocking.
+    /** This includes anything left buffered by Recv.  Throws if the socket
+     *  closed before any data.
+     *  @return The number of bytes appended.
+     */
+    inline size_t RecvAvailable(std::string& data) {
+      return helper->RecvAvailable(data);
+    }
+
+
     /// Sends the contents of str through the socket with a newline added.
     /** @param str The string containing the data to send.
      *  @param do_block If true, sends all of str.  If false, sends as much of
@@ -340,18 +384,74 @@ namespace SP {
       if (add_newline) {
         str += "\n";
       }
-      std::cout << "Send: " << str;  // Testing
-      if (add_newline) {             // Testing
-        std::cout.flush();           // Testing
-      }                              // Testing
-      else {                         // Testing
-        std::cout << std::endl;      // Testing
-      }                              // Testing
       return helper->SendData(str.c_str(), str.size(), do_block);
     }
   };
 
 
+  /// Waits for a socket to become readable, for an event driven loop.
+  /** This uses epoll on Linux, and select elsewhere.
+   */
+  class Poller {
+    public:
+    inline Poller(const Sock& sock)
+      : sock(sock) {
+#ifdef __linux__
+      epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+      if (epoll_fd < 0) {
+        throw std::runtime_error("Could not create epoll instance");
+      }
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN | EPOLLRDHUP;
+      ev.data.fd = sock.Raw();
+      if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock.Raw(), &ev) < 0) {
+        close(epoll_fd);
+        throw std::runtime_error("Could not add socket to epoll");
+      }
+#endif
+    }
+
+    inline ~Poller() {
+#ifdef __linux__
+      close(epoll_fd);
+#endif
+    }
+
+    // Rule of 3.
+    Poller(const Poller&) = delete;
+    Poller& operator=(const Poller&) = delete;
+
+    /// Returns true if data, or a close, is ready to read.
+    /** @param timeout_ms The most to wait, or -1 to wait indefinitely.
+     */
+    inline bool WaitReadable(int timeout_ms) {
+#ifdef __linux__
+      struct epoll_event ev;
+      return epoll_wait(epoll_fd, &ev, 1, timeout_ms) > 0;
+#else
+      fd_set readset;
+      FD_ZERO(&readset);
+      FD_SET(sock.Raw(), &readset);
+      struct timeval timeout;
+      struct timeval *timeptr = NULL;
+      if (timeout_ms >= 0) {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_usec = (timeout_ms % 1000) * 1000;
+        timeptr = &timeout;
+      }
+      return select(sock.Raw()+1, &readset, NULL, NULL, timeptr) > 0;
+#endif
+    }
+
+    protected:
+    Sock sock;
+#ifdef __linux__
+    int epoll_fd = -1;
+#endif
+  };
+
+
   /// Provides client side of blocking TCP connections.
   class Net {
     public:
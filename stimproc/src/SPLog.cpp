@@ -0,0 +1,47 @@
+#include "SPLog.h"
+#include <chrono>
+#include <stdexcept>
+
+namespace SP {
+  uint64_t NowUs() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+
+  Log::Log(const std::string& filename)
+    : file(filename, std::ios::binary | std::ios::app),
+      start_us(NowUs()) {
+    if ( ! file.is_open() ) {
+      throw std::runtime_error("Could not open StimProc log file.");
+    }
+    buffer.reserve(2*flush_size);
+  }
+
+
+  Log::~Log() {
+    Flush();
+  }
+
+
+  void Log::Write(const std::string& line) {
+    buffer += std::to_string(NowUs() - start_us);
+    buffer += ' ';
+    buffer += line;
+    buffer += '\n';
+    if (buffer.size() >= flush_size) {
+      Flush();
+    }
+  }
+
+
+  void Log::Flush() {
+    if (buffer.empty()) {
+      return;
+    }
+    file.write(buffer.data(), std::streamsize(buffer.size()));
+    file.flush();
+    buffer.clear();
+  }
+}
+
@@ -0,0 +1,37 @@
+#ifndef SPLOG_H
+#define SPLOG_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace SP {
+  // Microseconds on a monotonic clock.
+  uint64_t NowUs();
+
+  // A buffered log file, so that logging costs no I/O on the stim path.
+  // Each line is prefixed by microseconds since the log was opened.  Call
+  // Flush when idle, and it is flushed when large or destructed.
+  class Log {
+    public:
+    Log(const std::string& filename);
+    ~Log();
+
+    Log(const Log&) = delete;
+    Log& operator=(const Log&) = delete;
+
+    void Write(const std::string& line);
+    void Flush();
+    bool Pending() const { return buffer.size() > 0; }
+
+    private:
+    static const size_t flush_size = 64*1024;
+
+    std::ofstream file;
+    std::string buffer;
+    uint64_t start_us;
+  };
+}
+
+#endif
+
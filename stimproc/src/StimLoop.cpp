@@ -31,42 +31,97 @@ T1 UnitScale(T1 val, T2 mult) {
 
 
 void StimLoop::Run() {
-  std::string line;
-
   stim_configured = false;
 
   if ( ! StimInitialize() ) {
     return;
   }
 
+  Poller poller(soc);
+
   try {
+    // Collect anything received along with the handshake.
+    input_us = NowUs();
+    soc.RecvAvailable(input);
+
     while (true) { // Loop until closed by network exception.
-      soc.Recv(line);
-      const std::vector<std::string> cmd = SplitCSV(line);
+      // Handle everything already received before waiting again, so
+      // pipelined commands are not held up by the poll.
+      HandleInput(input_us);
 
-      if (cmd.size() < 1) {
+      if ( ! poller.WaitReadable(log.Pending() ? idle_flush_ms : -1) ) {
+        log.Flush();  // Only when idle, to keep file I/O off the stim path.
         continue;
       }
 
-      if (cmd.at(0) == "SPSTIMSTART") {
-        StimStart();
-      }
-      else if (cmd.at(0) == "SPSTIMCONFIG") {
-        StimConfig(cmd, false);
-      }
-      else if (cmd.at(0) == "SPSTIMTHETACONFIG") {
-        StimConfig(cmd, true);
-      }
-      else {
-        soc.Send(std::string("SPERROR,") + CleanError("StimProc command not "
-              "recognized:  \"", cmd.at(0), "\""));
+      input_us = NowUs();
+      soc.RecvAvailable(input);
+      if (input.size() > max_input) {
+        throw std::runtime_error("StimProc command exceeded maximum length.");
       }
     }
   }
   catch (std::runtime_error& ex) {
-    // Pass.
     // Connection closed, so proceed to terminate.
+    log.Write(std::string("Closed: ") + ex.what());
+  }
+}
+
+
+// Handles each complete command in input, leaving any partial line.
+void StimLoop::HandleInput(uint64_t recv_us) {
+  size_t pos = 0;
+  while (pos < input.size()) {
+    if (input[pos] == binary_trigger) {
+      pos++;
+      StimStart(recv_us, true);
+      continue;
+    }
+
+    size_t end = input.find_first_of(std::string("\n\0", 2), pos);
+    if (end == input.npos) {
+      break;
+    }
+    size_t len = end - pos;
+    while (len > 0 && input[pos+len-1] == '\r') {
+      len--;
+    }
+    std::string line = input.substr(pos, len);
+    pos = end + 1;
+
+    log.Write("Recv: " + line);
+    HandleCommand(line, recv_us);
+  }
+  input.erase(0, pos);
+}
+
+
+void StimLoop::HandleCommand(const std::string& line, uint64_t recv_us) {
+  const std::vector<std::string> cmd = SplitCSV(line);
+
+  if (cmd.size() < 1) {
+    return;
   }
+
+  if (cmd.at(0) == "SPSTIMSTART") {
+    StimStart(recv_us, false);
+  }
+  else if (cmd.at(0) == "SPSTIMCONFIG") {
+    StimConfig(cmd, false);
+  }
+  else if (cmd.at(0) == "SPSTIMTHETACONFIG") {
+    StimConfig(cmd, true);
+  }
+  else {
+    Reply(std::string("SPERROR,") + CleanError("StimProc command not "
+          "recognized:  \"", cmd.at(0), "\""));
+  }
+}
+
+
+void StimLoop::Reply(const std::string& msg) {
+  soc.Send(msg);
+  log.Write("Send: " + msg);
 }
 
 
@@ -74,36 +129,42 @@ bool StimLoop::StimInitialize() {
   std::string line;
 
   soc.Recv(line);
+  log.Write("Recv: " + line);
 
   if (line != conf.subject) {
-    soc.Send(std::string("SPERROR,") +
+    Reply(std::string("SPERROR,") +
         CleanError("Subject code ", line, " does not match configuration "
           "code ", conf.subject));
     return false;
   }
 
-  soc.Send(std::string("SPREADY,StimProc,") + CleanStr(version));
+  Reply(std::string("SPREADY,StimProc,") + CleanStr(version));
   return true;
 }
 
 
-void StimLoop::StimStart() {
+void StimLoop::StimStart(uint64_t recv_us, bool binary) {
   if ( ! stim_configured ) {
-    soc.Send("SPSTIMSTARTERROR,Attempted to stimulate with no stimulation "
+    Reply("SPSTIMSTARTERROR,Attempted to stimulate with no stimulation "
         "configured.");
     return;
   }
 
+  uint64_t call_us = NowUs();
   try {
     cerestim.Stimulate();
   }
   catch (std::exception& ex) {
-    soc.Send(std::string("SPSTIMSTARTERROR,") +
+    Reply(std::string("SPSTIMSTARTERROR,") +
         CleanError(ex.what()));
     return;
   }
+  uint64_t done_us = NowUs();
 
-  soc.Send("SPSTIMSTARTDONE");
+  Reply("SPSTIMSTARTDONE");
+  // From the read until the trigger call, and the call itself.
+  log.Write(AssembleString("Trigger: ", binary ? "binary" : "text",
+        ", wait_us ", call_us - recv_us, ", call_us ", done_us - call_us));
 }
 
 
@@ -114,10 +175,10 @@ void StimLoop::StimConfig(const std::vector<std::string>& cmd,
     // No channels specified.  Configure for no-stim.
     try {
       cerestim.ConfigureStimulation(CML::CSStimProfile{});
-      soc.Send("SPSTIMCONFIGDONE");
+      Reply("SPSTIMCONFIGDONE");
     }
     catch (std::exception& ex) {
-      soc.Send(std::string("SPSTIMCONFIGERROR,") + CleanStr(ex.what()));
+      Reply(std::string("SPSTIMCONFIGERROR,") + CleanStr(ex.what()));
     }
     return;
   }
@@ -128,13 +189,13 @@ void StimLoop::StimConfig(const std::vector<std::string>& cmd,
     pair_cnt = To_uint64(cmd.at(1));
 
     if (pair_cnt > 6) {
-      soc.Send(std::string("SPSTIMCONFIGERROR,") +
+      Reply(std::string("SPSTIMCONFIGERROR,") +
           CleanError("Stim pair count ", pair_cnt, " exceeded maximum 6."));
     }
 
     uint64_t expected = 2 + pair_cnt*elem_cnt;
     if (cmd.size() != expected) {
-      soc.Send(std::string("SPSTIMCONFIGERROR,") + CleanError("Expected ",
+      Reply(std::string("SPSTIMCONFIGERROR,") + CleanError("Expected ",
             expected, " stim config line elements and got ", cmd.size()));
       return;
     }
@@ -156,7 +217,7 @@ void StimLoop::StimConfig(const std::vector<std::string>& cmd,
       if (thetaburst) {
         csc.burst_frac = To_float(cmd.at(i+5));
         if (csc.burst_frac <= 0 || csc.burst_frac >= 1) {
-          soc.Send(std::string("SPSTIMCONFIGERROR,") + CleanError("Burst "
+          Reply(std::string("SPSTIMCONFIGERROR,") + CleanError("Burst "
             "fraction ", csc.burst_frac, " must be greater than 0 and less "
             "than 1."));
           return;
@@ -179,10 +240,10 @@ void StimLoop::StimConfig(const std::vector<std::string>& cmd,
 
     cerestim.ConfigureStimulation(stim_profile);
     stim_configured = true;
-    soc.Send("SPSTIMCONFIGDONE");
+    Reply("SPSTIMCONFIGDONE");
   }
   catch(std::exception& ex) {
-    soc.Send(std::string("SPSTIMCONFIGERROR,") + CleanStr(ex.what()));
+    Reply(std::string("SPSTIMCONFIGERROR,") + CleanStr(ex.what()));
     return;
   }
 }
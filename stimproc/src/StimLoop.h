@@ -4,27 +4,42 @@
 #include "NetClient.h"
 #include "CereStim.h"
 #include "Config.h"
+#include "SPLog.h"
 #include <string>
 #include <vector>
 
 namespace SP {
   class StimLoop {
     public:
-    StimLoop(Config conf, Sock soc, std::string version)
-      : conf(conf), soc(soc), version(version) { }
+    StimLoop(Config conf, Sock soc, std::string version, Log& log)
+      : conf(conf), soc(soc), version(version), log(log) { }
     void Run();
 
+    // Sent alone, not as a line, to stimulate with no parsing.
+    static const char binary_trigger = '\x02';
+
     private:
     bool StimInitialize();
-    void StimStart();
+    void HandleInput(uint64_t recv_us);
+    void HandleCommand(const std::string& line, uint64_t recv_us);
+    void StimStart(uint64_t recv_us, bool binary);
     void StimConfig(const std::vector<std::string>& cmd, bool thetaburst);
+    void Reply(const std::string& msg);
 
     ChannelLimits FindLimit(uint8_t pos, uint8_t neg);
 
+    // Pending log lines are written after this long with no commands.
+    static const int idle_flush_ms = 100;
+    static const size_t max_input = 64*1024;
+
     CML::CereStim cerestim;
     Config conf;
     Sock soc;
     std::string version;
+    Log& log;
+    // Received bytes not yet handled, and when they arrived.
+    std::string input;
+    uint64_t input_us = 0;
     bool stim_configured = false;
   };
 }
@@ -11,10 +11,11 @@ int main(int argc, char* argv[]) {
   unsigned long long port = 0;
   std::string host;
   std::string config_file;
+  std::string log_file = "StimProc.log";
 
   if (argc < 4) {
     std::cerr << "StimProc, " << MYTIMESTAMP << std::endl;
-    std::cerr << argv[0] << " [host] [port] [config_file]" << std::endl;
+    std::cerr << argv[0] << " [host] [port] [config_file] [log_file]" << std::endl;
     return -1;
   }
 
@@ -29,13 +30,17 @@ int main(int argc, char* argv[]) {
   }
 
   config_file = argv[3];
+  if (argc > 4) {
+    log_file = argv[4];
+  }
 
   try {
+    SP::Log log{log_file};
     SP::Sock soc;
     SP::Net::Connect(soc, host, std::to_string(port));
     try {
       SP::Config config{config_file};
-      SP::StimLoop stim_loop{config, soc, MYTIMESTAMP};
+      SP::StimLoop stim_loop{config, soc, MYTIMESTAMP, log};
       stim_loop.Run();
     }
     catch (std::exception &ex) {